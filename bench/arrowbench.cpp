@@ -0,0 +1,138 @@
+#include <badval_arrow.hpp>
+#include <badval_serial.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t valueCount = 100000;
+
+  /**
+   * Numbers, strings, or both.
+   */
+  std::shared_ptr<std::vector<value_t>> Values(const std::string& kind)
+  {
+    std::mt19937 rng(1);
+    auto values = std::make_shared<std::vector<value_t>>();
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      const bool number = (kind == "number") || ((kind == "mixed") && (rng() % 2 == 0));
+      if (number)
+      {
+        values->emplace_back(static_cast<double>(rng() % 100000) / 16.0);
+      }
+      else
+      {
+        values->emplace_back("key:" + std::to_string(rng() % 100000));
+      }
+    }
+    return values;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    for (const std::string kind: { "number", "string", "mixed" })
+    {
+      auto values = Values(kind);
+      auto array = std::make_shared<bvl::arrow::array_t>(bvl::arrow::FromValues(*values));
+      auto encoded = std::make_shared<std::string>();
+      for (const auto& value: *values)
+      {
+        bvl::serial::Encode(value, *encoded);
+      }
+
+      // columnar export against per-value tagged encoding
+      cases.push_back({"export/" + kind + "/arrow", [values](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          auto result = bvl::arrow::FromValues(*values);
+          bvl::bench::DoNotOptimize(result);
+        }
+      }});
+      cases.push_back({"export/" + kind + "/serial", [values](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          std::string out;
+          for (const auto& value: *values)
+          {
+            bvl::serial::Encode(value, out);
+          }
+          bvl::bench::DoNotOptimize(out);
+        }
+      }});
+
+      // import through C data interface does not touch values
+      cases.push_back({"import/" + kind + "/arrow", [array](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          ArrowArray exported;
+          ArrowSchema schema;
+          bvl::arrow::Export(*array, "column", &exported, &schema);
+          auto result = bvl::arrow::Import(&exported, &schema);
+          bvl::bench::DoNotOptimize(result);
+        }
+      }});
+      cases.push_back({"import/" + kind + "/values", [array](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          auto result = bvl::arrow::ToValues(*array);
+          bvl::bench::DoNotOptimize(result);
+        }
+      }});
+      cases.push_back({"import/" + kind + "/serial", [encoded](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          std::vector<value_t> result;
+          const char* cursor = encoded->data();
+          const char* end = cursor + encoded->size();
+          while (cursor < end)
+          {
+            result.push_back(bvl::serial::Decode(cursor, end));
+          }
+          bvl::bench::DoNotOptimize(result);
+        }
+      }});
+
+      // file round trip, reader maps file and does not copy buffers
+      cases.push_back({"stream/" + kind, [array](std::size_t iterations)
+      {
+        const std::string path = "arrowbench.arrows";
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          {
+            bvl::arrow::streamWriter_t writer(path);
+            bvl::arrow::batch_t batch;
+            batch.names.push_back("column");
+            batch.columns.push_back(*array);
+            writer.Write(batch);
+          }
+          auto batches = bvl::arrow::ReadStream(path);
+          bvl::bench::DoNotOptimize(batches);
+        }
+        std::remove(path.c_str());
+      }});
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
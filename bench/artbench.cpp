@@ -0,0 +1,154 @@
+#include <badval_art.hpp>
+#include "badbench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t keyCount = 200000;
+
+  /**
+   * Keys in random order, with shared prefixes like real identifiers.
+   */
+  std::vector<std::string> Keys()
+  {
+    std::vector<std::string> keys;
+    keys.reserve(keyCount);
+    for (std::size_t i = 0; i < keyCount; ++i)
+    {
+      char key[32];
+      std::snprintf(key, sizeof(key), "user:%04zu:%06zu", i % 1000, i);
+      keys.push_back(key);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+    return keys;
+  }
+
+  /**
+   * Ordered container filled with next key on every insert, and
+   * replaced when all keys are inserted.
+   */
+  template<typename container_t>
+  struct filler_t
+  {
+    std::unique_ptr<container_t> container;
+    std::size_t next = keyCount;
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto keys = std::make_shared<std::vector<std::string>>(Keys());
+    auto tree = std::make_shared<bvl::art::tree_t>();
+    auto map = std::make_shared<std::map<std::string, value_t>>();
+    for (const auto& key: *keys)
+    {
+      tree->Insert(key, value_t(1.0));
+      map->emplace(key, value_t(1.0));
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"art/lookup", [keys, tree](std::size_t iterations)
+    {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        tree->Visit((*keys)[i % keyCount], [&sum](const value_t& value)
+        {
+          sum += value.As<value_t::number>();
+        });
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+
+    cases.push_back({"map/lookup", [keys, map](std::size_t iterations)
+    {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        auto it = map->find((*keys)[i % keyCount]);
+        if (it != map->end())
+        {
+          sum += it->second.As<value_t::number>();
+        }
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+
+    // one operation scans 200 keys under one prefix
+    cases.push_back({"art/prefix", [tree](std::size_t iterations)
+    {
+      std::size_t count = 0;
+      char prefix[16];
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::snprintf(prefix, sizeof(prefix), "user:%04zu:", i % 1000);
+        tree->ScanPrefix(prefix, [&count](const std::string&, const value_t&)
+        {
+          ++count;
+          return true;
+        });
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+
+    cases.push_back({"map/prefix", [map](std::size_t iterations)
+    {
+      std::size_t count = 0;
+      char prefix[16];
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        const auto size = static_cast<std::size_t>(std::snprintf(prefix, sizeof(prefix), "user:%04zu:", i % 1000));
+        for (auto it = map->lower_bound(prefix); (it != map->end()) && (it->first.compare(0, size, prefix) == 0); ++it)
+        {
+          ++count;
+        }
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+
+    auto artFiller = std::make_shared<filler_t<bvl::art::tree_t>>();
+    cases.push_back({"art/insert", [keys, artFiller](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (artFiller->next == keyCount)
+        {
+          artFiller->container.reset(new bvl::art::tree_t());
+          artFiller->next = 0;
+        }
+        artFiller->container->Insert((*keys)[artFiller->next++], value_t(1.0));
+      }
+    }});
+
+    auto mapFiller = std::make_shared<filler_t<std::map<std::string, value_t>>>();
+    cases.push_back({"map/insert", [keys, mapFiller](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (mapFiller->next == keyCount)
+        {
+          mapFiller->container.reset(new std::map<std::string, value_t>());
+          mapFiller->next = 0;
+        }
+        mapFiller->container->emplace((*keys)[mapFiller->next++], value_t(1.0));
+      }
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,174 @@
+#include <badval.hpp>
+#include "badbench.hpp"
+
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::bench::DoNotOptimize;
+
+  const char shortText[] = "short";
+  const char longText[] = "long enough string to never fit into small string buffer";
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"construct/number", [](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t value(static_cast<double>(i));
+        DoNotOptimize(value);
+      }
+    }});
+
+    cases.push_back({"construct/string", [](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t value(longText);
+        DoNotOptimize(value);
+      }
+    }});
+
+    cases.push_back({"copy/number", [](std::size_t iterations)
+    {
+      value_t src(42.0);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t copy(src);
+        DoNotOptimize(copy);
+      }
+    }});
+
+    cases.push_back({"copy/string-short", [](std::size_t iterations)
+    {
+      value_t src(shortText);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t copy(src);
+        DoNotOptimize(copy);
+      }
+    }});
+
+    cases.push_back({"copy/string-long", [](std::size_t iterations)
+    {
+      value_t src(longText);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t copy(src);
+        DoNotOptimize(copy);
+      }
+    }});
+
+    cases.push_back({"copy-assign/string", [](std::size_t iterations)
+    {
+      value_t src(longText);
+      value_t dst;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        dst = src;
+        DoNotOptimize(dst);
+      }
+    }});
+
+    cases.push_back({"move/number", [](std::size_t iterations)
+    {
+      value_t a(42.0);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t b(std::move(a));
+        DoNotOptimize(b);
+        a = std::move(b);
+      }
+    }});
+
+    cases.push_back({"move/string", [](std::size_t iterations)
+    {
+      value_t a(longText);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t b(std::move(a));
+        DoNotOptimize(b);
+        a = std::move(b);
+      }
+    }});
+
+    cases.push_back({"move/pointer", [](std::size_t iterations)
+    {
+      value_t a(nullptr, nullptr);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t b(std::move(a));
+        DoNotOptimize(b);
+        a = std::move(b);
+      }
+    }});
+
+    cases.push_back({"access/number", [](std::size_t iterations)
+    {
+      value_t value(42.0);
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        DoNotOptimize(value);
+        sum += value.As<value_t::number>();
+      }
+      DoNotOptimize(sum);
+    }});
+
+    cases.push_back({"access/string", [](std::size_t iterations)
+    {
+      value_t value(longText);
+      std::size_t sum = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        DoNotOptimize(value);
+        sum += value.As<value_t::string>().size();
+      }
+      DoNotOptimize(sum);
+    }});
+
+    cases.push_back({"access/type", [](std::size_t iterations)
+    {
+      value_t value(longText);
+      std::size_t sum = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        DoNotOptimize(value);
+        sum += value.Type();
+      }
+      DoNotOptimize(sum);
+    }});
+
+    cases.push_back({"access/mismatch", [](std::size_t iterations)
+    {
+      value_t value(42.0);
+      std::size_t caught = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        try
+        {
+          DoNotOptimize(value);
+          DoNotOptimize(value.As<value_t::string>());
+        }
+        catch (const std::runtime_error&)
+        {
+          ++caught;
+        }
+      }
+      DoNotOptimize(caught);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,527 @@
+/**
+ * @file badbench.hpp
+ * @author masscry
+ *
+ * Tiny benchmark harness with regression gate.
+ *
+ * Each benchmark case is measured several times, every sample is stored
+ * as nanoseconds per operation. Results can be written to a text file
+ * and later compared against such file (baseline). Regression is reported
+ * only when median slowdown exceeds tolerance and Mann-Whitney U test
+ * says that slowdown is statistically significant.
+ *
+ * Results file format (one benchmark per line, '#' starts comment):
+ *
+ *     <name> <sample ns/op> <sample ns/op> ...
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_BENCH_HEADER
+#define BAD_VALUE_BENCH_HEADER
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bvl
+{
+namespace bench
+{
+
+  /**
+   * Benchmark body. Must perform given number of operations.
+   */
+  using body_t = std::function<void(std::size_t iterations)>;
+
+  /**
+   * Named benchmark case.
+   */
+  struct case_t
+  {
+    std::string name; /**< Unique name without spaces */
+    body_t body;      /**< Measured function */
+  };
+
+  /**
+   * Measured samples of one benchmark.
+   */
+  struct result_t
+  {
+    std::string name;            /**< Benchmark name */
+    std::vector<double> samples; /**< Nanoseconds per operation */
+
+    /**
+     * Median of samples.
+     */
+    double Median() const
+    {
+      if (this->samples.empty())
+      {
+        return 0.0;
+      }
+      std::vector<double> sorted(this->samples);
+      std::sort(sorted.begin(), sorted.end());
+      auto mid = sorted.size() / 2;
+      if (sorted.size() % 2 == 0)
+      {
+        return (sorted[mid - 1] + sorted[mid]) / 2.0;
+      }
+      return sorted[mid];
+    }
+  };
+
+  /**
+   * Harness settings, filled from command line.
+   */
+  struct options_t
+  {
+    std::size_t samples = 15;               /**< Samples per benchmark */
+    double minSampleTime = 0.02;            /**< Minimal sample duration in seconds */
+    std::string filter;                     /**< Run only benchmarks containing this substring */
+    std::string out;                        /**< Where to write results */
+    std::string baseline;                   /**< Baseline to compare with */
+    double tolerance = 0.10;                /**< Allowed relative slowdown of median */
+    std::map<std::string, double> perCase;  /**< Per benchmark tolerance overrides */
+    double alpha = 0.01;                    /**< Significance level */
+  };
+
+  /**
+   * Outcome of comparing one benchmark with baseline.
+   */
+  struct verdict_t
+  {
+    std::string name;        /**< Benchmark name */
+    double baseline = 0.0;   /**< Baseline median, ns/op */
+    double current = 0.0;    /**< Current median, ns/op */
+    double tolerance = 0.0;  /**< Tolerance used */
+    double pvalue = 1.0;     /**< One-sided p-value of "current is slower" */
+    bool regressed = false;  /**< Slower than tolerance allows and significant */
+  };
+
+  /**
+   * Prevent compiler from optimizing value away.
+   */
+  template<typename data_t>
+  inline void DoNotOptimize(data_t& value)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+  }
+
+  /**
+   * Force compiler to assume all memory was changed.
+   */
+  inline void ClobberMemory()
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+  }
+
+  /**
+   * Measure benchmark case.
+   *
+   * Number of iterations is doubled until one sample takes at least
+   * minSampleTime, then requested number of samples is collected.
+   */
+  inline result_t Run(const case_t& bench, const options_t& options)
+  {
+    using clock_t = std::chrono::steady_clock;
+
+    auto measure = [&bench](std::size_t iterations)
+    {
+      auto start = clock_t::now();
+      bench.body(iterations);
+      auto stop = clock_t::now();
+      return std::chrono::duration<double>(stop - start).count();
+    };
+
+    std::size_t iterations = 1;
+    for (;;)
+    {
+      auto elapsed = measure(iterations);
+      if ((elapsed >= options.minSampleTime) || (iterations >= (std::size_t(1) << 40)))
+      {
+        break;
+      }
+      if (elapsed * 10.0 < options.minSampleTime)
+      {
+        iterations *= 10;
+      }
+      else
+      {
+        iterations *= 2;
+      }
+    }
+
+    result_t result;
+    result.name = bench.name;
+    result.samples.reserve(options.samples);
+    for (std::size_t i = 0; i < options.samples; ++i)
+    {
+      result.samples.push_back(measure(iterations) * 1e9 / static_cast<double>(iterations));
+    }
+    return result;
+  }
+
+  /**
+   * Write results in text format described in file header.
+   */
+  inline void WriteResults(std::ostream& output, const std::vector<result_t>& results)
+  {
+    output << "# badbench results, samples in ns/op" << std::endl;
+    output << std::setprecision(6);
+    for (const auto& result: results)
+    {
+      output << result.name;
+      for (auto sample: result.samples)
+      {
+        output << ' ' << sample;
+      }
+      output << std::endl;
+    }
+  }
+
+  /**
+   * Read results written by WriteResults.
+   *
+   * @throws std::runtime_error on malformed input
+   */
+  inline std::vector<result_t> ReadResults(std::istream& input)
+  {
+    std::vector<result_t> results;
+    std::string line;
+    while (std::getline(input, line))
+    {
+      if (line.empty() || (line[0] == '#'))
+      {
+        continue;
+      }
+      std::istringstream fields(line);
+      result_t result;
+      if (!(fields >> result.name))
+      {
+        continue;
+      }
+      double sample;
+      while (fields >> sample)
+      {
+        result.samples.push_back(sample);
+      }
+      if (!fields.eof() || result.samples.empty())
+      {
+        throw std::runtime_error("Malformed benchmark results line: " + line);
+      }
+      results.push_back(std::move(result));
+    }
+    return results;
+  }
+
+  /**
+   * One-sided Mann-Whitney U test.
+   *
+   * Uses normal approximation with tie and continuity correction.
+   *
+   * @return p-value of hypothesis that current samples tend to be greater than baseline samples
+   */
+  inline double MannWhitneyGreater(const std::vector<double>& baseline, const std::vector<double>& current)
+  {
+    const double n1 = static_cast<double>(current.size());
+    const double n2 = static_cast<double>(baseline.size());
+    if ((n1 == 0.0) || (n2 == 0.0))
+    {
+      return 1.0;
+    }
+
+    std::vector<std::pair<double, int>> all;
+    all.reserve(current.size() + baseline.size());
+    for (auto sample: current)
+    {
+      all.emplace_back(sample, 1);
+    }
+    for (auto sample: baseline)
+    {
+      all.emplace_back(sample, 0);
+    }
+    std::sort(all.begin(), all.end());
+
+    double rankSum = 0.0;
+    double tieSum = 0.0;
+    for (std::size_t i = 0; i < all.size();)
+    {
+      auto j = i;
+      while ((j < all.size()) && (all[j].first == all[i].first))
+      {
+        ++j;
+      }
+      // ranks are 1-based, tied samples share average rank
+      const double rank = (static_cast<double>(i + 1) + static_cast<double>(j)) / 2.0;
+      const double ties = static_cast<double>(j - i);
+      tieSum += ties * ties * ties - ties;
+      for (auto k = i; k < j; ++k)
+      {
+        if (all[k].second == 1)
+        {
+          rankSum += rank;
+        }
+      }
+      i = j;
+    }
+
+    const double n = n1 + n2;
+    const double u = rankSum - n1 * (n1 + 1.0) / 2.0;
+    const double mean = n1 * n2 / 2.0;
+    const double variance = n1 * n2 / 12.0 * ((n + 1.0) - tieSum / (n * (n - 1.0)));
+    if (variance <= 0.0)
+    {
+      return 1.0;
+    }
+    const double z = (u - mean - 0.5) / std::sqrt(variance);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+  }
+
+  /**
+   * Compare current results with baseline.
+   *
+   * Benchmarks missing in baseline are skipped.
+   */
+  inline std::vector<verdict_t> Compare(
+    const std::vector<result_t>& baseline,
+    const std::vector<result_t>& current,
+    const options_t& options
+  )
+  {
+    std::vector<verdict_t> verdicts;
+    for (const auto& cur: current)
+    {
+      auto base = std::find_if(baseline.begin(), baseline.end(),
+        [&cur](const result_t& item)
+        {
+          return item.name == cur.name;
+        }
+      );
+      if (base == baseline.end())
+      {
+        continue;
+      }
+
+      verdict_t verdict;
+      verdict.name = cur.name;
+      verdict.baseline = base->Median();
+      verdict.current = cur.Median();
+      auto custom = options.perCase.find(cur.name);
+      verdict.tolerance = (custom != options.perCase.end())? custom->second: options.tolerance;
+      verdict.pvalue = MannWhitneyGreater(base->samples, cur.samples);
+      verdict.regressed = (verdict.current > verdict.baseline * (1.0 + verdict.tolerance))
+        && (verdict.pvalue < options.alpha);
+      verdicts.push_back(verdict);
+    }
+    return verdicts;
+  }
+
+  /**
+   * Parse command line options.
+   *
+   * @throws std::runtime_error on unknown or malformed option
+   */
+  inline options_t ParseOptions(int argc, char* argv[])
+  {
+    options_t options;
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg(argv[i]);
+      auto next = [&]() -> std::string
+      {
+        if (i + 1 >= argc)
+        {
+          throw std::runtime_error("Missing argument for " + arg);
+        }
+        return argv[++i];
+      };
+
+      if (arg == "--samples")
+      {
+        options.samples = std::stoul(next());
+        if (options.samples == 0)
+        {
+          throw std::runtime_error("At least one sample required");
+        }
+      }
+      else if (arg == "--min-time")
+      {
+        options.minSampleTime = std::stod(next());
+      }
+      else if (arg == "--filter")
+      {
+        options.filter = next();
+      }
+      else if (arg == "--out")
+      {
+        options.out = next();
+      }
+      else if (arg == "--baseline")
+      {
+        options.baseline = next();
+      }
+      else if (arg == "--alpha")
+      {
+        options.alpha = std::stod(next());
+      }
+      else if (arg == "--tolerance")
+      {
+        auto value = next();
+        auto eq = value.find('=');
+        if (eq == std::string::npos)
+        {
+          options.tolerance = std::stod(value);
+        }
+        else
+        {
+          options.perCase[value.substr(0, eq)] = std::stod(value.substr(eq + 1));
+        }
+      }
+      else
+      {
+        throw std::runtime_error("Unknown option: " + arg);
+      }
+    }
+    return options;
+  }
+
+  /**
+   * Print command line help.
+   */
+  inline void Usage(const char* name)
+  {
+    std::cerr << "Usage: " << name << " [options]" << std::endl
+      << "  --samples N            samples per benchmark (15)" << std::endl
+      << "  --min-time SEC         minimal sample duration (0.02)" << std::endl
+      << "  --filter TEXT          run only benchmarks containing TEXT" << std::endl
+      << "  --out FILE             write results to FILE" << std::endl
+      << "  --baseline FILE        compare with results in FILE, fail on regression" << std::endl
+      << "  --tolerance X          allowed relative median slowdown (0.10)" << std::endl
+      << "  --tolerance NAME=X     tolerance for one benchmark" << std::endl
+      << "  --alpha P              significance level of Mann-Whitney test (0.01)" << std::endl;
+  }
+
+  /**
+   * Benchmark program entry point.
+   *
+   * @return EXIT_SUCCESS, or EXIT_FAILURE on error or regression
+   */
+  inline int Main(int argc, char* argv[], const std::vector<case_t>& cases)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      if ((std::strcmp(argv[i], "--help") == 0) || (std::strcmp(argv[i], "-h") == 0))
+      {
+        Usage(argv[0]);
+        return EXIT_SUCCESS;
+      }
+    }
+
+    options_t options;
+    try
+    {
+      options = ParseOptions(argc, argv);
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << error.what() << std::endl;
+      Usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    std::vector<result_t> results;
+    for (const auto& bench: cases)
+    {
+      if (!options.filter.empty() && (bench.name.find(options.filter) == std::string::npos))
+      {
+        continue;
+      }
+      results.push_back(Run(bench, options));
+      const auto median = results.back().Median();
+      std::cout << std::left << std::setw(40) << bench.name << std::right
+        << std::fixed << std::setprecision(2)
+        << std::setw(12) << median << " ns/op"
+        << std::setw(14) << ((median > 0.0)? 1e3 / median: 0.0) << " Mops/s"
+        << std::defaultfloat << std::endl;
+    }
+
+    if (!options.out.empty())
+    {
+      std::ofstream output(options.out);
+      if (!output)
+      {
+        std::cerr << "Can't write " << options.out << std::endl;
+        return EXIT_FAILURE;
+      }
+      WriteResults(output, results);
+    }
+
+    if (options.baseline.empty())
+    {
+      return EXIT_SUCCESS;
+    }
+
+    std::vector<result_t> baseline;
+    try
+    {
+      std::ifstream input(options.baseline);
+      if (!input)
+      {
+        throw std::runtime_error("Can't read " + options.baseline);
+      }
+      baseline = ReadResults(input);
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << error.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    int regressions = 0;
+    for (const auto& verdict: Compare(baseline, results, options))
+    {
+      std::cout << (verdict.regressed? "REGRESSION ": "ok         ")
+        << std::left << std::setw(40) << verdict.name << std::right
+        << std::fixed << std::setprecision(2)
+        << std::setw(10) << verdict.baseline << " -> "
+        << std::setw(10) << verdict.current << " ns/op"
+        << "  (" << std::showpos << (verdict.current / verdict.baseline - 1.0) * 100.0 << std::noshowpos
+        << "%, limit " << verdict.tolerance * 100.0 << "%, p=" << std::setprecision(4) << verdict.pvalue << ")"
+        << std::defaultfloat << std::endl;
+      if (verdict.regressed)
+      {
+        ++regressions;
+      }
+    }
+
+    if (regressions != 0)
+    {
+      std::cerr << regressions << " benchmark(s) regressed" << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+} // namespace bench
+} // namespace bvl
+
+#endif /* BAD_VALUE_BENCH_HEADER */
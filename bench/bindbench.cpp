@@ -0,0 +1,202 @@
+#include <badval_bind.hpp>
+#include "badbench.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  struct order_t
+  {
+    std::uint64_t orderId;
+    std::string customerName;
+    std::string shippingAddress;
+    double totalAmount;
+    std::int32_t itemCount;
+    bool expressDelivery;
+    std::string currencyCode;
+    double discountRate;
+  };
+
+  BVL_BIND(order_t, orderId, customerName, shippingAddress, totalAmount, itemCount, expressDelivery, currencyCode, discountRate)
+
+  const std::size_t orderCount = 1024;
+
+  order_t Order(std::size_t id)
+  {
+    return { id, "customer-" + std::to_string(id), "street " + std::to_string(id % 100) + ", city", 10.5 * static_cast<double>(id), static_cast<std::int32_t>(id % 7), id % 2 == 0, "EUR", 0.05 };
+  }
+
+  /**
+   * Typical converter written by hand.
+   */
+  node_t HandNode(const order_t& order)
+  {
+    auto result = node_t::Object();
+    result.Set("orderId", node_t(value_t(static_cast<double>(order.orderId))));
+    result.Set("customerName", node_t(value_t(order.customerName)));
+    result.Set("shippingAddress", node_t(value_t(order.shippingAddress)));
+    result.Set("totalAmount", node_t(value_t(order.totalAmount)));
+    result.Set("itemCount", node_t(value_t(static_cast<double>(order.itemCount))));
+    result.Set("expressDelivery", node_t(value_t(order.expressDelivery? 1.0: 0.0)));
+    result.Set("currencyCode", node_t(value_t(order.currencyCode)));
+    result.Set("discountRate", node_t(value_t(order.discountRate)));
+    return result;
+  }
+
+  void HandFromNode(const node_t& node, order_t& order)
+  {
+    order.orderId = static_cast<std::uint64_t>(node.Find("orderId")->Value().AsNumber());
+    order.customerName = node.Find("customerName")->Value().AsString();
+    order.shippingAddress = node.Find("shippingAddress")->Value().AsString();
+    order.totalAmount = node.Find("totalAmount")->Value().AsNumber();
+    order.itemCount = static_cast<std::int32_t>(node.Find("itemCount")->Value().AsNumber());
+    order.expressDelivery = node.Find("expressDelivery")->Value().AsNumber() != 0.0;
+    order.currencyCode = node.Find("currencyCode")->Value().AsString();
+    order.discountRate = node.Find("discountRate")->Value().AsNumber();
+  }
+
+  void HandEncode(const order_t& order, std::string& out)
+  {
+    bvl::serial::Encode(value_t(static_cast<double>(order.orderId)), out);
+    bvl::serial::Encode(value_t(order.customerName), out);
+    bvl::serial::Encode(value_t(order.shippingAddress), out);
+    bvl::serial::Encode(value_t(order.totalAmount), out);
+    bvl::serial::Encode(value_t(static_cast<double>(order.itemCount)), out);
+    bvl::serial::Encode(value_t(order.expressDelivery? 1.0: 0.0), out);
+    bvl::serial::Encode(value_t(order.currencyCode), out);
+    bvl::serial::Encode(value_t(order.discountRate), out);
+  }
+
+  void HandDecode(const char*& cursor, const char* end, order_t& order)
+  {
+    order.orderId = static_cast<std::uint64_t>(bvl::serial::Decode(cursor, end).AsNumber());
+    order.customerName = bvl::serial::Decode(cursor, end).AsString();
+    order.shippingAddress = bvl::serial::Decode(cursor, end).AsString();
+    order.totalAmount = bvl::serial::Decode(cursor, end).AsNumber();
+    order.itemCount = static_cast<std::int32_t>(bvl::serial::Decode(cursor, end).AsNumber());
+    order.expressDelivery = bvl::serial::Decode(cursor, end).AsNumber() != 0.0;
+    order.currencyCode = bvl::serial::Decode(cursor, end).AsString();
+    order.discountRate = bvl::serial::Decode(cursor, end).AsNumber();
+  }
+
+  struct state_t
+  {
+    std::vector<order_t> orders;    /**< Source structures */
+    std::vector<node_t> nodes;      /**< Orders as documents */
+    std::string stream;             /**< Orders serialized */
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto state = std::make_shared<state_t>();
+    for (std::size_t i = 0; i < orderCount; ++i)
+    {
+      state->orders.push_back(Order(i));
+      state->nodes.push_back(HandNode(state->orders.back()));
+      HandEncode(state->orders.back(), state->stream);
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"tonode/hand", [state](std::size_t iterations)
+    {
+      std::size_t size = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        size += HandNode(state->orders[i % orderCount]).Size();
+      }
+      bvl::bench::DoNotOptimize(size);
+    }});
+    cases.push_back({"tonode/bind", [state](std::size_t iterations)
+    {
+      std::size_t size = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        size += bvl::bind::ToNode(state->orders[i % orderCount]).Size();
+      }
+      bvl::bench::DoNotOptimize(size);
+    }});
+    cases.push_back({"fromnode/hand", [state](std::size_t iterations)
+    {
+      order_t order;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        HandFromNode(state->nodes[i % orderCount], order);
+      }
+      bvl::bench::DoNotOptimize(order.orderId);
+    }});
+    cases.push_back({"fromnode/bind", [state](std::size_t iterations)
+    {
+      order_t order;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::bind::FromNode(state->nodes[i % orderCount], order);
+      }
+      bvl::bench::DoNotOptimize(order.orderId);
+    }});
+    cases.push_back({"encode/hand", [state](std::size_t iterations)
+    {
+      std::string out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        out.clear();
+        HandEncode(state->orders[i % orderCount], out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+    cases.push_back({"encode/bind", [state](std::size_t iterations)
+    {
+      std::string out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        out.clear();
+        bvl::bind::Encode(state->orders[i % orderCount], out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+    cases.push_back({"decode/hand", [state](std::size_t iterations)
+    {
+      order_t order;
+      const char* cursor = state->stream.data();
+      const char* end = cursor + state->stream.size();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (cursor == end)
+        {
+          cursor = state->stream.data();
+        }
+        HandDecode(cursor, end, order);
+      }
+      bvl::bench::DoNotOptimize(order.orderId);
+    }});
+    cases.push_back({"decode/bind", [state](std::size_t iterations)
+    {
+      order_t order;
+      const char* cursor = state->stream.data();
+      const char* end = cursor + state->stream.size();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (cursor == end)
+        {
+          cursor = state->stream.data();
+        }
+        bvl::bind::Decode(cursor, end, order);
+      }
+      bvl::bench::DoNotOptimize(order.orderId);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
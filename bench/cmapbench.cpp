@@ -0,0 +1,168 @@
+#include <badval_cmap.hpp>
+#include "badbench.hpp"
+
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t keyCount = 16384;
+
+  /**
+   * Reference implementation: one lock around std::unordered_map.
+   */
+  class locked_map_t final
+  {
+  public:
+
+    bool Find(const std::string& key, value_t& out) const
+    {
+      std::shared_lock<std::shared_timed_mutex> lock(this->mutex);
+      auto it = this->map.find(key);
+      if (it == this->map.end())
+      {
+        return false;
+      }
+      out = it->second;
+      return true;
+    }
+
+    void Assign(const std::string& key, value_t value)
+    {
+      std::unique_lock<std::shared_timed_mutex> lock(this->mutex);
+      this->map[key] = std::move(value);
+    }
+
+    void Reclaim()
+    {
+      ;
+    }
+
+  private:
+    mutable std::shared_timed_mutex mutex;
+    std::unordered_map<std::string, value_t> map;
+  };
+
+  /**
+   * Adapter to give concurrent map same interface.
+   */
+  class sharded_map_t final
+  {
+  public:
+
+    bool Find(const std::string& key, value_t& out) const
+    {
+      return this->map.Find(key, out);
+    }
+
+    void Assign(const std::string& key, value_t value)
+    {
+      this->map.Assign(value_t(key), std::move(value));
+    }
+
+    void Reclaim()
+    {
+      this->map.Reclaim();
+    }
+
+  private:
+    bvl::concurrent_map_t map;
+  };
+
+  const std::vector<std::string>& Keys()
+  {
+    static const std::vector<std::string> keys = []()
+    {
+      std::vector<std::string> result;
+      for (std::size_t i = 0; i < keyCount; ++i)
+      {
+        result.push_back("symbol_" + std::to_string(i));
+      }
+      return result;
+    }();
+    return keys;
+  }
+
+  /**
+   * Run workload on given number of threads.
+   *
+   * @param [in] writePercent share of operations which replace value
+   */
+  template<typename map_t>
+  bvl::bench::case_t Workload(const std::string& name, std::shared_ptr<map_t> map, unsigned threads, unsigned writePercent)
+  {
+    return {name + "/t" + std::to_string(threads), [map, threads, writePercent](std::size_t iterations)
+    {
+      const auto& keys = Keys();
+      const auto perThread = iterations / threads + 1;
+      std::vector<std::thread> workers;
+      for (unsigned t = 0; t < threads; ++t)
+      {
+        workers.emplace_back([&keys, &map, perThread, writePercent, t]()
+        {
+          std::uint64_t rng = 0x9e3779b97f4a7c15ULL * (t + 1);
+          value_t out;
+          std::size_t found = 0;
+          for (std::size_t i = 0; i < perThread; ++i)
+          {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            const auto& key = keys[rng % keys.size()];
+            if ((rng >> 32) % 100 < writePercent)
+            {
+              map->Assign(key, value_t(static_cast<double>(i)));
+            }
+            else
+            {
+              found += map->Find(key, out)? 1: 0;
+            }
+          }
+          bvl::bench::DoNotOptimize(found);
+        });
+      }
+      for (auto& worker: workers)
+      {
+        worker.join();
+      }
+      map->Reclaim();
+    }};
+  }
+
+  template<typename map_t>
+  std::shared_ptr<map_t> Filled()
+  {
+    auto map = std::make_shared<map_t>();
+    for (const auto& key: Keys())
+    {
+      map->Assign(key, value_t(key));
+    }
+    return map;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+    auto locked = Filled<locked_map_t>();
+    auto sharded = Filled<sharded_map_t>();
+    for (unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+      cases.push_back(Workload("read-mostly/locked", locked, threads, 5));
+      cases.push_back(Workload("read-mostly/sharded", sharded, threads, 5));
+      cases.push_back(Workload("mixed/locked", locked, threads, 50));
+      cases.push_back(Workload("mixed/sharded", sharded, threads, 50));
+    }
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
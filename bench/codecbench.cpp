@@ -0,0 +1,157 @@
+#include <badval_codec.hpp>
+#include "badbench.hpp"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using namespace bvl::codec;
+
+  /**
+   * Market tick: id, symbol, price, size, side, exchange, sequence, timestamp.
+   */
+  using tick_t = schema_t<u64_t, str_t, f64_t, i32_t, bool_t, str_t, u32_t, i64_t>;
+
+  const std::size_t tickCount = 1024;
+
+  tick_t::message_t Tick(std::size_t i)
+  {
+    return tick_t::message_t{ i, "SYM" + std::to_string(i % 50), 100.0 + static_cast<double>(i) * 0.01, static_cast<std::int32_t>(i % 1000), i % 2 == 0, "XNAS", static_cast<std::uint32_t>(i), 1700000000000LL + static_cast<std::int64_t>(i) };
+  }
+
+  std::vector<value_t> Row(const tick_t::message_t& tick)
+  {
+    std::vector<value_t> result;
+    result.emplace_back(static_cast<double>(std::get<0>(tick)));
+    result.emplace_back(std::get<1>(tick));
+    result.emplace_back(std::get<2>(tick));
+    result.emplace_back(static_cast<double>(std::get<3>(tick)));
+    result.emplace_back(std::get<4>(tick)? 1.0: 0.0);
+    result.emplace_back(std::get<5>(tick));
+    result.emplace_back(static_cast<double>(std::get<6>(tick)));
+    result.emplace_back(static_cast<double>(std::get<7>(tick)));
+    return result;
+  }
+
+  struct state_t
+  {
+    std::vector<tick_t::message_t> ticks;       /**< Typed messages */
+    std::vector<std::vector<value_t>> rows;     /**< Same messages as rows */
+    std::string tagged;                         /**< Rows written by bvl::serial */
+    std::string compact;                        /**< Messages written by codec */
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto state = std::make_shared<state_t>();
+    for (std::size_t i = 0; i < tickCount; ++i)
+    {
+      state->ticks.push_back(Tick(i));
+      state->rows.push_back(Row(state->ticks.back()));
+      for (const auto& value: state->rows.back())
+      {
+        bvl::serial::Encode(value, state->tagged);
+      }
+      tick_t::Encode(state->ticks.back(), state->compact);
+    }
+    std::cout << tickCount << " ticks: tagged " << state->tagged.size() << " bytes, codec " << state->compact.size() << " bytes" << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"encode/tagged", [state](std::size_t iterations)
+    {
+      std::string out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        out.clear();
+        for (const auto& value: state->rows[i % tickCount])
+        {
+          bvl::serial::Encode(value, out);
+        }
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+    cases.push_back({"encode/codec-row", [state](std::size_t iterations)
+    {
+      std::string out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        out.clear();
+        tick_t::Encode(state->rows[i % tickCount], out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+    cases.push_back({"encode/codec", [state](std::size_t iterations)
+    {
+      std::string out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        out.clear();
+        tick_t::Encode(state->ticks[i % tickCount], out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+    cases.push_back({"decode/tagged", [state](std::size_t iterations)
+    {
+      std::vector<value_t> row;
+      const char* cursor = state->tagged.data();
+      const char* end = cursor + state->tagged.size();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (cursor == end)
+        {
+          cursor = state->tagged.data();
+        }
+        row.clear();
+        for (std::size_t field = 0; field < tick_t::Size(); ++field)
+        {
+          row.push_back(bvl::serial::Decode(cursor, end));
+        }
+      }
+      bvl::bench::DoNotOptimize(row);
+    }});
+    cases.push_back({"decode/codec-row", [state](std::size_t iterations)
+    {
+      std::vector<value_t> row;
+      const char* cursor = state->compact.data();
+      const char* end = cursor + state->compact.size();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (cursor == end)
+        {
+          cursor = state->compact.data();
+        }
+        tick_t::Decode(cursor, end, row);
+      }
+      bvl::bench::DoNotOptimize(row);
+    }});
+    cases.push_back({"decode/codec", [state](std::size_t iterations)
+    {
+      tick_t::message_t tick;
+      const char* cursor = state->compact.data();
+      const char* end = cursor + state->compact.size();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (cursor == end)
+        {
+          cursor = state->compact.data();
+        }
+        tick_t::Decode(cursor, end, tick);
+      }
+      bvl::bench::DoNotOptimize(tick);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,182 @@
+#include <badval_columnar.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::zonemap::predicate_t;
+
+  const std::size_t rowCount = 200000;
+  const char columnarPath[] = "columnarbench.col";
+  const char rowPath[] = "columnarbench.rows";
+
+  const std::vector<std::string> names = { "id", "time", "category", "price", "url" };
+
+  std::vector<value_t> Row(std::size_t row, std::mt19937& rng)
+  {
+    std::vector<value_t> result;
+    result.emplace_back(static_cast<double>(row));
+    result.emplace_back(static_cast<double>(1600000000 + row * 2 + rng() % 2));
+    result.emplace_back("category-" + std::to_string(rng() % 20));
+    result.emplace_back(static_cast<double>(rng() % 1000000) / 100.0);
+    char url[64];
+    std::snprintf(url, sizeof(url), "https://example.com/items/%08zu", row);
+    result.emplace_back(url);
+    return result;
+  }
+
+  /**
+   * Write table as columnar file and as serialized rows.
+   */
+  void WriteFiles()
+  {
+    std::mt19937 rng(1);
+    bvl::columnar::writer_t writer(columnarPath, names);
+    std::string rows;
+    for (std::size_t row = 0; row < rowCount; ++row)
+    {
+      auto values = Row(row, rng);
+      for (const auto& value: values)
+      {
+        bvl::serial::Encode(value, rows);
+      }
+      writer.Append(std::move(values));
+    }
+    writer.Finish();
+
+    auto file = std::fopen(rowPath, "wb");
+    std::fwrite(rows.data(), 1, rows.size(), file);
+    std::fclose(file);
+    std::cout << "columnar bytes: " << writer.FileSize() << ", row bytes: " << rows.size() << std::endl;
+  }
+
+  std::string ReadAll(const char* path)
+  {
+    std::string result;
+    auto file = std::fopen(path, "rb");
+    char buffer[65536];
+    std::size_t size;
+    while ((size = std::fread(buffer, 1, sizeof(buffer), file)) != 0)
+    {
+      result.append(buffer, size);
+    }
+    std::fclose(file);
+    return result;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    WriteFiles();
+    auto file = std::make_shared<bvl::columnar::file_t>(columnarPath);
+    const char* encodings[] = { "plain", "dictionary", "rle", "delta", "bitpacked" };
+    for (std::size_t column = 0; column < names.size(); ++column)
+    {
+      const auto& chunk = file->Chunk(0, column);
+      std::cout << names[column] << ": numbers " << encodings[chunk.numbers] << ", strings " << encodings[chunk.strings] << std::endl;
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"write/columnar", [](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::mt19937 rng(1);
+        bvl::columnar::writer_t writer(columnarPath, names);
+        for (std::size_t row = 0; row < rowCount; ++row)
+        {
+          writer.Append(Row(row, rng));
+        }
+        writer.Finish();
+      }
+    }});
+    cases.push_back({"write/rows", [](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::mt19937 rng(1);
+        std::string rows;
+        for (std::size_t row = 0; row < rowCount; ++row)
+        {
+          for (const auto& value: Row(row, rng))
+          {
+            bvl::serial::Encode(value, rows);
+          }
+        }
+        auto out = std::fopen(rowPath, "wb");
+        std::fwrite(rows.data(), 1, rows.size(), out);
+        std::fclose(out);
+      }
+    }});
+
+    // one column of table, rows must decode everything
+    for (const std::string name: { "time", "category" })
+    {
+      const auto column = file->Column(name);
+      cases.push_back({"read/" + name + "/columnar", [file, column](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          std::vector<value_t> values;
+          file->Read(column, values);
+          bvl::bench::DoNotOptimize(values);
+        }
+      }});
+      cases.push_back({"read/" + name + "/rows", [column](std::size_t iterations)
+      {
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          const auto rows = ReadAll(rowPath);
+          std::vector<value_t> values;
+          auto cursor = rows.data();
+          const auto end = cursor + rows.size();
+          for (std::size_t index = 0; cursor < end; ++index)
+          {
+            auto value = bvl::serial::Decode(cursor, end);
+            if (index % names.size() == column)
+            {
+              values.push_back(std::move(value));
+            }
+          }
+          bvl::bench::DoNotOptimize(values);
+        }
+      }});
+    }
+
+    // 0.1% of rows by time, zones rule out other pages
+    auto predicate = std::make_shared<predicate_t>(predicate_t::Between(1600200000.0, 1600200400.0));
+    for (const bool skip: { true, false })
+    {
+      cases.push_back({std::string("scan/time") + (skip? "/zones": "/full"), [file, predicate, skip](std::size_t iterations)
+      {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          count += file->Scan(1, *predicate, [](std::uint64_t, const value_t&)
+          {
+            return true;
+          }, skip).matched;
+        }
+        bvl::bench::DoNotOptimize(count);
+      }});
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  const auto result = bvl::bench::Main(argc, argv, Cases());
+  std::remove(columnarPath);
+  std::remove(rowPath);
+  return result;
+}
@@ -0,0 +1,124 @@
+#include <badval_diff.hpp>
+#include "badbench.hpp"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  const std::size_t memberCount = 1000;
+  const std::size_t leafCount = 100;
+  const std::size_t changeCount = 10;
+
+  /**
+   * Object of 1000 records with 100 fields each.
+   */
+  node_t Document()
+  {
+    auto result = node_t::Object();
+    for (std::size_t i = 0; i < memberCount; ++i)
+    {
+      auto record = node_t::Object();
+      for (std::size_t j = 0; j < leafCount; ++j)
+      {
+        record.Set("field" + std::to_string(j), (j % 2 == 0)? value_t(static_cast<double>(i * j)): value_t("text-" + std::to_string(j)));
+      }
+      result.Set("record" + std::to_string(i), std::move(record));
+    }
+    return result;
+  }
+
+  /**
+   * Document replica on both sides with random changes.
+   */
+  struct state_t
+  {
+    node_t current;               /**< Sender document, changed in place */
+    node_t last;                  /**< Document receiver has */
+    std::mt19937 rng;             /**< Picks changed fields */
+    double counter = 0.0;         /**< New field value */
+
+    void Change()
+    {
+      for (std::size_t i = 0; i < changeCount; ++i)
+      {
+        auto& record = this->current.At(this->rng() % memberCount);
+        record.At(2 * (this->rng() % (leafCount / 2))) = value_t(++this->counter);
+      }
+    }
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto state = std::make_shared<state_t>();
+    state->current = Document();
+    state->last = state->current;
+    {
+      std::string full;
+      bvl::diff::detail::EncodeNode(state->current, full);
+      state->Change();
+      std::string patch;
+      bvl::diff::Encode(bvl::diff::Diff(state->last, state->current), patch);
+      std::cout << "document " << full.size() << " bytes, patch of " << changeCount << " changes " << patch.size() << " bytes" << std::endl;
+      state->last = state->current;
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"sync/full", [state](std::size_t iterations)
+    {
+      std::size_t bytes = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        state->Change();
+        std::string out;
+        bvl::diff::detail::EncodeNode(state->current, out);
+        bytes += out.size();
+      }
+      bvl::bench::DoNotOptimize(bytes);
+    }});
+    cases.push_back({"sync/diff", [state](std::size_t iterations)
+    {
+      std::size_t bytes = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        state->Change();
+        const auto patch = bvl::diff::Diff(state->last, state->current);
+        std::string out;
+        bvl::diff::Encode(patch, out);
+        bytes += out.size();
+        bvl::diff::Apply(state->last, patch);
+      }
+      bvl::bench::DoNotOptimize(bytes);
+    }});
+    cases.push_back({"diff/uncached", [state](std::size_t iterations)
+    {
+      std::size_t ops = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        // decoded copies have no cached hashes
+        std::string out;
+        bvl::diff::detail::EncodeNode(state->current, out);
+        const char* cursor = out.data();
+        const auto copy = bvl::diff::detail::DecodeNode(cursor, out.data() + out.size());
+        ops += bvl::diff::Diff(state->last, copy).size();
+      }
+      bvl::bench::DoNotOptimize(ops);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
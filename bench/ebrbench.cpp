@@ -0,0 +1,127 @@
+#include <badval_ebr.hpp>
+#include "badbench.hpp"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Threads which keep pinning domain in background.
+   */
+  class readers_t final
+  {
+  public:
+
+    readers_t(bvl::ebr::domain_t& domain, unsigned count)
+      : stop(false)
+    {
+      for (unsigned i = 0; i < count; ++i)
+      {
+        this->threads.emplace_back([this, &domain]()
+        {
+          while (!this->stop.load(std::memory_order_relaxed))
+          {
+            auto guard = domain.Pin();
+            std::this_thread::yield();
+          }
+        });
+      }
+    }
+
+    ~readers_t()
+    {
+      this->stop = true;
+      for (auto& thread: this->threads)
+      {
+        thread.join();
+      }
+    }
+
+  private:
+    std::atomic<bool> stop;
+    std::vector<std::thread> threads;
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"pin", [](std::size_t iterations)
+    {
+      static bvl::ebr::domain_t domain;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        auto guard = domain.Pin();
+        bvl::bench::DoNotOptimize(guard);
+      }
+    }});
+
+    cases.push_back({"pin-nested", [](std::size_t iterations)
+    {
+      static bvl::ebr::domain_t domain;
+      auto outer = domain.Pin();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        auto guard = domain.Pin();
+        bvl::bench::DoNotOptimize(guard);
+      }
+    }});
+
+    cases.push_back({"delete/string", [](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        value_t value("string long enough to be allocated on heap");
+        bvl::bench::DoNotOptimize(value);
+      }
+    }});
+
+    cases.push_back({"retire/string", [](std::size_t iterations)
+    {
+      static bvl::ebr::domain_t domain;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        domain.Retire(value_t("string long enough to be allocated on heap"));
+      }
+      domain.Synchronize();
+    }});
+
+    for (unsigned readers = 1; readers <= 16; readers *= 4)
+    {
+      cases.push_back({"retire/string/readers" + std::to_string(readers), [readers](std::size_t iterations)
+      {
+        static bvl::ebr::domain_t domain;
+        readers_t background(domain, readers);
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          domain.Retire(value_t("string long enough to be allocated on heap"));
+        }
+        domain.Synchronize();
+      }});
+
+      // time from retire until value is released
+      cases.push_back({"grace-period/readers" + std::to_string(readers), [readers](std::size_t iterations)
+      {
+        static bvl::ebr::domain_t domain;
+        readers_t background(domain, readers);
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          domain.Retire(value_t(nullptr, nullptr));
+          domain.Synchronize();
+        }
+      }});
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,150 @@
+#include <badval_hll.hpp>
+#include "badbench.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t valueCount = 1000000;
+
+  /**
+   * Stream of values with about half distinct.
+   */
+  std::shared_ptr<std::vector<value_t>> Values()
+  {
+    std::mt19937 rng(1);
+    auto values = std::make_shared<std::vector<value_t>>();
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      const auto key = rng() % valueCount;
+      if (key % 2 == 0)
+      {
+        values->emplace_back(static_cast<double>(key));
+      }
+      else
+      {
+        values->emplace_back("session-" + std::to_string(key));
+      }
+    }
+    return values;
+  }
+
+  /**
+   * Print relative error of estimates for growing cardinalities.
+   */
+  void Accuracy()
+  {
+    for (const unsigned precision: { 10u, 14u })
+    {
+      for (const std::size_t count: { 100, 10000, 1000000 })
+      {
+        bvl::hll::sketch_t sketch(precision);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          sketch.Add(value_t("item-" + std::to_string(i)));
+        }
+        const auto error = (sketch.Estimate() - static_cast<double>(count)) / static_cast<double>(count);
+        std::cout << "precision " << precision << ", " << count << " distinct: error "
+          << 100.0 * error << "%, expected " << 100.0 * sketch.StandardError() << "%, bytes " << sketch.Bytes() << std::endl;
+      }
+    }
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    Accuracy();
+    auto values = Values();
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"count/hll", [values](std::size_t iterations)
+    {
+      double estimate = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::hll::sketch_t sketch(14);
+        for (const auto& value: *values)
+        {
+          sketch.Add(value);
+        }
+        estimate += sketch.Estimate();
+      }
+      bvl::bench::DoNotOptimize(estimate);
+    }});
+    cases.push_back({"count/exact", [values](std::size_t iterations)
+    {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::unordered_set<value_t> seen;
+        for (const auto& value: *values)
+        {
+          seen.insert(value);
+        }
+        count += seen.size();
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+
+    // dense registers of 2^16 bytes
+    auto lhs = std::make_shared<std::vector<std::uint8_t>>();
+    auto rhs = std::make_shared<std::vector<std::uint8_t>>();
+    std::mt19937 rng(2);
+    for (std::size_t i = 0; i < (1 << 16); ++i)
+    {
+      lhs->push_back(static_cast<std::uint8_t>(rng() % 20));
+      rhs->push_back(static_cast<std::uint8_t>(rng() % 20));
+    }
+    cases.push_back({"merge/scalar", [lhs, rhs](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::hll::detail::MaxScalar(lhs->data(), rhs->data(), lhs->size());
+      }
+      bvl::bench::DoNotOptimize(*lhs);
+    }});
+    cases.push_back({"merge/simd", [lhs, rhs](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::hll::detail::Max(lhs->data(), rhs->data(), lhs->size());
+      }
+      bvl::bench::DoNotOptimize(*lhs);
+    }});
+    cases.push_back({"estimate/scalar", [lhs](std::size_t iterations)
+    {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::size_t zeros;
+        sum += bvl::hll::detail::SumScalar(lhs->data(), lhs->size(), zeros);
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+    cases.push_back({"estimate/simd", [lhs](std::size_t iterations)
+    {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::size_t zeros;
+        sum += bvl::hll::detail::Sum(lhs->data(), lhs->size(), zeros);
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,112 @@
+#include <badval_intern.hpp>
+#include "badbench.hpp"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+  using bvl::intern::factory_t;
+  using bvl::intern::handle_t;
+
+  const std::size_t recordCount = 10000;
+
+  /**
+   * Cached record, most parts repeat across records.
+   */
+  node_t Record(std::size_t id)
+  {
+    auto address = node_t::Object();
+    address.Set("country", value_t("country-" + std::to_string(id % 4)));
+    address.Set("city", value_t("city-" + std::to_string(id % 16)));
+    auto tags = node_t::Array();
+    for (std::size_t i = 0; i < 8; ++i)
+    {
+      tags.Push(value_t("tag-" + std::to_string((id + i) % 10)));
+    }
+    auto result = node_t::Object();
+    result.Set("status", value_t((id % 3 == 0)? "active": "inactive"));
+    result.Set("address", std::move(address));
+    result.Set("tags", std::move(tags));
+    result.Set("group", value_t(static_cast<double>(id % 50)));
+    return result;
+  }
+
+  std::size_t Nodes(const node_t& node)
+  {
+    std::size_t result = 1;
+    for (std::size_t i = 0; i < node.Size(); ++i)
+    {
+      result += Nodes(node.At(i));
+    }
+    return result;
+  }
+
+  struct state_t
+  {
+    std::vector<node_t> records;    /**< Plain documents */
+    std::vector<node_t> copies;     /**< Equal documents without cached hashes */
+    factory_t factory;              /**< Keeps interned terms */
+    std::vector<handle_t> terms;    /**< Interned documents */
+  };
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto state = std::make_shared<state_t>();
+    std::size_t nodes = 0;
+    for (std::size_t i = 0; i < recordCount; ++i)
+    {
+      state->records.push_back(Record(i));
+      state->copies.push_back(Record(i));
+      nodes += Nodes(state->records.back());
+      state->terms.push_back(state->factory.Intern(state->records.back()));
+    }
+    std::cout << recordCount << " records: " << nodes << " nodes, " << state->factory.Size() << " interned terms" << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"intern/record", [state](std::size_t iterations)
+    {
+      std::size_t same = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        const auto index = i % recordCount;
+        same += (state->factory.Intern(state->records[index]) == state->terms[index])? 1: 0;
+      }
+      bvl::bench::DoNotOptimize(same);
+    }});
+    cases.push_back({"equal/deep", [state](std::size_t iterations)
+    {
+      std::size_t same = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        const auto index = i % recordCount;
+        same += (state->records[index] == state->copies[(index * 7) % recordCount])? 1: 0;
+      }
+      bvl::bench::DoNotOptimize(same);
+    }});
+    cases.push_back({"equal/interned", [state](std::size_t iterations)
+    {
+      std::size_t same = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        const auto index = i % recordCount;
+        same += (state->terms[index] == state->terms[(index * 7) % recordCount])? 1: 0;
+      }
+      bvl::bench::DoNotOptimize(same);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
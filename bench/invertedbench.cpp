@@ -0,0 +1,170 @@
+#include <badval_inverted.hpp>
+#include "badbench.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t docCount = 200000;
+  const std::size_t vocabulary = 5000;
+
+  /**
+   * Documents of 8 words, word frequency follows Zipf law.
+   */
+  std::vector<value_t> Documents()
+  {
+    std::mt19937 rng(1);
+    std::vector<double> weights;
+    for (std::size_t i = 0; i < vocabulary; ++i)
+    {
+      weights.push_back(1.0 / static_cast<double>(i + 1));
+    }
+    std::discrete_distribution<std::size_t> word(weights.begin(), weights.end());
+
+    std::vector<value_t> docs;
+    docs.reserve(docCount);
+    for (std::size_t i = 0; i < docCount; ++i)
+    {
+      std::string text;
+      for (int j = 0; j < 8; ++j)
+      {
+        text += "w" + std::to_string(word(rng)) + " ";
+      }
+      docs.emplace_back(std::move(text));
+    }
+    return docs;
+  }
+
+  /**
+   * Answer query by tokenizing every document, what index replaces.
+   */
+  std::size_t ScanAll(const std::vector<value_t>& docs, const std::vector<std::string>& terms)
+  {
+    std::size_t count = 0;
+    for (const auto& doc: docs)
+    {
+      std::size_t found = 0;
+      std::vector<bool> seen(terms.size(), false);
+      bvl::inverted::Tokenize(doc.As<value_t::string>(), [&](const std::string& token)
+      {
+        for (std::size_t i = 0; i < terms.size(); ++i)
+        {
+          if (!seen[i] && (token == terms[i]))
+          {
+            seen[i] = true;
+            ++found;
+          }
+        }
+      });
+      count += (found == terms.size())? 1: 0;
+    }
+    return count;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto docs = std::make_shared<std::vector<value_t>>(Documents());
+    auto index = std::make_shared<bvl::inverted::index_t>();
+    for (const auto& doc: *docs)
+    {
+      index->Add(doc);
+    }
+    index->Flush();
+    std::cout << "segments: " << index->Segments()
+      << ", posting bytes: " << index->PostingBytes()
+      << ", bytes per document reference: " << static_cast<double>(index->PostingBytes()) / (docCount * 8) << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"index/add", [docs](std::size_t iterations)
+    {
+      bvl::inverted::index_t fresh;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        fresh.Add((*docs)[i % docCount]);
+      }
+      fresh.Flush();
+      bvl::bench::DoNotOptimize(fresh);
+    }});
+
+    const std::vector<std::pair<std::string, std::vector<std::string>>> queries = {
+      { "common+common", { "w0", "w1" } },
+      { "common+rare", { "w0", "w2000" } },
+      { "rare+rare", { "w1500", "w2000" } },
+      { "three", { "w0", "w3", "w10" } }
+    };
+    for (const auto& query: queries)
+    {
+      const auto terms = query.second;
+      cases.push_back({"and/" + query.first, [index, terms](std::size_t iterations)
+      {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          count += index->And(terms).size();
+        }
+        bvl::bench::DoNotOptimize(count);
+      }});
+      cases.push_back({"or/" + query.first, [index, terms](std::size_t iterations)
+      {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          count += index->Or(terms).size();
+        }
+        bvl::bench::DoNotOptimize(count);
+      }});
+    }
+    cases.push_back({"scan/common+rare", [docs](std::size_t iterations)
+    {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        count += ScanAll(*docs, { "w0", "w2000" });
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+
+    // one operation decodes one block
+    auto block = std::make_shared<std::string>();
+    std::uint32_t sorted[bvl::inverted::blockSize];
+    for (std::size_t i = 0; i < bvl::inverted::blockSize; ++i)
+    {
+      sorted[i] = static_cast<std::uint32_t>(i * 37);
+    }
+    const auto width = bvl::inverted::detail::Pack(sorted, 0, *block);
+    cases.push_back({"unpack/simd", [block, width](std::size_t iterations)
+    {
+      std::uint32_t docs[bvl::inverted::blockSize];
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::inverted::detail::Unpack(block->data(), width, static_cast<std::uint32_t>(i), docs);
+        bvl::bench::DoNotOptimize(docs);
+      }
+    }});
+    cases.push_back({"unpack/scalar", [block, width](std::size_t iterations)
+    {
+      std::uint32_t docs[bvl::inverted::blockSize];
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::inverted::detail::UnpackScalar(block->data(), width, static_cast<std::uint32_t>(i), docs);
+        bvl::bench::DoNotOptimize(docs);
+      }
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,124 @@
+#include <badval_join.hpp>
+#include "badbench.hpp"
+
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t buildRows = 1000000;
+  const std::size_t probeRows = 10000000;
+
+  /**
+   * Keys of customers, numbers and strings, about half of probe keys match.
+   */
+  std::shared_ptr<std::vector<value_t>> Keys(std::size_t size, std::size_t universe, unsigned seed)
+  {
+    std::mt19937 rng(seed);
+    auto keys = std::make_shared<std::vector<value_t>>();
+    keys->reserve(size);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      const auto key = rng() % universe;
+      if (key % 2 == 0)
+      {
+        keys->emplace_back(static_cast<double>(key));
+      }
+      else
+      {
+        keys->emplace_back("customer-" + std::to_string(key));
+      }
+    }
+    return keys;
+  }
+
+  /**
+   * Key as string, as application code does it.
+   */
+  std::string Stringify(const value_t& value)
+  {
+    if (value.Type() == value_t::number)
+    {
+      return std::to_string(value.As<value_t::number>());
+    }
+    return value.As<value_t::string>();
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto build = Keys(buildRows, 2 * buildRows, 1);
+    auto probe = Keys(probeRows, 2 * buildRows, 2);
+    std::cout << "join " << build->size() << " x " << probe->size() << " rows: "
+      << bvl::join::Join(*build, *probe).size() << " pairs" << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"join/map", [build, probe](std::size_t iterations)
+    {
+      std::size_t matched = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::unordered_multimap<std::string, std::size_t> rows;
+        for (std::size_t row = 0; row < build->size(); ++row)
+        {
+          rows.emplace(Stringify((*build)[row]), row);
+        }
+        std::vector<bvl::join::pair_t> pairs;
+        for (std::size_t row = 0; row < probe->size(); ++row)
+        {
+          const auto range = rows.equal_range(Stringify((*probe)[row]));
+          for (auto it = range.first; it != range.second; ++it)
+          {
+            pairs.push_back({ it->second, row });
+          }
+        }
+        matched += pairs.size();
+      }
+      bvl::bench::DoNotOptimize(matched);
+    }});
+
+    const auto threads = std::max(1u, std::thread::hardware_concurrency());
+    for (const std::size_t count: { std::size_t(1), std::size_t(threads) })
+    {
+      bvl::join::options_t plain;
+      plain.threads = count;
+      plain.radixThreshold = std::numeric_limits<std::size_t>::max();
+      bvl::join::options_t radix;
+      radix.threads = count;
+      for (const auto& item: { std::make_pair(std::string("hash"), plain), std::make_pair(std::string("radix"), radix) })
+      {
+        const auto options = item.second;
+        cases.push_back({"join/" + item.first + "/" + std::to_string(count), [build, probe, options](std::size_t iterations)
+        {
+          std::size_t matched = 0;
+          for (std::size_t i = 0; i < iterations; ++i)
+          {
+            matched += bvl::join::Join(*build, *probe, options).size();
+          }
+          bvl::bench::DoNotOptimize(matched);
+        }});
+      }
+      if (threads == 1)
+      {
+        break;
+      }
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
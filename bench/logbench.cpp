@@ -0,0 +1,132 @@
+#include <badval_log.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Fields of typical record.
+   */
+  struct fields_t
+  {
+    value_t path;
+    value_t status;
+    value_t latency;
+    value_t handler;
+
+    fields_t()
+      : path("/api/v1/items/42"), status(200.0), latency(12.375), handler(&path, nullptr)
+    {
+      ;
+    }
+  };
+
+  /**
+   * Run body on threads, every thread logs its share of records.
+   */
+  template<typename body_t>
+  void OnThreads(unsigned threads, std::size_t iterations, body_t body)
+  {
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&body, iterations, threads]()
+      {
+        fields_t fields;
+        for (std::size_t i = 0; i < iterations / threads + 1; ++i)
+        {
+          body(fields);
+        }
+      });
+    }
+    for (auto& worker: workers)
+    {
+      worker.join();
+    }
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"format/record", [](std::size_t iterations)
+    {
+      fields_t fields;
+      char data[bvl::logging::sink_t::recordSize];
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::logging::buffer_t buffer(data, sizeof(data));
+        bvl::logging::FormatRecord(buffer, bvl::logging::info, "request",
+          { { "path", fields.path }, { "status", fields.status }, { "ms", fields.latency }, { "handler", fields.handler } }
+        );
+        bvl::bench::DoNotOptimize(data);
+      }
+    }});
+
+    cases.push_back({"format/ostream", [](std::size_t iterations)
+    {
+      fields_t fields;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::ostringstream stream;
+        stream << "info request path=" << fields.path.As<value_t::string>()
+          << " status=" << fields.status.As<value_t::number>()
+          << " ms=" << fields.latency.As<value_t::number>()
+          << " handler=" << fields.handler.As<value_t::pointer>() << std::endl;
+        auto text = stream.str();
+        bvl::bench::DoNotOptimize(text);
+      }
+    }});
+
+    for (unsigned threads = 1; threads <= 16; threads *= 4)
+    {
+      cases.push_back({"sink/t" + std::to_string(threads), [threads](std::size_t iterations)
+      {
+        static std::FILE* null = std::fopen("/dev/null", "w");
+        static bvl::logging::sink_t sink(null, 8192);
+        OnThreads(threads, iterations, [](const fields_t& fields)
+        {
+          sink.Log(bvl::logging::info, "request",
+            { { "path", fields.path }, { "status", fields.status }, { "ms", fields.latency }, { "handler", fields.handler } }
+          );
+        });
+        sink.Flush();
+      }});
+
+      cases.push_back({"ostream-locked/t" + std::to_string(threads), [threads](std::size_t iterations)
+      {
+        static std::ofstream null("/dev/null");
+        static std::mutex mutex;
+        OnThreads(threads, iterations, [](const fields_t& fields)
+        {
+          std::ostringstream stream;
+          stream << "info request path=" << fields.path.As<value_t::string>()
+            << " status=" << fields.status.As<value_t::number>()
+            << " ms=" << fields.latency.As<value_t::number>()
+            << " handler=" << fields.handler.As<value_t::pointer>() << '\n';
+          std::lock_guard<std::mutex> lock(mutex);
+          null << stream.str() << std::flush;
+        });
+      }});
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  std::cout << "Mops/s column is millions of logged records per second" << std::endl;
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,168 @@
+#include <badval_lsm.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const char path[] = "lsmbench.db";
+
+  /**
+   * Number of keys loaded before read benchmarks, can be changed with
+   * BADVAL_LSM_KEYS environment variable.
+   */
+  std::size_t KeyCount()
+  {
+    auto env = std::getenv("BADVAL_LSM_KEYS");
+    return (env != nullptr)? std::strtoull(env, nullptr, 10): 500000;
+  }
+
+  std::string Key(std::size_t i)
+  {
+    char key[32];
+    std::snprintf(key, sizeof(key), "user:%012zu", i);
+    return key;
+  }
+
+  std::uint64_t Next(std::uint64_t& rng)
+  {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+  }
+
+  /**
+   * Load keys in random order, so every level holds part of key space.
+   */
+  void Load(bvl::lsm::store_t& store, std::size_t count)
+  {
+    std::uint64_t rng = 2463534242ULL;
+    const std::string payload(100, 'v');
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const auto key = Next(rng) % count;
+      if (key % 2 == 0)
+      {
+        store.Put(Key(key * 2), value_t(static_cast<double>(key)));
+      }
+      else
+      {
+        store.Put(Key(key * 2), value_t(payload));
+      }
+    }
+    store.WaitForCompaction();
+  }
+
+  void Print(const bvl::lsm::stats_t& stats)
+  {
+    std::cout << "levels:";
+    for (std::size_t level = 0; level < stats.files.size(); ++level)
+    {
+      std::cout << " " << stats.files[level] << "/" << stats.levelBytes[level] / 1024 << "KiB";
+    }
+    std::cout << std::endl;
+    if (stats.bytesPut != 0)
+    {
+      std::cout << "write amplification: "
+        << static_cast<double>(stats.bytesFlushed + stats.bytesCompacted) / stats.bytesPut
+        << ", stalls: " << stats.stalls << std::endl;
+    }
+    if (stats.gets != 0)
+    {
+      std::cout << "read amplification: "
+        << static_cast<double>(stats.tablesChecked) / stats.gets << " tables checked, "
+        << static_cast<double>(stats.tablesRead) / stats.gets << " tables searched per get" << std::endl;
+    }
+  }
+
+  std::vector<bvl::bench::case_t> Cases(std::shared_ptr<bvl::lsm::store_t> store, std::shared_ptr<bvl::lsm::store_t> writes, std::size_t count)
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"get/hit", [store, count](std::size_t iterations)
+    {
+      std::uint64_t rng = 88172645463325252ULL;
+      value_t out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        store->Get(Key((Next(rng) % count) * 2), out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+
+    cases.push_back({"get/miss", [store, count](std::size_t iterations)
+    {
+      std::uint64_t rng = 88172645463325252ULL;
+      value_t out;
+      std::size_t found = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        found += store->Get(Key((Next(rng) % count) * 2 + 1), out)? 1: 0;
+      }
+      bvl::bench::DoNotOptimize(found);
+    }});
+
+    cases.push_back({"scan", [store](std::size_t iterations)
+    {
+      std::size_t seen = 0;
+      store->Scan("", "", [&seen, &iterations](const std::string& key, const value_t&)
+      {
+        seen += key.size();
+        return --iterations != 0;
+      });
+      bvl::bench::DoNotOptimize(seen);
+    }});
+
+    // write cases use own store, which grows across samples
+    auto written = std::make_shared<std::size_t>(0);
+    auto rng = std::make_shared<std::uint64_t>(88172645463325252ULL);
+
+    cases.push_back({"put/sequential", [writes, written](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        writes->Put(Key((*written)++), value_t(static_cast<double>(i)));
+      }
+    }});
+
+    cases.push_back({"put/random", [writes, rng](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        writes->Put(Key(Next(*rng) % 100000000), value_t(static_cast<double>(i)));
+      }
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  bvl::lsm::Destroy(path);
+  bvl::lsm::Destroy("lsmbench-write.db");
+  int result;
+  {
+    const auto count = KeyCount();
+    auto store = std::make_shared<bvl::lsm::store_t>(path);
+    auto writes = std::make_shared<bvl::lsm::store_t>("lsmbench-write.db");
+    Load(*store, count);
+    result = bvl::bench::Main(argc, argv, Cases(store, writes, count));
+    std::cout << "read store" << std::endl;
+    Print(store->Stats());
+    std::cout << "write store" << std::endl;
+    Print(writes->Stats());
+  }
+  bvl::lsm::Destroy(path);
+  bvl::lsm::Destroy("lsmbench-write.db");
+  return result;
+}
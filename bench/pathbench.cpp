@@ -0,0 +1,145 @@
+#include <badval_path.hpp>
+#include "badbench.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  const std::size_t documentCount = 100000;
+  const char expression[] = "order.items[3].price";
+
+  /**
+   * Order documents with several members on every level.
+   */
+  std::shared_ptr<std::vector<node_t>> Documents()
+  {
+    auto documents = std::make_shared<std::vector<node_t>>();
+    for (std::size_t i = 0; i < documentCount; ++i)
+    {
+      auto items = node_t::Array();
+      for (std::size_t j = 0; j < 5; ++j)
+      {
+        auto item = node_t::Object();
+        item.Set("sku", value_t("sku-" + std::to_string(j)));
+        item.Set("quantity", value_t(static_cast<double>(j + 1)));
+        item.Set("discount", value_t(0.0));
+        item.Set("price", value_t(static_cast<double>(i % 100 + j)));
+        items.Push(std::move(item));
+      }
+      auto order = node_t::Object();
+      order.Set("id", value_t(static_cast<double>(i)));
+      order.Set("customer", value_t("customer-" + std::to_string(i % 1000)));
+      order.Set("status", value_t("paid"));
+      order.Set("items", std::move(items));
+      auto document = node_t::Object();
+      document.Set("version", value_t(1.0));
+      document.Set("source", value_t("web"));
+      document.Set("order", std::move(order));
+      documents->push_back(std::move(document));
+    }
+    return documents;
+  }
+
+  /**
+   * Walk path splitting it and looking keys up on every level, as before.
+   */
+  const node_t* Interpret(const node_t& document, const std::string& path)
+  {
+    const node_t* current = &document;
+    std::size_t pos = 0;
+    while ((current != nullptr) && (pos < path.size()))
+    {
+      if (path[pos] == '.')
+      {
+        ++pos;
+      }
+      if (path[pos] == '[')
+      {
+        const auto end = path.find(']', pos);
+        const auto index = std::stoul(path.substr(pos + 1, end - pos - 1));
+        current = ((current->Kind() == node_t::array) && (index < current->Size()))? &current->At(index): nullptr;
+        pos = end + 1;
+        continue;
+      }
+      const auto end = path.find_first_of(".[", pos);
+      current = current->Find(path.substr(pos, end - pos));
+      pos = (end == std::string::npos)? path.size(): end;
+    }
+    return current;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto documents = Documents();
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"path/interpret", [documents](std::size_t iterations)
+    {
+      double sum = 0.0;
+      const std::string path(expression);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        for (const auto& document: *documents)
+        {
+          sum += Interpret(document, path)->Value().As<value_t::number>();
+        }
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+    cases.push_back({"path/compiled", [documents](std::size_t iterations)
+    {
+      double sum = 0.0;
+      const bvl::path::path_t path(expression);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        for (const auto& document: *documents)
+        {
+          sum += path.Eval(document)->Value().As<value_t::number>();
+        }
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+    cases.push_back({"path/compiled/batch", [documents](std::size_t iterations)
+    {
+      double sum = 0.0;
+      const bvl::path::path_t path(expression);
+      std::vector<const node_t*> found(documents->size());
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        path.Eval(documents->data(), documents->size(), found.data());
+        for (const auto* node: found)
+        {
+          sum += node->Value().As<value_t::number>();
+        }
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+    cases.push_back({"path/cached", [documents](std::size_t iterations)
+    {
+      double sum = 0.0;
+      bvl::path::cache_t cache;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        for (const auto& document: *documents)
+        {
+          sum += cache.Get(expression)->Eval(document)->Value().As<value_t::number>();
+        }
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,150 @@
+#include <badval_quantile.hpp>
+#include "badbench.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t valueCount = 1000000;
+  const std::size_t batchSize = 4096;
+
+  /**
+   * Latencies, with some non-number values.
+   */
+  std::shared_ptr<std::vector<value_t>> Values()
+  {
+    std::mt19937 rng(1);
+    std::lognormal_distribution<double> latency(3.0, 1.0);
+    auto values = std::make_shared<std::vector<value_t>>();
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      if (i % 100 == 0)
+      {
+        values->emplace_back("timeout");
+      }
+      else
+      {
+        values->emplace_back(latency(rng));
+      }
+    }
+    return values;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto values = Values();
+    {
+      std::vector<double> sorted;
+      for (const auto& value: *values)
+      {
+        if (value.Type() == value_t::number)
+        {
+          sorted.push_back(value.As<value_t::number>());
+        }
+      }
+      std::sort(sorted.begin(), sorted.end());
+      bvl::quantile::sketch_t sketch;
+      sketch.Add(values->data(), values->size());
+      for (const auto fraction: { 0.5, 0.99, 0.999 })
+      {
+        const auto estimate = sketch.Quantile(fraction);
+        const auto rank = static_cast<double>(std::upper_bound(sorted.begin(), sorted.end(), estimate) - sorted.begin()) / static_cast<double>(sorted.size());
+        std::cout << "p" << 100.0 * fraction << ": exact " << sorted[static_cast<std::size_t>(fraction * static_cast<double>(sorted.size()))]
+          << ", sketch " << estimate << ", rank error " << 100.0 * (rank - fraction) << "%" << std::endl;
+      }
+      std::cout << "retained " << sketch.Retained() << " of " << sketch.Count() << " numbers" << std::endl;
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"p99/sort", [values](std::size_t iterations)
+    {
+      double result = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        std::vector<double> numbers;
+        for (const auto& value: *values)
+        {
+          if (value.Type() == value_t::number)
+          {
+            numbers.push_back(value.As<value_t::number>());
+          }
+        }
+        std::sort(numbers.begin(), numbers.end());
+        result += numbers[numbers.size() * 99 / 100];
+      }
+      bvl::bench::DoNotOptimize(result);
+    }});
+    cases.push_back({"p99/sketch", [values](std::size_t iterations)
+    {
+      double result = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::quantile::sketch_t sketch;
+        for (const auto& value: *values)
+        {
+          sketch.Add(value);
+        }
+        result += sketch.Quantile(0.99);
+      }
+      bvl::bench::DoNotOptimize(result);
+    }});
+    cases.push_back({"p99/sketch/batch", [values](std::size_t iterations)
+    {
+      double result = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::quantile::sketch_t sketch;
+        for (std::size_t begin = 0; begin < values->size(); begin += batchSize)
+        {
+          sketch.Add(values->data() + begin, std::min(batchSize, values->size() - begin));
+        }
+        result += sketch.Quantile(0.99);
+      }
+      bvl::bench::DoNotOptimize(result);
+    }});
+
+    const auto threads = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    cases.push_back({"p99/sharded/" + std::to_string(threads), [values, threads](std::size_t iterations)
+    {
+      double result = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::quantile::sharded_t sketch(threads);
+        std::vector<std::thread> workers;
+        for (std::size_t t = 0; t < threads; ++t)
+        {
+          workers.emplace_back([&sketch, &values, t, threads]()
+          {
+            for (auto begin = t * batchSize; begin < values->size(); begin += threads * batchSize)
+            {
+              sketch.Add(values->data() + begin, std::min(batchSize, values->size() - begin));
+            }
+          });
+        }
+        for (auto& worker: workers)
+        {
+          worker.join();
+        }
+        result += sketch.Snapshot().Quantile(0.99);
+      }
+      bvl::bench::DoNotOptimize(result);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
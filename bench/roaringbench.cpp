@@ -0,0 +1,142 @@
+#include <badval_roaring.hpp>
+#include "badbench.hpp"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t rowCount = 1000000;
+
+  /**
+   * Column of numbers and strings. Category strings are clustered,
+   * numbers are uniform.
+   */
+  std::shared_ptr<bvl::roaring::column_t> Column()
+  {
+    std::mt19937 rng(1);
+    auto column = std::make_shared<bvl::roaring::column_t>();
+    for (std::size_t row = 0; row < rowCount; ++row)
+    {
+      if (row % 4 == 0)
+      {
+        column->Append(value_t("category:" + std::to_string(row / 50000)));
+      }
+      else
+      {
+        column->Append(value_t(static_cast<double>(rng() % 1000)));
+      }
+    }
+    return column;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto scanned = Column();
+    auto indexed = Column();
+    indexed->BuildIndex();
+    std::cout << "distinct values: " << indexed->DistinctValues()
+      << ", index bytes: " << indexed->IndexBytes() << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    // one operation builds index of whole column
+    cases.push_back({"index/build", [scanned](std::size_t iterations)
+    {
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        scanned->BuildIndex();
+        scanned->DropIndex();
+      }
+    }});
+
+    const std::vector<std::pair<std::string, value_t>> keys = {
+      { "number", value_t(42.0) },
+      { "category", value_t("category:7") }
+    };
+    for (const auto& key: keys)
+    {
+      auto copy = std::make_shared<value_t>(key.second);
+      for (const auto& column: { std::make_pair(std::string("scan"), scanned), std::make_pair(std::string("index"), indexed) })
+      {
+        auto target = column.second;
+        cases.push_back({"equal/" + key.first + "/" + column.first, [target, copy](std::size_t iterations)
+        {
+          double sum = 0.0;
+          for (std::size_t i = 0; i < iterations; ++i)
+          {
+            target->ScanEqual(*copy, [&sum](std::uint32_t row, const value_t&)
+            {
+              sum += row;
+              return true;
+            });
+          }
+          bvl::bench::DoNotOptimize(sum);
+        }});
+      }
+    }
+
+    for (const auto& column: { std::make_pair(std::string("scan"), scanned), std::make_pair(std::string("index"), indexed) })
+    {
+      auto target = column.second;
+      cases.push_back({"type/string/" + column.first, [target](std::size_t iterations)
+      {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          target->ScanType(value_t::string, [&count](std::uint32_t, const value_t&)
+          {
+            ++count;
+            return true;
+          });
+        }
+        bvl::bench::DoNotOptimize(count);
+      }});
+    }
+
+    // rows of 42 and 7 are disjoint, but intersection still compares containers
+    auto fortyTwo = std::make_shared<bvl::roaring::bitmap_t>(indexed->Equal(value_t(42.0)));
+    auto seven = std::make_shared<bvl::roaring::bitmap_t>(indexed->Equal(value_t(7.0)));
+    auto numbers = std::make_shared<bvl::roaring::bitmap_t>(indexed->OfType(value_t::number));
+    cases.push_back({"and/array-array", [fortyTwo, seven](std::size_t iterations)
+    {
+      std::uint64_t count = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        count += And(*fortyTwo, *seven).Cardinality();
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+    cases.push_back({"and/array-bitmap", [fortyTwo, numbers](std::size_t iterations)
+    {
+      std::uint64_t count = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        count += And(*fortyTwo, *numbers).Cardinality();
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+    cases.push_back({"or/bitmap-bitmap", [numbers](std::size_t iterations)
+    {
+      std::uint64_t count = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        count += Or(*numbers, *numbers).Cardinality();
+      }
+      bvl::bench::DoNotOptimize(count);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
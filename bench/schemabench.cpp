@@ -0,0 +1,260 @@
+#include <badval_schema.hpp>
+#include "badbench.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  const std::size_t documentCount = 100000;
+
+  node_t Strings(const std::vector<std::string>& items)
+  {
+    auto result = node_t::Array();
+    for (const auto& item: items)
+    {
+      result.Push(value_t(item));
+    }
+    return result;
+  }
+
+  node_t Typed(const char* type)
+  {
+    auto result = node_t::Object();
+    result.Set("type", value_t(type));
+    return result;
+  }
+
+  /**
+   * Order schema with nested line items.
+   */
+  std::shared_ptr<node_t> Schema()
+  {
+    auto id = Typed("integer");
+    id.Set("minimum", value_t(0.0));
+    auto customer = Typed("string");
+    customer.Set("minLength", value_t(1.0));
+    customer.Set("maxLength", value_t(64.0));
+    auto status = Typed("string");
+    status.Set("maxLength", value_t(16.0));
+    auto price = Typed("number");
+    price.Set("minimum", value_t(0.0));
+    auto quantity = Typed("integer");
+    quantity.Set("minimum", value_t(1.0));
+    quantity.Set("maximum", value_t(1000.0));
+
+    auto itemProperties = node_t::Object();
+    itemProperties.Set("sku", Typed("string"));
+    itemProperties.Set("price", price);
+    itemProperties.Set("quantity", quantity);
+    auto item = Typed("object");
+    item.Set("required", Strings({ "sku", "price", "quantity" }));
+    item.Set("additionalProperties", value_t(0.0));
+    item.Set("properties", itemProperties);
+    auto items = Typed("array");
+    items.Set("minItems", value_t(1.0));
+    items.Set("maxItems", value_t(100.0));
+    items.Set("items", item);
+
+    auto properties = node_t::Object();
+    properties.Set("id", id);
+    properties.Set("customer", customer);
+    properties.Set("status", status);
+    properties.Set("items", items);
+    auto schema = std::make_shared<node_t>(Typed("object"));
+    schema->Set("required", Strings({ "id", "customer", "items" }));
+    schema->Set("properties", properties);
+    return schema;
+  }
+
+  /**
+   * Orders, every tenth one is invalid somewhere inside.
+   */
+  std::shared_ptr<std::vector<node_t>> Documents()
+  {
+    auto documents = std::make_shared<std::vector<node_t>>();
+    for (std::size_t i = 0; i < documentCount; ++i)
+    {
+      auto items = node_t::Array();
+      for (std::size_t j = 0; j < 5; ++j)
+      {
+        auto item = node_t::Object();
+        item.Set("sku", value_t("sku-" + std::to_string(j)));
+        item.Set("price", value_t(9.99 + static_cast<double>(j)));
+        item.Set("quantity", value_t((i % 10 == 9) && (j == 4)? 0.0: 1.0));
+        items.Push(std::move(item));
+      }
+      auto document = node_t::Object();
+      document.Set("id", value_t(static_cast<double>(i)));
+      document.Set("customer", value_t("customer-" + std::to_string(i % 1000)));
+      document.Set("status", value_t("paid"));
+      document.Set("items", std::move(items));
+      documents->push_back(std::move(document));
+    }
+    return documents;
+  }
+
+  /**
+   * Walk schema together with document, as before.
+   */
+  bool Interpret(const node_t& schema, const node_t& node)
+  {
+    const auto* type = schema.Find("type");
+    if (type != nullptr)
+    {
+      const auto& name = type->Value().As<value_t::string>();
+      const auto isNumber = (node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::number);
+      const auto isString = (node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::string);
+      const auto ok = ((name == "object") && (node.Kind() == node_t::object))
+        || ((name == "array") && (node.Kind() == node_t::array))
+        || ((name == "string") && isString)
+        || ((name == "number") && isNumber)
+        || ((name == "integer") && isNumber && (std::trunc(node.Value().As<value_t::number>()) == node.Value().As<value_t::number>()));
+      if (!ok)
+      {
+        return false;
+      }
+    }
+    if ((node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::number))
+    {
+      const auto number = node.Value().As<value_t::number>();
+      const auto* minimum = schema.Find("minimum");
+      const auto* maximum = schema.Find("maximum");
+      if (((minimum != nullptr) && (number < minimum->Value().As<value_t::number>()))
+        || ((maximum != nullptr) && (number > maximum->Value().As<value_t::number>())))
+      {
+        return false;
+      }
+    }
+    if ((node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::string))
+    {
+      const auto size = static_cast<double>(node.Value().As<value_t::string>().size());
+      const auto* minLength = schema.Find("minLength");
+      const auto* maxLength = schema.Find("maxLength");
+      if (((minLength != nullptr) && (size < minLength->Value().As<value_t::number>()))
+        || ((maxLength != nullptr) && (size > maxLength->Value().As<value_t::number>())))
+      {
+        return false;
+      }
+    }
+    if (node.Kind() == node_t::array)
+    {
+      const auto size = static_cast<double>(node.Size());
+      const auto* minItems = schema.Find("minItems");
+      const auto* maxItems = schema.Find("maxItems");
+      if (((minItems != nullptr) && (size < minItems->Value().As<value_t::number>()))
+        || ((maxItems != nullptr) && (size > maxItems->Value().As<value_t::number>())))
+      {
+        return false;
+      }
+      const auto* items = schema.Find("items");
+      for (std::size_t i = 0; (items != nullptr) && (i < node.Size()); ++i)
+      {
+        if (!Interpret(*items, node.At(i)))
+        {
+          return false;
+        }
+      }
+    }
+    if (node.Kind() == node_t::object)
+    {
+      const auto* required = schema.Find("required");
+      for (std::size_t i = 0; (required != nullptr) && (i < required->Size()); ++i)
+      {
+        if (node.Find(required->At(i).Value().As<value_t::string>()) == nullptr)
+        {
+          return false;
+        }
+      }
+      const auto* properties = schema.Find("properties");
+      const auto* additional = schema.Find("additionalProperties");
+      for (std::size_t i = 0; i < node.Size(); ++i)
+      {
+        const auto* property = (properties != nullptr)? properties->Find(node.Key(i).name): nullptr;
+        if (property == nullptr)
+        {
+          if ((additional != nullptr) && (additional->Value().As<value_t::number>() == 0.0))
+          {
+            return false;
+          }
+          continue;
+        }
+        if (!Interpret(*property, node.At(i)))
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto schema = Schema();
+    auto documents = Documents();
+    auto validator = std::make_shared<bvl::schema::validator_t>(*schema);
+
+    std::size_t valid = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& document: *documents)
+    {
+      valid += validator->Validate(document)? 1: 0;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << validator->Ops() << " ops, " << valid << " of " << documents->size() << " documents valid, "
+      << static_cast<double>(documents->size()) / elapsed.count() << " validations/s" << std::endl;
+
+    std::vector<bvl::bench::case_t> cases;
+
+    cases.push_back({"validate/interpret", [schema, documents](std::size_t iterations)
+    {
+      std::size_t valid = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        for (const auto& document: *documents)
+        {
+          valid += Interpret(*schema, document)? 1: 0;
+        }
+      }
+      bvl::bench::DoNotOptimize(valid);
+    }});
+    cases.push_back({"validate/compiled", [validator, documents](std::size_t iterations)
+    {
+      std::size_t valid = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        for (const auto& document: *documents)
+        {
+          valid += validator->Validate(document)? 1: 0;
+        }
+      }
+      bvl::bench::DoNotOptimize(valid);
+    }});
+    cases.push_back({"validate/compiled/batch", [validator, documents](std::size_t iterations)
+    {
+      std::size_t valid = 0;
+      std::unique_ptr<bool[]> results(new bool[documents->size()]);
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        valid += validator->Validate(documents->data(), documents->size(), results.get());
+      }
+      bvl::bench::DoNotOptimize(valid);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,126 @@
+#include <badval_sstable.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const char path[] = "sstablebench.tmp";
+
+  /**
+   * Number of keys in table, can be changed with BADVAL_SSTABLE_KEYS
+   * environment variable to check multi-gigabyte tables.
+   */
+  std::size_t KeyCount()
+  {
+    auto env = std::getenv("BADVAL_SSTABLE_KEYS");
+    return (env != nullptr)? std::strtoull(env, nullptr, 10): 1000000;
+  }
+
+  std::string Key(std::size_t i)
+  {
+    char key[32];
+    std::snprintf(key, sizeof(key), "user:%012zu", i);
+    return key;
+  }
+
+  void Build(std::size_t count)
+  {
+    bvl::sstable::builder_t builder(path);
+    const std::string payload(100, 'v');
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (i % 2 == 0)
+      {
+        builder.Add(Key(i * 2), value_t(static_cast<double>(i)));
+      }
+      else
+      {
+        builder.Add(Key(i * 2), value_t(payload));
+      }
+    }
+    builder.Finish();
+  }
+
+  std::vector<bvl::bench::case_t> Cases(std::size_t count)
+  {
+    std::vector<bvl::bench::case_t> cases;
+    auto table = std::make_shared<bvl::sstable::table_t>(path);
+    std::cout << "table: " << table->Size() << " entries, " << table->FileSize() / (1024 * 1024) << " MiB" << std::endl;
+
+    cases.push_back({"find/hit", [table, count](std::size_t iterations)
+    {
+      std::uint64_t rng = 88172645463325252ULL;
+      value_t out;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        table->Find(Key((rng % count) * 2), out);
+      }
+      bvl::bench::DoNotOptimize(out);
+    }});
+
+    cases.push_back({"find/miss", [table, count](std::size_t iterations)
+    {
+      std::uint64_t rng = 88172645463325252ULL;
+      value_t out;
+      std::size_t found = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        found += table->Find(Key((rng % count) * 2 + 1), out)? 1: 0;
+      }
+      bvl::bench::DoNotOptimize(found);
+    }});
+
+    cases.push_back({"scan", [table](std::size_t iterations)
+    {
+      std::size_t seen = 0;
+      auto it = table->Begin();
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        if (!it.Valid())
+        {
+          it = table->Begin();
+        }
+        seen += it.RawValueSize();
+        it.Next();
+      }
+      bvl::bench::DoNotOptimize(seen);
+    }});
+
+    cases.push_back({"build", [](std::size_t iterations)
+    {
+      bvl::sstable::builder_t builder("sstablebench-build.tmp");
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        builder.Add(Key(i), value_t(static_cast<double>(i)));
+      }
+      builder.Finish();
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  const auto count = KeyCount();
+  Build(count);
+  const auto result = bvl::bench::Main(argc, argv, Cases(count));
+  std::remove(path);
+  std::remove("sstablebench-build.tmp");
+  return result;
+}
@@ -0,0 +1,107 @@
+#include <badval_topk.hpp>
+#include "badbench.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t numberCount = 10000000;
+  const std::size_t stringCount = 1000000;
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::mt19937 rng(1);
+    std::lognormal_distribution<double> latency(3.0, 1.0);
+    auto numbers = std::make_shared<std::vector<value_t>>();
+    for (std::size_t i = 0; i < numberCount; ++i)
+    {
+      numbers->emplace_back(latency(rng));
+    }
+    auto strings = std::make_shared<std::vector<value_t>>();
+    for (std::size_t i = 0; i < stringCount; ++i)
+    {
+      strings->emplace_back("user-" + std::to_string(rng()));
+    }
+
+    std::vector<bvl::bench::case_t> cases;
+
+    // moved number values stay numbers, so range is reused
+    for (const std::size_t k: { std::size_t(100), std::size_t(100000) })
+    {
+      const auto suffix = "/" + std::to_string(k);
+      cases.push_back({"numbers/sort" + suffix, [numbers, k](std::size_t iterations)
+      {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          auto copy = *numbers;
+          std::sort(copy.begin(), copy.end(), bvl::topk::greater_t());
+          sum += copy[k - 1].As<value_t::number>();
+        }
+        bvl::bench::DoNotOptimize(sum);
+      }});
+
+      bvl::topk::options_t heap;
+      heap.heapLimit = k;
+      bvl::topk::options_t select;
+      select.heapLimit = 0;
+      bvl::topk::options_t parallel;
+      parallel.threads = 0;
+      for (const auto& item: { std::make_pair(std::string("heap"), heap), std::make_pair(std::string("select"), select),
+        std::make_pair("parallel/" + std::to_string(std::max(1u, std::thread::hardware_concurrency())), parallel) })
+      {
+        const auto options = item.second;
+        cases.push_back({"numbers/" + item.first + suffix, [numbers, k, options](std::size_t iterations)
+        {
+          double sum = 0.0;
+          for (std::size_t i = 0; i < iterations; ++i)
+          {
+            sum += bvl::topk::TopK(*numbers, k, bvl::topk::greater_t(), options).back().As<value_t::number>();
+          }
+          bvl::bench::DoNotOptimize(sum);
+        }});
+      }
+    }
+
+    // string values are moved out, so every iteration works on copy
+    cases.push_back({"strings/sort/100", [strings](std::size_t iterations)
+    {
+      std::size_t size = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        auto copy = *strings;
+        std::sort(copy.begin(), copy.end(), bvl::topk::greater_t());
+        copy.resize(100);
+        size += copy.back().As<value_t::string>().size();
+      }
+      bvl::bench::DoNotOptimize(size);
+    }});
+    cases.push_back({"strings/topk/100", [strings](std::size_t iterations)
+    {
+      std::size_t size = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        auto copy = *strings;
+        size += bvl::topk::TopK(copy, 100).back().As<value_t::string>().size();
+      }
+      bvl::bench::DoNotOptimize(size);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -0,0 +1,140 @@
+#include <badval_wal.hpp>
+#include "badbench.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const char path[] = "walbench.tmp";
+  const char replayPath[] = "walbench-replay.tmp";
+
+  /**
+   * Log of 100k single put records, replayed by benchmark.
+   */
+  void WriteReplayLog()
+  {
+    std::remove(replayPath);
+    bvl::wal::writer_t writer(replayPath, false);
+    bvl::wal::batch_t batch;
+    for (int i = 0; i < 100000; ++i)
+    {
+      batch.Clear();
+      batch.Put("key:" + std::to_string(i), value_t(static_cast<double>(i)));
+      writer.Commit(batch);
+    }
+  }
+
+  /**
+   * Writer and counters of one benchmark case.
+   */
+  struct log_t
+  {
+    std::string name;
+    std::unique_ptr<bvl::wal::writer_t> writer;
+  };
+
+  /**
+   * Commit iterations batches from given number of threads.
+   */
+  void Commit(bvl::wal::writer_t& writer, std::size_t threads, std::size_t iterations)
+  {
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+      const auto count = iterations / threads + ((t < iterations % threads)? 1: 0);
+      workers.emplace_back([&writer, count, t]()
+      {
+        bvl::wal::batch_t batch;
+        const auto key = "writer:" + std::to_string(t);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          batch.Clear();
+          batch.Put(key, value_t(static_cast<double>(i)));
+          writer.Commit(batch);
+        }
+      });
+    }
+    for (auto& worker: workers)
+    {
+      worker.join();
+    }
+  }
+
+  std::vector<bvl::bench::case_t> Cases(std::vector<std::shared_ptr<log_t>>& logs)
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    for (std::size_t threads = 1; threads <= 64; threads *= 2)
+    {
+      for (const bool sync: { true, false })
+      {
+        auto log = std::make_shared<log_t>();
+        log->name = std::string(sync? "commit/fsync/": "commit/nosync/") + std::to_string(threads);
+        logs.push_back(log);
+        cases.push_back({log->name, [log, threads, sync](std::size_t iterations)
+        {
+          if (!log->writer)
+          {
+            std::remove(path);
+            log->writer.reset(new bvl::wal::writer_t(path, sync));
+          }
+          Commit(*log->writer, threads, iterations);
+        }});
+      }
+    }
+
+    cases.push_back({"crc32c/4KiB", [](std::size_t iterations)
+    {
+      const std::string block(4096, 'c');
+      std::uint32_t crc = 0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        crc = bvl::wal::Crc32c(block.data(), block.size(), crc);
+      }
+      bvl::bench::DoNotOptimize(crc);
+    }});
+
+    cases.push_back({"replay/100k", [](std::size_t iterations)
+    {
+      double sum = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::wal::Replay(replayPath, [&sum](const std::string&, const value_t* value)
+        {
+          sum += value->As<value_t::number>();
+        }, false);
+      }
+      bvl::bench::DoNotOptimize(sum);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  std::cout << "hardware crc: " << (bvl::wal::HardwareCrc()? "yes": "no") << std::endl;
+  WriteReplayLog();
+  std::vector<std::shared_ptr<log_t>> logs;
+  const auto result = bvl::bench::Main(argc, argv, Cases(logs));
+  for (const auto& log: logs)
+  {
+    if (log->writer && (log->writer->Groups() != 0))
+    {
+      std::cout << log->name << ": " << static_cast<double>(log->writer->Commits()) / log->writer->Groups()
+        << " commits per group" << std::endl;
+    }
+    log->writer.reset();
+  }
+  std::remove(path);
+  std::remove(replayPath);
+  return result;
+}
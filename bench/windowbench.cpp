@@ -0,0 +1,140 @@
+#include <badval_window.hpp>
+#include "badbench.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const std::size_t valueCount = 2000000;
+  const std::size_t batchSize = 4096;
+
+  /**
+   * Stream of numbers, one per time unit.
+   */
+  struct stream_t
+  {
+    std::vector<std::int64_t> times;
+    std::vector<value_t> values;
+  };
+
+  std::shared_ptr<stream_t> Stream()
+  {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> price(100.0, 5.0);
+    auto stream = std::make_shared<stream_t>();
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      stream->times.push_back(static_cast<std::int64_t>(i));
+      stream->values.emplace_back(price(rng));
+    }
+    return stream;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    auto stream = Stream();
+    std::vector<bvl::bench::case_t> cases;
+
+    // recomputing whole window every tick, as before
+    for (const std::int64_t width: { 10, 100 })
+    {
+      cases.push_back({"sliding/recompute/" + std::to_string(width), [stream, width](std::size_t iterations)
+      {
+        double total = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          for (std::size_t tick = 0; tick < stream->values.size(); ++tick)
+          {
+            bvl::window::aggregate_t aggregate;
+            for (auto j = tick + 1 - std::min<std::size_t>(tick + 1, static_cast<std::size_t>(width)); j <= tick; ++j)
+            {
+              aggregate.Add(stream->values[j].As<value_t::number>());
+            }
+            total += aggregate.Mean() + aggregate.max;
+          }
+        }
+        bvl::bench::DoNotOptimize(total);
+      }});
+    }
+
+    for (const std::int64_t width: { 10, 1000, 100000, 1000000 })
+    {
+      const auto suffix = "/" + std::to_string(width);
+      cases.push_back({"sliding" + suffix, [stream, width](std::size_t iterations)
+      {
+        double total = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          bvl::window::sliding_t window(width);
+          for (std::size_t tick = 0; tick < stream->values.size(); ++tick)
+          {
+            window.Add(stream->times[tick], stream->values[tick]);
+            const auto aggregate = window.Aggregate();
+            total += aggregate.Mean() + aggregate.max;
+          }
+        }
+        bvl::bench::DoNotOptimize(total);
+      }});
+      cases.push_back({"sliding/batch" + suffix, [stream, width](std::size_t iterations)
+      {
+        double total = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          bvl::window::sliding_t window(width);
+          for (std::size_t begin = 0; begin < stream->values.size(); begin += batchSize)
+          {
+            const auto size = std::min(batchSize, stream->values.size() - begin);
+            window.Add(stream->times.data() + begin, stream->values.data() + begin, size);
+            const auto aggregate = window.Aggregate();
+            total += aggregate.Mean() + aggregate.max;
+          }
+        }
+        bvl::bench::DoNotOptimize(total);
+      }});
+      cases.push_back({"tumbling" + suffix, [stream, width](std::size_t iterations)
+      {
+        double total = 0.0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          bvl::window::tumbling_t window(width, [&total](const bvl::window::window_t& closed)
+          {
+            total += closed.aggregate.Mean();
+          });
+          window.Add(stream->times.data(), stream->values.data(), stream->values.size());
+          window.Flush();
+        }
+        bvl::bench::DoNotOptimize(total);
+      }});
+    }
+
+    cases.push_back({"session", [stream](std::size_t iterations)
+    {
+      double total = 0.0;
+      for (std::size_t i = 0; i < iterations; ++i)
+      {
+        bvl::window::session_t session(0, [&total](const bvl::window::window_t& closed)
+        {
+          total += closed.aggregate.Mean();
+        });
+        session.Add(stream->times.data(), stream->values.data(), stream->values.size());
+        session.Flush();
+      }
+      bvl::bench::DoNotOptimize(total);
+    }});
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
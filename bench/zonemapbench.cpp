@@ -0,0 +1,124 @@
+#include <badval_zonemap.hpp>
+#include "badbench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::zonemap::predicate_t;
+
+  const std::size_t valueCount = 1000000;
+
+  /**
+   * Numbers in [0, valueCount) laid out in given order:
+   * sorted, clustered (sorted runs of 20000 values in random order)
+   * or random.
+   */
+  std::shared_ptr<bvl::zonemap::array_t> Numbers(const std::string& layout)
+  {
+    std::mt19937 rng(1);
+    std::vector<double> numbers;
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      numbers.push_back(static_cast<double>(i));
+    }
+    if (layout == "clustered")
+    {
+      const std::size_t cluster = 20000;
+      std::vector<std::size_t> order;
+      for (std::size_t i = 0; i < valueCount / cluster; ++i)
+      {
+        order.push_back(i);
+      }
+      std::shuffle(order.begin(), order.end(), rng);
+      std::vector<double> clustered;
+      for (const auto item: order)
+      {
+        // values of cluster are mixed inside it
+        std::vector<double> part(numbers.begin() + item * cluster, numbers.begin() + (item + 1) * cluster);
+        std::shuffle(part.begin(), part.end(), rng);
+        clustered.insert(clustered.end(), part.begin(), part.end());
+      }
+      numbers.swap(clustered);
+    }
+    else if (layout == "random")
+    {
+      std::shuffle(numbers.begin(), numbers.end(), rng);
+    }
+
+    auto array = std::make_shared<bvl::zonemap::array_t>();
+    for (const auto number: numbers)
+    {
+      array->Append(value_t(number));
+    }
+    return array;
+  }
+
+  std::vector<bvl::bench::case_t> Cases()
+  {
+    std::vector<bvl::bench::case_t> cases;
+
+    // range holds 0.1% of values
+    auto predicate = std::make_shared<predicate_t>(predicate_t::Between(500000.0, 500999.0));
+    for (const std::string layout: { "sorted", "clustered", "random" })
+    {
+      auto array = Numbers(layout);
+      const auto stats = array->Scan(*predicate, [](std::size_t, const value_t&)
+      {
+        return true;
+      });
+      std::cout << layout << ": skipped " << stats.skipped << " of " << stats.blocks
+        << " blocks (" << 100.0 * static_cast<double>(stats.skipped) / static_cast<double>(stats.blocks) << "%)" << std::endl;
+
+      for (const bool skip: { true, false })
+      {
+        cases.push_back({"range/" + layout + (skip? "/zones": "/full"), [array, predicate, skip](std::size_t iterations)
+        {
+          std::size_t count = 0;
+          for (std::size_t i = 0; i < iterations; ++i)
+          {
+            count += array->Count(*predicate, skip);
+          }
+          bvl::bench::DoNotOptimize(count);
+        }});
+      }
+    }
+
+    // strings sorted by key, equality lookup
+    auto strings = std::make_shared<bvl::zonemap::array_t>();
+    for (std::size_t i = 0; i < valueCount; ++i)
+    {
+      char key[32];
+      std::snprintf(key, sizeof(key), "%08zu", i);
+      strings->Append(value_t(key));
+    }
+    auto key = std::make_shared<predicate_t>(predicate_t::Equal(value_t("00777777")));
+    for (const bool skip: { true, false })
+    {
+      cases.push_back({std::string("equal/string/sorted") + (skip? "/zones": "/full"), [strings, key, skip](std::size_t iterations)
+      {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+          count += strings->Count(*key, skip);
+        }
+        bvl::bench::DoNotOptimize(count);
+      }});
+    }
+
+    return cases;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  return bvl::bench::Main(argc, argv, Cases());
+}
@@ -16,6 +16,7 @@
 #include <string>
 #include <new>
 #include <utility>
+#include <functional>
 
 namespace bvl
 {
@@ -94,6 +95,65 @@ namespace bvl
       return this->type;
     }
 
+    /**
+     * Get value hash.
+     *
+     * Hash of string value is equal to std::hash of stored string,
+     * so containers can look strings up without boxing them.
+     */
+    std::size_t Hash() const noexcept
+    {
+      switch (this->type)
+      {
+        case number:
+          return std::hash<double>()(this->value.num);
+        case string:
+          return std::hash<std::string>()(*this->value.str);
+        case pointer:
+          return std::hash<const void*>()(this->value.ptr);
+        default:
+          assert(0);
+      }
+      return 0;
+    }
+
+    /**
+     * Compare values.
+     *
+     * Values are equal when they have same type and equal data.
+     * Numbers compared as doubles, so NaN is not equal to itself.
+     * Pointers compared by address.
+     */
+    bool operator==(const value_t& rhs) const noexcept
+    {
+      if (this->type != rhs.type)
+      {
+        return false;
+      }
+      switch (this->type)
+      {
+        case number:
+          return this->value.num == rhs.value.num;
+        case string:
+          return *this->value.str == *rhs.value.str;
+        case pointer:
+          return this->value.ptr == rhs.value.ptr;
+        default:
+          assert(0);
+      }
+      return false;
+    }
+
+    /**
+     * Compare values.
+     *
+     * @see bvl::value_t::operator==
+     */
+    bool operator!=(const value_t& rhs) const noexcept
+    {
+      return !(*this == rhs);
+    }
+
     /**
      * Default constructor.
      * 
@@ -371,4 +431,18 @@ namespace bvl
 
 } // namespace bvl
 
+namespace std
+{
+
+  template<>
+  struct hash<bvl::value_t>
+  {
+    std::size_t operator()(const bvl::value_t& value) const noexcept
+    {
+      return value.Hash();
+    }
+  };
+
+} // namespace std
+
 #endif /* BAD_VALUE_HEADER */
\ No newline at end of file
@@ -0,0 +1,1520 @@
+/**
+ * @file badval_arrow.hpp
+ * @author masscry
+ *
+ * Apache Arrow columnar layout for value columns.
+ *
+ * Column of values is exported into one of Arrow arrays:
+ *
+ *  - Float64, when column holds only numbers;
+ *  - Utf8 (int32 offsets and data), when column holds only strings;
+ *  - dense Union of Float64 (type id 0) and Utf8 (type id 1) children,
+ *    when column holds both.
+ *
+ * Arrow has no pointers, so pointer values are exported as nulls, and
+ * nulls are imported as null pointer values. Buffers are 64-byte
+ * aligned and padded, as Arrow recommends.
+ *
+ * Arrays are passed to and from other libraries through Arrow C data
+ * interface (ArrowArray and ArrowSchema structs) without copying
+ * buffers, and are written to and read from files in Arrow IPC stream
+ * format: schema message, record batch messages, end-of-stream marker.
+ * Message metadata is flatbuffer, encoded and decoded here by hand,
+ * so no Arrow or flatbuffers library is needed. Stream reader maps file
+ * into memory and arrays point directly into mapping.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_ARROW_HEADER
+#define BAD_VALUE_ARROW_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C"
+{
+
+  struct ArrowSchema
+  {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+  };
+
+  struct ArrowArray
+  {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+  };
+
+} // extern "C"
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+namespace bvl
+{
+namespace arrow
+{
+
+  /**
+   * Supported Arrow types.
+   */
+  enum type_t
+  {
+    float64 = 0,   /**< 64-bit floating point */
+    utf8,          /**< Strings with 32-bit offsets */
+    denseUnion     /**< Dense union of float64 and utf8 */
+  };
+
+  /**
+   * Type ids of union children.
+   */
+  constexpr std::int8_t numberTypeId = 0;
+  constexpr std::int8_t stringTypeId = 1;
+
+  /**
+   * Memory region, kept alive by owner.
+   */
+  struct buffer_t
+  {
+    const std::uint8_t* data = nullptr;    /**< First byte, nullptr for absent buffer */
+    std::size_t size = 0;                  /**< Bytes used */
+    std::shared_ptr<const void> owner;     /**< Keeps memory alive */
+  };
+
+  /**
+   * Arrow array.
+   *
+   * Buffers follow Arrow order: validity and values for float64,
+   * validity, offsets and data for utf8, type ids and offsets for
+   * dense union.
+   */
+  struct array_t
+  {
+    type_t type = float64;                 /**< Array type */
+    std::int64_t length = 0;               /**< Number of elements */
+    std::int64_t nullCount = 0;            /**< Number of nulls, union has none of its own */
+    std::int64_t offset = 0;               /**< First element in buffers */
+    std::vector<buffer_t> buffers;         /**< Buffers */
+    std::vector<array_t> children;         /**< Union children */
+    std::vector<std::int8_t> typeIds;      /**< Union type id of every child */
+
+    /**
+     * Check if element is null.
+     */
+    bool IsNull(std::int64_t index) const
+    {
+      if (this->type == denseUnion)
+      {
+        const auto& child = this->Child(index);
+        return child.IsNull(this->ChildIndex(index));
+      }
+      const auto bit = this->offset + index;
+      const auto validity = this->buffers[0].data;
+      return (validity != nullptr) && (((validity[bit / 8] >> (bit % 8)) & 1) == 0);
+    }
+
+    /**
+     * Element as value, null is pointer value with nullptr.
+     */
+    value_t Value(std::int64_t index) const
+    {
+      if (this->IsNull(index))
+      {
+        return value_t(nullptr, nullptr);
+      }
+      switch (this->type)
+      {
+        case float64:
+          {
+            double number;
+            std::memcpy(&number, this->buffers[1].data + 8 * (this->offset + index), sizeof(number));
+            return value_t(number);
+          }
+        case utf8:
+          {
+            std::int32_t bounds[2];
+            std::memcpy(bounds, this->buffers[1].data + 4 * (this->offset + index), sizeof(bounds));
+            return value_t(reinterpret_cast<const char*>(this->buffers[2].data) + bounds[0], static_cast<std::size_t>(bounds[1] - bounds[0]));
+          }
+        default:
+          return this->Child(index).Value(this->ChildIndex(index));
+      }
+    }
+
+  private:
+
+    const array_t& Child(std::int64_t index) const
+    {
+      const auto id = static_cast<std::int8_t>(this->buffers[0].data[this->offset + index]);
+      for (std::size_t i = 0; i < this->typeIds.size(); ++i)
+      {
+        if (this->typeIds[i] == id)
+        {
+          return this->children[i];
+        }
+      }
+      throw std::runtime_error("Unknown union type id");
+    }
+
+    std::int64_t ChildIndex(std::int64_t index) const
+    {
+      std::int32_t childIndex;
+      std::memcpy(&childIndex, this->buffers[1].data + 4 * (this->offset + index), sizeof(childIndex));
+      return childIndex;
+    }
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Zeroed 64-byte aligned buffer, padded to multiple of 64 bytes.
+     */
+    inline buffer_t Allocate(std::size_t size, std::uint8_t*& data)
+    {
+      const auto padded = (size + 63) / 64 * 64;
+      void* memory = nullptr;
+      if (::posix_memalign(&memory, 64, (padded == 0)? 64: padded) != 0)
+      {
+        throw std::bad_alloc();
+      }
+      std::memset(memory, 0, (padded == 0)? 64: padded);
+      data = static_cast<std::uint8_t*>(memory);
+      buffer_t result;
+      result.data = data;
+      result.size = size;
+      result.owner = std::shared_ptr<const void>(memory, std::free);
+      return result;
+    }
+
+    /**
+     * Float64 array of numbers, other values are null.
+     */
+    inline array_t Numbers(const std::vector<const value_t*>& values)
+    {
+      array_t result;
+      result.type = float64;
+      result.length = static_cast<std::int64_t>(values.size());
+      std::uint8_t* validity;
+      std::uint8_t* data;
+      result.buffers.push_back(Allocate((values.size() + 7) / 8, validity));
+      result.buffers.push_back(Allocate(8 * values.size(), data));
+      for (std::size_t i = 0; i < values.size(); ++i)
+      {
+        if ((values[i] != nullptr) && (values[i]->Type() == value_t::number))
+        {
+          const auto number = values[i]->As<value_t::number>();
+          std::memcpy(data + 8 * i, &number, sizeof(number));
+          validity[i / 8] |= static_cast<std::uint8_t>(1 << (i % 8));
+        }
+        else
+        {
+          ++result.nullCount;
+        }
+      }
+      if (result.nullCount == 0)
+      {
+        result.buffers[0] = buffer_t();
+      }
+      return result;
+    }
+
+    /**
+     * Utf8 array of strings, other values are null.
+     */
+    inline array_t Strings(const std::vector<const value_t*>& values)
+    {
+      array_t result;
+      result.type = utf8;
+      result.length = static_cast<std::int64_t>(values.size());
+      std::size_t bytes = 0;
+      for (const auto value: values)
+      {
+        if ((value != nullptr) && (value->Type() == value_t::string))
+        {
+          bytes += value->As<value_t::string>().size();
+        }
+      }
+      if (bytes > 0x7FFFFFFF)
+      {
+        throw std::runtime_error("Strings do not fit 32-bit offsets");
+      }
+
+      std::uint8_t* validity;
+      std::uint8_t* offsets;
+      std::uint8_t* data;
+      result.buffers.push_back(Allocate((values.size() + 7) / 8, validity));
+      result.buffers.push_back(Allocate(4 * (values.size() + 1), offsets));
+      result.buffers.push_back(Allocate(bytes, data));
+      std::int32_t offset = 0;
+      for (std::size_t i = 0; i < values.size(); ++i)
+      {
+        std::memcpy(offsets + 4 * i, &offset, sizeof(offset));
+        if ((values[i] != nullptr) && (values[i]->Type() == value_t::string))
+        {
+          const auto& text = values[i]->As<value_t::string>();
+          std::memcpy(data + offset, text.data(), text.size());
+          offset += static_cast<std::int32_t>(text.size());
+          validity[i / 8] |= static_cast<std::uint8_t>(1 << (i % 8));
+        }
+        else
+        {
+          ++result.nullCount;
+        }
+      }
+      std::memcpy(offsets + 4 * values.size(), &offset, sizeof(offset));
+      if (result.nullCount == 0)
+      {
+        result.buffers[0] = buffer_t();
+      }
+      return result;
+    }
+
+  } // namespace detail
+
+  /**
+   * Export values into Arrow array.
+   */
+  inline array_t FromValues(const std::vector<value_t>& values)
+  {
+    bool numbers = false;
+    bool strings = false;
+    for (const auto& value: values)
+    {
+      numbers = numbers || (value.Type() == value_t::number);
+      strings = strings || (value.Type() == value_t::string);
+    }
+
+    std::vector<const value_t*> all;
+    all.reserve(values.size());
+    for (const auto& value: values)
+    {
+      all.push_back(&value);
+    }
+    if (!strings)
+    {
+      return detail::Numbers(all);
+    }
+    if (!numbers)
+    {
+      return detail::Strings(all);
+    }
+
+    // pointers go to number child as nulls
+    array_t result;
+    result.type = denseUnion;
+    result.length = static_cast<std::int64_t>(values.size());
+    std::uint8_t* types;
+    std::uint8_t* offsets;
+    result.buffers.push_back(detail::Allocate(values.size(), types));
+    result.buffers.push_back(detail::Allocate(4 * values.size(), offsets));
+    std::vector<const value_t*> children[2];
+    for (std::size_t i = 0; i < values.size(); ++i)
+    {
+      const auto id = (values[i].Type() == value_t::string)? stringTypeId: numberTypeId;
+      const auto offset = static_cast<std::int32_t>(children[id].size());
+      types[i] = static_cast<std::uint8_t>(id);
+      std::memcpy(offsets + 4 * i, &offset, sizeof(offset));
+      children[id].push_back(&values[i]);
+    }
+    result.children.push_back(detail::Numbers(children[numberTypeId]));
+    result.children.push_back(detail::Strings(children[stringTypeId]));
+    result.typeIds = { numberTypeId, stringTypeId };
+    return result;
+  }
+
+  /**
+   * Copy array elements into values.
+   */
+  inline std::vector<value_t> ToValues(const array_t& array)
+  {
+    std::vector<value_t> result;
+    result.reserve(static_cast<std::size_t>(array.length));
+    for (std::int64_t i = 0; i < array.length; ++i)
+    {
+      result.push_back(array.Value(i));
+    }
+    return result;
+  }
+
+  namespace detail
+  {
+
+    /**
+     * Exported array: keeps buffers alive and owns child structs.
+     */
+    struct exportedArray_t
+    {
+      array_t array;
+      std::vector<const void*> buffers;
+      std::vector<ArrowArray*> children;
+    };
+
+    inline void ReleaseArray(ArrowArray* array)
+    {
+      auto exported = static_cast<exportedArray_t*>(array->private_data);
+      for (auto child: exported->children)
+      {
+        if (child->release != nullptr)
+        {
+          child->release(child);
+        }
+        delete child;
+      }
+      delete exported;
+      array->release = nullptr;
+    }
+
+    inline void ExportArray(array_t array, ArrowArray* out)
+    {
+      std::unique_ptr<exportedArray_t> exported(new exportedArray_t());
+      exported->array = std::move(array);
+      const auto& source = exported->array;
+      for (const auto& buffer: source.buffers)
+      {
+        exported->buffers.push_back(buffer.data);
+      }
+      for (const auto& child: source.children)
+      {
+        std::unique_ptr<ArrowArray> item(new ArrowArray());
+        item->release = nullptr;
+        exported->children.push_back(item.get());
+        ExportArray(child, item.release());
+      }
+      out->length = source.length;
+      out->null_count = source.nullCount;
+      out->offset = source.offset;
+      out->n_buffers = static_cast<std::int64_t>(exported->buffers.size());
+      out->n_children = static_cast<std::int64_t>(exported->children.size());
+      out->buffers = exported->buffers.data();
+      out->children = exported->children.empty()? nullptr: exported->children.data();
+      out->dictionary = nullptr;
+      out->release = ReleaseArray;
+      out->private_data = exported.release();
+    }
+
+    struct exportedSchema_t
+    {
+      std::string format;
+      std::string name;
+      std::vector<ArrowSchema*> children;
+    };
+
+    inline void ReleaseSchema(ArrowSchema* schema)
+    {
+      auto exported = static_cast<exportedSchema_t*>(schema->private_data);
+      for (auto child: exported->children)
+      {
+        if (child->release != nullptr)
+        {
+          child->release(child);
+        }
+        delete child;
+      }
+      delete exported;
+      schema->release = nullptr;
+    }
+
+    inline void ExportSchema(const array_t& array, const std::string& name, ArrowSchema* out)
+    {
+      std::unique_ptr<exportedSchema_t> exported(new exportedSchema_t());
+      exported->name = name;
+      switch (array.type)
+      {
+        case float64:
+          exported->format = "g";
+          break;
+        case utf8:
+          exported->format = "u";
+          break;
+        default:
+          exported->format = "+ud:";
+          for (std::size_t i = 0; i < array.typeIds.size(); ++i)
+          {
+            exported->format += ((i == 0)? "": ",") + std::to_string(array.typeIds[i]);
+          }
+          break;
+      }
+      for (std::size_t i = 0; i < array.children.size(); ++i)
+      {
+        std::unique_ptr<ArrowSchema> item(new ArrowSchema());
+        item->release = nullptr;
+        exported->children.push_back(item.get());
+        ExportSchema(array.children[i], (array.children[i].type == float64)? "number": "string", item.release());
+      }
+      out->format = exported->format.c_str();
+      out->name = exported->name.c_str();
+      out->metadata = nullptr;
+      out->flags = ARROW_FLAG_NULLABLE;
+      out->n_children = static_cast<std::int64_t>(exported->children.size());
+      out->children = exported->children.empty()? nullptr: exported->children.data();
+      out->dictionary = nullptr;
+      out->release = ReleaseSchema;
+      out->private_data = exported.release();
+    }
+
+    /**
+     * Type of Arrow format string, with union type ids.
+     */
+    inline type_t ParseFormat(const std::string& format, std::vector<std::int8_t>& typeIds)
+    {
+      if (format == "g")
+      {
+        return float64;
+      }
+      if (format == "u")
+      {
+        return utf8;
+      }
+      if (format.compare(0, 4, "+ud:") == 0)
+      {
+        std::size_t pos = 4;
+        while (pos < format.size())
+        {
+          auto end = format.find(',', pos);
+          end = (end == std::string::npos)? format.size(): end;
+          typeIds.push_back(static_cast<std::int8_t>(std::atoi(format.substr(pos, end - pos).c_str())));
+          pos = end + 1;
+        }
+        return denseUnion;
+      }
+      throw std::runtime_error("Unsupported Arrow format: " + format);
+    }
+
+    inline buffer_t Borrow(const void* data, std::size_t size, const std::shared_ptr<const void>& owner)
+    {
+      buffer_t result;
+      result.data = static_cast<const std::uint8_t*>(data);
+      result.size = size;
+      result.owner = owner;
+      return result;
+    }
+
+    /**
+     * Count nulls in validity bitmap.
+     */
+    inline std::int64_t CountNulls(const array_t& array)
+    {
+      std::int64_t result = 0;
+      for (std::int64_t i = 0; i < array.length; ++i)
+      {
+        result += array.IsNull(i)? 1: 0;
+      }
+      return result;
+    }
+
+    inline array_t ImportArray(const ArrowArray* source, const ArrowSchema* schema, const std::shared_ptr<const void>& owner)
+    {
+      array_t result;
+      result.type = ParseFormat(schema->format, result.typeIds);
+      result.length = source->length;
+      result.offset = source->offset;
+      const auto end = static_cast<std::size_t>(source->offset + source->length);
+      const auto expected = (result.type == utf8)? 3: 2;
+      if ((source->n_buffers != expected) || (source->n_children != schema->n_children)
+        || ((result.type == denseUnion) != (source->n_children != 0))
+        || (result.typeIds.size() != static_cast<std::size_t>(source->n_children)))
+      {
+        throw std::runtime_error("Malformed Arrow array");
+      }
+
+      switch (result.type)
+      {
+        case float64:
+          result.buffers.push_back(Borrow(source->buffers[0], (end + 7) / 8, owner));
+          result.buffers.push_back(Borrow(source->buffers[1], 8 * end, owner));
+          break;
+        case utf8:
+          {
+            std::int32_t bytes = 0;
+            if (source->buffers[1] != nullptr)
+            {
+              std::memcpy(&bytes, static_cast<const std::uint8_t*>(source->buffers[1]) + 4 * end, sizeof(bytes));
+            }
+            result.buffers.push_back(Borrow(source->buffers[0], (end + 7) / 8, owner));
+            result.buffers.push_back(Borrow(source->buffers[1], 4 * (end + 1), owner));
+            result.buffers.push_back(Borrow(source->buffers[2], static_cast<std::size_t>(bytes), owner));
+          }
+          break;
+        default:
+          result.buffers.push_back(Borrow(source->buffers[0], end, owner));
+          result.buffers.push_back(Borrow(source->buffers[1], 4 * end, owner));
+          for (std::int64_t i = 0; i < source->n_children; ++i)
+          {
+            result.children.push_back(ImportArray(source->children[i], schema->children[i], owner));
+            if (result.children.back().type == denseUnion)
+            {
+              throw std::runtime_error("Nested unions are not supported");
+            }
+          }
+          break;
+      }
+      result.nullCount = (result.type == denseUnion)? 0: ((source->null_count < 0)? CountNulls(result): source->null_count);
+      return result;
+    }
+
+  } // namespace detail
+
+  /**
+   * Export array through Arrow C data interface.
+   *
+   * Buffers are not copied. Consumer calls release callbacks of both
+   * structs when done.
+   */
+  inline void Export(array_t array, const std::string& name, ArrowArray* outArray, ArrowSchema* outSchema)
+  {
+    detail::ExportSchema(array, name, outSchema);
+    try
+    {
+      detail::ExportArray(std::move(array), outArray);
+    }
+    catch (...)
+    {
+      outSchema->release(outSchema);
+      throw;
+    }
+  }
+
+  /**
+   * Import array from Arrow C data interface.
+   *
+   * Array struct is moved: its release callback is called, when last
+   * imported buffer is destroyed. Schema is released before return.
+   * Buffers are not copied.
+   *
+   * @throws std::runtime_error for types other than float64, utf8 and dense union of them
+   */
+  inline array_t Import(ArrowArray* array, ArrowSchema* schema)
+  {
+    std::unique_ptr<ArrowSchema, void (*)(ArrowSchema*)> schemaGuard(schema,
+      [](ArrowSchema* item)
+      {
+        if (item->release != nullptr)
+        {
+          item->release(item);
+        }
+      }
+    );
+    std::shared_ptr<ArrowArray> moved(new ArrowArray(*array),
+      [](ArrowArray* item)
+      {
+        if (item->release != nullptr)
+        {
+          item->release(item);
+        }
+        delete item;
+      }
+    );
+    array->release = nullptr;
+    return detail::ImportArray(moved.get(), schema, moved);
+  }
+
+  /**
+   * Named columns of equal length.
+   */
+  struct batch_t
+  {
+    std::vector<std::string> names;   /**< Column names */
+    std::vector<array_t> columns;     /**< Columns */
+
+    std::int64_t Rows() const noexcept
+    {
+      return this->columns.empty()? 0: this->columns.front().length;
+    }
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Minimal flatbuffer writer.
+     *
+     * Objects are written front to back: table before objects it refers
+     * to, so offsets (unsigned in flatbuffers) always point forward.
+     * Vtable is written right before its table.
+     */
+    class builder_t final
+    {
+    public:
+
+      /**
+       * Inline table field.
+       */
+      struct slot_t
+      {
+        unsigned id;            /**< Field id */
+        unsigned size;          /**< 1, 2, 4 or 8 bytes */
+        std::uint64_t value;    /**< Scalar value, ignored for offsets */
+        bool offset;            /**< Offset to object, patched later */
+      };
+
+      builder_t()
+      {
+        // root offset
+        this->Put(0, 4);
+      }
+
+      /**
+       * Write table.
+       *
+       * @param [out] offsets positions of offset fields, in slot order
+       *
+       * @return table position
+       */
+      std::size_t Table(const std::vector<slot_t>& slots, std::vector<std::size_t>& offsets)
+      {
+        // inline layout: soffset, then fields from biggest to smallest
+        std::vector<std::size_t> order(slots.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+        {
+          order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(),
+          [&slots](std::size_t lhs, std::size_t rhs)
+          {
+            return slots[lhs].size > slots[rhs].size;
+          }
+        );
+        std::vector<std::size_t> positions(slots.size());
+        std::size_t inlineSize = 4;
+        unsigned fields = 0;
+        for (const auto i: order)
+        {
+          inlineSize = (inlineSize + slots[i].size - 1) / slots[i].size * slots[i].size;
+          positions[i] = inlineSize;
+          inlineSize += slots[i].size;
+          fields = std::max(fields, slots[i].id + 1);
+        }
+        inlineSize = (inlineSize + 3) / 4 * 4;
+
+        // vtable ends right before 8-aligned table
+        const std::size_t vtableSize = 4 + 2 * fields;
+        auto vtable = this->data.size();
+        while ((vtable + vtableSize) % 8 != 0)
+        {
+          ++vtable;
+        }
+        this->data.resize(vtable, '\0');
+        std::vector<std::uint16_t> entries(fields, 0);
+        for (std::size_t i = 0; i < slots.size(); ++i)
+        {
+          entries[slots[i].id] = static_cast<std::uint16_t>(positions[i]);
+        }
+        this->Put(vtableSize, 2);
+        this->Put(inlineSize, 2);
+        for (const auto entry: entries)
+        {
+          this->Put(entry, 2);
+        }
+
+        const auto table = this->data.size();
+        this->data.resize(table + inlineSize, '\0');
+        this->Set(table, table - vtable, 4);
+        for (std::size_t i = 0; i < slots.size(); ++i)
+        {
+          if (slots[i].offset)
+          {
+            offsets.push_back(table + positions[i]);
+          }
+          else
+          {
+            this->Set(table + positions[i], slots[i].value, slots[i].size);
+          }
+        }
+        return table;
+      }
+
+      /**
+       * Point offset field at object.
+       */
+      void Patch(std::size_t slot, std::size_t target)
+      {
+        this->Set(slot, target - slot, 4);
+      }
+
+      std::size_t String(const std::string& text)
+      {
+        this->Align(4);
+        const auto pos = this->data.size();
+        this->Put(text.size(), 4);
+        this->data.append(text);
+        this->data.push_back('\0');
+        return pos;
+      }
+
+      /**
+       * Vector of offsets to be patched.
+       */
+      std::size_t OffsetVector(std::size_t count, std::vector<std::size_t>& slots)
+      {
+        this->Align(4);
+        const auto pos = this->data.size();
+        this->Put(count, 4);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          slots.push_back(this->data.size());
+          this->Put(0, 4);
+        }
+        return pos;
+      }
+
+      std::size_t IntVector(const std::vector<std::int32_t>& items)
+      {
+        this->Align(4);
+        const auto pos = this->data.size();
+        this->Put(items.size(), 4);
+        for (const auto item: items)
+        {
+          this->Put(static_cast<std::uint32_t>(item), 4);
+        }
+        return pos;
+      }
+
+      /**
+       * Vector of structs of two 64-bit integers.
+       */
+      std::size_t PairVector(const std::vector<std::pair<std::int64_t, std::int64_t>>& items)
+      {
+        // elements are 8-aligned, length is right before them
+        this->Align(8);
+        this->Put(0, 4);
+        const auto pos = this->data.size();
+        this->Put(items.size(), 4);
+        for (const auto& item: items)
+        {
+          this->Put(static_cast<std::uint64_t>(item.first), 8);
+          this->Put(static_cast<std::uint64_t>(item.second), 8);
+        }
+        return pos;
+      }
+
+      /**
+       * Set root table and return buffer padded to 8 bytes.
+       */
+      std::string Finish(std::size_t root)
+      {
+        this->Patch(0, root);
+        this->Align(8);
+        return std::move(this->data);
+      }
+
+    private:
+
+      void Align(std::size_t alignment)
+      {
+        while (this->data.size() % alignment != 0)
+        {
+          this->data.push_back('\0');
+        }
+      }
+
+      void Put(std::uint64_t value, unsigned size)
+      {
+        const auto pos = this->data.size();
+        this->data.resize(pos + size, '\0');
+        this->Set(pos, value, size);
+      }
+
+      void Set(std::size_t pos, std::uint64_t value, unsigned size)
+      {
+        for (unsigned i = 0; i < size; ++i)
+        {
+          this->data[pos + i] = static_cast<char>(value >> (8 * i));
+        }
+      }
+
+      std::string data; /**< Buffer */
+    };
+
+    /**
+     * Minimal flatbuffer reader with bounds checks.
+     */
+    class reader_t final
+    {
+    public:
+
+      reader_t(const std::uint8_t* data, std::size_t size) noexcept
+        : data(data), size(size)
+      {
+        ;
+      }
+
+      std::uint64_t Get(std::size_t pos, unsigned bytes) const
+      {
+        if ((pos > this->size) || (this->size - pos < bytes))
+        {
+          throw std::runtime_error("Malformed Arrow message");
+        }
+        std::uint64_t result = 0;
+        for (unsigned i = 0; i < bytes; ++i)
+        {
+          result |= static_cast<std::uint64_t>(this->data[pos + i]) << (8 * i);
+        }
+        return result;
+      }
+
+      std::size_t Root() const
+      {
+        return this->Deref(0);
+      }
+
+      /**
+       * Follow offset stored at pos.
+       */
+      std::size_t Deref(std::size_t pos) const
+      {
+        return pos + static_cast<std::size_t>(this->Get(pos, 4));
+      }
+
+      /**
+       * Position of table field, 0 when absent.
+       */
+      std::size_t Field(std::size_t table, unsigned id) const
+      {
+        const auto vtable = table - static_cast<std::size_t>(static_cast<std::int64_t>(static_cast<std::int32_t>(this->Get(table, 4))));
+        const auto vtableSize = this->Get(vtable, 2);
+        if (4 + 2 * id + 2 > vtableSize)
+        {
+          return 0;
+        }
+        const auto offset = this->Get(vtable + 4 + 2 * id, 2);
+        return (offset == 0)? 0: table + static_cast<std::size_t>(offset);
+      }
+
+      std::uint64_t Scalar(std::size_t table, unsigned id, unsigned bytes, std::uint64_t fallback) const
+      {
+        const auto pos = this->Field(table, id);
+        return (pos == 0)? fallback: this->Get(pos, bytes);
+      }
+
+      /**
+       * Referenced object of table field, 0 when absent.
+       */
+      std::size_t Object(std::size_t table, unsigned id) const
+      {
+        const auto pos = this->Field(table, id);
+        return (pos == 0)? 0: this->Deref(pos);
+      }
+
+      std::string String(std::size_t pos) const
+      {
+        const auto length = static_cast<std::size_t>(this->Get(pos, 4));
+        this->Get(pos + 4, 0);
+        if (this->size - pos - 4 < length)
+        {
+          throw std::runtime_error("Malformed Arrow message");
+        }
+        return std::string(reinterpret_cast<const char*>(this->data + pos + 4), length);
+      }
+
+    private:
+
+      const std::uint8_t* data;   /**< Flatbuffer */
+      std::size_t size;           /**< Flatbuffer size */
+    };
+
+    /**
+     * Flatbuffer enum values of Arrow schema.
+     */
+    enum : std::uint64_t
+    {
+      metadataV5 = 4,
+      headerSchema = 1,
+      headerRecordBatch = 3,
+      typeFloatingPoint = 3,
+      typeUtf8 = 5,
+      typeUnion = 14,
+      precisionDouble = 2,
+      unionDense = 1
+    };
+
+    inline std::size_t WriteField(builder_t& builder, const std::string& name, const array_t& array)
+    {
+      const auto code = (array.type == float64)? typeFloatingPoint: (array.type == utf8)? typeUtf8: typeUnion;
+      std::vector<std::size_t> offsets;
+      std::vector<builder_t::slot_t> slots = {
+        { 0, 4, 0, true },       // name
+        { 1, 1, 1, false },      // nullable
+        { 2, 1, code, false },   // type_type
+        { 3, 4, 0, true }        // type
+      };
+      if (array.type == denseUnion)
+      {
+        slots.push_back({ 5, 4, 0, true });  // children
+      }
+      const auto field = builder.Table(slots, offsets);
+      builder.Patch(offsets[0], builder.String(name));
+
+      std::vector<std::size_t> typeOffsets;
+      switch (array.type)
+      {
+        case float64:
+          builder.Patch(offsets[1], builder.Table({ { 0, 2, precisionDouble, false } }, typeOffsets));
+          break;
+        case utf8:
+          builder.Patch(offsets[1], builder.Table({}, typeOffsets));
+          break;
+        default:
+          {
+            builder.Patch(offsets[1], builder.Table({ { 0, 2, unionDense, false }, { 1, 4, 0, true } }, typeOffsets));
+            builder.Patch(typeOffsets[0], builder.IntVector(std::vector<std::int32_t>(array.typeIds.begin(), array.typeIds.end())));
+            std::vector<std::size_t> children;
+            builder.Patch(offsets[2], builder.OffsetVector(array.children.size(), children));
+            for (std::size_t i = 0; i < array.children.size(); ++i)
+            {
+              builder.Patch(children[i], WriteField(builder, (array.children[i].type == float64)? "number": "string", array.children[i]));
+            }
+          }
+          break;
+      }
+      return field;
+    }
+
+    inline std::string SchemaMessage(const batch_t& batch)
+    {
+      builder_t builder;
+      std::vector<std::size_t> offsets;
+      const auto message = builder.Table({
+        { 0, 2, metadataV5, false },
+        { 1, 1, headerSchema, false },
+        { 2, 4, 0, true },
+        { 3, 8, 0, false }
+      }, offsets);
+      std::vector<std::size_t> schemaOffsets;
+      builder.Patch(offsets[0], builder.Table({ { 0, 2, 0, false }, { 1, 4, 0, true } }, schemaOffsets));
+      std::vector<std::size_t> fields;
+      builder.Patch(schemaOffsets[0], builder.OffsetVector(batch.columns.size(), fields));
+      for (std::size_t i = 0; i < batch.columns.size(); ++i)
+      {
+        builder.Patch(fields[i], WriteField(builder, batch.names[i], batch.columns[i]));
+      }
+      return builder.Finish(message);
+    }
+
+    /**
+     * Collect field nodes and buffers of array in depth-first order.
+     */
+    inline void Flatten(const array_t& array, std::vector<std::pair<std::int64_t, std::int64_t>>& nodes,
+      std::vector<const buffer_t*>& buffers)
+    {
+      nodes.emplace_back(array.length, array.nullCount);
+      for (const auto& buffer: array.buffers)
+      {
+        buffers.push_back(&buffer);
+      }
+      for (const auto& child: array.children)
+      {
+        Flatten(child, nodes, buffers);
+      }
+    }
+
+    inline std::string BatchMessage(const batch_t& batch, const std::vector<const buffer_t*>& buffers,
+      const std::vector<std::pair<std::int64_t, std::int64_t>>& nodes, std::int64_t& bodySize)
+    {
+      std::vector<std::pair<std::int64_t, std::int64_t>> regions;
+      bodySize = 0;
+      for (const auto buffer: buffers)
+      {
+        const auto size = static_cast<std::int64_t>((buffer->data == nullptr)? 0: buffer->size);
+        regions.emplace_back(bodySize, size);
+        bodySize += (size + 7) / 8 * 8;
+      }
+
+      builder_t builder;
+      std::vector<std::size_t> offsets;
+      const auto message = builder.Table({
+        { 0, 2, metadataV5, false },
+        { 1, 1, headerRecordBatch, false },
+        { 2, 4, 0, true },
+        { 3, 8, static_cast<std::uint64_t>(bodySize), false }
+      }, offsets);
+      std::vector<std::size_t> batchOffsets;
+      builder.Patch(offsets[0], builder.Table({
+        { 0, 8, static_cast<std::uint64_t>(batch.Rows()), false },
+        { 1, 4, 0, true },
+        { 2, 4, 0, true }
+      }, batchOffsets));
+      builder.Patch(batchOffsets[0], builder.PairVector(nodes));
+      builder.Patch(batchOffsets[1], builder.PairVector(regions));
+      return builder.Finish(message);
+    }
+
+    /**
+     * Field of schema: name and array without data.
+     */
+    inline void ReadField(const reader_t& reader, std::size_t field, std::string& name, array_t& array)
+    {
+      const auto namePos = reader.Object(field, 0);
+      name = (namePos != 0)? reader.String(namePos): std::string();
+      const auto typeType = reader.Scalar(field, 2, 1, 0);
+      const auto type = reader.Object(field, 3);
+      switch (typeType)
+      {
+        case typeFloatingPoint:
+          if ((type == 0) || (reader.Scalar(type, 0, 2, 0) != precisionDouble))
+          {
+            throw std::runtime_error("Unsupported Arrow floating point precision");
+          }
+          array.type = float64;
+          break;
+        case typeUtf8:
+          array.type = utf8;
+          break;
+        case typeUnion:
+          {
+            if ((type == 0) || (reader.Scalar(type, 0, 2, 0) != unionDense))
+            {
+              throw std::runtime_error("Unsupported Arrow union mode");
+            }
+            array.type = denseUnion;
+            const auto children = reader.Object(field, 5);
+            const auto count = (children == 0)? 0: static_cast<std::size_t>(reader.Get(children, 4));
+            const auto ids = reader.Object(type, 1);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              array.children.emplace_back();
+              std::string childName;
+              ReadField(reader, reader.Deref(children + 4 + 4 * i), childName, array.children.back());
+              if (array.children.back().type == denseUnion)
+              {
+                throw std::runtime_error("Nested unions are not supported");
+              }
+              array.typeIds.push_back(static_cast<std::int8_t>((ids == 0)? i: reader.Get(ids + 4 + 4 * i, 4)));
+            }
+          }
+          break;
+        default:
+          throw std::runtime_error("Unsupported Arrow type");
+      }
+    }
+
+    /**
+     * Attach nodes and buffers of record batch to array, in schema order.
+     */
+    inline void ReadArray(const reader_t& reader, std::size_t nodes, std::size_t buffers,
+      std::size_t& node, std::size_t& buffer, const std::uint8_t* body, std::size_t bodySize,
+      const std::shared_ptr<const void>& owner, array_t& array)
+    {
+      if (node >= reader.Get(nodes, 4))
+      {
+        throw std::runtime_error("Malformed Arrow record batch");
+      }
+      array.length = static_cast<std::int64_t>(reader.Get(nodes + 4 + 16 * node, 8));
+      array.nullCount = static_cast<std::int64_t>(reader.Get(nodes + 4 + 16 * node + 8, 8));
+      array.offset = 0;
+      ++node;
+      if ((array.length < 0) || (array.nullCount < 0) || (array.nullCount > array.length))
+      {
+        throw std::runtime_error("Malformed Arrow record batch");
+      }
+
+      const auto count = (array.type == utf8)? 3: 2;
+      const auto length = static_cast<std::size_t>(array.length);
+      array.buffers.clear();
+      for (int i = 0; i < count; ++i, ++buffer)
+      {
+        if (buffer >= reader.Get(buffers, 4))
+        {
+          throw std::runtime_error("Malformed Arrow record batch");
+        }
+        const auto offset = reader.Get(buffers + 4 + 16 * buffer, 8);
+        const auto size = reader.Get(buffers + 4 + 16 * buffer + 8, 8);
+        if ((offset > bodySize) || (size > bodySize - offset))
+        {
+          throw std::runtime_error("Malformed Arrow record batch");
+        }
+        buffer_t item;
+        if (size != 0)
+        {
+          item.data = body + offset;
+          item.size = static_cast<std::size_t>(size);
+          item.owner = owner;
+        }
+        array.buffers.push_back(item);
+      }
+
+      // buffers must cover all elements
+      std::size_t need[3] = { 0, 0, 0 };
+      switch (array.type)
+      {
+        case float64:
+          need[1] = 8 * length;
+          break;
+        case utf8:
+          need[1] = 4 * (length + 1);
+          break;
+        default:
+          need[0] = length;
+          need[1] = 4 * length;
+          break;
+      }
+      // validity bitmap is read whenever present, even with no nulls
+      if ((array.type != denseUnion) && ((array.nullCount != 0) || (array.buffers[0].data != nullptr)))
+      {
+        need[0] = (length + 7) / 8;
+      }
+      for (int i = 0; i < count; ++i)
+      {
+        if ((need[i] != 0) && (array.buffers[i].size < need[i]))
+        {
+          throw std::runtime_error("Malformed Arrow record batch");
+        }
+      }
+      if (array.type == utf8)
+      {
+        // offsets must stay inside data
+        const auto offsets = array.buffers[1].data;
+        std::int32_t prev = 0;
+        for (std::size_t i = 0; (offsets != nullptr) && (i <= length); ++i)
+        {
+          std::int32_t current;
+          std::memcpy(&current, offsets + 4 * i, sizeof(current));
+          if ((current < prev) || (static_cast<std::size_t>(current) > array.buffers[2].size))
+          {
+            throw std::runtime_error("Malformed Arrow record batch");
+          }
+          prev = current;
+        }
+      }
+
+      for (auto& child: array.children)
+      {
+        ReadArray(reader, nodes, buffers, node, buffer, body, bodySize, owner, child);
+      }
+      if (array.type == denseUnion)
+      {
+        for (std::size_t i = 0; i < length; ++i)
+        {
+          const auto id = static_cast<std::int8_t>(array.buffers[0].data[i]);
+          std::int32_t childIndex;
+          std::memcpy(&childIndex, array.buffers[1].data + 4 * i, sizeof(childIndex));
+          std::size_t child = 0;
+          while ((child < array.typeIds.size()) && (array.typeIds[child] != id))
+          {
+            ++child;
+          }
+          if ((child == array.typeIds.size()) || (childIndex < 0) || (childIndex >= array.children[child].length))
+          {
+            throw std::runtime_error("Malformed Arrow record batch");
+          }
+        }
+      }
+    }
+
+    /**
+     * Array with all buffers and no offset.
+     */
+    inline array_t Compact(const array_t& array)
+    {
+      if ((array.offset == 0) && ((array.type != denseUnion) || ((array.children[0].offset == 0) && (array.children[1].offset == 0))))
+      {
+        return array;
+      }
+      return FromValues(ToValues(array));
+    }
+
+  } // namespace detail
+
+  /**
+   * Writer of Arrow IPC stream file.
+   *
+   * First batch defines schema, all other batches must have same
+   * column names and types.
+   */
+  class streamWriter_t final
+  {
+  public:
+
+    /**
+     * Create or truncate file.
+     *
+     * @throws std::runtime_error when file can't be opened
+     */
+    explicit streamWriter_t(const std::string& path)
+      : file(std::fopen(path.c_str(), "wb")), started(false), closed(false)
+    {
+      if (this->file == nullptr)
+      {
+        throw std::runtime_error("Can't open " + path + ": " + std::strerror(errno));
+      }
+    }
+
+    streamWriter_t(const streamWriter_t&) = delete;
+    streamWriter_t& operator=(const streamWriter_t&) = delete;
+
+    /**
+     * Closes stream, if it was not closed.
+     */
+    ~streamWriter_t()
+    {
+      try
+      {
+        this->Close();
+      }
+      catch (...)
+      {
+        ;
+      }
+    }
+
+    /**
+     * Write record batch.
+     */
+    void Write(const batch_t& source)
+    {
+      if (this->closed)
+      {
+        throw std::logic_error("Stream is closed");
+      }
+      if (source.names.size() != source.columns.size())
+      {
+        throw std::invalid_argument("Every column needs name");
+      }
+      batch_t batch;
+      batch.names = source.names;
+      for (const auto& column: source.columns)
+      {
+        if (column.length != source.Rows())
+        {
+          throw std::invalid_argument("Columns have different length");
+        }
+        batch.columns.push_back(detail::Compact(column));
+      }
+
+      const auto schema = detail::SchemaMessage(batch);
+      if (!this->started)
+      {
+        this->schema = schema;
+        this->Message(schema, {}, 0);
+        this->started = true;
+      }
+      else if (schema != this->schema)
+      {
+        throw std::invalid_argument("Batch schema differs from stream schema");
+      }
+
+      std::vector<std::pair<std::int64_t, std::int64_t>> nodes;
+      std::vector<const buffer_t*> buffers;
+      for (const auto& column: batch.columns)
+      {
+        detail::Flatten(column, nodes, buffers);
+      }
+      std::int64_t bodySize;
+      const auto message = detail::BatchMessage(batch, buffers, nodes, bodySize);
+      this->Message(message, buffers, bodySize);
+    }
+
+    /**
+     * Write end-of-stream marker and close file.
+     */
+    void Close()
+    {
+      if (this->closed)
+      {
+        return;
+      }
+      this->closed = true;
+      const std::uint32_t marker[2] = { 0xFFFFFFFFu, 0 };
+      const bool written = std::fwrite(marker, sizeof(marker), 1, this->file) == 1;
+      const bool flushed = std::fclose(this->file) == 0;
+      if (!written || !flushed)
+      {
+        throw std::runtime_error("Can't write Arrow stream");
+      }
+    }
+
+  private:
+
+    void Message(const std::string& metadata, const std::vector<const buffer_t*>& buffers, std::int64_t bodySize)
+    {
+      const std::uint32_t prefix[2] = { 0xFFFFFFFFu, static_cast<std::uint32_t>(metadata.size()) };
+      static const char padding[8] = { 0 };
+      bool ok = (std::fwrite(prefix, sizeof(prefix), 1, this->file) == 1)
+        && (std::fwrite(metadata.data(), metadata.size(), 1, this->file) == 1);
+      std::int64_t written = 0;
+      for (const auto buffer: buffers)
+      {
+        const auto size = (buffer->data == nullptr)? 0: buffer->size;
+        const auto padded = (size + 7) / 8 * 8;
+        ok = ok && ((size == 0) || (std::fwrite(buffer->data, size, 1, this->file) == 1))
+          && ((padded == size) || (std::fwrite(padding, padded - size, 1, this->file) == 1));
+        written += static_cast<std::int64_t>(padded);
+      }
+      if (!ok || (written != bodySize))
+      {
+        throw std::runtime_error("Can't write Arrow stream");
+      }
+    }
+
+    std::FILE* file;      /**< Output */
+    std::string schema;   /**< Schema message of stream */
+    bool started;         /**< Schema is written */
+    bool closed;          /**< End-of-stream is written */
+  };
+
+  /**
+   * Read Arrow IPC stream file.
+   *
+   * File is mapped into memory, arrays point into mapping, which lives
+   * while any array lives.
+   *
+   * @throws std::runtime_error when file can't be read, is malformed or has unsupported types
+   */
+  inline std::vector<batch_t> ReadStream(const std::string& path)
+  {
+    const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      throw std::runtime_error("Can't open " + path + ": " + std::strerror(errno));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("Can't stat " + path);
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* memory = nullptr;
+    if (size != 0)
+    {
+      memory = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+      throw std::runtime_error("Can't map " + path);
+    }
+    std::shared_ptr<const void> owner(memory,
+      [size](const void* item)
+      {
+        if (item != nullptr)
+        {
+          ::munmap(const_cast<void*>(item), size);
+        }
+      }
+    );
+
+    const auto data = static_cast<const std::uint8_t*>(memory);
+    const detail::reader_t file(data, size);
+    std::vector<batch_t> result;
+    batch_t schema;
+    bool hasSchema = false;
+    std::size_t pos = 0;
+    while (pos + 4 <= size)
+    {
+      // continuation marker is optional in old streams
+      auto length = file.Get(pos, 4);
+      pos += 4;
+      if (length == 0xFFFFFFFFu)
+      {
+        length = file.Get(pos, 4);
+        pos += 4;
+      }
+      if (length == 0)
+      {
+        break;
+      }
+      if (length > size - pos)
+      {
+        throw std::runtime_error("Malformed Arrow stream");
+      }
+
+      const detail::reader_t reader(data + pos, static_cast<std::size_t>(length));
+      pos += static_cast<std::size_t>(length);
+      const auto message = reader.Root();
+      const auto header = reader.Object(message, 2);
+      const auto bodySize = reader.Scalar(message, 3, 8, 0);
+      if ((header == 0) || (bodySize > size - pos))
+      {
+        throw std::runtime_error("Malformed Arrow stream");
+      }
+      const auto body = data + pos;
+      pos += static_cast<std::size_t>(bodySize);
+
+      switch (reader.Scalar(message, 1, 1, 0))
+      {
+        case detail::headerSchema:
+          {
+            schema = batch_t();
+            const auto fields = reader.Object(header, 1);
+            const auto count = (fields == 0)? 0: static_cast<std::size_t>(reader.Get(fields, 4));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              schema.names.emplace_back();
+              schema.columns.emplace_back();
+              detail::ReadField(reader, reader.Deref(fields + 4 + 4 * i), schema.names.back(), schema.columns.back());
+            }
+            hasSchema = true;
+          }
+          break;
+        case detail::headerRecordBatch:
+          {
+            if (!hasSchema || (reader.Object(header, 3) != 0))
+            {
+              throw std::runtime_error((!hasSchema)? "Arrow record batch before schema": "Compressed Arrow batches are not supported");
+            }
+            const auto nodes = reader.Object(header, 1);
+            const auto buffers = reader.Object(header, 2);
+            if ((nodes == 0) || (buffers == 0))
+            {
+              throw std::runtime_error("Malformed Arrow record batch");
+            }
+            auto batch = schema;
+            std::size_t node = 0;
+            std::size_t buffer = 0;
+            for (auto& column: batch.columns)
+            {
+              detail::ReadArray(reader, nodes, buffers, node, buffer, body, static_cast<std::size_t>(bodySize), owner, column);
+            }
+            result.push_back(std::move(batch));
+          }
+          break;
+        default:
+          throw std::runtime_error("Unsupported Arrow message");
+      }
+    }
+    return result;
+  }
+
+} // namespace arrow
+} // namespace bvl
+
+#endif /* BAD_VALUE_ARROW_HEADER */
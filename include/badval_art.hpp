@@ -0,0 +1,1360 @@
+/**
+ * @file badval_art.hpp
+ * @author masscry
+ *
+ * Adaptive radix tree from string keys to values.
+ *
+ * Inner node consumes one key byte and grows through four layouts as
+ * children are added: Node4 and Node16 keep sorted key bytes next to
+ * children (Node16 is searched with SSE2 compare), Node48 maps every
+ * byte to one of 48 child slots, Node256 is indexed by byte directly.
+ * Chains of single-child nodes are collapsed into node prefix (path
+ * compression), up to 16 bytes per node. Key, which ends inside tree,
+ * is stored in terminal slot of node where it ends. Leaves hold full
+ * key and value inline.
+ *
+ * Concurrency is optimistic lock coupling: every node has version
+ * word with lock and obsolete bits. Readers never write shared memory,
+ * they validate node version after reading it and restart on change.
+ * Writers lock only nodes they modify. Nodes and leaves replaced or
+ * removed by writers are retired to reclamation domain. Nodes do not
+ * shrink on erase.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_ART_HEADER
+#define BAD_VALUE_ART_HEADER
+
+#include <badval.hpp>
+#include <badval_ebr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bvl
+{
+namespace art
+{
+
+  namespace detail
+  {
+
+    /**
+     * Leaf, immutable after it is published.
+     */
+    struct leaf_t
+    {
+      const std::string key;  /**< Full key */
+      const value_t value;    /**< Stored value */
+
+      leaf_t(const std::string& key, value_t&& value)
+        : key(key), value(std::move(value))
+      {
+        ;
+      }
+    };
+
+    /**
+     * Child reference: inner node, or leaf with lowest bit set.
+     */
+    using child_t = std::uintptr_t;
+
+    inline bool IsLeaf(child_t child) noexcept
+    {
+      return (child & 1) != 0;
+    }
+
+    inline leaf_t* AsLeaf(child_t child) noexcept
+    {
+      return reinterpret_cast<leaf_t*>(child & ~child_t(1));
+    }
+
+    inline child_t FromLeaf(leaf_t* leaf) noexcept
+    {
+      return reinterpret_cast<child_t>(leaf) | 1;
+    }
+
+    enum type_t : unsigned char
+    {
+      node4 = 0,
+      node16 = 1,
+      node48 = 2,
+      node256 = 3
+    };
+
+    /**
+     * Bytes of prefix stored in node.
+     */
+    constexpr std::size_t maxPrefix = 16;
+
+    /**
+     * Common part of all node layouts.
+     *
+     * Version word: bit 0 marks obsolete node, bit 1 marks locked node,
+     * other bits count changes. Every field is atomic, because readers
+     * look at it while writer changes it, and only validate afterwards.
+     */
+    struct node_t
+    {
+      std::atomic<std::uint64_t> version;     /**< Lock and change counter */
+      const type_t type;                      /**< Layout */
+      std::atomic<std::uint16_t> count;       /**< Number of children */
+      std::atomic<std::uint32_t> prefixSize;  /**< Bytes in prefix */
+      std::atomic<std::uint64_t> prefix[2];   /**< Prefix bytes, little-endian */
+      std::atomic<leaf_t*> terminal;          /**< Leaf of key ending after prefix */
+
+      explicit node_t(type_t type) noexcept
+        : version(0), type(type), count(0), prefixSize(0), terminal(nullptr)
+      {
+        this->prefix[0].store(0, std::memory_order_relaxed);
+        this->prefix[1].store(0, std::memory_order_relaxed);
+      }
+
+      unsigned char PrefixAt(std::size_t i) const noexcept
+      {
+        return static_cast<unsigned char>(this->prefix[i / 8].load(std::memory_order_relaxed) >> (8 * (i % 8)));
+      }
+
+      void SetPrefix(const char* bytes, std::size_t size) noexcept
+      {
+        std::uint64_t words[2] = { 0, 0 };
+        for (std::size_t i = 0; i < size; ++i)
+        {
+          words[i / 8] |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * (i % 8));
+        }
+        this->prefix[0].store(words[0], std::memory_order_relaxed);
+        this->prefix[1].store(words[1], std::memory_order_relaxed);
+        this->prefixSize.store(static_cast<std::uint32_t>(size), std::memory_order_relaxed);
+      }
+
+      /**
+       * Drop first bytes of prefix.
+       */
+      void CutPrefix(std::size_t bytes) noexcept
+      {
+        char buffer[maxPrefix];
+        const auto size = this->prefixSize.load(std::memory_order_relaxed);
+        for (std::size_t i = bytes; i < size; ++i)
+        {
+          buffer[i - bytes] = static_cast<char>(this->PrefixAt(i));
+        }
+        this->SetPrefix(buffer, size - bytes);
+      }
+
+      /**
+       * Wait for unlocked node and return its version.
+       *
+       * @return false when node is obsolete
+       */
+      bool ReadLock(std::uint64_t& seen) const noexcept
+      {
+        unsigned spins = 0;
+        seen = this->version.load(std::memory_order_acquire);
+        while ((seen & 2) != 0)
+        {
+          if (++spins > 64)
+          {
+            std::this_thread::yield();
+          }
+          seen = this->version.load(std::memory_order_acquire);
+        }
+        return (seen & 1) == 0;
+      }
+
+      /**
+       * Everything read since ReadLock is consistent.
+       */
+      bool Validate(std::uint64_t seen) const noexcept
+      {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return this->version.load(std::memory_order_relaxed) == seen;
+      }
+
+      /**
+       * Lock node, if it did not change since ReadLock.
+       */
+      bool Upgrade(std::uint64_t seen) noexcept
+      {
+        if (!this->version.compare_exchange_strong(seen, seen + 2, std::memory_order_acquire))
+        {
+          return false;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return true;
+      }
+
+      void Unlock() noexcept
+      {
+        this->version.fetch_add(2, std::memory_order_release);
+      }
+
+      /**
+       * Unlock and mark node as replaced.
+       */
+      void UnlockObsolete() noexcept
+      {
+        this->version.fetch_add(3, std::memory_order_release);
+      }
+    };
+
+    struct node4_t: node_t
+    {
+      std::atomic<std::uint32_t> keys;        /**< Sorted key bytes */
+      std::atomic<child_t> children[4];       /**< Children */
+
+      node4_t() noexcept
+        : node_t(node4), keys(0)
+      {
+        for (auto& child: this->children)
+        {
+          child.store(0, std::memory_order_relaxed);
+        }
+      }
+
+      unsigned char KeyAt(unsigned i) const noexcept
+      {
+        return static_cast<unsigned char>(this->keys.load(std::memory_order_relaxed) >> (8 * i));
+      }
+    };
+
+    struct node16_t: node_t
+    {
+      std::atomic<std::uint64_t> keys[2];     /**< Sorted key bytes */
+      std::atomic<child_t> children[16];      /**< Children */
+
+      node16_t() noexcept
+        : node_t(node16)
+      {
+        this->keys[0].store(0, std::memory_order_relaxed);
+        this->keys[1].store(0, std::memory_order_relaxed);
+        for (auto& child: this->children)
+        {
+          child.store(0, std::memory_order_relaxed);
+        }
+      }
+
+      unsigned char KeyAt(unsigned i) const noexcept
+      {
+        return static_cast<unsigned char>(this->keys[i / 8].load(std::memory_order_relaxed) >> (8 * (i % 8)));
+      }
+
+      /**
+       * Slot of key byte, or 16 when missing.
+       */
+      unsigned Find(unsigned char byte) const noexcept
+      {
+        const auto count = this->count.load(std::memory_order_relaxed);
+#if defined(__SSE2__)
+        const auto keys = _mm_set_epi64x(
+          static_cast<long long>(this->keys[1].load(std::memory_order_relaxed)),
+          static_cast<long long>(this->keys[0].load(std::memory_order_relaxed))
+        );
+        const auto equal = _mm_cmpeq_epi8(keys, _mm_set1_epi8(static_cast<char>(byte)));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(equal)) & ((1u << std::min<unsigned>(count, 16)) - 1);
+        return (mask != 0)? static_cast<unsigned>(__builtin_ctz(mask)): 16;
+#else
+        for (unsigned i = 0; (i < count) && (i < 16); ++i)
+        {
+          if (this->KeyAt(i) == byte)
+          {
+            return i;
+          }
+        }
+        return 16;
+#endif
+      }
+    };
+
+    struct node48_t: node_t
+    {
+      std::atomic<unsigned char> index[256];  /**< Child slot + 1 per byte, 0 when missing */
+      std::atomic<child_t> children[48];      /**< Children */
+
+      node48_t() noexcept
+        : node_t(node48)
+      {
+        for (auto& item: this->index)
+        {
+          item.store(0, std::memory_order_relaxed);
+        }
+        for (auto& child: this->children)
+        {
+          child.store(0, std::memory_order_relaxed);
+        }
+      }
+    };
+
+    struct node256_t: node_t
+    {
+      std::atomic<child_t> children[256];     /**< Children by byte */
+
+      node256_t() noexcept
+        : node_t(node256)
+      {
+        for (auto& child: this->children)
+        {
+          child.store(0, std::memory_order_relaxed);
+        }
+      }
+    };
+
+    /**
+     * Set byte in little-endian packed word.
+     */
+    template<typename word_t>
+    word_t SetByte(word_t word, unsigned i, unsigned char byte) noexcept
+    {
+      const auto shift = 8 * i;
+      return static_cast<word_t>((word & ~(word_t(0xFF) << shift)) | (word_t(byte) << shift));
+    }
+
+    inline child_t FindChild(const node_t* node, unsigned char byte) noexcept
+    {
+      switch (node->type)
+      {
+        case node4:
+          {
+            auto n = static_cast<const node4_t*>(node);
+            const auto count = std::min<unsigned>(n->count.load(std::memory_order_relaxed), 4);
+            for (unsigned i = 0; i < count; ++i)
+            {
+              if (n->KeyAt(i) == byte)
+              {
+                return n->children[i].load(std::memory_order_acquire);
+              }
+            }
+            return 0;
+          }
+        case node16:
+          {
+            auto n = static_cast<const node16_t*>(node);
+            const auto i = n->Find(byte);
+            return (i < 16)? n->children[i].load(std::memory_order_acquire): 0;
+          }
+        case node48:
+          {
+            auto n = static_cast<const node48_t*>(node);
+            const auto slot = n->index[byte].load(std::memory_order_relaxed);
+            return (slot != 0)? n->children[(slot - 1) % 48].load(std::memory_order_acquire): 0;
+          }
+        default:
+          return static_cast<const node256_t*>(node)->children[byte].load(std::memory_order_acquire);
+      }
+    }
+
+    inline bool IsFull(const node_t* node) noexcept
+    {
+      const auto count = node->count.load(std::memory_order_relaxed);
+      switch (node->type)
+      {
+        case node4:
+          return count == 4;
+        case node16:
+          return count == 16;
+        case node48:
+          return count == 48;
+        default:
+          return false;
+      }
+    }
+
+    /**
+     * Add child for missing byte into node which is not full. Node is locked.
+     */
+    inline void AddChild(node_t* node, unsigned char byte, child_t child) noexcept
+    {
+      const auto count = node->count.load(std::memory_order_relaxed);
+      switch (node->type)
+      {
+        case node4:
+          {
+            auto n = static_cast<node4_t*>(node);
+            auto keys = n->keys.load(std::memory_order_relaxed);
+            unsigned pos = 0;
+            while ((pos < count) && (n->KeyAt(pos) < byte))
+            {
+              ++pos;
+            }
+            for (unsigned i = count; i > pos; --i)
+            {
+              keys = SetByte(keys, i, n->KeyAt(i - 1));
+              n->children[i].store(n->children[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            n->keys.store(SetByte(keys, pos, byte), std::memory_order_relaxed);
+            n->children[pos].store(child, std::memory_order_release);
+          }
+          break;
+        case node16:
+          {
+            auto n = static_cast<node16_t*>(node);
+            std::uint64_t keys[2] = { n->keys[0].load(std::memory_order_relaxed), n->keys[1].load(std::memory_order_relaxed) };
+            unsigned pos = 0;
+            while ((pos < count) && (n->KeyAt(pos) < byte))
+            {
+              ++pos;
+            }
+            for (unsigned i = count; i > pos; --i)
+            {
+              keys[i / 8] = SetByte(keys[i / 8], i % 8, n->KeyAt(i - 1));
+              n->children[i].store(n->children[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            keys[pos / 8] = SetByte(keys[pos / 8], pos % 8, byte);
+            n->keys[0].store(keys[0], std::memory_order_relaxed);
+            n->keys[1].store(keys[1], std::memory_order_relaxed);
+            n->children[pos].store(child, std::memory_order_release);
+          }
+          break;
+        case node48:
+          {
+            auto n = static_cast<node48_t*>(node);
+            unsigned slot = 0;
+            while (n->children[slot].load(std::memory_order_relaxed) != 0)
+            {
+              ++slot;
+            }
+            n->children[slot].store(child, std::memory_order_release);
+            n->index[byte].store(static_cast<unsigned char>(slot + 1), std::memory_order_relaxed);
+          }
+          break;
+        default:
+          static_cast<node256_t*>(node)->children[byte].store(child, std::memory_order_release);
+          break;
+      }
+      node->count.store(static_cast<std::uint16_t>(count + 1), std::memory_order_relaxed);
+    }
+
+    /**
+     * Replace child of existing byte. Node is locked.
+     */
+    inline void ChangeChild(node_t* node, unsigned char byte, child_t child) noexcept
+    {
+      switch (node->type)
+      {
+        case node4:
+          {
+            auto n = static_cast<node4_t*>(node);
+            const auto count = n->count.load(std::memory_order_relaxed);
+            for (unsigned i = 0; i < count; ++i)
+            {
+              if (n->KeyAt(i) == byte)
+              {
+                n->children[i].store(child, std::memory_order_release);
+                return;
+              }
+            }
+          }
+          break;
+        case node16:
+          {
+            auto n = static_cast<node16_t*>(node);
+            n->children[n->Find(byte)].store(child, std::memory_order_release);
+          }
+          break;
+        case node48:
+          {
+            auto n = static_cast<node48_t*>(node);
+            n->children[n->index[byte].load(std::memory_order_relaxed) - 1].store(child, std::memory_order_release);
+          }
+          break;
+        default:
+          static_cast<node256_t*>(node)->children[byte].store(child, std::memory_order_release);
+          break;
+      }
+    }
+
+    /**
+     * Remove child of existing byte. Node is locked.
+     */
+    inline void RemoveChild(node_t* node, unsigned char byte) noexcept
+    {
+      const auto count = node->count.load(std::memory_order_relaxed);
+      switch (node->type)
+      {
+        case node4:
+          {
+            auto n = static_cast<node4_t*>(node);
+            auto keys = n->keys.load(std::memory_order_relaxed);
+            unsigned pos = 0;
+            while (n->KeyAt(pos) != byte)
+            {
+              ++pos;
+            }
+            for (unsigned i = pos; i + 1 < count; ++i)
+            {
+              keys = SetByte(keys, i, n->KeyAt(i + 1));
+              n->children[i].store(n->children[i + 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            n->keys.store(keys, std::memory_order_relaxed);
+            n->children[count - 1].store(0, std::memory_order_relaxed);
+          }
+          break;
+        case node16:
+          {
+            auto n = static_cast<node16_t*>(node);
+            std::uint64_t keys[2] = { n->keys[0].load(std::memory_order_relaxed), n->keys[1].load(std::memory_order_relaxed) };
+            const auto pos = n->Find(byte);
+            for (unsigned i = pos; i + 1 < count; ++i)
+            {
+              keys[i / 8] = SetByte(keys[i / 8], i % 8, n->KeyAt(i + 1));
+              n->children[i].store(n->children[i + 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            n->keys[0].store(keys[0], std::memory_order_relaxed);
+            n->keys[1].store(keys[1], std::memory_order_relaxed);
+            n->children[count - 1].store(0, std::memory_order_relaxed);
+          }
+          break;
+        case node48:
+          {
+            auto n = static_cast<node48_t*>(node);
+            const auto slot = n->index[byte].load(std::memory_order_relaxed);
+            n->index[byte].store(0, std::memory_order_relaxed);
+            n->children[slot - 1].store(0, std::memory_order_relaxed);
+          }
+          break;
+        default:
+          static_cast<node256_t*>(node)->children[byte].store(0, std::memory_order_relaxed);
+          break;
+      }
+      node->count.store(static_cast<std::uint16_t>(count - 1), std::memory_order_relaxed);
+    }
+
+    /**
+     * Call fn(byte, child) for children in byte order.
+     */
+    template<typename fn_t>
+    void ForEachChild(const node_t* node, fn_t&& fn)
+    {
+      switch (node->type)
+      {
+        case node4:
+          {
+            auto n = static_cast<const node4_t*>(node);
+            const auto count = std::min<unsigned>(n->count.load(std::memory_order_relaxed), 4);
+            for (unsigned i = 0; i < count; ++i)
+            {
+              fn(n->KeyAt(i), n->children[i].load(std::memory_order_acquire));
+            }
+          }
+          break;
+        case node16:
+          {
+            auto n = static_cast<const node16_t*>(node);
+            const auto count = std::min<unsigned>(n->count.load(std::memory_order_relaxed), 16);
+            for (unsigned i = 0; i < count; ++i)
+            {
+              fn(n->KeyAt(i), n->children[i].load(std::memory_order_acquire));
+            }
+          }
+          break;
+        case node48:
+          {
+            auto n = static_cast<const node48_t*>(node);
+            for (unsigned byte = 0; byte < 256; ++byte)
+            {
+              const auto slot = n->index[byte].load(std::memory_order_relaxed);
+              if (slot != 0)
+              {
+                fn(static_cast<unsigned char>(byte), n->children[(slot - 1) % 48].load(std::memory_order_acquire));
+              }
+            }
+          }
+          break;
+        default:
+          {
+            auto n = static_cast<const node256_t*>(node);
+            for (unsigned byte = 0; byte < 256; ++byte)
+            {
+              const auto child = n->children[byte].load(std::memory_order_acquire);
+              if (child != 0)
+              {
+                fn(static_cast<unsigned char>(byte), child);
+              }
+            }
+          }
+          break;
+      }
+    }
+
+    inline node_t* NewNode(type_t type)
+    {
+      switch (type)
+      {
+        case node4:
+          return new node4_t();
+        case node16:
+          return new node16_t();
+        case node48:
+          return new node48_t();
+        default:
+          return new node256_t();
+      }
+    }
+
+    inline void DeleteNode(node_t* node) noexcept
+    {
+      switch (node->type)
+      {
+        case node4:
+          delete static_cast<node4_t*>(node);
+          break;
+        case node16:
+          delete static_cast<node16_t*>(node);
+          break;
+        case node48:
+          delete static_cast<node48_t*>(node);
+          break;
+        default:
+          delete static_cast<node256_t*>(node);
+          break;
+      }
+    }
+
+    /**
+     * Delete node with whole subtree and leaves.
+     */
+    inline void DeleteTree(node_t* node) noexcept
+    {
+      delete node->terminal.load(std::memory_order_relaxed);
+      ForEachChild(node, [](unsigned char, child_t child)
+      {
+        if (IsLeaf(child))
+        {
+          delete AsLeaf(child);
+        }
+        else
+        {
+          DeleteTree(reinterpret_cast<node_t*>(child));
+        }
+      });
+      DeleteNode(node);
+    }
+
+    /**
+     * Copy of node in next bigger layout. Source is locked.
+     */
+    inline node_t* Grow(const node_t* node)
+    {
+      auto grown = NewNode(static_cast<type_t>(node->type + 1));
+      char prefix[maxPrefix];
+      const auto size = node->prefixSize.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        prefix[i] = static_cast<char>(node->PrefixAt(i));
+      }
+      grown->SetPrefix(prefix, size);
+      grown->terminal.store(node->terminal.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      ForEachChild(node, [grown](unsigned char byte, child_t child)
+      {
+        AddChild(grown, byte, child);
+      });
+      return grown;
+    }
+
+    /**
+     * Unpublished node for bytes[0, size) followed by subtree made by
+     * attach(node), which fills node children. Prefix longer than
+     * maxPrefix is split into chain of nodes with one child.
+     */
+    template<typename attach_t>
+    node_t* NewPath(const char* bytes, std::size_t size, attach_t&& attach)
+    {
+      auto top = NewNode(node4);
+      auto node = top;
+      while (size > maxPrefix)
+      {
+        node->SetPrefix(bytes, maxPrefix);
+        auto next = NewNode(node4);
+        AddChild(node, static_cast<unsigned char>(bytes[maxPrefix]), reinterpret_cast<child_t>(next));
+        bytes += maxPrefix + 1;
+        size -= maxPrefix + 1;
+        node = next;
+      }
+      node->SetPrefix(bytes, size);
+      attach(node);
+      return top;
+    }
+
+  } // namespace detail
+
+  /**
+   * Concurrent adaptive radix tree from string keys to values.
+   *
+   * All methods can be called from any number of threads concurrently.
+   * Scans are not atomic: they see every key present during whole
+   * scan, and may or may not see keys changed while it runs.
+   */
+  class tree_t final
+  {
+  public:
+
+    /**
+     * Create empty tree.
+     *
+     * @param [in] domain reclamation domain for replaced nodes and leaves
+     */
+    explicit tree_t(ebr::domain_t& domain = ebr::DefaultDomain())
+      : domain(domain), root(new detail::node256_t()), size(0)
+    {
+      ;
+    }
+
+    tree_t(const tree_t&) = delete;
+    tree_t& operator=(const tree_t&) = delete;
+
+    /**
+     * Destructor. Destroys all stored values.
+     */
+    ~tree_t()
+    {
+      detail::DeleteTree(this->root);
+    }
+
+    /**
+     * Pass value of key to visitor.
+     *
+     * Visitor is called at most once, with reference to value which may
+     * be already removed from tree by other thread.
+     *
+     * @param [in] visitor function called as visitor(const value_t&)
+     *
+     * @return true when key was found
+     */
+    template<typename visitor_t>
+    bool Visit(const std::string& key, visitor_t&& visitor) const
+    {
+      auto pin = this->domain.Pin();
+      detail::leaf_t* leaf;
+      while (!this->Lookup(key, leaf))
+      {
+        ;
+      }
+      if (leaf == nullptr)
+      {
+        return false;
+      }
+      visitor(leaf->value);
+      return true;
+    }
+
+    /**
+     * Copy value of key.
+     *
+     * @throws std::runtime_error when stored value is a pointer
+     *
+     * @return true when key was found
+     */
+    bool Find(const std::string& key, value_t& out) const
+    {
+      return this->Visit(key,
+        [&out](const value_t& value)
+        {
+          out = value;
+        }
+      );
+    }
+
+    /**
+     * Check if key is stored in tree.
+     */
+    bool Contains(const std::string& key) const
+    {
+      return this->Visit(key,
+        [](const value_t&)
+        {
+          ;
+        }
+      );
+    }
+
+    /**
+     * Insert value if key is not in tree yet.
+     *
+     * @return true when value was inserted
+     */
+    bool Insert(const std::string& key, value_t value)
+    {
+      return this->Store(key, std::move(value), false);
+    }
+
+    /**
+     * Insert value or replace existing one.
+     *
+     * @return true when new key was inserted, false when value was replaced
+     */
+    bool Assign(const std::string& key, value_t value)
+    {
+      return this->Store(key, std::move(value), true);
+    }
+
+    /**
+     * Remove key.
+     *
+     * @return true when key was removed
+     */
+    bool Erase(const std::string& key)
+    {
+      auto pin = this->domain.Pin();
+      int result;
+      while ((result = this->TryErase(key)) < 0)
+      {
+        ;
+      }
+      return result != 0;
+    }
+
+    /**
+     * Number of keys.
+     */
+    std::size_t Size() const noexcept
+    {
+      return this->size.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Visit keys in range [from, to) in order. Empty to means no upper bound.
+     *
+     * @param visitor called as visitor(const std::string& key, const value_t& value), returns false to stop
+     */
+    template<typename visitor_t>
+    void Scan(const std::string& from, const std::string& to, visitor_t&& visitor) const
+    {
+      auto pin = this->domain.Pin();
+      std::string last;
+      bool started = false;
+      const std::string* low = &from;
+
+      // subtree is skipped when all its keys are below low or not below to
+      auto enter = [&low, &to](const std::string& path)
+      {
+        if (low->compare(0, path.size(), path) > 0)
+        {
+          return false;
+        }
+        const auto above = to.compare(0, path.size(), path);
+        return to.empty() || (above > 0) || ((above == 0) && (to.size() > path.size()));
+      };
+      auto leafVisitor = [&](const detail::leaf_t* leaf)
+      {
+        if ((started && !(last < leaf->key)) || (leaf->key < from))
+        {
+          return true;
+        }
+        if (!to.empty() && !(leaf->key < to))
+        {
+          return false;
+        }
+        last = leaf->key;
+        started = true;
+        return static_cast<bool>(visitor(leaf->key, leaf->value));
+      };
+
+      // restart continues after last visited key
+      std::string path;
+      while (this->Walk(this->root, nullptr, 0, 0, path, enter, leafVisitor) < 0)
+      {
+        path.clear();
+        low = started? &last: &from;
+      }
+    }
+
+    /**
+     * Visit keys starting with prefix in order.
+     *
+     * @param visitor called as visitor(const std::string& key, const value_t& value), returns false to stop
+     */
+    template<typename visitor_t>
+    void ScanPrefix(const std::string& prefix, visitor_t&& visitor) const
+    {
+      // first string after all strings with prefix
+      auto to = prefix;
+      while (!to.empty() && (static_cast<unsigned char>(to.back()) == 0xFF))
+      {
+        to.pop_back();
+      }
+      if (!to.empty())
+      {
+        to.back() = static_cast<char>(static_cast<unsigned char>(to.back()) + 1);
+      }
+      this->Scan(prefix, to, std::forward<visitor_t>(visitor));
+    }
+
+  private:
+
+    /**
+     * Optimistic lookup.
+     *
+     * @return false when lookup must restart
+     */
+    bool Lookup(const std::string& key, detail::leaf_t*& leaf) const
+    {
+      leaf = nullptr;
+      const detail::node_t* node = this->root;
+      std::uint64_t version;
+      if (!node->ReadLock(version))
+      {
+        return false;
+      }
+      std::size_t level = 0;
+      for (;;)
+      {
+        const auto prefixSize = std::min<std::size_t>(node->prefixSize.load(std::memory_order_relaxed), detail::maxPrefix);
+        for (std::size_t i = 0; i < prefixSize; ++i, ++level)
+        {
+          if ((level >= key.size()) || (node->PrefixAt(i) != static_cast<unsigned char>(key[level])))
+          {
+            return node->Validate(version);
+          }
+        }
+        if (level == key.size())
+        {
+          leaf = node->terminal.load(std::memory_order_acquire);
+          return node->Validate(version);
+        }
+
+        const auto child = detail::FindChild(node, static_cast<unsigned char>(key[level]));
+        if (!node->Validate(version))
+        {
+          return false;
+        }
+        if (child == 0)
+        {
+          return true;
+        }
+        if (detail::IsLeaf(child))
+        {
+          auto found = detail::AsLeaf(child);
+          leaf = (found->key == key)? found: nullptr;
+          return true;
+        }
+
+        auto next = reinterpret_cast<const detail::node_t*>(child);
+        std::uint64_t nextVersion;
+        if (!next->ReadLock(nextVersion) || !node->Validate(version))
+        {
+          return false;
+        }
+        node = next;
+        version = nextVersion;
+        ++level;
+      }
+    }
+
+    bool Store(const std::string& key, value_t&& value, bool replace)
+    {
+      auto pin = this->domain.Pin();
+      int result;
+      while ((result = this->TryStore(key, value, replace)) < 0)
+      {
+        ;
+      }
+      if (result != 0)
+      {
+        this->size.fetch_add(1, std::memory_order_relaxed);
+      }
+      return result != 0;
+    }
+
+    /**
+     * One optimistic insert attempt.
+     *
+     * @return 1 when key was inserted, 0 when it existed, -1 to restart
+     */
+    int TryStore(const std::string& key, value_t& value, bool replace)
+    {
+      detail::node_t* parent = nullptr;
+      std::uint64_t parentVersion = 0;
+      unsigned char parentByte = 0;
+      detail::node_t* node = this->root;
+      std::uint64_t version;
+      if (!node->ReadLock(version))
+      {
+        return -1;
+      }
+      std::size_t level = 0;
+
+      for (;;)
+      {
+        // prefix mismatch: split node with new parent
+        const auto prefixSize = std::min<std::size_t>(node->prefixSize.load(std::memory_order_relaxed), detail::maxPrefix);
+        std::size_t matched = 0;
+        while ((matched < prefixSize) && (level + matched < key.size())
+          && (node->PrefixAt(matched) == static_cast<unsigned char>(key[level + matched])))
+        {
+          ++matched;
+        }
+        if (matched < prefixSize)
+        {
+          if (!parent->Upgrade(parentVersion))
+          {
+            return -1;
+          }
+          if (!node->Upgrade(version))
+          {
+            parent->Unlock();
+            return -1;
+          }
+          char prefix[detail::maxPrefix];
+          for (std::size_t i = 0; i < prefixSize; ++i)
+          {
+            prefix[i] = static_cast<char>(node->PrefixAt(i));
+          }
+          auto split = detail::NewNode(detail::node4);
+          split->SetPrefix(prefix, matched);
+          this->AttachLeaf(split, key, level + matched, value);
+          detail::AddChild(split, static_cast<unsigned char>(prefix[matched]), reinterpret_cast<detail::child_t>(node));
+          node->CutPrefix(matched + 1);
+          detail::ChangeChild(parent, parentByte, reinterpret_cast<detail::child_t>(split));
+          node->Unlock();
+          parent->Unlock();
+          return 1;
+        }
+        level += prefixSize;
+
+        // key ends here
+        if (level == key.size())
+        {
+          if (!node->Upgrade(version))
+          {
+            return -1;
+          }
+          auto old = node->terminal.load(std::memory_order_relaxed);
+          if ((old != nullptr) && !replace)
+          {
+            node->Unlock();
+            return 0;
+          }
+          node->terminal.store(new detail::leaf_t(key, std::move(value)), std::memory_order_release);
+          node->Unlock();
+          if (old != nullptr)
+          {
+            this->domain.Retire(old);
+            return 0;
+          }
+          return 1;
+        }
+
+        const auto byte = static_cast<unsigned char>(key[level]);
+        const auto child = detail::FindChild(node, byte);
+        if (!node->Validate(version))
+        {
+          return -1;
+        }
+
+        if (child == 0)
+        {
+          if (detail::IsFull(node))
+          {
+            // replace node with bigger copy, parent points to copy
+            if (!parent->Upgrade(parentVersion))
+            {
+              return -1;
+            }
+            if (!node->Upgrade(version))
+            {
+              parent->Unlock();
+              return -1;
+            }
+            auto grown = detail::Grow(node);
+            detail::AddChild(grown, byte, detail::FromLeaf(new detail::leaf_t(key, std::move(value))));
+            detail::ChangeChild(parent, parentByte, reinterpret_cast<detail::child_t>(grown));
+            node->UnlockObsolete();
+            parent->Unlock();
+            this->domain.Retire(static_cast<void*>(node),
+              [](void* item)
+              {
+                detail::DeleteNode(static_cast<detail::node_t*>(item));
+              }
+            );
+            return 1;
+          }
+          if (!node->Upgrade(version))
+          {
+            return -1;
+          }
+          if ((parent != nullptr) && !parent->Validate(parentVersion))
+          {
+            node->Unlock();
+            return -1;
+          }
+          detail::AddChild(node, byte, detail::FromLeaf(new detail::leaf_t(key, std::move(value))));
+          node->Unlock();
+          return 1;
+        }
+
+        if ((parent != nullptr) && !parent->Validate(parentVersion))
+        {
+          return -1;
+        }
+
+        if (detail::IsLeaf(child))
+        {
+          if (!node->Upgrade(version))
+          {
+            return -1;
+          }
+          auto leaf = detail::AsLeaf(child);
+          if (leaf->key == key)
+          {
+            if (!replace)
+            {
+              node->Unlock();
+              return 0;
+            }
+            detail::ChangeChild(node, byte, detail::FromLeaf(new detail::leaf_t(key, std::move(value))));
+            node->Unlock();
+            this->domain.Retire(leaf);
+            return 0;
+          }
+
+          // two keys share this byte: new node for their common part
+          const auto start = level + 1;
+          std::size_t common = 0;
+          while ((start + common < key.size()) && (start + common < leaf->key.size())
+            && (key[start + common] == leaf->key[start + common]))
+          {
+            ++common;
+          }
+          auto path = detail::NewPath(key.data() + start, common,
+            [this, &key, &value, leaf, start, common](detail::node_t* bottom)
+            {
+              this->AttachLeaf(bottom, key, start + common, value);
+              if (leaf->key.size() == start + common)
+              {
+                bottom->terminal.store(leaf, std::memory_order_relaxed);
+              }
+              else
+              {
+                detail::AddChild(bottom, static_cast<unsigned char>(leaf->key[start + common]), detail::FromLeaf(leaf));
+              }
+            }
+          );
+          detail::ChangeChild(node, byte, reinterpret_cast<detail::child_t>(path));
+          node->Unlock();
+          return 1;
+        }
+
+        auto next = reinterpret_cast<detail::node_t*>(child);
+        std::uint64_t nextVersion;
+        if (!next->ReadLock(nextVersion) || !node->Validate(version))
+        {
+          return -1;
+        }
+        parent = node;
+        parentVersion = version;
+        parentByte = byte;
+        node = next;
+        version = nextVersion;
+        ++level;
+      }
+    }
+
+    /**
+     * Put new leaf of key into unpublished node, at position of key byte at level.
+     */
+    void AttachLeaf(detail::node_t* node, const std::string& key, std::size_t level, value_t& value)
+    {
+      auto leaf = new detail::leaf_t(key, std::move(value));
+      if (level == key.size())
+      {
+        node->terminal.store(leaf, std::memory_order_relaxed);
+      }
+      else
+      {
+        detail::AddChild(node, static_cast<unsigned char>(key[level]), detail::FromLeaf(leaf));
+      }
+    }
+
+    /**
+     * One optimistic erase attempt.
+     *
+     * @return 1 when key was removed, 0 when it was missing, -1 to restart
+     */
+    int TryErase(const std::string& key)
+    {
+      detail::node_t* node = this->root;
+      std::uint64_t version;
+      if (!node->ReadLock(version))
+      {
+        return -1;
+      }
+      std::size_t level = 0;
+      for (;;)
+      {
+        const auto prefixSize = std::min<std::size_t>(node->prefixSize.load(std::memory_order_relaxed), detail::maxPrefix);
+        for (std::size_t i = 0; i < prefixSize; ++i, ++level)
+        {
+          if ((level >= key.size()) || (node->PrefixAt(i) != static_cast<unsigned char>(key[level])))
+          {
+            return node->Validate(version)? 0: -1;
+          }
+        }
+
+        detail::leaf_t* leaf = nullptr;
+        if (level == key.size())
+        {
+          if (!node->Upgrade(version))
+          {
+            return -1;
+          }
+          leaf = node->terminal.load(std::memory_order_relaxed);
+          node->terminal.store(nullptr, std::memory_order_relaxed);
+          node->Unlock();
+        }
+        else
+        {
+          const auto byte = static_cast<unsigned char>(key[level]);
+          const auto child = detail::FindChild(node, byte);
+          if (!node->Validate(version))
+          {
+            return -1;
+          }
+          if (child == 0)
+          {
+            return 0;
+          }
+          if (!detail::IsLeaf(child))
+          {
+            auto next = reinterpret_cast<detail::node_t*>(child);
+            std::uint64_t nextVersion;
+            if (!next->ReadLock(nextVersion) || !node->Validate(version))
+            {
+              return -1;
+            }
+            node = next;
+            version = nextVersion;
+            ++level;
+            continue;
+          }
+          if (detail::AsLeaf(child)->key != key)
+          {
+            return 0;
+          }
+          if (!node->Upgrade(version))
+          {
+            return -1;
+          }
+          leaf = detail::AsLeaf(child);
+          detail::RemoveChild(node, byte);
+          node->Unlock();
+        }
+
+        if (leaf == nullptr)
+        {
+          return 0;
+        }
+        this->domain.Retire(leaf);
+        this->size.fetch_sub(1, std::memory_order_relaxed);
+        return 1;
+      }
+    }
+
+    /**
+     * Visit subtree in key order.
+     *
+     * Node state is copied and validated before anything is visited.
+     * Node path is correct only while parent still points to node,
+     * so parent is checked too. Scan restarts from root when check fails.
+     *
+     * @param enter called with path of inner node, returns false to skip it
+     * @param leafVisitor called with leaf, returns false to stop
+     *
+     * @return 1 to continue, 0 to stop, -1 to restart
+     */
+    template<typename enter_t, typename leafVisitor_t>
+    int Walk(const detail::node_t* node, const detail::node_t* parent, std::uint64_t parentVersion,
+      unsigned char byte, std::string& path, enter_t& enter, leafVisitor_t& leafVisitor) const
+    {
+      struct item_t
+      {
+        unsigned char byte;
+        detail::child_t child;
+      };
+      item_t items[256];
+      std::size_t count = 0;
+      const auto base = path.size();
+
+      std::uint64_t version;
+      if (!node->ReadLock(version))
+      {
+        return -1;
+      }
+      const auto prefixSize = std::min<std::size_t>(node->prefixSize.load(std::memory_order_relaxed), detail::maxPrefix);
+      for (std::size_t i = 0; i < prefixSize; ++i)
+      {
+        path.push_back(static_cast<char>(node->PrefixAt(i)));
+      }
+      const auto terminal = node->terminal.load(std::memory_order_acquire);
+      detail::ForEachChild(node, [&items, &count](unsigned char byte, detail::child_t child)
+      {
+        if (count < 256)
+        {
+          items[count++] = { byte, child };
+        }
+      });
+      if (!node->Validate(version))
+      {
+        return -1;
+      }
+      if ((parent != nullptr) && !parent->Validate(parentVersion))
+      {
+        std::uint64_t current;
+        if (!parent->ReadLock(current)
+          || (detail::FindChild(parent, byte) != reinterpret_cast<detail::child_t>(node))
+          || !parent->Validate(current))
+        {
+          return -1;
+        }
+      }
+
+      if (!enter(path))
+      {
+        path.resize(base);
+        return 1;
+      }
+      if ((terminal != nullptr) && !leafVisitor(terminal))
+      {
+        return 0;
+      }
+      const auto depth = path.size();
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        if (detail::IsLeaf(items[i].child))
+        {
+          if (!leafVisitor(detail::AsLeaf(items[i].child)))
+          {
+            return 0;
+          }
+          continue;
+        }
+        path.push_back(static_cast<char>(items[i].byte));
+        const auto result = this->Walk(reinterpret_cast<const detail::node_t*>(items[i].child), node, version,
+          items[i].byte, path, enter, leafVisitor);
+        if (result != 1)
+        {
+          return result;
+        }
+        path.resize(depth);
+      }
+      path.resize(base);
+      return 1;
+    }
+
+    ebr::domain_t& domain;            /**< Reclamation domain */
+    detail::node_t* const root;       /**< Node256 root, never replaced */
+    std::atomic<std::size_t> size;    /**< Number of keys */
+  };
+
+} // namespace art
+} // namespace bvl
+
+#endif /* BAD_VALUE_ART_HEADER */
@@ -0,0 +1,583 @@
+/**
+ * @file badval_bind.hpp
+ * @author masscry
+ *
+ * Compile-time binding of structures to documents, rows and streams.
+ *
+ * BVL_BIND(Type, field...) placed next to structure lists its public
+ * fields. Macro expands to function returning tuple of member pointers
+ * with field names, found by argument dependent lookup, so converters
+ * are templates unrolled over fields at compile time: no runtime
+ * reflection, no intermediate maps. Member keys with their hashes are
+ * built once per type, conversions never allocate names.
+ *
+ * Fields may be arithmetic, std::string, std::vector of fields, or
+ * other bound structures, which must be bound before use:
+ *
+ *  - ToNode / FromNode convert to and from document object, nested
+ *    structures are objects, vectors are arrays;
+ *  - ToRow / FromRow convert to and from row of values in field order,
+ *    only arithmetic and string fields are allowed;
+ *  - Encode / Decode write and read fields in order without names,
+ *    every scalar is written as bvl::serial value, vector as varint
+ *    size and items, nested structure as its fields. Scalar structure
+ *    is written exactly as serial::Encode of its row.
+ *
+ * Arithmetic fields are stored as numbers, so 64-bit integers above
+ * 2^53 lose precision. Reading integral field from number that is not
+ * finite or out of its range fails.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_BIND_HEADER
+#define BAD_VALUE_BIND_HEADER
+
+#include <badval_doc.hpp>
+#include <badval_serial.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define BVL_BIND_CAT_(a, b) a ## b
+#define BVL_BIND_CAT(a, b) BVL_BIND_CAT_(a, b)
+#define BVL_BIND_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, N, ...) N
+#define BVL_BIND_COUNT(...) BVL_BIND_COUNT_(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define BVL_BIND_FIELD(Type, field) ::bvl::bind::detail::Field(#field, &Type::field)
+#define BVL_BIND_1(Type, a) BVL_BIND_FIELD(Type, a)
+#define BVL_BIND_2(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_1(Type, __VA_ARGS__)
+#define BVL_BIND_3(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_2(Type, __VA_ARGS__)
+#define BVL_BIND_4(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_3(Type, __VA_ARGS__)
+#define BVL_BIND_5(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_4(Type, __VA_ARGS__)
+#define BVL_BIND_6(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_5(Type, __VA_ARGS__)
+#define BVL_BIND_7(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_6(Type, __VA_ARGS__)
+#define BVL_BIND_8(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_7(Type, __VA_ARGS__)
+#define BVL_BIND_9(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_8(Type, __VA_ARGS__)
+#define BVL_BIND_10(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_9(Type, __VA_ARGS__)
+#define BVL_BIND_11(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_10(Type, __VA_ARGS__)
+#define BVL_BIND_12(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_11(Type, __VA_ARGS__)
+#define BVL_BIND_13(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_12(Type, __VA_ARGS__)
+#define BVL_BIND_14(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_13(Type, __VA_ARGS__)
+#define BVL_BIND_15(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_14(Type, __VA_ARGS__)
+#define BVL_BIND_16(Type, a, ...) BVL_BIND_FIELD(Type, a), BVL_BIND_15(Type, __VA_ARGS__)
+
+/**
+ * Bind up to 16 public fields of structure.
+ *
+ * Must be placed in namespace of Type, after its definition.
+ */
+#define BVL_BIND(Type, ...) \
+  inline auto BvlFields(const Type*) \
+  { \
+    return std::make_tuple(BVL_BIND_CAT(BVL_BIND_, BVL_BIND_COUNT(__VA_ARGS__))(Type, __VA_ARGS__)); \
+  }
+
+namespace bvl
+{
+namespace bind
+{
+
+  using doc::node_t;
+
+  namespace detail
+  {
+
+    /**
+     * Bound field.
+     */
+    template<typename T, typename M>
+    struct field_t
+    {
+      const char* name;   /**< Field name */
+      M T::* member;      /**< Member pointer */
+    };
+
+    template<typename T, typename M>
+    constexpr field_t<T, M> Field(const char* name, M T::* member) noexcept
+    {
+      return { name, member };
+    }
+
+    /**
+     * Type was bound by BVL_BIND.
+     */
+    template<typename T, typename = void>
+    struct bound_t: std::false_type
+    {};
+
+    template<typename T>
+    struct bound_t<T, decltype((void)BvlFields(static_cast<const T*>(nullptr)))>: std::true_type
+    {};
+
+    /**
+     * Type is stored as one value.
+     */
+    template<typename M>
+    struct scalar_t: std::integral_constant<bool, std::is_arithmetic<M>::value || std::is_same<M, std::string>::value>
+    {};
+
+    template<typename T>
+    auto Fields() -> decltype(BvlFields(static_cast<const T*>(nullptr)))
+    {
+      static_assert(bound_t<T>::value, "type is not bound with BVL_BIND");
+      return BvlFields(static_cast<const T*>(nullptr));
+    }
+
+    template<typename T>
+    using fields_t = decltype(Fields<T>());
+
+    /**
+     * Call func(field, index) for every field, unrolled at compile time.
+     */
+    template<typename Tuple, typename Func, std::size_t... I>
+    void Each(const Tuple& fields, Func&& func, std::index_sequence<I...>)
+    {
+      using expand = int[];
+      (void)expand{ 0, (func(std::get<I>(fields), I), 0)... };
+    }
+
+    template<typename T, typename Func>
+    void Each(Func&& func)
+    {
+      Each(Fields<T>(), std::forward<Func>(func), std::make_index_sequence<std::tuple_size<fields_t<T>>::value>());
+    }
+
+    /**
+     * Member keys of bound type, built once.
+     */
+    template<typename T>
+    const std::vector<node_t::key_t>& Keys()
+    {
+      static const std::vector<node_t::key_t> keys = []()
+      {
+        std::vector<node_t::key_t> result;
+        Each<T>([&result](const auto& field, std::size_t)
+        {
+          std::string name(field.name);
+          const auto hash = doc::KeyHash(name);
+          result.push_back({ std::move(name), hash });
+        });
+        return result;
+      }();
+      return keys;
+    }
+
+    [[noreturn]] inline void Fail(const char* what)
+    {
+      throw std::runtime_error(what);
+    }
+
+    /*
+     * Scalars.
+     */
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type = 0>
+    value_t Value(const M& field)
+    {
+      return value_t(static_cast<double>(field));
+    }
+
+    inline value_t Value(const std::string& field)
+    {
+      return value_t(field);
+    }
+
+    /**
+     * Number converts to integral field, other conversions are undefined.
+     */
+    template<typename M>
+    bool Fits(double number, std::true_type) noexcept
+    {
+      // max() of 64-bit types rounds up to 2^N as double, so compare with 2^N
+      const auto upper = (static_cast<double>(std::numeric_limits<M>::max() / 2) + 1.0) * 2.0;
+      return std::isfinite(number) && (number >= static_cast<double>(std::numeric_limits<M>::lowest())) && (number < upper);
+    }
+
+    template<typename M>
+    bool Fits(double, std::false_type) noexcept
+    {
+      return true;
+    }
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type = 0>
+    void Scalar(const value_t& value, M& field)
+    {
+      if (value.Type() != value_t::number)
+      {
+        Fail("bound field expects number");
+      }
+      const auto number = value.As<value_t::number>();
+      if (!Fits<M>(number, std::is_integral<M>()))
+      {
+        Fail("bound field number is out of range");
+      }
+      field = static_cast<M>(number);
+    }
+
+    inline void Scalar(const value_t& value, bool& field)
+    {
+      if (value.Type() != value_t::number)
+      {
+        Fail("bound field expects number");
+      }
+      field = (value.As<value_t::number>() != 0.0);
+    }
+
+    inline void Scalar(const value_t& value, std::string& field)
+    {
+      if (value.Type() != value_t::string)
+      {
+        Fail("bound field expects string");
+      }
+      field = value.As<value_t::string>();
+    }
+
+    /*
+     * Documents.
+     */
+
+    template<typename M, typename std::enable_if<scalar_t<M>::value, int>::type = 0>
+    node_t Node(const M& field);
+    template<typename E>
+    node_t Node(const std::vector<E>& field);
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type = 0>
+    node_t Node(const M& field);
+
+    template<typename M, typename std::enable_if<scalar_t<M>::value, int>::type = 0>
+    void Read(const node_t& node, M& field);
+    template<typename E>
+    void Read(const node_t& node, std::vector<E>& field);
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type = 0>
+    void Read(const node_t& node, M& field);
+
+    template<typename M, typename std::enable_if<scalar_t<M>::value, int>::type>
+    node_t Node(const M& field)
+    {
+      return node_t(Value(field));
+    }
+
+    template<typename E>
+    node_t Node(const std::vector<E>& field)
+    {
+      auto result = node_t::Array();
+      for (const auto& item: field)
+      {
+        result.Push(Node(item));
+      }
+      return result;
+    }
+
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type>
+    node_t Node(const M& object)
+    {
+      const auto& keys = Keys<M>();
+      auto result = node_t::Object();
+      Each<M>([&object, &keys, &result](const auto& field, std::size_t index)
+      {
+        result.Set(keys[index], Node(object.*field.member));
+      });
+      return result;
+    }
+
+    template<typename M, typename std::enable_if<scalar_t<M>::value, int>::type>
+    void Read(const node_t& node, M& field)
+    {
+      if (node.Kind() != node_t::leaf)
+      {
+        Fail("bound field expects leaf");
+      }
+      Scalar(node.Value(), field);
+    }
+
+    template<typename E>
+    void Read(const node_t& node, std::vector<E>& field)
+    {
+      if (node.Kind() != node_t::array)
+      {
+        Fail("bound field expects array");
+      }
+      field.resize(node.Size());
+      for (std::size_t i = 0; i < node.Size(); ++i)
+      {
+        E item;
+        Read(node.At(i), item);
+        field[i] = std::move(item);
+      }
+    }
+
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type>
+    void Read(const node_t& node, M& object)
+    {
+      if (node.Kind() != node_t::object)
+      {
+        Fail("bound structure expects object");
+      }
+      const auto& keys = Keys<M>();
+      Each<M>([&node, &object, &keys](const auto& field, std::size_t index)
+      {
+        const auto& key = keys[index];
+        // members usually come in field order
+        const node_t* member = nullptr;
+        if ((index < node.Size()) && (node.Key(index).hash == key.hash) && (node.Key(index).name == key.name))
+        {
+          member = &node.At(index);
+        }
+        else
+        {
+          member = node.Find(key.name, key.hash);
+        }
+        if (member == nullptr)
+        {
+          throw std::runtime_error("document has no member '" + key.name + "'");
+        }
+        Read(*member, object.*field.member);
+      });
+    }
+
+    /*
+     * Streams.
+     */
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type = 0>
+    void Put(const M& field, std::string& out);
+    inline void Put(const std::string& field, std::string& out);
+    template<typename E>
+    void Put(const std::vector<E>& field, std::string& out);
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type = 0>
+    void Put(const M& field, std::string& out);
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type = 0>
+    void Get(const char*& cursor, const char* end, M& field);
+    inline void Get(const char*& cursor, const char* end, std::string& field);
+    template<typename E>
+    void Get(const char*& cursor, const char* end, std::vector<E>& field);
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type = 0>
+    void Get(const char*& cursor, const char* end, M& field);
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type>
+    void Put(const M& field, std::string& out)
+    {
+      const auto num = static_cast<double>(field);
+      std::uint64_t bits;
+      std::memcpy(&bits, &num, sizeof(bits));
+      out.push_back(static_cast<char>(serial::numberTag));
+      serial::PutFixed64(out, bits);
+    }
+
+    inline void Put(const std::string& field, std::string& out)
+    {
+      out.push_back(static_cast<char>(serial::stringTag));
+      serial::PutVarint(out, field.size());
+      out.append(field);
+    }
+
+    template<typename E>
+    void Put(const std::vector<E>& field, std::string& out)
+    {
+      serial::PutVarint(out, field.size());
+      for (const auto& item: field)
+      {
+        Put(item, out);
+      }
+    }
+
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type>
+    void Put(const M& object, std::string& out)
+    {
+      Each<M>([&object, &out](const auto& field, std::size_t)
+      {
+        Put(object.*field.member, out);
+      });
+    }
+
+    inline std::uint64_t Count(const char*& cursor, const char* end)
+    {
+      std::uint64_t result;
+      if (!serial::GetVarint(cursor, end, result))
+      {
+        Fail("Serialized structure is truncated");
+      }
+      return result;
+    }
+
+    inline void Tag(const char*& cursor, const char* end, serial::tag_t expected)
+    {
+      if (cursor >= end)
+      {
+        Fail("Serialized structure is truncated");
+      }
+      if (static_cast<unsigned char>(*cursor++) != expected)
+      {
+        Fail("Serialized field has other type");
+      }
+    }
+
+    template<typename M, typename std::enable_if<std::is_arithmetic<M>::value, int>::type>
+    void Get(const char*& cursor, const char* end, M& field)
+    {
+      Tag(cursor, end, serial::numberTag);
+      if (end - cursor < 8)
+      {
+        Fail("Serialized number is truncated");
+      }
+      const auto bits = serial::DecodeFixed64(cursor);
+      cursor += 8;
+      double num;
+      std::memcpy(&num, &bits, sizeof(num));
+      Scalar(value_t(num), field);
+    }
+
+    inline void Get(const char*& cursor, const char* end, std::string& field)
+    {
+      Tag(cursor, end, serial::stringTag);
+      const auto size = Count(cursor, end);
+      if (static_cast<std::uint64_t>(end - cursor) < size)
+      {
+        Fail("Serialized string is truncated");
+      }
+      field.assign(cursor, static_cast<std::size_t>(size));
+      cursor += size;
+    }
+
+    template<typename E>
+    void Get(const char*& cursor, const char* end, std::vector<E>& field)
+    {
+      const auto size = Count(cursor, end);
+      if (size > static_cast<std::uint64_t>(end - cursor))
+      {
+        // every item takes at least one byte
+        Fail("Serialized array is truncated");
+      }
+      field.resize(static_cast<std::size_t>(size));
+      for (auto& item: field)
+      {
+        E next;
+        Get(cursor, end, next);
+        item = std::move(next);
+      }
+    }
+
+    template<typename M, typename std::enable_if<bound_t<M>::value, int>::type>
+    void Get(const char*& cursor, const char* end, M& object)
+    {
+      Each<M>([&cursor, end, &object](const auto& field, std::size_t)
+      {
+        Get(cursor, end, object.*field.member);
+      });
+    }
+
+  } // namespace detail
+
+  /**
+   * Number of bound fields.
+   */
+  template<typename T>
+  constexpr std::size_t Size() noexcept
+  {
+    return std::tuple_size<detail::fields_t<T>>::value;
+  }
+
+  /**
+   * Member keys in field order.
+   */
+  template<typename T>
+  const std::vector<node_t::key_t>& Keys()
+  {
+    return detail::Keys<T>();
+  }
+
+  /**
+   * Document object with member per field.
+   */
+  template<typename T>
+  node_t ToNode(const T& object)
+  {
+    static_assert(detail::bound_t<T>::value, "type is not bound with BVL_BIND");
+    return detail::Node(object);
+  }
+
+  /**
+   * Read fields from document object, other members are ignored.
+   *
+   * @throws std::runtime_error when member is missing or has other type
+   */
+  template<typename T>
+  void FromNode(const node_t& node, T& object)
+  {
+    static_assert(detail::bound_t<T>::value, "type is not bound with BVL_BIND");
+    detail::Read(node, object);
+  }
+
+  /**
+   * Row of values in field order.
+   */
+  template<typename T>
+  std::vector<value_t> ToRow(const T& object)
+  {
+    std::vector<value_t> result;
+    result.reserve(Size<T>());
+    detail::Each<T>([&object, &result](const auto& field, std::size_t)
+    {
+      using member_t = typename std::decay<decltype(object.*field.member)>::type;
+      static_assert(detail::scalar_t<member_t>::value, "row field must be arithmetic or string");
+      result.push_back(detail::Value(object.*field.member));
+    });
+    return result;
+  }
+
+  /**
+   * Read fields from row of values in field order.
+   *
+   * @throws std::invalid_argument when row size differs from field count
+   * @throws std::runtime_error when value has other type
+   */
+  template<typename T>
+  void FromRow(const std::vector<value_t>& row, T& object)
+  {
+    if (row.size() != Size<T>())
+    {
+      throw std::invalid_argument("Row size differs from field count");
+    }
+    detail::Each<T>([&row, &object](const auto& field, std::size_t index)
+    {
+      using member_t = typename std::decay<decltype(object.*field.member)>::type;
+      static_assert(detail::scalar_t<member_t>::value, "row field must be arithmetic or string");
+      detail::Scalar(row[index], object.*field.member);
+    });
+  }
+
+  /**
+   * Append serialized fields.
+   */
+  template<typename T>
+  void Encode(const T& object, std::string& out)
+  {
+    static_assert(detail::bound_t<T>::value, "type is not bound with BVL_BIND");
+    detail::Put(object, out);
+  }
+
+  /**
+   * Read serialized fields and move cursor past them.
+   *
+   * @throws std::runtime_error on malformed input
+   */
+  template<typename T>
+  void Decode(const char*& cursor, const char* end, T& object)
+  {
+    static_assert(detail::bound_t<T>::value, "type is not bound with BVL_BIND");
+    detail::Get(cursor, end, object);
+  }
+
+} // namespace bind
+} // namespace bvl
+
+#endif /* BAD_VALUE_BIND_HEADER */
@@ -0,0 +1,610 @@
+/**
+ * @file badval_cmap.hpp
+ * @author masscry
+ *
+ * Sharded concurrent hash map of values.
+ *
+ * Map is split into shards, every shard is open addressing table
+ * with keys and values stored inline in slots. Writers of one shard
+ * are serialized by shard mutex, readers never lock: they read slots
+ * optimistically and validate what they read with shard sequence
+ * counter (seqlock). Removed values are retired to reclamation
+ * domain, so readers never see them destroyed.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_CMAP_HEADER
+#define BAD_VALUE_CMAP_HEADER
+
+#include <badval.hpp>
+#include <badval_ebr.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bvl
+{
+
+  namespace detail
+  {
+
+    /**
+     * Bitwise copy of value made by optimistic reader.
+     *
+     * Snapshot never runs value destructor, so it does not own
+     * anything. It is safe to use only after reader validated it
+     * and only while original data is not released.
+     */
+    class snapshot_t final
+    {
+    public:
+
+      /**
+       * Copy value bits.
+       */
+      void Take(const value_t& src) noexcept
+      {
+        std::memcpy(this->raw, static_cast<const void*>(&src), sizeof(value_t));
+      }
+
+      /**
+       * Access copied value.
+       */
+      const value_t& Get() const noexcept
+      {
+        return *reinterpret_cast<const value_t*>(this->raw);
+      }
+
+    private:
+      alignas(value_t) unsigned char raw[sizeof(value_t)]; /**< Copied value bits */
+    };
+
+    /**
+     * Finalize hash, so it can be split into shard and slot bits.
+     */
+    inline std::uint64_t MixHash(std::uint64_t hash) noexcept
+    {
+      hash ^= hash >> 33;
+      hash *= 0xff51afd7ed558ccdULL;
+      hash ^= hash >> 33;
+      hash *= 0xc4ceb9fe1a85ec53ULL;
+      hash ^= hash >> 33;
+      return hash;
+    }
+
+    /**
+     * Spin a bit, then give up time slice.
+     */
+    inline void Backoff(unsigned& spins) noexcept
+    {
+      if (++spins > 64)
+      {
+        std::this_thread::yield();
+      }
+    }
+
+  } // namespace detail
+
+  /**
+   * Concurrent hash map from values to values.
+   *
+   * Find, Contains and Visit can be called from any number of threads
+   * concurrently with each other and with Insert, Assign and Erase.
+   *
+   * Values replaced or erased from map are not destroyed immediately,
+   * because concurrent reader can still look at them. They are retired
+   * to reclamation domain and destroyed when all readers left.
+   */
+  class concurrent_map_t final
+  {
+  public:
+
+    /**
+     * Create empty map.
+     *
+     * @param [in] shards number of shards, rounded up to power of two
+     * @param [in] capacity expected number of elements
+     * @param [in] domain reclamation domain for removed values
+     */
+    explicit concurrent_map_t(std::size_t shards = 64, std::size_t capacity = 0, ebr::domain_t& domain = ebr::DefaultDomain())
+      : domain(domain), shardBits(0)
+    {
+      while ((std::size_t(1) << this->shardBits) < shards)
+      {
+        ++this->shardBits;
+      }
+      const auto count = std::size_t(1) << this->shardBits;
+      this->shards.reset(new shard_t[count]);
+
+      std::size_t slots = minSlots;
+      while (slots * maxLoadNum < (capacity / count + 1) * maxLoadDen)
+      {
+        slots *= 2;
+      }
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        this->shards[i].table.store(new table_t(slots), std::memory_order_relaxed);
+      }
+    }
+
+    concurrent_map_t(const concurrent_map_t&) = delete;
+    concurrent_map_t& operator=(const concurrent_map_t&) = delete;
+
+    /**
+     * Destructor.
+     *
+     * Destroys all stored values.
+     */
+    ~concurrent_map_t()
+    {
+      const auto count = std::size_t(1) << this->shardBits;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        delete this->shards[i].table.load(std::memory_order_relaxed);
+      }
+    }
+
+    /**
+     * Look key up and pass stored value to visitor.
+     *
+     * Visitor is called at most once, without any locks held, with
+     * reference to value which is not owned by caller and may be
+     * already removed from map by other thread.
+     *
+     * @param [in] key key to look up
+     * @param [in] visitor function called as visitor(const value_t&)
+     *
+     * @return true when key was found
+     */
+    template<typename visitor_t>
+    bool Visit(const value_t& key, visitor_t&& visitor) const
+    {
+      return this->Lookup(key.Hash(),
+        [&key](const value_t& item)
+        {
+          return item == key;
+        },
+        std::forward<visitor_t>(visitor)
+      );
+    }
+
+    /**
+     * Look string key up and pass stored value to visitor.
+     *
+     * Same as Visit(value_t(key), visitor), but does not box key.
+     */
+    template<typename visitor_t>
+    bool Visit(const std::string& key, visitor_t&& visitor) const
+    {
+      return this->Lookup(std::hash<std::string>()(key),
+        [&key](const value_t& item)
+        {
+          return (item.Type() == value_t::string) && (item.AsString() == key);
+        },
+        std::forward<visitor_t>(visitor)
+      );
+    }
+
+    /**
+     * Copy value stored by key.
+     *
+     * @throws std::runtime_error when stored value is a pointer
+     *
+     * @return true when key was found
+     */
+    template<typename key_t>
+    bool Find(const key_t& key, value_t& out) const
+    {
+      return this->Visit(key,
+        [&out](const value_t& value)
+        {
+          out = value;
+        }
+      );
+    }
+
+    /**
+     * Check if key is stored in map.
+     */
+    template<typename key_t>
+    bool Contains(const key_t& key) const
+    {
+      return this->Visit(key,
+        [](const value_t&)
+        {
+          ;
+        }
+      );
+    }
+
+    /**
+     * Insert value if key is not in map yet.
+     *
+     * @return true when value was inserted
+     */
+    bool Insert(value_t key, value_t value)
+    {
+      return this->Store(std::move(key), std::move(value), false);
+    }
+
+    /**
+     * Insert value or replace existing one.
+     *
+     * @return true when new key was inserted, false when value was replaced
+     */
+    bool Assign(value_t key, value_t value)
+    {
+      return this->Store(std::move(key), std::move(value), true);
+    }
+
+    /**
+     * Remove key from map.
+     *
+     * @return true when key was removed
+     */
+    bool Erase(const value_t& key)
+    {
+      const auto hash = Hash(key.Hash());
+      auto& shard = this->ShardOf(hash);
+      std::lock_guard<std::mutex> lock(shard.writer);
+
+      auto table = shard.table.load(std::memory_order_relaxed);
+      auto slot = table->Find(hash, key);
+      if (slot == nullptr)
+      {
+        return false;
+      }
+
+      value_t oldKey;
+      value_t oldValue;
+      {
+        writeGuard_t guard(shard);
+        oldKey = std::move(slot->key);
+        oldValue = std::move(slot->value);
+        slot->hash.store(tombstone, std::memory_order_relaxed);
+        --table->size;
+        shard.size.store(table->size, std::memory_order_relaxed);
+      }
+      this->domain.Retire(std::move(oldKey));
+      this->domain.Retire(std::move(oldValue));
+      return true;
+    }
+
+    /**
+     * Number of stored elements.
+     *
+     * Exact only when no writers are running.
+     */
+    std::size_t Size() const noexcept
+    {
+      std::size_t result = 0;
+      const auto count = std::size_t(1) << this->shardBits;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        result += this->shards[i].size.load(std::memory_order_relaxed);
+      }
+      return result;
+    }
+
+    /**
+     * Wait until values and tables removed from map by calling thread are destroyed.
+     *
+     * @see bvl::ebr::domain_t::Synchronize
+     */
+    void Reclaim()
+    {
+      this->domain.Synchronize();
+    }
+
+  private:
+
+    static constexpr std::uint64_t empty = 0;     /**< Hash of never used slot */
+    static constexpr std::uint64_t tombstone = 1; /**< Hash of erased slot */
+    static constexpr std::size_t minSlots = 16;   /**< Smallest shard table */
+    static constexpr std::size_t maxLoadNum = 1;  /**< Max share of used slots, numerator */
+    static constexpr std::size_t maxLoadDen = 2;  /**< Max share of used slots, denominator */
+
+    /**
+     * Map user hash to slot hash, which never equals empty or tombstone.
+     */
+    static std::uint64_t Hash(std::size_t hash) noexcept
+    {
+      auto result = detail::MixHash(hash);
+      return (result <= tombstone)? result + 2: result;
+    }
+
+    /**
+     * Table slot.
+     */
+    struct slot_t
+    {
+      std::atomic<std::uint64_t> hash; /**< Key hash, empty or tombstone */
+      value_t key;                     /**< Stored key */
+      value_t value;                   /**< Stored value */
+
+      slot_t()
+        : hash(empty)
+      {
+        ;
+      }
+    };
+
+    /**
+     * Open addressing table with linear probing.
+     */
+    struct table_t
+    {
+      std::size_t mask;                 /**< Number of slots minus one */
+      std::size_t used;                 /**< Live and erased slots */
+      std::size_t size;                 /**< Live slots */
+      std::unique_ptr<slot_t[]> slots;  /**< Slots */
+
+      explicit table_t(std::size_t count)
+        : mask(count - 1), used(0), size(0), slots(new slot_t[count])
+      {
+        ;
+      }
+
+      /**
+       * Find slot with given key. Only for writers.
+       */
+      slot_t* Find(std::uint64_t hash, const value_t& key) noexcept
+      {
+        for (auto index = hash & this->mask;; index = (index + 1) & this->mask)
+        {
+          auto& slot = this->slots[index];
+          auto slotHash = slot.hash.load(std::memory_order_relaxed);
+          if (slotHash == empty)
+          {
+            return nullptr;
+          }
+          if ((slotHash == hash) && (slot.key == key))
+          {
+            return &slot;
+          }
+        }
+      }
+
+      /**
+       * Move live slots of other table into this one. Only for writers.
+       */
+      void MoveFrom(table_t& src) noexcept
+      {
+        for (std::size_t i = 0; i <= src.mask; ++i)
+        {
+          auto& from = src.slots[i];
+          const auto hash = from.hash.load(std::memory_order_relaxed);
+          if ((hash == empty) || (hash == tombstone))
+          {
+            continue;
+          }
+          auto to = this->FindFree(hash);
+          to->key = std::move(from.key);
+          to->value = std::move(from.value);
+          to->hash.store(hash, std::memory_order_relaxed);
+          ++this->used;
+          ++this->size;
+        }
+      }
+
+      /**
+       * Find slot where new key can be placed. Only for writers.
+       */
+      slot_t* FindFree(std::uint64_t hash) noexcept
+      {
+        for (auto index = hash & this->mask;; index = (index + 1) & this->mask)
+        {
+          auto& slot = this->slots[index];
+          auto slotHash = slot.hash.load(std::memory_order_relaxed);
+          if ((slotHash == empty) || (slotHash == tombstone))
+          {
+            return &slot;
+          }
+        }
+      }
+    };
+
+    /**
+     * Map shard.
+     */
+    struct shard_t
+    {
+      std::atomic<std::uint64_t> seq;                  /**< Odd while writer modifies shard */
+      std::atomic<table_t*> table;                     /**< Current table */
+      std::atomic<std::size_t> size;                   /**< Copy of table size for Size() */
+      std::mutex writer;                               /**< Serializes writers */
+      char padding[64];                                /**< Keeps shards on separate cache lines */
+
+      shard_t()
+        : seq(0), table(nullptr), size(0)
+      {
+        ;
+      }
+    };
+
+    /**
+     * Marks shard as being modified while alive.
+     */
+    class writeGuard_t final
+    {
+    public:
+      explicit writeGuard_t(shard_t& shard) noexcept
+        : shard(shard), seq(shard.seq.load(std::memory_order_relaxed))
+      {
+        this->shard.seq.store(this->seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+      }
+
+      ~writeGuard_t()
+      {
+        this->shard.seq.store(this->seq + 2, std::memory_order_release);
+      }
+
+      writeGuard_t(const writeGuard_t&) = delete;
+      writeGuard_t& operator=(const writeGuard_t&) = delete;
+
+    private:
+      shard_t& shard;
+      std::uint64_t seq;
+    };
+
+    shard_t& ShardOf(std::uint64_t hash) const noexcept
+    {
+      return (this->shardBits == 0)? this->shards[0]: this->shards[hash >> (64 - this->shardBits)];
+    }
+
+    /**
+     * Optimistic lookup.
+     *
+     * Reader probes table without locks. When full hash matches, it takes
+     * snapshot of key and value and validates shard sequence before
+     * looking into snapshot, because slot could be changed under reader.
+     */
+    template<typename equal_t, typename visitor_t>
+    bool Lookup(std::size_t userHash, equal_t&& equal, visitor_t&& visitor) const
+    {
+      const auto hash = Hash(userHash);
+      const auto& shard = this->ShardOf(hash);
+      auto pin = this->domain.Pin();
+
+      detail::snapshot_t key;
+      detail::snapshot_t value;
+      unsigned spins = 0;
+      for (;;)
+      {
+        const auto seq = shard.seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0)
+        {
+          detail::Backoff(spins);
+          continue;
+        }
+
+        const auto table = shard.table.load(std::memory_order_acquire);
+        bool found = false;
+        bool valid = true;
+        auto index = hash & table->mask;
+        for (std::size_t probe = 0; probe <= table->mask; ++probe, index = (index + 1) & table->mask)
+        {
+          const auto& slot = table->slots[index];
+          const auto slotHash = slot.hash.load(std::memory_order_relaxed);
+          if (slotHash == empty)
+          {
+            break;
+          }
+          if (slotHash != hash)
+          {
+            continue;
+          }
+
+          key.Take(slot.key);
+          value.Take(slot.value);
+          std::atomic_thread_fence(std::memory_order_acquire);
+          if (shard.seq.load(std::memory_order_relaxed) != seq)
+          {
+            valid = false;
+            break;
+          }
+          if (equal(key.Get()))
+          {
+            found = true;
+            break;
+          }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!valid || (shard.seq.load(std::memory_order_relaxed) != seq))
+        {
+          detail::Backoff(spins);
+          continue;
+        }
+
+        if (found)
+        {
+          visitor(value.Get());
+        }
+        return found;
+      }
+    }
+
+    /**
+     * Insert or replace value under shard lock.
+     */
+    bool Store(value_t&& key, value_t&& value, bool replace)
+    {
+      const auto hash = Hash(key.Hash());
+      auto& shard = this->ShardOf(hash);
+      std::lock_guard<std::mutex> lock(shard.writer);
+
+      auto table = shard.table.load(std::memory_order_relaxed);
+      auto slot = table->Find(hash, key);
+      if (slot != nullptr)
+      {
+        if (!replace)
+        {
+          return false;
+        }
+        value_t oldValue;
+        {
+          writeGuard_t guard(shard);
+          oldValue = std::move(slot->value);
+          slot->value = std::move(value);
+        }
+        this->domain.Retire(std::move(oldValue));
+        return false;
+      }
+
+      std::unique_ptr<table_t> bigger;
+      if ((table->used + 1) * maxLoadDen > (table->mask + 1) * maxLoadNum)
+      {
+        // tombstones are dropped on rehash, so grow only when live slots need it
+        auto count = table->mask + 1;
+        if ((table->size + 1) * maxLoadDen * 2 > count * maxLoadNum)
+        {
+          count *= 2;
+        }
+        bigger.reset(new table_t(count));
+      }
+
+      table_t* retired = nullptr;
+      {
+        writeGuard_t guard(shard);
+        if (bigger)
+        {
+          retired = table;
+          table = bigger.release();
+          table->MoveFrom(*retired);
+          shard.table.store(table, std::memory_order_release);
+        }
+
+        slot = table->FindFree(hash);
+        if (slot->hash.load(std::memory_order_relaxed) == empty)
+        {
+          ++table->used;
+        }
+        slot->key = std::move(key);
+        slot->value = std::move(value);
+        slot->hash.store(hash, std::memory_order_relaxed);
+        ++table->size;
+        shard.size.store(table->size, std::memory_order_relaxed);
+      }
+
+      if (retired != nullptr)
+      {
+        this->domain.Retire(retired);
+      }
+      return true;
+    }
+
+    ebr::domain_t& domain;             /**< Where removed values go */
+    unsigned shardBits;                /**< log2 of shard count */
+    std::unique_ptr<shard_t[]> shards; /**< Shards */
+  };
+
+} // namespace bvl
+
+#endif /* BAD_VALUE_CMAP_HEADER */
@@ -0,0 +1,460 @@
+/**
+ * @file badval_codec.hpp
+ * @author masscry
+ *
+ * Codecs generated from compile-time message schemas.
+ *
+ * Schema is list of field types, like
+ *
+ *     using trade_t = bvl::codec::schema_t<u64_t, str_t, f64_t, i32_t>;
+ *
+ * Since field types are known to compiler, message is written without
+ * tag bytes (compare with bvl::serial). All fixed-size fields form one
+ * block in front of message, every field at offset computed at compile
+ * time, so encoder reserves block once and decoder checks its bounds
+ * once. Variable-size fields follow in schema order as varint size and
+ * bytes. Loops over fields are unrolled with index sequences.
+ *
+ *     message := fixed block, { varint size, bytes }
+ *
+ * Numbers are little-endian, floats are IEEE 754. Messages are held in
+ * std::tuple of field types, or in rows of bvl::value_t for use with
+ * other value containers. Row numbers are converted to field types,
+ * integer fields take only finite numbers in their range, and 64-bit
+ * integers above 2^53 lose precision in rows.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_CODEC_HEADER
+#define BAD_VALUE_CODEC_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace codec
+{
+
+  namespace detail
+  {
+
+    template<std::size_t size>
+    void Store(char* at, std::uint64_t bits) noexcept
+    {
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        at[i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+      }
+    }
+
+    template<std::size_t size>
+    std::uint64_t Load(const char* at) noexcept
+    {
+      std::uint64_t result = 0;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        result |= static_cast<std::uint64_t>(static_cast<unsigned char>(at[i])) << (8 * i);
+      }
+      return result;
+    }
+
+    /**
+     * Fixed-size integer field.
+     */
+    template<typename T>
+    struct integer_t
+    {
+      using type = T;                               /**< Field type */
+      static constexpr std::size_t size = sizeof(T); /**< Encoded size */
+
+      static void Store(char* at, T value) noexcept
+      {
+        detail::Store<size>(at, static_cast<std::uint64_t>(static_cast<typename std::make_unsigned<T>::type>(value)));
+      }
+
+      static T Load(const char* at) noexcept
+      {
+        return static_cast<T>(static_cast<typename std::make_unsigned<T>::type>(detail::Load<size>(at)));
+      }
+    };
+
+    /**
+     * Fixed-size float field.
+     */
+    template<typename T, typename bits_t>
+    struct floating_t
+    {
+      using type = T;                               /**< Field type */
+      static constexpr std::size_t size = sizeof(T); /**< Encoded size */
+
+      static void Store(char* at, T value) noexcept
+      {
+        bits_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        detail::Store<size>(at, bits);
+      }
+
+      static T Load(const char* at) noexcept
+      {
+        const auto bits = static_cast<bits_t>(detail::Load<size>(at));
+        T result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+      }
+    };
+
+  } // namespace detail
+
+  using i8_t = detail::integer_t<std::int8_t>;      /**< 8-bit signed integer */
+  using i16_t = detail::integer_t<std::int16_t>;    /**< 16-bit signed integer */
+  using i32_t = detail::integer_t<std::int32_t>;    /**< 32-bit signed integer */
+  using i64_t = detail::integer_t<std::int64_t>;    /**< 64-bit signed integer */
+  using u8_t = detail::integer_t<std::uint8_t>;     /**< 8-bit unsigned integer */
+  using u16_t = detail::integer_t<std::uint16_t>;   /**< 16-bit unsigned integer */
+  using u32_t = detail::integer_t<std::uint32_t>;   /**< 32-bit unsigned integer */
+  using u64_t = detail::integer_t<std::uint64_t>;   /**< 64-bit unsigned integer */
+  using f32_t = detail::floating_t<float, std::uint32_t>;    /**< Single precision float */
+  using f64_t = detail::floating_t<double, std::uint64_t>;   /**< Double precision float */
+
+  /**
+   * Boolean field, one byte.
+   */
+  struct bool_t
+  {
+    using type = bool;                    /**< Field type */
+    static constexpr std::size_t size = 1; /**< Encoded size */
+
+    static void Store(char* at, bool value) noexcept
+    {
+      *at = value? 1: 0;
+    }
+
+    static bool Load(const char* at) noexcept
+    {
+      return *at != 0;
+    }
+  };
+
+  /**
+   * String field, varint size and bytes.
+   */
+  struct str_t
+  {
+    using type = std::string;             /**< Field type */
+    static constexpr std::size_t size = 0; /**< Variable size */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Offset of field in fixed block, or size of block when index is field count.
+     */
+    template<typename... fields_t>
+    constexpr std::size_t Offset(std::size_t index) noexcept
+    {
+      const std::size_t sizes[] = { fields_t::size..., 0 };
+      std::size_t result = 0;
+      for (std::size_t i = 0; i < index; ++i)
+      {
+        result += sizes[i];
+      }
+      return result;
+    }
+
+    template<typename field_t>
+    using fixed_t = std::integral_constant<bool, (field_t::size != 0)>;
+
+    [[noreturn]] inline void Truncated()
+    {
+      throw std::runtime_error("Encoded message is truncated");
+    }
+
+    /*
+     * Typed fields, fixed ones are stored in block, variable ones are appended.
+     */
+
+    template<typename field_t>
+    void Put(std::string& out, std::size_t offset, const typename field_t::type& value, std::true_type) noexcept
+    {
+      field_t::Store(&out[offset], value);
+    }
+
+    template<typename field_t>
+    void Put(std::string& out, std::size_t, const std::string& value, std::false_type)
+    {
+      serial::PutVarint(out, value.size());
+      out.append(value);
+    }
+
+    template<typename field_t>
+    void Get(const char* block, std::size_t offset, const char*&, const char*, typename field_t::type& value, std::true_type) noexcept
+    {
+      value = field_t::Load(block + offset);
+    }
+
+    template<typename field_t>
+    void Get(const char*, std::size_t, const char*& cursor, const char* end, std::string& value, std::false_type)
+    {
+      std::uint64_t size;
+      if (!serial::GetVarint(cursor, end, size) || (static_cast<std::uint64_t>(end - cursor) < size))
+      {
+        Truncated();
+      }
+      value.assign(cursor, static_cast<std::size_t>(size));
+      cursor += size;
+    }
+
+    template<typename field_t>
+    std::size_t Variable(const typename field_t::type&, std::true_type) noexcept
+    {
+      return 0;
+    }
+
+    template<typename field_t>
+    std::size_t Variable(const std::string& value, std::false_type) noexcept
+    {
+      return serial::VarintSize(value.size()) + value.size();
+    }
+
+    /*
+     * Fields of value rows.
+     */
+
+    inline void Expect(const value_t& value, value_t::type_t type)
+    {
+      if (value.Type() != type)
+      {
+        throw std::invalid_argument("Row value has other type than schema field");
+      }
+    }
+
+    /**
+     * Number converts to integer field, other conversions are undefined.
+     */
+    template<typename T>
+    bool Fits(double number, std::true_type) noexcept
+    {
+      // max() of 64-bit types rounds up to 2^N as double, so compare with 2^N
+      const auto upper = (static_cast<double>(std::numeric_limits<T>::max() / 2) + 1.0) * 2.0;
+      return std::isfinite(number) && (number >= static_cast<double>(std::numeric_limits<T>::lowest())) && (number < upper);
+    }
+
+    template<typename T>
+    bool Fits(double, std::false_type) noexcept
+    {
+      return true;
+    }
+
+    template<typename field_t>
+    void PutValue(std::string& out, std::size_t offset, const value_t& value, std::true_type)
+    {
+      using type = typename field_t::type;
+      Expect(value, value_t::number);
+      const auto number = value.As<value_t::number>();
+      if (!Fits<type>(number, std::integral_constant<bool, std::is_integral<type>::value && !std::is_same<type, bool>::value>()))
+      {
+        throw std::invalid_argument("Row number does not fit schema field");
+      }
+      field_t::Store(&out[offset], static_cast<type>(number));
+    }
+
+    template<typename field_t>
+    void PutValue(std::string& out, std::size_t, const value_t& value, std::false_type)
+    {
+      Expect(value, value_t::string);
+      const auto& text = value.As<value_t::string>();
+      serial::PutVarint(out, text.size());
+      out.append(text);
+    }
+
+    template<typename field_t>
+    value_t GetValue(const char* block, std::size_t offset, const char*&, const char*, std::true_type) noexcept
+    {
+      return value_t(static_cast<double>(field_t::Load(block + offset)));
+    }
+
+    template<typename field_t>
+    value_t GetValue(const char*, std::size_t, const char*& cursor, const char* end, std::false_type)
+    {
+      std::uint64_t size;
+      if (!serial::GetVarint(cursor, end, size) || (static_cast<std::uint64_t>(end - cursor) < size))
+      {
+        Truncated();
+      }
+      const auto begin = cursor;
+      cursor += size;
+      return value_t(begin, static_cast<std::size_t>(size));
+    }
+
+  } // namespace detail
+
+  /**
+   * Codec of messages with fields of given types.
+   */
+  template<typename... fields_t>
+  class schema_t final
+  {
+  public:
+
+    /**
+     * Decoded message.
+     */
+    using message_t = std::tuple<typename fields_t::type...>;
+
+    /**
+     * Number of fields.
+     */
+    static constexpr std::size_t Size() noexcept
+    {
+      return sizeof...(fields_t);
+    }
+
+    /**
+     * Size of block with fixed-size fields.
+     */
+    static constexpr std::size_t FixedSize() noexcept
+    {
+      return detail::Offset<fields_t...>(sizeof...(fields_t));
+    }
+
+    /**
+     * Offset of fixed-size field in block.
+     */
+    static constexpr std::size_t Offset(std::size_t index) noexcept
+    {
+      return detail::Offset<fields_t...>(index);
+    }
+
+    /**
+     * Size of encoded message.
+     */
+    static std::size_t EncodedSize(const message_t& message) noexcept
+    {
+      return EncodedSize(message, index_t());
+    }
+
+    /**
+     * Append encoded message.
+     */
+    static void Encode(const message_t& message, std::string& out)
+    {
+      Encode(message, out, index_t());
+    }
+
+    /**
+     * Read encoded message and move cursor past it.
+     *
+     * @throws std::runtime_error when input is truncated
+     */
+    static void Decode(const char*& cursor, const char* end, message_t& message)
+    {
+      Decode(cursor, end, message, index_t());
+    }
+
+    /**
+     * Append encoded row, numbers are converted to field types.
+     *
+     * @throws std::invalid_argument when row does not match schema or
+     *         number does not fit integer field
+     */
+    static void Encode(const std::vector<value_t>& row, std::string& out)
+    {
+      if (row.size() != sizeof...(fields_t))
+      {
+        throw std::invalid_argument("Row size differs from schema field count");
+      }
+      Encode(row, out, index_t());
+    }
+
+    /**
+     * Read encoded message into row and move cursor past it.
+     *
+     * @throws std::runtime_error when input is truncated
+     */
+    static void Decode(const char*& cursor, const char* end, std::vector<value_t>& row)
+    {
+      Decode(cursor, end, row, index_t());
+    }
+
+  private:
+    using index_t = std::index_sequence_for<fields_t...>;
+    using expand_t = int[];
+
+    template<std::size_t... I>
+    static std::size_t EncodedSize(const message_t& message, std::index_sequence<I...>) noexcept
+    {
+      std::size_t result = FixedSize();
+      (void)expand_t{ 0, (result += detail::Variable<fields_t>(std::get<I>(message), detail::fixed_t<fields_t>()), 0)... };
+      return result;
+    }
+
+    template<std::size_t... I>
+    static void Encode(const message_t& message, std::string& out, std::index_sequence<I...>)
+    {
+      const auto base = out.size();
+      out.resize(base + FixedSize());
+      // block is addressed by offset, appended variable fields may move string
+      (void)expand_t{ 0, (detail::Put<fields_t>(out, base + Offset(I), std::get<I>(message), detail::fixed_t<fields_t>()), 0)... };
+    }
+
+    template<std::size_t... I>
+    static void Decode(const char*& cursor, const char* end, message_t& message, std::index_sequence<I...>)
+    {
+      if (static_cast<std::size_t>(end - cursor) < FixedSize())
+      {
+        detail::Truncated();
+      }
+      const char* block = cursor;
+      cursor += FixedSize();
+      (void)expand_t{ 0, (detail::Get<fields_t>(block, Offset(I), cursor, end, std::get<I>(message), detail::fixed_t<fields_t>()), 0)... };
+    }
+
+    template<std::size_t... I>
+    static void Encode(const std::vector<value_t>& row, std::string& out, std::index_sequence<I...>)
+    {
+      const auto base = out.size();
+      out.resize(base + FixedSize());
+      try
+      {
+        (void)expand_t{ 0, (detail::PutValue<fields_t>(out, base + Offset(I), row[I], detail::fixed_t<fields_t>()), 0)... };
+      }
+      catch (...)
+      {
+        out.resize(base);
+        throw;
+      }
+    }
+
+    template<std::size_t... I>
+    static void Decode(const char*& cursor, const char* end, std::vector<value_t>& row, std::index_sequence<I...>)
+    {
+      if (static_cast<std::size_t>(end - cursor) < FixedSize())
+      {
+        detail::Truncated();
+      }
+      const char* block = cursor;
+      const char* variable = cursor + FixedSize();
+      row.resize(sizeof...(fields_t));
+      (void)expand_t{ 0, (row[I] = detail::GetValue<fields_t>(block, Offset(I), variable, end, detail::fixed_t<fields_t>()), 0)... };
+      cursor = variable;
+    }
+  };
+
+} // namespace codec
+} // namespace bvl
+
+#endif /* BAD_VALUE_CODEC_HEADER */
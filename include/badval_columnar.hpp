@@ -0,0 +1,1482 @@
+/**
+ * @file badval_columnar.hpp
+ * @author masscry
+ *
+ * Columnar file of value tables.
+ *
+ * File layout:
+ *
+ *     [row group]...[row group][footer][trailer]
+ *
+ * Row group holds one chunk per column. Chunk is optional dictionary
+ * followed by pages of up to pageRows values. Every chunk picks own
+ * encodings, one for numbers and one for strings, by statistics of its
+ * values: the one with smallest estimated size wins.
+ *
+ * Number encodings:
+ *
+ *  - plain: fixed64 per number;
+ *  - dictionary: chunk dictionary of fixed64, bit-packed indexes;
+ *  - rle: varint run length, fixed64 number;
+ *  - delta: integers only, fixed64 first, fixed64 smallest delta,
+ *    bit-packed difference of deltas from smallest one;
+ *  - bitpacked: integers only, fixed64 smallest, bit-packed difference
+ *    from smallest one.
+ *
+ * String encodings:
+ *
+ *  - plain: varint size, bytes;
+ *  - dictionary: chunk dictionary of varint size and bytes, bit-packed
+ *    indexes;
+ *  - rle: varint run length, varint size, bytes;
+ *  - delta: varint prefix shared with previous string, varint suffix
+ *    size, suffix bytes.
+ *
+ * Page is varint row count, type map (byte 0 for numbers only, byte 1
+ * for strings only, byte 2 with varint count of runs of byte type and
+ * varint length), then varint size and bytes of number section and of
+ * string section, if page has any. Bit-packed values are little-endian
+ * bit stream prefixed with byte width.
+ *
+ * Footer has column names and, for every row group, row count and for
+ * every chunk encodings, dictionary place and pages: place, row count
+ * and zone map (bvl::zonemap::zone_t). Trailer is four fixed64: footer
+ * offset, footer size, row count and magic.
+ *
+ * Writer keeps in memory only current row group, which is flushed
+ * after rowGroupRows rows or rowGroupBytes bytes, and footer. Reader
+ * maps file, parses footer and decodes only pages of requested columns,
+ * skipping pages which zone maps rule out.
+ *
+ * Pointers have no meaning outside of process and can't be written.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_COLUMNAR_HEADER
+#define BAD_VALUE_COLUMNAR_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+#include <badval_zonemap.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bvl
+{
+namespace columnar
+{
+
+  /**
+   * Magic number at the end of file, "BVLCOL01".
+   */
+  constexpr std::uint64_t magic = 0x31304c4f434c5642ULL;
+
+  /**
+   * Trailer size in bytes.
+   */
+  constexpr std::size_t trailerSize = 4 * 8;
+
+  /**
+   * Value encodings of chunk.
+   */
+  enum encoding_t : unsigned char
+  {
+    plain = 0,     /**< Values as is */
+    dictionary,    /**< Indexes into chunk dictionary */
+    rle,           /**< Runs of equal values */
+    delta,         /**< Integer deltas, or prefixes shared with previous strings */
+    bitpacked      /**< Integers as offsets from smallest one */
+  };
+
+  /**
+   * File writing options.
+   */
+  struct options_t
+  {
+    std::size_t rowGroupRows = 65536;              /**< Rows buffered before row group is written */
+    std::size_t rowGroupBytes = 16 * 1024 * 1024;  /**< Approximate bytes buffered before row group is written */
+    std::size_t pageRows = 4096;                   /**< Rows per page */
+    std::size_t dictionaryLimit = 4096;            /**< Most distinct values in dictionary */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Bits needed to store number.
+     */
+    inline unsigned Bits(std::uint64_t num) noexcept
+    {
+      unsigned result = 0;
+      while (num != 0)
+      {
+        ++result;
+        num >>= 1;
+      }
+      return result;
+    }
+
+    /**
+     * Number is integer, which survives conversion to int64 and back.
+     */
+    inline bool Integral(double num) noexcept
+    {
+      return (std::floor(num) == num) && (std::fabs(num) <= 9007199254740992.0) && !((num == 0.0) && std::signbit(num));
+    }
+
+    inline std::uint64_t Bits(double num) noexcept
+    {
+      std::uint64_t result;
+      std::memcpy(&result, &num, sizeof(result));
+      return result;
+    }
+
+    inline double Number(std::uint64_t bits) noexcept
+    {
+      double result;
+      std::memcpy(&result, &bits, sizeof(result));
+      return result;
+    }
+
+    /**
+     * Append width byte and values of width bits, width is at most 56.
+     */
+    inline void Pack(std::string& out, const std::vector<std::uint64_t>& items, unsigned width)
+    {
+      out.push_back(static_cast<char>(width));
+      std::uint64_t acc = 0;
+      unsigned bits = 0;
+      for (const auto item: items)
+      {
+        acc |= item << bits;
+        bits += width;
+        while (bits >= 8)
+        {
+          out.push_back(static_cast<char>(acc & 0xFF));
+          acc >>= 8;
+          bits -= 8;
+        }
+      }
+      if (bits != 0)
+      {
+        out.push_back(static_cast<char>(acc & 0xFF));
+      }
+    }
+
+    [[noreturn]] inline void Malformed()
+    {
+      throw std::runtime_error("Columnar page is malformed");
+    }
+
+    /**
+     * Reader of bit-packed values.
+     */
+    class unpacker_t final
+    {
+    public:
+
+      /**
+       * Check that count values follow and move cursor past them.
+       */
+      unpacker_t(const char*& cursor, const char* end, std::size_t count)
+        : data(nullptr), size(0), width(0), pos(0)
+      {
+        if (cursor >= end)
+        {
+          Malformed();
+        }
+        this->width = static_cast<unsigned char>(*cursor++);
+        const auto bytes = (static_cast<std::uint64_t>(count) * this->width + 7) / 8;
+        if ((this->width > 56) || (static_cast<std::uint64_t>(end - cursor) < bytes))
+        {
+          Malformed();
+        }
+        this->data = reinterpret_cast<const unsigned char*>(cursor);
+        this->size = static_cast<std::size_t>(bytes);
+        cursor += bytes;
+      }
+
+      std::uint64_t Next() noexcept
+      {
+        const auto byte = static_cast<std::size_t>(this->pos / 8);
+        std::uint64_t word = 0;
+        if (byte + 8 <= this->size)
+        {
+          word = serial::DecodeFixed64(reinterpret_cast<const char*>(this->data + byte));
+        }
+        else
+        {
+          for (std::size_t i = byte; i < this->size; ++i)
+          {
+            word |= static_cast<std::uint64_t>(this->data[i]) << (8 * (i - byte));
+          }
+        }
+        const auto result = (word >> (this->pos % 8)) & ((std::uint64_t(1) << this->width) - 1);
+        this->pos += this->width;
+        return result;
+      }
+
+    private:
+      const unsigned char* data;  /**< Packed values */
+      std::size_t size;           /**< Packed bytes */
+      unsigned width;             /**< Bits per value */
+      std::uint64_t pos;          /**< Next bit */
+    };
+
+    inline std::uint64_t Varint(const char*& cursor, const char* end)
+    {
+      std::uint64_t result;
+      if (!serial::GetVarint(cursor, end, result))
+      {
+        Malformed();
+      }
+      return result;
+    }
+
+    inline std::uint64_t Fixed64(const char*& cursor, const char* end)
+    {
+      if (end - cursor < 8)
+      {
+        Malformed();
+      }
+      const auto result = serial::DecodeFixed64(cursor);
+      cursor += 8;
+      return result;
+    }
+
+    /**
+     * Bytes of given size, moves cursor past them.
+     */
+    inline const char* Bytes(const char*& cursor, const char* end, std::uint64_t size)
+    {
+      if (static_cast<std::uint64_t>(end - cursor) < size)
+      {
+        Malformed();
+      }
+      const auto result = cursor;
+      cursor += size;
+      return result;
+    }
+
+    /**
+     * Pick number encoding with smallest estimated size.
+     */
+    inline encoding_t ChooseNumbers(const std::vector<double>& numbers, std::size_t limit)
+    {
+      const auto count = static_cast<std::uint64_t>(numbers.size());
+      std::uint64_t runs = 0;
+      bool integral = true;
+      std::int64_t min = 0;
+      std::int64_t max = 0;
+      std::int64_t minDelta = 0;
+      std::int64_t maxDelta = 0;
+      std::unordered_map<std::uint64_t, std::uint32_t> distinct;
+      for (std::size_t i = 0; i < numbers.size(); ++i)
+      {
+        const auto bits = Bits(numbers[i]);
+        runs += ((i == 0) || (bits != Bits(numbers[i - 1])))? 1: 0;
+        if (distinct.size() <= limit)
+        {
+          distinct.emplace(bits, 0);
+        }
+        integral = integral && Integral(numbers[i]);
+        if (!integral)
+        {
+          continue;
+        }
+        const auto item = static_cast<std::int64_t>(numbers[i]);
+        min = (i == 0)? item: std::min(min, item);
+        max = (i == 0)? item: std::max(max, item);
+        if (i != 0)
+        {
+          const auto step = item - static_cast<std::int64_t>(numbers[i - 1]);
+          minDelta = (i == 1)? step: std::min(minDelta, step);
+          maxDelta = (i == 1)? step: std::max(maxDelta, step);
+        }
+      }
+
+      auto best = plain;
+      auto bestSize = 8 * count;
+      const auto consider = [&best, &bestSize](encoding_t encoding, std::uint64_t size)
+      {
+        if (size < bestSize)
+        {
+          best = encoding;
+          bestSize = size;
+        }
+      };
+      if (distinct.size() <= limit)
+      {
+        const auto width = Bits(distinct.empty()? 0: distinct.size() - 1);
+        consider(dictionary, 8 * distinct.size() + (count * width + 7) / 8);
+      }
+      consider(rle, 10 * runs);
+      if (integral && (count != 0))
+      {
+        consider(delta, 16 + ((count - 1) * Bits(static_cast<std::uint64_t>(maxDelta - minDelta)) + 7) / 8);
+        consider(bitpacked, 8 + (count * Bits(static_cast<std::uint64_t>(max - min)) + 7) / 8);
+      }
+      return best;
+    }
+
+    /**
+     * Pick string encoding with smallest estimated size.
+     */
+    inline encoding_t ChooseStrings(const std::vector<const std::string*>& strings, std::size_t limit)
+    {
+      std::uint64_t plainSize = 0;
+      std::uint64_t rleSize = 0;
+      std::uint64_t deltaSize = 0;
+      std::uint64_t dictionarySize = 0;
+      std::unordered_map<std::string, std::uint32_t> distinct;
+      for (std::size_t i = 0; i < strings.size(); ++i)
+      {
+        const auto& text = *strings[i];
+        const auto size = serial::VarintSize(text.size()) + text.size();
+        plainSize += size;
+        if ((i == 0) || (text != *strings[i - 1]))
+        {
+          rleSize += 1 + size;
+        }
+        std::size_t shared = 0;
+        if (i != 0)
+        {
+          const auto& prev = *strings[i - 1];
+          const auto common = std::min(prev.size(), text.size());
+          while ((shared < common) && (prev[shared] == text[shared]))
+          {
+            ++shared;
+          }
+        }
+        deltaSize += serial::VarintSize(shared) + serial::VarintSize(text.size() - shared) + text.size() - shared;
+        if ((distinct.size() <= limit) && distinct.emplace(text, 0).second)
+        {
+          dictionarySize += size;
+        }
+      }
+
+      auto best = plain;
+      auto bestSize = plainSize;
+      const auto consider = [&best, &bestSize](encoding_t encoding, std::uint64_t size)
+      {
+        if (size < bestSize)
+        {
+          best = encoding;
+          bestSize = size;
+        }
+      };
+      if (distinct.size() <= limit)
+      {
+        const auto width = Bits(distinct.empty()? 0: distinct.size() - 1);
+        consider(dictionary, dictionarySize + (strings.size() * width + 7) / 8);
+      }
+      consider(rle, rleSize);
+      consider(delta, deltaSize);
+      return best;
+    }
+
+    /**
+     * Append number section of page.
+     */
+    inline void EncodeNumbers(std::string& out, encoding_t encoding, const double* numbers, std::size_t count,
+      const std::unordered_map<std::uint64_t, std::uint32_t>& ids)
+    {
+      std::vector<std::uint64_t> packed;
+      switch (encoding)
+      {
+        case plain:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            serial::PutFixed64(out, Bits(numbers[i]));
+          }
+          break;
+        case dictionary:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            packed.push_back(ids.at(Bits(numbers[i])));
+          }
+          Pack(out, packed, Bits(ids.empty()? 0: ids.size() - 1));
+          break;
+        case rle:
+          for (std::size_t i = 0; i < count;)
+          {
+            auto end = i + 1;
+            while ((end < count) && (Bits(numbers[end]) == Bits(numbers[i])))
+            {
+              ++end;
+            }
+            serial::PutVarint(out, end - i);
+            serial::PutFixed64(out, Bits(numbers[i]));
+            i = end;
+          }
+          break;
+        case delta:
+          {
+            std::int64_t minDelta = 0;
+            for (std::size_t i = 1; i < count; ++i)
+            {
+              const auto step = static_cast<std::int64_t>(numbers[i]) - static_cast<std::int64_t>(numbers[i - 1]);
+              minDelta = (i == 1)? step: std::min(minDelta, step);
+            }
+            std::uint64_t widest = 0;
+            for (std::size_t i = 1; i < count; ++i)
+            {
+              const auto step = static_cast<std::int64_t>(numbers[i]) - static_cast<std::int64_t>(numbers[i - 1]);
+              packed.push_back(static_cast<std::uint64_t>(step - minDelta));
+              widest = std::max(widest, packed.back());
+            }
+            serial::PutFixed64(out, static_cast<std::uint64_t>(static_cast<std::int64_t>(numbers[0])));
+            serial::PutFixed64(out, static_cast<std::uint64_t>(minDelta));
+            Pack(out, packed, Bits(widest));
+          }
+          break;
+        default:
+          {
+            auto min = static_cast<std::int64_t>(numbers[0]);
+            for (std::size_t i = 1; i < count; ++i)
+            {
+              min = std::min(min, static_cast<std::int64_t>(numbers[i]));
+            }
+            std::uint64_t widest = 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              packed.push_back(static_cast<std::uint64_t>(static_cast<std::int64_t>(numbers[i]) - min));
+              widest = std::max(widest, packed.back());
+            }
+            serial::PutFixed64(out, static_cast<std::uint64_t>(min));
+            Pack(out, packed, Bits(widest));
+          }
+          break;
+      }
+    }
+
+    /**
+     * Append string section of page.
+     */
+    inline void EncodeStrings(std::string& out, encoding_t encoding, const std::string* const* strings, std::size_t count,
+      const std::unordered_map<std::string, std::uint32_t>& ids)
+    {
+      std::vector<std::uint64_t> packed;
+      switch (encoding)
+      {
+        case plain:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            serial::PutVarint(out, strings[i]->size());
+            out.append(*strings[i]);
+          }
+          break;
+        case dictionary:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            packed.push_back(ids.at(*strings[i]));
+          }
+          Pack(out, packed, Bits(ids.empty()? 0: ids.size() - 1));
+          break;
+        case rle:
+          for (std::size_t i = 0; i < count;)
+          {
+            auto end = i + 1;
+            while ((end < count) && (*strings[end] == *strings[i]))
+            {
+              ++end;
+            }
+            serial::PutVarint(out, end - i);
+            serial::PutVarint(out, strings[i]->size());
+            out.append(*strings[i]);
+            i = end;
+          }
+          break;
+        default:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            std::size_t shared = 0;
+            if (i != 0)
+            {
+              const auto common = std::min(strings[i]->size(), strings[i - 1]->size());
+              while ((shared < common) && ((*strings[i])[shared] == (*strings[i - 1])[shared]))
+              {
+                ++shared;
+              }
+            }
+            serial::PutVarint(out, shared);
+            serial::PutVarint(out, strings[i]->size() - shared);
+            out.append(*strings[i], shared, std::string::npos);
+          }
+          break;
+      }
+    }
+
+    /**
+     * Decode number section, call sink(double) for every number.
+     */
+    template<typename sink_t>
+    void DecodeNumbers(const char* cursor, const char* end, encoding_t encoding, std::size_t count,
+      const std::vector<double>& words, sink_t&& sink)
+    {
+      switch (encoding)
+      {
+        case plain:
+          {
+            const auto items = Bytes(cursor, end, 8 * static_cast<std::uint64_t>(count));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              sink(Number(serial::DecodeFixed64(items + 8 * i)));
+            }
+          }
+          break;
+        case dictionary:
+          {
+            unpacker_t unpacker(cursor, end, count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              const auto id = unpacker.Next();
+              if (id >= words.size())
+              {
+                Malformed();
+              }
+              sink(words[static_cast<std::size_t>(id)]);
+            }
+          }
+          break;
+        case rle:
+          for (std::size_t i = 0; i < count;)
+          {
+            const auto length = Varint(cursor, end);
+            const auto number = Number(Fixed64(cursor, end));
+            if ((length == 0) || (length > count - i))
+            {
+              Malformed();
+            }
+            for (std::uint64_t j = 0; j < length; ++j)
+            {
+              sink(number);
+            }
+            i += static_cast<std::size_t>(length);
+          }
+          break;
+        case delta:
+          {
+            auto current = static_cast<std::int64_t>(Fixed64(cursor, end));
+            const auto minDelta = static_cast<std::int64_t>(Fixed64(cursor, end));
+            unpacker_t unpacker(cursor, end, count - 1);
+            sink(static_cast<double>(current));
+            for (std::size_t i = 1; i < count; ++i)
+            {
+              current = static_cast<std::int64_t>(static_cast<std::uint64_t>(current) + static_cast<std::uint64_t>(minDelta) + unpacker.Next());
+              sink(static_cast<double>(current));
+            }
+          }
+          break;
+        case bitpacked:
+          {
+            const auto min = Fixed64(cursor, end);
+            unpacker_t unpacker(cursor, end, count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              sink(static_cast<double>(static_cast<std::int64_t>(min + unpacker.Next())));
+            }
+          }
+          break;
+        default:
+          Malformed();
+      }
+    }
+
+    /**
+     * Decode string section, call sink(const char* data, std::size_t size)
+     * for every string.
+     */
+    template<typename sink_t>
+    void DecodeStrings(const char* cursor, const char* end, encoding_t encoding, std::size_t count,
+      const std::vector<std::string>& words, sink_t&& sink)
+    {
+      switch (encoding)
+      {
+        case plain:
+          for (std::size_t i = 0; i < count; ++i)
+          {
+            const auto size = Varint(cursor, end);
+            const auto data = Bytes(cursor, end, size);
+            sink(data, static_cast<std::size_t>(size));
+          }
+          break;
+        case dictionary:
+          {
+            unpacker_t unpacker(cursor, end, count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              const auto id = unpacker.Next();
+              if (id >= words.size())
+              {
+                Malformed();
+              }
+              const auto& text = words[static_cast<std::size_t>(id)];
+              sink(text.data(), text.size());
+            }
+          }
+          break;
+        case rle:
+          for (std::size_t i = 0; i < count;)
+          {
+            const auto length = Varint(cursor, end);
+            const auto size = Varint(cursor, end);
+            const auto data = Bytes(cursor, end, size);
+            if ((length == 0) || (length > count - i))
+            {
+              Malformed();
+            }
+            for (std::uint64_t j = 0; j < length; ++j)
+            {
+              sink(data, static_cast<std::size_t>(size));
+            }
+            i += static_cast<std::size_t>(length);
+          }
+          break;
+        case delta:
+          {
+            std::string current;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+              const auto shared = Varint(cursor, end);
+              const auto size = Varint(cursor, end);
+              const auto data = Bytes(cursor, end, size);
+              if (shared > current.size())
+              {
+                Malformed();
+              }
+              current.resize(static_cast<std::size_t>(shared));
+              current.append(data, static_cast<std::size_t>(size));
+              sink(current.data(), current.size());
+            }
+          }
+          break;
+        default:
+          Malformed();
+      }
+    }
+
+    inline void PutZone(std::string& out, const zonemap::zone_t& zone)
+    {
+      serial::PutVarint(out, zone.count);
+      serial::PutVarint(out, zone.types);
+      serial::PutVarint(out, zone.numbers);
+      serial::PutVarint(out, zone.strings);
+      serial::PutFixed64(out, Bits(zone.min));
+      serial::PutFixed64(out, Bits(zone.max));
+      serial::PutVarint(out, zone.minPrefix.size());
+      out.append(zone.minPrefix);
+      serial::PutVarint(out, zone.maxPrefix.size());
+      out.append(zone.maxPrefix);
+    }
+
+    inline zonemap::zone_t GetZone(const char*& cursor, const char* end)
+    {
+      zonemap::zone_t zone;
+      zone.count = static_cast<std::uint32_t>(Varint(cursor, end));
+      zone.types = static_cast<std::uint32_t>(Varint(cursor, end));
+      zone.numbers = static_cast<std::uint32_t>(Varint(cursor, end));
+      zone.strings = static_cast<std::uint32_t>(Varint(cursor, end));
+      zone.min = Number(Fixed64(cursor, end));
+      zone.max = Number(Fixed64(cursor, end));
+      auto size = Varint(cursor, end);
+      zone.minPrefix.assign(Bytes(cursor, end, size), static_cast<std::size_t>(size));
+      size = Varint(cursor, end);
+      zone.maxPrefix.assign(Bytes(cursor, end, size), static_cast<std::size_t>(size));
+      return zone;
+    }
+
+  } // namespace detail
+
+  /**
+   * Streaming file writer.
+   *
+   * Rows are buffered until row group is full, then every column is
+   * encoded and written. Memory use is bounded by row group limits.
+   * File is complete only after Finish.
+   */
+  class writer_t final
+  {
+  public:
+
+    /**
+     * Create file.
+     *
+     * @throws std::invalid_argument when there are no columns
+     * @throws std::runtime_error when file can't be created
+     */
+    writer_t(const std::string& path, std::vector<std::string> columns, options_t options = options_t())
+      : options(options), names(std::move(columns)), file(nullptr),
+        offset(0), rows(0), buffered(0), groups(0), finished(false)
+    {
+      if (this->names.empty())
+      {
+        throw std::invalid_argument("Columnar file needs columns");
+      }
+      this->file = std::fopen(path.c_str(), "wb");
+      if (this->file == nullptr)
+      {
+        throw std::runtime_error("Can't create columnar file " + path);
+      }
+      this->options.pageRows = std::max<std::size_t>(1, this->options.pageRows);
+      this->options.rowGroupRows = std::max<std::size_t>(1, this->options.rowGroupRows);
+      this->values.resize(this->names.size());
+    }
+
+    writer_t(const writer_t&) = delete;
+    writer_t& operator=(const writer_t&) = delete;
+
+    /**
+     * Destructor. Closes file, which is incomplete without Finish.
+     */
+    ~writer_t()
+    {
+      std::fclose(this->file);
+    }
+
+    /**
+     * Add row, one value per column.
+     *
+     * @throws std::invalid_argument when row size differs from column count
+     * @throws std::runtime_error when row has pointer, or on write error
+     */
+    void Append(std::vector<value_t> row)
+    {
+      if (this->finished)
+      {
+        throw std::logic_error("Columnar file is already finished");
+      }
+      if (row.size() != this->names.size())
+      {
+        throw std::invalid_argument("Row size differs from column count");
+      }
+      for (const auto& value: row)
+      {
+        this->buffered += serial::EncodedSize(value);
+      }
+      for (std::size_t column = 0; column < row.size(); ++column)
+      {
+        this->values[column].push_back(std::move(row[column]));
+      }
+      ++this->rows;
+      if ((this->values.front().size() >= this->options.rowGroupRows) || (this->buffered >= this->options.rowGroupBytes))
+      {
+        this->FlushGroup();
+      }
+    }
+
+    /**
+     * Write rest of rows, footer and trailer.
+     *
+     * @throws std::runtime_error on write error
+     */
+    void Finish()
+    {
+      if (this->finished)
+      {
+        return;
+      }
+      this->FlushGroup();
+
+      std::string footer;
+      serial::PutVarint(footer, this->names.size());
+      for (const auto& name: this->names)
+      {
+        serial::PutVarint(footer, name.size());
+        footer.append(name);
+      }
+      serial::PutVarint(footer, this->groups);
+      footer.append(this->index);
+
+      const auto footerOffset = this->offset;
+      this->Write(footer);
+      std::string trailer;
+      serial::PutFixed64(trailer, footerOffset);
+      serial::PutFixed64(trailer, footer.size());
+      serial::PutFixed64(trailer, this->rows);
+      serial::PutFixed64(trailer, magic);
+      this->Write(trailer);
+
+      if (std::fflush(this->file) != 0)
+      {
+        throw std::runtime_error("Can't write columnar file");
+      }
+      this->finished = true;
+    }
+
+    /**
+     * Flush file to storage device. Call after Finish.
+     *
+     * @throws std::runtime_error on error
+     */
+    void Sync()
+    {
+      if ((std::fflush(this->file) != 0) || (::fsync(::fileno(this->file)) != 0))
+      {
+        throw std::runtime_error("Can't sync columnar file");
+      }
+    }
+
+    /**
+     * Number of added rows.
+     */
+    std::uint64_t Rows() const noexcept
+    {
+      return this->rows;
+    }
+
+    /**
+     * Bytes written to file so far.
+     */
+    std::uint64_t FileSize() const noexcept
+    {
+      return this->offset;
+    }
+
+  private:
+
+    void Write(const std::string& data)
+    {
+      if (!data.empty() && (std::fwrite(data.data(), 1, data.size(), this->file) != data.size()))
+      {
+        throw std::runtime_error("Can't write columnar file");
+      }
+      this->offset += data.size();
+    }
+
+    /**
+     * Write buffered rows as row group.
+     */
+    void FlushGroup()
+    {
+      const auto groupRows = this->values.front().size();
+      if (groupRows == 0)
+      {
+        return;
+      }
+      serial::PutVarint(this->index, groupRows);
+      for (auto& column: this->values)
+      {
+        this->WriteChunk(column);
+        std::vector<value_t>().swap(column);
+      }
+      ++this->groups;
+      this->buffered = 0;
+    }
+
+    /**
+     * Write dictionary and pages of column chunk, append chunk to index.
+     */
+    void WriteChunk(const std::vector<value_t>& column)
+    {
+      std::vector<double> numbers;
+      std::vector<const std::string*> strings;
+      for (const auto& value: column)
+      {
+        if (value.Type() == value_t::number)
+        {
+          numbers.push_back(value.As<value_t::number>());
+        }
+        else
+        {
+          strings.push_back(&value.As<value_t::string>());
+        }
+      }
+      const auto numberEncoding = detail::ChooseNumbers(numbers, this->options.dictionaryLimit);
+      const auto stringEncoding = detail::ChooseStrings(strings, this->options.dictionaryLimit);
+
+      // dictionaries in order of first use
+      std::string chunk;
+      std::unordered_map<std::uint64_t, std::uint32_t> numberIds;
+      std::unordered_map<std::string, std::uint32_t> stringIds;
+      if (numberEncoding == dictionary)
+      {
+        std::string items;
+        for (const auto number: numbers)
+        {
+          if (numberIds.emplace(detail::Bits(number), static_cast<std::uint32_t>(numberIds.size())).second)
+          {
+            serial::PutFixed64(items, detail::Bits(number));
+          }
+        }
+        chunk.append(items);
+      }
+      if (stringEncoding == dictionary)
+      {
+        std::string items;
+        for (const auto text: strings)
+        {
+          if (stringIds.emplace(*text, static_cast<std::uint32_t>(stringIds.size())).second)
+          {
+            serial::PutVarint(items, text->size());
+            items.append(*text);
+          }
+        }
+        chunk.append(items);
+      }
+
+      std::string pages;
+      std::size_t numberPos = 0;
+      std::size_t stringPos = 0;
+      for (std::size_t begin = 0; begin < column.size(); begin += this->options.pageRows)
+      {
+        const auto end = std::min(column.size(), begin + this->options.pageRows);
+        const auto pageOffset = chunk.size();
+        zonemap::zone_t zone;
+        std::vector<std::pair<unsigned char, std::uint64_t>> runs;
+        for (auto row = begin; row < end; ++row)
+        {
+          zone.Add(column[row]);
+          const auto type = static_cast<unsigned char>((column[row].Type() == value_t::number)? 0: 1);
+          if (runs.empty() || (runs.back().first != type))
+          {
+            runs.emplace_back(type, 0);
+          }
+          ++runs.back().second;
+        }
+
+        serial::PutVarint(chunk, end - begin);
+        if (runs.size() == 1)
+        {
+          chunk.push_back(static_cast<char>(runs.front().first));
+        }
+        else
+        {
+          chunk.push_back(2);
+          serial::PutVarint(chunk, runs.size());
+          for (const auto& run: runs)
+          {
+            chunk.push_back(static_cast<char>(run.first));
+            serial::PutVarint(chunk, run.second);
+          }
+        }
+        std::string section;
+        if (zone.numbers != 0)
+        {
+          detail::EncodeNumbers(section, numberEncoding, numbers.data() + numberPos, zone.numbers, numberIds);
+          serial::PutVarint(chunk, section.size());
+          chunk.append(section);
+          numberPos += zone.numbers;
+        }
+        if (zone.strings != 0)
+        {
+          section.clear();
+          detail::EncodeStrings(section, stringEncoding, strings.data() + stringPos, zone.strings, stringIds);
+          serial::PutVarint(chunk, section.size());
+          chunk.append(section);
+          stringPos += zone.strings;
+        }
+
+        serial::PutVarint(pages, this->offset + pageOffset);
+        serial::PutVarint(pages, chunk.size() - pageOffset);
+        detail::PutZone(pages, zone);
+      }
+
+      this->index.push_back(static_cast<char>(numberEncoding));
+      this->index.push_back(static_cast<char>(stringEncoding));
+      serial::PutVarint(this->index, this->offset);
+      serial::PutVarint(this->index, numberIds.size());
+      serial::PutVarint(this->index, stringIds.size());
+      serial::PutVarint(this->index, (column.size() + this->options.pageRows - 1) / this->options.pageRows);
+      this->index.append(pages);
+      this->Write(chunk);
+    }
+
+    options_t options;                          /**< Writing options */
+    std::vector<std::string> names;             /**< Column names */
+    std::FILE* file;                            /**< Output file */
+    std::uint64_t offset;                       /**< Bytes written */
+    std::uint64_t rows;                         /**< Rows added */
+    std::size_t buffered;                       /**< Encoded size of buffered rows */
+    std::uint64_t groups;                       /**< Row groups written */
+    bool finished;                              /**< Footer written */
+    std::vector<std::vector<value_t>> values;   /**< Buffered rows, by column */
+    std::string index;                          /**< Footer part about row groups */
+  };
+
+  /**
+   * Memory mapped file reader.
+   *
+   * Reader is immutable after construction, so it can be used from many
+   * threads at once.
+   */
+  class file_t final
+  {
+  public:
+
+    /**
+     * Page of column chunk.
+     */
+    struct page_t
+    {
+      const char* data;       /**< Page bytes, point into file */
+      std::size_t size;       /**< Page size */
+      std::uint64_t firstRow; /**< Row of first value */
+      zonemap::zone_t zone;   /**< Summary of page values */
+    };
+
+    /**
+     * Values of one column in one row group.
+     */
+    struct chunk_t
+    {
+      encoding_t numbers;            /**< Number encoding */
+      encoding_t strings;            /**< String encoding */
+      const char* data;              /**< Dictionaries, point into file */
+      std::size_t numberDictionary;  /**< Numbers in dictionary */
+      std::size_t stringDictionary;  /**< Strings in dictionary */
+      std::vector<page_t> pages;     /**< Pages */
+    };
+
+    /**
+     * Open file.
+     *
+     * @throws std::runtime_error when file can't be opened or is malformed
+     */
+    explicit file_t(const std::string& path)
+      : data(nullptr), size(0), rows(0)
+    {
+      auto fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        throw std::runtime_error("Can't open columnar file " + path);
+      }
+      struct stat info;
+      if (::fstat(fd, &info) != 0)
+      {
+        ::close(fd);
+        throw std::runtime_error("Can't stat columnar file " + path);
+      }
+      this->size = static_cast<std::size_t>(info.st_size);
+      if (this->size < trailerSize)
+      {
+        ::close(fd);
+        throw std::runtime_error("Columnar file is too small " + path);
+      }
+      auto mapped = ::mmap(nullptr, this->size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (mapped == MAP_FAILED)
+      {
+        throw std::runtime_error("Can't map columnar file " + path);
+      }
+      this->data = static_cast<const char*>(mapped);
+
+      try
+      {
+        this->Load();
+      }
+      catch (...)
+      {
+        ::munmap(mapped, this->size);
+        throw;
+      }
+    }
+
+    file_t(const file_t&) = delete;
+    file_t& operator=(const file_t&) = delete;
+
+    /**
+     * Destructor. Unmaps file.
+     */
+    ~file_t()
+    {
+      ::munmap(const_cast<char*>(this->data), this->size);
+    }
+
+    /**
+     * Number of rows.
+     */
+    std::uint64_t Rows() const noexcept
+    {
+      return this->rows;
+    }
+
+    /**
+     * Size of file.
+     */
+    std::size_t FileSize() const noexcept
+    {
+      return this->size;
+    }
+
+    /**
+     * Column names.
+     */
+    const std::vector<std::string>& Columns() const noexcept
+    {
+      return this->names;
+    }
+
+    /**
+     * Index of named column.
+     *
+     * @throws std::out_of_range when there is no such column
+     */
+    std::size_t Column(const std::string& name) const
+    {
+      const auto it = std::find(this->names.begin(), this->names.end(), name);
+      if (it == this->names.end())
+      {
+        throw std::out_of_range("No column " + name);
+      }
+      return static_cast<std::size_t>(it - this->names.begin());
+    }
+
+    /**
+     * Number of row groups.
+     */
+    std::size_t RowGroups() const noexcept
+    {
+      return (this->names.empty())? 0: this->chunks.size() / this->names.size();
+    }
+
+    /**
+     * Chunk of column in row group.
+     */
+    const chunk_t& Chunk(std::size_t group, std::size_t column) const
+    {
+      return this->chunks.at(group * this->names.size() + column);
+    }
+
+    /**
+     * Append all values of column to out.
+     *
+     * @throws std::runtime_error when file is malformed
+     */
+    void Read(std::size_t column, std::vector<value_t>& out) const
+    {
+      out.reserve(out.size() + static_cast<std::size_t>(this->rows));
+      std::vector<double> numbers;
+      std::vector<std::string> strings;
+      for (std::size_t group = 0; group < this->RowGroups(); ++group)
+      {
+        const auto& chunk = this->Chunk(group, column);
+        this->Dictionaries(chunk, numbers, strings);
+        for (const auto& page: chunk.pages)
+        {
+          this->Decode(chunk, page, numbers, strings, out);
+        }
+      }
+    }
+
+    /**
+     * Call visitor(std::uint64_t row, const value_t& value) for values of
+     * column matching predicate in row order, stop when visitor returns
+     * false. Pages which zones rule out are not decoded.
+     *
+     * @param skip false to decode every page, ignoring zones
+     *
+     * @return stats with pages as blocks
+     */
+    template<typename visitor_t>
+    zonemap::stats_t Scan(std::size_t column, const zonemap::predicate_t& predicate, visitor_t&& visitor, bool skip = true) const
+    {
+      zonemap::stats_t stats;
+      std::vector<double> numbers;
+      std::vector<std::string> strings;
+      std::vector<value_t> values;
+      for (std::size_t group = 0; group < this->RowGroups(); ++group)
+      {
+        const auto& chunk = this->Chunk(group, column);
+        bool loaded = false;
+        stats.blocks += chunk.pages.size();
+        for (const auto& page: chunk.pages)
+        {
+          if (skip && !predicate.MayMatch(page.zone))
+          {
+            ++stats.skipped;
+            continue;
+          }
+          if (!loaded)
+          {
+            this->Dictionaries(chunk, numbers, strings);
+            loaded = true;
+          }
+          values.clear();
+          this->Decode(chunk, page, numbers, strings, values);
+          stats.checked += values.size();
+          for (std::size_t i = 0; i < values.size(); ++i)
+          {
+            if (predicate.Matches(values[i]))
+            {
+              ++stats.matched;
+              if (!visitor(page.firstRow + i, values[i]))
+              {
+                return stats;
+              }
+            }
+          }
+        }
+      }
+      return stats;
+    }
+
+  private:
+
+    /**
+     * Decode dictionaries of chunk.
+     */
+    void Dictionaries(const chunk_t& chunk, std::vector<double>& numbers, std::vector<std::string>& strings) const
+    {
+      numbers.clear();
+      strings.clear();
+      auto cursor = chunk.data;
+      const auto end = chunk.pages.empty()? this->data + this->footer: chunk.pages.front().data;
+      for (std::size_t i = 0; i < chunk.numberDictionary; ++i)
+      {
+        numbers.push_back(detail::Number(detail::Fixed64(cursor, end)));
+      }
+      for (std::size_t i = 0; i < chunk.stringDictionary; ++i)
+      {
+        const auto size = detail::Varint(cursor, end);
+        strings.emplace_back(detail::Bytes(cursor, end, size), static_cast<std::size_t>(size));
+      }
+    }
+
+    /**
+     * Append values of page to out.
+     */
+    void Decode(const chunk_t& chunk, const page_t& page, const std::vector<double>& numbers,
+      const std::vector<std::string>& strings, std::vector<value_t>& out) const
+    {
+      auto cursor = page.data;
+      const auto end = page.data + page.size;
+      const auto count = detail::Varint(cursor, end);
+      if (cursor == end)
+      {
+        detail::Malformed();
+      }
+      std::vector<std::pair<unsigned char, std::uint64_t>> runs;
+      const auto mode = static_cast<unsigned char>(*cursor++);
+      if (mode < 2)
+      {
+        runs.emplace_back(mode, count);
+      }
+      else
+      {
+        const auto runCount = detail::Varint(cursor, end);
+        std::uint64_t total = 0;
+        for (std::uint64_t i = 0; (i < runCount) && (total <= count); ++i)
+        {
+          if (cursor == end)
+          {
+            detail::Malformed();
+          }
+          const auto type = static_cast<unsigned char>(*cursor++);
+          runs.emplace_back(type, detail::Varint(cursor, end));
+          total += runs.back().second;
+          if (type > 1)
+          {
+            detail::Malformed();
+          }
+        }
+        if (total != count)
+        {
+          detail::Malformed();
+        }
+      }
+      if ((count != page.zone.count) || (mode > 2))
+      {
+        detail::Malformed();
+      }
+
+      const char* sections[2] = { nullptr, nullptr };
+      const char* ends[2] = { nullptr, nullptr };
+      const std::size_t counts[2] = { page.zone.numbers, page.zone.strings };
+      for (int type = 0; type < 2; ++type)
+      {
+        if (counts[type] != 0)
+        {
+          const auto sectionSize = detail::Varint(cursor, end);
+          sections[type] = detail::Bytes(cursor, end, sectionSize);
+          ends[type] = cursor;
+        }
+      }
+
+      // single type pages are decoded right into values
+      if (runs.size() == 1)
+      {
+        if (counts[runs.front().first] != count)
+        {
+          detail::Malformed();
+        }
+        if (runs.front().first == 0)
+        {
+          detail::DecodeNumbers(sections[0], ends[0], chunk.numbers, counts[0], numbers,
+            [&out](double number)
+            {
+              out.emplace_back(number);
+            }
+          );
+        }
+        else
+        {
+          detail::DecodeStrings(sections[1], ends[1], chunk.strings, counts[1], strings,
+            [&out](const char* text, std::size_t size)
+            {
+              out.emplace_back(text, size);
+            }
+          );
+        }
+        return;
+      }
+
+      std::vector<value_t> decoded[2];
+      if ((counts[0] == 0) || (counts[1] == 0))
+      {
+        detail::Malformed();
+      }
+      detail::DecodeNumbers(sections[0], ends[0], chunk.numbers, counts[0], numbers,
+        [&decoded](double number)
+        {
+          decoded[0].emplace_back(number);
+        }
+      );
+      detail::DecodeStrings(sections[1], ends[1], chunk.strings, counts[1], strings,
+        [&decoded](const char* text, std::size_t size)
+        {
+          decoded[1].emplace_back(text, size);
+        }
+      );
+      std::size_t next[2] = { 0, 0 };
+      for (const auto& run: runs)
+      {
+        auto& source = decoded[run.first];
+        if (run.second > source.size() - next[run.first])
+        {
+          detail::Malformed();
+        }
+        for (std::uint64_t i = 0; i < run.second; ++i)
+        {
+          out.push_back(std::move(source[next[run.first]++]));
+        }
+      }
+    }
+
+    /**
+     * Parse trailer and footer.
+     */
+    void Load()
+    {
+      const auto trailer = this->data + this->size - trailerSize;
+      if (serial::DecodeFixed64(trailer + 24) != magic)
+      {
+        throw std::runtime_error("Columnar file has wrong magic");
+      }
+      const auto footerOffset = serial::DecodeFixed64(trailer);
+      const auto footerSize = serial::DecodeFixed64(trailer + 8);
+      this->rows = serial::DecodeFixed64(trailer + 16);
+      const std::uint64_t body = this->size - trailerSize;
+      if ((footerOffset > body) || (footerSize != body - footerOffset))
+      {
+        throw std::runtime_error("Columnar file footer is malformed");
+      }
+      this->footer = static_cast<std::size_t>(footerOffset);
+
+      try
+      {
+        auto cursor = this->data + footerOffset;
+        const auto end = cursor + footerSize;
+        const auto columns = detail::Varint(cursor, end);
+        for (std::uint64_t i = 0; i < columns; ++i)
+        {
+          const auto size = detail::Varint(cursor, end);
+          this->names.emplace_back(detail::Bytes(cursor, end, size), static_cast<std::size_t>(size));
+        }
+        const auto groups = detail::Varint(cursor, end);
+        std::uint64_t firstRow = 0;
+        for (std::uint64_t group = 0; group < groups; ++group)
+        {
+          const auto groupRows = detail::Varint(cursor, end);
+          for (std::uint64_t column = 0; column < columns; ++column)
+          {
+            this->chunks.push_back(this->LoadChunk(cursor, end, firstRow, groupRows));
+          }
+          firstRow += groupRows;
+        }
+        if ((firstRow != this->rows) || (cursor != end))
+        {
+          detail::Malformed();
+        }
+      }
+      catch (const std::runtime_error&)
+      {
+        throw std::runtime_error("Columnar file footer is malformed");
+      }
+    }
+
+    chunk_t LoadChunk(const char*& cursor, const char* end, std::uint64_t firstRow, std::uint64_t groupRows) const
+    {
+      chunk_t chunk;
+      if (end - cursor < 2)
+      {
+        detail::Malformed();
+      }
+      chunk.numbers = static_cast<encoding_t>(*cursor++);
+      chunk.strings = static_cast<encoding_t>(*cursor++);
+      const auto offset = detail::Varint(cursor, end);
+      chunk.numberDictionary = static_cast<std::size_t>(detail::Varint(cursor, end));
+      chunk.stringDictionary = static_cast<std::size_t>(detail::Varint(cursor, end));
+      const auto pages = detail::Varint(cursor, end);
+      if ((chunk.numbers > bitpacked) || (chunk.strings > delta) || (offset > this->footer))
+      {
+        detail::Malformed();
+      }
+      chunk.data = this->data + offset;
+
+      auto previous = offset;
+      auto row = firstRow;
+      for (std::uint64_t i = 0; i < pages; ++i)
+      {
+        const auto pageOffset = detail::Varint(cursor, end);
+        const auto pageSize = detail::Varint(cursor, end);
+        if ((pageOffset < previous) || (pageOffset > this->footer) || (pageSize > this->footer - pageOffset))
+        {
+          detail::Malformed();
+        }
+        page_t page;
+        page.data = this->data + pageOffset;
+        page.size = static_cast<std::size_t>(pageSize);
+        page.firstRow = row;
+        page.zone = detail::GetZone(cursor, end);
+        if (page.zone.numbers + static_cast<std::uint64_t>(page.zone.strings) != page.zone.count)
+        {
+          detail::Malformed();
+        }
+        row += page.zone.count;
+        previous = pageOffset + pageSize;
+        chunk.pages.push_back(std::move(page));
+      }
+      if (row - firstRow != groupRows)
+      {
+        detail::Malformed();
+      }
+      return chunk;
+    }
+
+    const char* data;                /**< Mapped file */
+    std::size_t size;                /**< File size */
+    std::size_t footer;              /**< Footer offset, end of row groups */
+    std::uint64_t rows;              /**< Row count */
+    std::vector<std::string> names;  /**< Column names */
+    std::vector<chunk_t> chunks;     /**< Chunks by row group, then column */
+  };
+
+} // namespace columnar
+} // namespace bvl
+
+#endif /* BAD_VALUE_COLUMNAR_HEADER */
@@ -0,0 +1,445 @@
+/**
+ * @file badval_diff.hpp
+ * @author masscry
+ *
+ * Structural diff and patch of documents.
+ *
+ * Diff walks both documents together and skips every pair of subtrees
+ * with equal hashes. Subtree hashes are cached in nodes (see
+ * bvl::doc::node_t::Hash), so when new version is changed copy of old
+ * one, only paths to changed nodes lose their caches and diff takes
+ * time proportional to changes, not to document size. Equal hashes are
+ * trusted, so diff is exact up to 64-bit hash collision.
+ *
+ * Patch is sequence of operations, each one has path of steps from
+ * document root and either sets node at path or removes it. Objects
+ * are compared by member keys, arrays by positions: changed items are
+ * set, new items are appended, removed items are cut from tail.
+ *
+ * Patch is applied in place and is serialized into compact binary form:
+ *
+ *     patch := varint count, count * op
+ *     op    := kind byte, varint steps, steps * step, [node]
+ *     step  := 0, varint index | 1, varint size, key bytes
+ *     node  := 0, value | 1, varint size, size * node | 2, varint size, size * (varint size, key bytes, node)
+ *
+ * where value is written by bvl::serial::Encode.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_DIFF_HEADER
+#define BAD_VALUE_DIFF_HEADER
+
+#include <badval_doc.hpp>
+#include <badval_path.hpp>
+#include <badval_serial.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace diff
+{
+
+  using doc::node_t;
+  using path::step_t;
+
+  /**
+   * Patch operation.
+   */
+  struct op_t
+  {
+    /**
+     * Operation kind.
+     */
+    enum kind_t
+    {
+      set = 0,    /**< Replace node at path, or append array item at index equal to size */
+      remove      /**< Remove node at path */
+    };
+
+    kind_t kind;                /**< Operation kind */
+    std::vector<step_t> path;   /**< Steps from root to node */
+    node_t node;                /**< New node of set operation */
+  };
+
+  /**
+   * Sequence of operations turning one document into another.
+   */
+  using patch_t = std::vector<op_t>;
+
+  namespace detail
+  {
+
+    inline step_t Member(const node_t::key_t& key)
+    {
+      return { true, key.name, key.hash, 0 };
+    }
+
+    inline step_t Item(std::size_t index)
+    {
+      return { false, std::string(), 0, static_cast<std::int64_t>(index) };
+    }
+
+    /**
+     * Find member of object, members are usually at same position in both versions.
+     */
+    inline const node_t* Same(const node_t& object, std::size_t index, const node_t::key_t& key) noexcept
+    {
+      if ((index < object.Size()) && (object.Key(index).hash == key.hash) && (object.Key(index).name == key.name))
+      {
+        return &object.At(index);
+      }
+      return object.Find(key.name, key.hash);
+    }
+
+    /**
+     * Append operations turning from into to, both at path.
+     */
+    inline void Diff(const node_t& from, const node_t& to, std::vector<step_t>& path, patch_t& patch)
+    {
+      if (from.Hash() == to.Hash())
+      {
+        return;
+      }
+      if ((from.Kind() != to.Kind()) || (to.Kind() == node_t::leaf))
+      {
+        patch.push_back({ op_t::set, path, to });
+        return;
+      }
+
+      if (to.Kind() == node_t::array)
+      {
+        const auto common = std::min(from.Size(), to.Size());
+        for (std::size_t i = 0; i < common; ++i)
+        {
+          path.push_back(Item(i));
+          Diff(from.At(i), to.At(i), path, patch);
+          path.pop_back();
+        }
+        for (auto i = common; i < to.Size(); ++i)
+        {
+          path.push_back(Item(i));
+          patch.push_back({ op_t::set, path, to.At(i) });
+          path.pop_back();
+        }
+        for (auto i = from.Size(); i-- > common;)
+        {
+          path.push_back(Item(i));
+          patch.push_back({ op_t::remove, path, node_t() });
+          path.pop_back();
+        }
+        return;
+      }
+
+      for (std::size_t i = 0; i < from.Size(); ++i)
+      {
+        const auto& key = from.Key(i);
+        if (Same(to, i, key) == nullptr)
+        {
+          path.push_back(Member(key));
+          patch.push_back({ op_t::remove, path, node_t() });
+          path.pop_back();
+        }
+      }
+      for (std::size_t i = 0; i < to.Size(); ++i)
+      {
+        const auto& key = to.Key(i);
+        const auto* old = Same(from, i, key);
+        path.push_back(Member(key));
+        if (old == nullptr)
+        {
+          patch.push_back({ op_t::set, path, to.At(i) });
+        }
+        else
+        {
+          Diff(*old, to.At(i), path, patch);
+        }
+        path.pop_back();
+      }
+    }
+
+    [[noreturn]] inline void Missing()
+    {
+      throw std::runtime_error("patch path does not exist in document");
+    }
+
+    inline void EncodeNode(const node_t& node, std::string& out)
+    {
+      out.push_back(static_cast<char>(node.Kind()));
+      switch (node.Kind())
+      {
+        case node_t::leaf:
+          serial::Encode(node.Value(), out);
+          break;
+        case node_t::array:
+          serial::PutVarint(out, node.Size());
+          for (std::size_t i = 0; i < node.Size(); ++i)
+          {
+            EncodeNode(node.At(i), out);
+          }
+          break;
+        case node_t::object:
+          serial::PutVarint(out, node.Size());
+          for (std::size_t i = 0; i < node.Size(); ++i)
+          {
+            serial::PutVarint(out, node.Key(i).name.size());
+            out.append(node.Key(i).name);
+            EncodeNode(node.At(i), out);
+          }
+          break;
+      }
+    }
+
+    inline std::uint64_t Count(const char*& cursor, const char* end)
+    {
+      std::uint64_t result;
+      if (!serial::GetVarint(cursor, end, result))
+      {
+        throw std::runtime_error("Serialized patch is truncated");
+      }
+      return result;
+    }
+
+    inline std::string Key(const char*& cursor, const char* end)
+    {
+      const auto size = Count(cursor, end);
+      if (static_cast<std::uint64_t>(end - cursor) < size)
+      {
+        throw std::runtime_error("Serialized patch key is truncated");
+      }
+      std::string result(cursor, static_cast<std::size_t>(size));
+      cursor += size;
+      return result;
+    }
+
+    inline node_t DecodeNode(const char*& cursor, const char* end)
+    {
+      if (cursor >= end)
+      {
+        throw std::runtime_error("Serialized patch node is truncated");
+      }
+      switch (static_cast<unsigned char>(*cursor++))
+      {
+        case node_t::leaf:
+          return node_t(serial::Decode(cursor, end));
+        case node_t::array:
+          {
+            auto result = node_t::Array();
+            for (auto size = Count(cursor, end); size != 0; --size)
+            {
+              result.Push(DecodeNode(cursor, end));
+            }
+            return result;
+          }
+        case node_t::object:
+          {
+            auto result = node_t::Object();
+            for (auto size = Count(cursor, end); size != 0; --size)
+            {
+              auto key = Key(cursor, end);
+              result.Set(key, DecodeNode(cursor, end));
+            }
+            return result;
+          }
+        default:
+          throw std::runtime_error("Unknown serialized patch node kind");
+      }
+    }
+
+  } // namespace detail
+
+  /**
+   * Operations turning one document into another.
+   *
+   * @param [in] from old document
+   * @param [in] to new document
+   *
+   * @return patch, empty when documents are equal
+   */
+  inline patch_t Diff(const node_t& from, const node_t& to)
+  {
+    patch_t result;
+    std::vector<step_t> path;
+    detail::Diff(from, to, path, result);
+    return result;
+  }
+
+  /**
+   * Apply patch to document in place.
+   *
+   * Patch made by Diff(from, to) turns from into to.
+   *
+   * @throws std::runtime_error when patch path does not exist in document
+   */
+  inline void Apply(node_t& document, const patch_t& patch)
+  {
+    for (const auto& op: patch)
+    {
+      if (op.path.empty())
+      {
+        if (op.kind == op_t::remove)
+        {
+          throw std::runtime_error("patch can't remove document root");
+        }
+        document = op.node;
+        continue;
+      }
+
+      node_t* parent = &document;
+      for (std::size_t i = 0; i + 1 < op.path.size(); ++i)
+      {
+        const auto& step = op.path[i];
+        if (step.member)
+        {
+          parent = parent->Find(step.key, step.hash);
+        }
+        else if ((parent->Kind() == node_t::array) && (step.index >= 0) && (static_cast<std::size_t>(step.index) < parent->Size()))
+        {
+          parent = &parent->At(static_cast<std::size_t>(step.index));
+        }
+        else
+        {
+          parent = nullptr;
+        }
+        if (parent == nullptr)
+        {
+          detail::Missing();
+        }
+      }
+
+      const auto& last = op.path.back();
+      if (last.member)
+      {
+        if (parent->Kind() != node_t::object)
+        {
+          detail::Missing();
+        }
+        if (op.kind == op_t::set)
+        {
+          parent->Set(last.key, op.node);
+        }
+        else if (!parent->Erase(last.key))
+        {
+          detail::Missing();
+        }
+        continue;
+      }
+      const auto index = static_cast<std::size_t>(last.index);
+      if ((parent->Kind() != node_t::array) || (last.index < 0) || (index > parent->Size()))
+      {
+        detail::Missing();
+      }
+      if (op.kind == op_t::remove)
+      {
+        if (index == parent->Size())
+        {
+          detail::Missing();
+        }
+        parent->Remove(index);
+      }
+      else if (index == parent->Size())
+      {
+        parent->Push(op.node);
+      }
+      else
+      {
+        parent->At(index) = op.node;
+      }
+    }
+  }
+
+  /**
+   * Append serialized patch.
+   *
+   * @throws std::runtime_error when patch holds pointers
+   */
+  inline void Encode(const patch_t& patch, std::string& out)
+  {
+    serial::PutVarint(out, patch.size());
+    for (const auto& op: patch)
+    {
+      out.push_back(static_cast<char>(op.kind));
+      serial::PutVarint(out, op.path.size());
+      for (const auto& step: op.path)
+      {
+        out.push_back(step.member? 1: 0);
+        if (step.member)
+        {
+          serial::PutVarint(out, step.key.size());
+          out.append(step.key);
+        }
+        else
+        {
+          serial::PutVarint(out, static_cast<std::uint64_t>(step.index));
+        }
+      }
+      if (op.kind == op_t::set)
+      {
+        detail::EncodeNode(op.node, out);
+      }
+    }
+  }
+
+  /**
+   * Read serialized patch and move cursor past it.
+   *
+   * @throws std::runtime_error on malformed input
+   */
+  inline patch_t Decode(const char*& cursor, const char* end)
+  {
+    patch_t result;
+    for (auto count = detail::Count(cursor, end); count != 0; --count)
+    {
+      if (cursor >= end)
+      {
+        throw std::runtime_error("Serialized patch is truncated");
+      }
+      const auto kind = static_cast<unsigned char>(*cursor++);
+      if (kind > op_t::remove)
+      {
+        throw std::runtime_error("Unknown serialized patch operation");
+      }
+      op_t op{ static_cast<op_t::kind_t>(kind), std::vector<step_t>(), node_t() };
+      for (auto steps = detail::Count(cursor, end); steps != 0; --steps)
+      {
+        if (cursor >= end)
+        {
+          throw std::runtime_error("Serialized patch is truncated");
+        }
+        if (*cursor++ != 0)
+        {
+          auto key = detail::Key(cursor, end);
+          const auto hash = doc::KeyHash(key);
+          op.path.push_back({ true, std::move(key), hash, 0 });
+        }
+        else
+        {
+          const auto index = detail::Count(cursor, end);
+          if (index > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()))
+          {
+            throw std::runtime_error("Serialized patch index is too large");
+          }
+          op.path.push_back(detail::Item(static_cast<std::size_t>(index)));
+        }
+      }
+      if (op.kind == op_t::set)
+      {
+        op.node = detail::DecodeNode(cursor, end);
+      }
+      result.push_back(std::move(op));
+    }
+    return result;
+  }
+
+} // namespace diff
+} // namespace bvl
+
+#endif /* BAD_VALUE_DIFF_HEADER */
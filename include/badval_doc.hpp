@@ -0,0 +1,503 @@
+/**
+ * @file badval_doc.hpp
+ * @author masscry
+ *
+ * Nested documents of values.
+ *
+ * Document node is either leaf with bvl::value_t, array of nodes, or
+ * object of named nodes. Object keeps members in insertion order with
+ * hash of every key, so lookups compare hashes first and strings only
+ * on hash match, and caller can hash key once and look it up in many
+ * objects.
+ *
+ * Node caches hash of its subtree. Every non-const access to node
+ * drops its cached hash, and child can only be reached for change
+ * through non-const access of all its ancestors, so caches on path to
+ * changed node are dropped while untouched subtrees keep them.
+ * Mutable reference to child must not be kept across Hash() of its
+ * ancestors. Cache is atomic, so const access to one node, including
+ * Hash(), is safe from many threads; racing threads may compute same
+ * hash twice.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_DOC_HEADER
+#define BAD_VALUE_DOC_HEADER
+
+#include <badval.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace doc
+{
+
+  namespace detail
+  {
+
+    /**
+     * Finalizer of splitmix64.
+     */
+    inline std::uint64_t Mix(std::uint64_t hash) noexcept
+    {
+      hash ^= hash >> 30;
+      hash *= 0xbf58476d1ce4e5b9ULL;
+      hash ^= hash >> 27;
+      hash *= 0x94d049bb133111ebULL;
+      hash ^= hash >> 31;
+      return hash;
+    }
+
+    /**
+     * Cached hash value meaning hash is not computed.
+     */
+    const std::uint64_t noDigest = 0;
+
+    /**
+     * Move hash out of reserved value.
+     */
+    inline std::uint64_t Digest(std::uint64_t hash) noexcept
+    {
+      return (hash == noDigest)? hash + 1: hash;
+    }
+
+  } // namespace detail
+
+  /**
+   * Hash of object key.
+   */
+  inline std::size_t KeyHash(const std::string& key) noexcept
+  {
+    return std::hash<std::string>()(key);
+  }
+
+  /**
+   * Document node.
+   */
+  class node_t final
+  {
+  public:
+
+    /**
+     * Node kind.
+     */
+    enum kind_t
+    {
+      leaf = 0, /**< Single value */
+      array,    /**< Sequence of nodes */
+      object    /**< Named nodes */
+    };
+
+    /**
+     * Object member key.
+     */
+    struct key_t
+    {
+      std::string name;   /**< Key */
+      std::size_t hash;   /**< KeyHash of name */
+    };
+
+    /**
+     * Leaf with number 0.
+     */
+    node_t()
+      : kind(leaf), digest(detail::noDigest)
+    {
+      ;
+    }
+
+    /**
+     * Leaf with value.
+     */
+    node_t(value_t value)
+      : kind(leaf), value(std::move(value)), digest(detail::noDigest)
+    {
+      ;
+    }
+
+    /**
+     * Copy document with its cached hash.
+     */
+    node_t(const node_t& src)
+      : kind(src.kind), value(src.value), children(src.children), keys(src.keys),
+        digest(src.digest.load(std::memory_order_relaxed))
+    {
+      ;
+    }
+
+    /**
+     * Move document with its cached hash.
+     */
+    node_t(node_t&& src) noexcept
+      : kind(src.kind), value(std::move(src.value)), children(std::move(src.children)), keys(std::move(src.keys)),
+        digest(src.digest.load(std::memory_order_relaxed))
+    {
+      src.digest.store(detail::noDigest, std::memory_order_relaxed);
+    }
+
+    /**
+     * Copy document with its cached hash.
+     */
+    node_t& operator=(const node_t& rhs)
+    {
+      if (this != &rhs)
+      {
+        node_t copy(rhs);
+        *this = std::move(copy);
+      }
+      return *this;
+    }
+
+    /**
+     * Move document with its cached hash.
+     */
+    node_t& operator=(node_t&& rhs) noexcept
+    {
+      if (this != &rhs)
+      {
+        this->kind = rhs.kind;
+        this->value = std::move(rhs.value);
+        this->children = std::move(rhs.children);
+        this->keys = std::move(rhs.keys);
+        this->digest.store(rhs.digest.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        rhs.digest.store(detail::noDigest, std::memory_order_relaxed);
+      }
+      return *this;
+    }
+
+    /**
+     * Empty array.
+     */
+    static node_t Array()
+    {
+      node_t result;
+      result.kind = array;
+      return result;
+    }
+
+    /**
+     * Empty object.
+     */
+    static node_t Object()
+    {
+      node_t result;
+      result.kind = object;
+      return result;
+    }
+
+    /**
+     * Node kind.
+     */
+    kind_t Kind() const noexcept
+    {
+      return this->kind;
+    }
+
+    /**
+     * Value of leaf.
+     *
+     * @throws std::logic_error when node is not leaf
+     */
+    const value_t& Value() const
+    {
+      this->Expect(leaf);
+      return this->value;
+    }
+
+    /**
+     * Number of array items or object members, 0 for leaf.
+     */
+    std::size_t Size() const noexcept
+    {
+      return this->children.size();
+    }
+
+    /**
+     * Array item or object member by position.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    const node_t& At(std::size_t index) const
+    {
+      return this->children.at(index);
+    }
+
+    /**
+     * Array item or object member by position.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    node_t& At(std::size_t index)
+    {
+      this->Drop();
+      return this->children.at(index);
+    }
+
+    /**
+     * Key of object member by position.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    const key_t& Key(std::size_t index) const
+    {
+      return this->keys.at(index);
+    }
+
+    /**
+     * Append array item.
+     *
+     * @return appended item, valid until next change of node
+     *
+     * @throws std::logic_error when node is not array
+     */
+    node_t& Push(node_t item)
+    {
+      this->Expect(array);
+      this->Drop();
+      this->children.push_back(std::move(item));
+      return this->children.back();
+    }
+
+    /**
+     * Set object member, replacing existing one.
+     *
+     * @return stored member, valid until next change of node
+     *
+     * @throws std::logic_error when node is not object
+     */
+    node_t& Set(const std::string& name, node_t member)
+    {
+      return this->Set(key_t{ name, KeyHash(name) }, std::move(member));
+    }
+
+    /**
+     * Set object member by key with precomputed hash, replacing existing one.
+     *
+     * @return stored member, valid until next change of node
+     *
+     * @throws std::logic_error when node is not object
+     */
+    node_t& Set(key_t key, node_t member)
+    {
+      this->Expect(object);
+      this->Drop();
+      const auto index = this->Index(key.name, key.hash);
+      if (index != this->keys.size())
+      {
+        this->children[index] = std::move(member);
+        return this->children[index];
+      }
+      this->keys.push_back(std::move(key));
+      this->children.push_back(std::move(member));
+      return this->children.back();
+    }
+
+    /**
+     * Remove object member.
+     *
+     * @return true when member was removed
+     *
+     * @throws std::logic_error when node is not object
+     */
+    bool Erase(const std::string& name)
+    {
+      this->Expect(object);
+      const auto index = this->Index(name, KeyHash(name));
+      if (index == this->keys.size())
+      {
+        return false;
+      }
+      this->Remove(index);
+      return true;
+    }
+
+    /**
+     * Remove array item or object member by position.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    void Remove(std::size_t index)
+    {
+      if (index >= this->children.size())
+      {
+        throw std::out_of_range("no document node at position");
+      }
+      this->Drop();
+      if (this->kind == object)
+      {
+        this->keys.erase(this->keys.begin() + static_cast<std::ptrdiff_t>(index));
+      }
+      this->children.erase(this->children.begin() + static_cast<std::ptrdiff_t>(index));
+    }
+
+    /**
+     * Find object member.
+     *
+     * @return member or nullptr when node is not object or has no such member
+     */
+    const node_t* Find(const std::string& name) const noexcept
+    {
+      return this->Find(name, KeyHash(name));
+    }
+
+    /**
+     * Find object member by key with precomputed hash.
+     *
+     * @param [in] name key
+     * @param [in] hash KeyHash of key
+     *
+     * @return member or nullptr when node is not object or has no such member
+     */
+    const node_t* Find(const std::string& name, std::size_t hash) const noexcept
+    {
+      const auto index = this->Index(name, hash);
+      return (index != this->keys.size())? &this->children[index]: nullptr;
+    }
+
+    /**
+     * Find object member by key with precomputed hash.
+     */
+    node_t* Find(const std::string& name, std::size_t hash) noexcept
+    {
+      this->Drop();
+      const auto index = this->Index(name, hash);
+      return (index != this->keys.size())? &this->children[index]: nullptr;
+    }
+
+    /**
+     * Hash of subtree, cached until node is changed.
+     *
+     * Equal documents have equal hashes, member order of objects does
+     * not matter.
+     */
+    std::uint64_t Hash() const noexcept
+    {
+      const auto cached = this->digest.load(std::memory_order_relaxed);
+      if (cached != detail::noDigest)
+      {
+        return cached;
+      }
+      std::uint64_t result = detail::Mix(static_cast<std::uint64_t>(this->kind) + 0x9E3779B97F4A7C15ULL);
+      switch (this->kind)
+      {
+        case leaf:
+          result ^= detail::Mix(static_cast<std::uint64_t>(this->value.Hash()) + static_cast<std::uint64_t>(this->value.Type()));
+          break;
+        case array:
+          for (const auto& child: this->children)
+          {
+            result = detail::Mix(result ^ child.Hash());
+          }
+          break;
+        case object:
+          // sum does not depend on member order
+          for (std::size_t i = 0; i < this->keys.size(); ++i)
+          {
+            result += detail::Mix(static_cast<std::uint64_t>(this->keys[i].hash) * 0x9E3779B97F4A7C15ULL ^ this->children[i].Hash());
+          }
+          break;
+      }
+      result = detail::Digest(result);
+      this->digest.store(result, std::memory_order_relaxed);
+      return result;
+    }
+
+    /**
+     * Compare documents.
+     *
+     * Objects are equal when they have same members in any order.
+     */
+    bool operator==(const node_t& rhs) const noexcept
+    {
+      if ((this->kind != rhs.kind) || (this->children.size() != rhs.children.size()))
+      {
+        return false;
+      }
+      const auto lhsDigest = this->digest.load(std::memory_order_relaxed);
+      const auto rhsDigest = rhs.digest.load(std::memory_order_relaxed);
+      if ((lhsDigest != detail::noDigest) && (rhsDigest != detail::noDigest) && (lhsDigest != rhsDigest))
+      {
+        return false;
+      }
+      switch (this->kind)
+      {
+        case leaf:
+          return this->value == rhs.value;
+        case array:
+          return this->children == rhs.children;
+        case object:
+          for (std::size_t i = 0; i < this->keys.size(); ++i)
+          {
+            const auto* other = rhs.Find(this->keys[i].name, this->keys[i].hash);
+            if ((other == nullptr) || !(this->children[i] == *other))
+            {
+              return false;
+            }
+          }
+          return true;
+      }
+      return false;
+    }
+
+    /**
+     * Compare documents.
+     *
+     * @see bvl::doc::node_t::operator==
+     */
+    bool operator!=(const node_t& rhs) const noexcept
+    {
+      return !(*this == rhs);
+    }
+
+  private:
+
+    /**
+     * Drop cached hash before change.
+     */
+    void Drop() noexcept
+    {
+      this->digest.store(detail::noDigest, std::memory_order_relaxed);
+    }
+
+    void Expect(kind_t expected) const
+    {
+      if (this->kind != expected)
+      {
+        throw std::logic_error("document node has other kind");
+      }
+    }
+
+    /**
+     * Position of member, keys.size() when not found.
+     */
+    std::size_t Index(const std::string& name, std::size_t hash) const noexcept
+    {
+      for (std::size_t i = 0; i < this->keys.size(); ++i)
+      {
+        if ((this->keys[i].hash == hash) && (this->keys[i].name == name))
+        {
+          return i;
+        }
+      }
+      return this->keys.size();
+    }
+
+    kind_t kind;                    /**< Node kind */
+    value_t value;                  /**< Value of leaf */
+    std::vector<node_t> children;   /**< Array items or object members */
+    std::vector<key_t> keys;        /**< Keys of object members */
+    mutable std::atomic<std::uint64_t> digest;  /**< Cached hash of subtree, noDigest when not computed */
+  };
+
+} // namespace doc
+} // namespace bvl
+
+#endif /* BAD_VALUE_DOC_HEADER */
@@ -0,0 +1,535 @@
+/**
+ * @file badval_ebr.hpp
+ * @author masscry
+ *
+ * Epoch-based memory reclamation for values.
+ *
+ * Lock-free readers enter critical section with domain_t::Pin().
+ * Writers, which removed value from shared structure, pass it to
+ * domain_t::Retire() instead of destroying it. Value is destroyed
+ * (and its cleanup function is called) only after every reader,
+ * which could see it, left critical section.
+ *
+ * Domain has global epoch counter. Pinned thread publishes epoch it
+ * observed, epoch is advanced only when all pinned threads observed
+ * current one. Value retired in epoch E is released when global
+ * epoch reaches E + 2.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_EBR_HEADER
+#define BAD_VALUE_EBR_HEADER
+
+#include <badval.hpp>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace ebr
+{
+
+  class domain_t;
+
+  namespace detail
+  {
+
+    /**
+     * Retired value with epoch it was retired in.
+     */
+    struct retired_t
+    {
+      std::uint64_t epoch; /**< Global epoch at retire time */
+      value_t value;       /**< Value to destroy */
+
+      retired_t(std::uint64_t epoch, value_t&& value) noexcept
+        : epoch(epoch), value(std::move(value))
+      {
+        ;
+      }
+    };
+
+    /**
+     * Per-thread domain state.
+     */
+    struct record_t
+    {
+      std::atomic<std::uint64_t> state;  /**< (epoch << 1) | 1 when pinned, 0 otherwise */
+      std::atomic<bool> owned;           /**< Record is used by some thread */
+      record_t* next;                    /**< Next record of domain */
+      domain_t* domain;                  /**< Owner domain */
+      unsigned nesting;                  /**< Depth of nested pins */
+      std::deque<retired_t> garbage;     /**< Values retired by owner thread */
+      char padding[64];                  /**< Keeps records on separate cache lines */
+
+      explicit record_t(domain_t* domain)
+        : state(0), owned(true), next(nullptr), domain(domain), nesting(0)
+      {
+        ;
+      }
+    };
+
+    /**
+     * Identifiers of alive domains.
+     *
+     * Exiting thread must not touch domain destroyed before it.
+     */
+    class registry_t final
+    {
+    public:
+
+      static registry_t& Instance()
+      {
+        static registry_t registry;
+        return registry;
+      }
+
+      std::uint64_t Add()
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto id = ++this->lastID;
+        this->alive.insert(id);
+        return id;
+      }
+
+      void Remove(std::uint64_t id)
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->alive.erase(id);
+      }
+
+      template<typename func_t>
+      void IfAlive(std::uint64_t id, func_t&& func)
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->alive.count(id) != 0)
+        {
+          func();
+        }
+      }
+
+    private:
+      std::mutex mutex;
+      std::uint64_t lastID = 0;
+      std::unordered_set<std::uint64_t> alive;
+    };
+
+    /**
+     * Records used by current thread, released on thread exit.
+     */
+    class threadCache_t final
+    {
+    public:
+
+      record_t* Find(std::uint64_t id) const noexcept
+      {
+        for (const auto& entry: this->entries)
+        {
+          if (entry.first == id)
+          {
+            return entry.second;
+          }
+        }
+        return nullptr;
+      }
+
+      void Add(std::uint64_t id, record_t* record)
+      {
+        this->entries.emplace_back(id, record);
+      }
+
+      ~threadCache_t();
+
+      static threadCache_t& Instance()
+      {
+        static thread_local threadCache_t cache;
+        return cache;
+      }
+
+    private:
+      std::vector<std::pair<std::uint64_t, record_t*>> entries;
+    };
+
+  } // namespace detail
+
+  /**
+   * Reclamation domain.
+   *
+   * Any number of threads can pin and retire concurrently. Domain must
+   * outlive all structures using it and can be destroyed only when no
+   * thread is pinned.
+   */
+  class domain_t final
+  {
+  public:
+
+    /**
+     * Critical section of reader. Unpins thread when destroyed.
+     */
+    class guard_t final
+    {
+    public:
+
+      guard_t(guard_t&& src) noexcept
+        : record(src.record)
+      {
+        src.record = nullptr;
+      }
+
+      guard_t(const guard_t&) = delete;
+      guard_t& operator=(const guard_t&) = delete;
+      guard_t& operator=(guard_t&&) = delete;
+
+      ~guard_t()
+      {
+        if ((this->record != nullptr) && (--this->record->nesting == 0))
+        {
+          this->record->state.store(0, std::memory_order_release);
+        }
+      }
+
+    private:
+      friend class domain_t;
+
+      explicit guard_t(detail::record_t* record) noexcept
+        : record(record)
+      {
+        ;
+      }
+
+      detail::record_t* record;
+    };
+
+    /**
+     * Create domain.
+     *
+     * @param [in] collectThreshold thread tries to release its garbage after retiring this many values
+     * @param [in] garbageLimit thread which is not pinned waits for readers when it holds this many retired values
+     */
+    explicit domain_t(std::size_t collectThreshold = 64, std::size_t garbageLimit = 4096)
+      : id(detail::registry_t::Instance().Add()),
+        epoch(0),
+        pending(0),
+        records(nullptr),
+        collectThreshold((collectThreshold == 0)? 1: collectThreshold),
+        garbageLimit((garbageLimit < this->collectThreshold)? this->collectThreshold: garbageLimit)
+    {
+      ;
+    }
+
+    domain_t(const domain_t&) = delete;
+    domain_t& operator=(const domain_t&) = delete;
+
+    /**
+     * Destructor.
+     *
+     * Releases all retired values.
+     */
+    ~domain_t()
+    {
+      // thread caches may keep id of destroyed domain, but ids are never reused
+      detail::registry_t::Instance().Remove(this->id);
+
+      auto record = this->records.load(std::memory_order_acquire);
+      while (record != nullptr)
+      {
+        auto next = record->next;
+        delete record;
+        record = next;
+      }
+    }
+
+    /**
+     * Enter critical section.
+     *
+     * Values retired after this call are not released until guard is destroyed.
+     * Pins can be nested.
+     */
+    guard_t Pin()
+    {
+      auto record = this->Local();
+      if (record->nesting++ == 0)
+      {
+        const auto current = this->epoch.load(std::memory_order_relaxed);
+        record->state.store((current << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+      }
+      return guard_t(record);
+    }
+
+    /**
+     * Release value when no reader can see it anymore.
+     *
+     * Value must be already unreachable for new readers.
+     */
+    void Retire(value_t&& value)
+    {
+      auto record = this->Local();
+      const auto current = this->epoch.load(std::memory_order_seq_cst);
+      record->garbage.emplace_back(current, std::move(value));
+      this->pending.fetch_add(1, std::memory_order_relaxed);
+
+      if (record->garbage.size() % this->collectThreshold == 0)
+      {
+        this->Collect(record);
+      }
+
+      // pinned thread can't wait, because it blocks epoch itself
+      unsigned spins = 0;
+      while ((record->garbage.size() >= this->garbageLimit) && (record->nesting == 0))
+      {
+        if (++spins > 16)
+        {
+          std::this_thread::yield();
+        }
+        this->Collect(record);
+      }
+    }
+
+    /**
+     * Call free(ptr) when no reader can see ptr anymore.
+     */
+    void Retire(void* ptr, value_t::freeFuncPtr_t free)
+    {
+      this->Retire(value_t(ptr, free));
+    }
+
+    /**
+     * Delete object when no reader can see it anymore.
+     */
+    template<typename data_t>
+    void Retire(data_t* ptr)
+    {
+      this->Retire(
+        static_cast<void*>(ptr),
+        [](void* item)
+        {
+          delete static_cast<data_t*>(item);
+        }
+      );
+    }
+
+    /**
+     * Try to advance epoch and release garbage of calling thread.
+     *
+     * @return true when thread has no unreleased garbage left
+     */
+    bool Collect()
+    {
+      auto record = this->Local();
+      this->Collect(record);
+      return record->garbage.empty();
+    }
+
+    /**
+     * Wait until everything retired by calling thread, and by exited
+     * threads, is released.
+     *
+     * Must not be called while calling thread is pinned.
+     */
+    void Synchronize()
+    {
+      auto record = this->Local();
+      assert(record->nesting == 0);
+
+      unsigned spins = 0;
+      for (;;)
+      {
+        this->Collect(record);
+        bool done = record->garbage.empty();
+        {
+          std::lock_guard<std::mutex> lock(this->orphanMutex);
+          done = done && this->orphans.empty();
+        }
+        if (done)
+        {
+          return;
+        }
+        if (++spins > 16)
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    /**
+     * Number of retired, but not yet released values.
+     */
+    std::size_t Pending() const noexcept
+    {
+      return this->pending.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Current global epoch.
+     */
+    std::uint64_t Epoch() const noexcept
+    {
+      return this->epoch.load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class detail::threadCache_t;
+
+    /**
+     * Find or create record of calling thread.
+     */
+    detail::record_t* Local()
+    {
+      auto& cache = detail::threadCache_t::Instance();
+      auto record = cache.Find(this->id);
+      if (record != nullptr)
+      {
+        return record;
+      }
+
+      // reuse record released by exited thread
+      for (record = this->records.load(std::memory_order_acquire); record != nullptr; record = record->next)
+      {
+        bool expected = false;
+        if (!record->owned.load(std::memory_order_relaxed)
+          && record->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+          cache.Add(this->id, record);
+          return record;
+        }
+      }
+
+      record = new detail::record_t(this);
+      auto head = this->records.load(std::memory_order_relaxed);
+      do
+      {
+        record->next = head;
+      }
+      while (!this->records.compare_exchange_weak(head, record, std::memory_order_release, std::memory_order_relaxed));
+      cache.Add(this->id, record);
+      return record;
+    }
+
+    /**
+     * Give record back on thread exit.
+     *
+     * Garbage of exited thread is moved to orphans.
+     */
+    void Release(detail::record_t* record)
+    {
+      record->state.store(0, std::memory_order_release);
+      record->nesting = 0;
+      {
+        std::lock_guard<std::mutex> lock(this->orphanMutex);
+        for (auto& item: record->garbage)
+        {
+          this->orphans.emplace_back(item.epoch, std::move(item.value));
+        }
+      }
+      record->garbage.clear();
+      record->owned.store(false, std::memory_order_release);
+    }
+
+    /**
+     * Advance epoch if all pinned threads observed current one.
+     */
+    void TryAdvance() noexcept
+    {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      auto current = this->epoch.load(std::memory_order_seq_cst);
+      for (auto record = this->records.load(std::memory_order_acquire); record != nullptr; record = record->next)
+      {
+        const auto state = record->state.load(std::memory_order_acquire);
+        if (((state & 1) != 0) && ((state >> 1) != current))
+        {
+          return;
+        }
+      }
+      this->epoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+    }
+
+    /**
+     * Release values retired at least two epochs ago.
+     */
+    void Free(std::deque<detail::retired_t>& garbage) noexcept
+    {
+      const auto current = this->epoch.load(std::memory_order_acquire);
+      std::size_t released = 0;
+      // values are retired in epoch order, so released ones are at the front
+      while (!garbage.empty() && (garbage.front().epoch + 2 <= current))
+      {
+        garbage.pop_front();
+        ++released;
+      }
+      this->pending.fetch_sub(released, std::memory_order_relaxed);
+    }
+
+    void Collect(detail::record_t* record)
+    {
+      this->TryAdvance();
+      this->Free(record->garbage);
+
+      std::unique_lock<std::mutex> lock(this->orphanMutex, std::try_to_lock);
+      if (lock.owns_lock() && !this->orphans.empty())
+      {
+        // orphans come from different threads, so they are not ordered
+        std::deque<detail::retired_t> left;
+        const auto current = this->epoch.load(std::memory_order_acquire);
+        std::size_t released = 0;
+        while (!this->orphans.empty())
+        {
+          if (this->orphans.front().epoch + 2 > current)
+          {
+            left.push_back(std::move(this->orphans.front()));
+          }
+          else
+          {
+            ++released;
+          }
+          this->orphans.pop_front();
+        }
+        this->orphans.swap(left);
+        this->pending.fetch_sub(released, std::memory_order_relaxed);
+      }
+    }
+
+    const std::uint64_t id;                    /**< Identifier in registry */
+    std::atomic<std::uint64_t> epoch;          /**< Global epoch */
+    std::atomic<std::size_t> pending;          /**< Retired, not released values */
+    std::atomic<detail::record_t*> records;    /**< Per-thread records, never removed */
+    const std::size_t collectThreshold;        /**< Retires between collections */
+    const std::size_t garbageLimit;            /**< Garbage size when thread waits for readers */
+    std::mutex orphanMutex;                    /**< Guards orphans */
+    std::deque<detail::retired_t> orphans;     /**< Garbage of exited threads */
+  };
+
+  inline detail::threadCache_t::~threadCache_t()
+  {
+    for (const auto& entry: this->entries)
+    {
+      auto record = entry.second;
+      registry_t::Instance().IfAlive(entry.first,
+        [record]()
+        {
+          record->domain->Release(record);
+        }
+      );
+    }
+  }
+
+  /**
+   * Domain shared by structures which were not given their own.
+   */
+  inline domain_t& DefaultDomain()
+  {
+    static domain_t domain;
+    return domain;
+  }
+
+} // namespace ebr
+} // namespace bvl
+
+#endif /* BAD_VALUE_EBR_HEADER */
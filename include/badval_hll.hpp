@@ -0,0 +1,537 @@
+/**
+ * @file badval_hll.hpp
+ * @author masscry
+ *
+ * HyperLogLog sketch, approximate number of distinct values.
+ *
+ * Value hash picks one of m = 2^precision registers by its top bits,
+ * register keeps largest rank (position of first set bit) of remaining
+ * bits seen. Estimate is harmonic mean of 2^rank over registers, or
+ * linear counting of empty registers for small cardinalities. Standard
+ * error is 1.04 / sqrt(m).
+ *
+ * New sketch is sparse: it stores sorted list of (index, rank) pairs of
+ * finer precision sparsePrecision, so small cardinalities are counted
+ * nearly exactly and take little memory. When list grows beyond size of
+ * dense registers, sketch turns dense: one byte per register.
+ *
+ * Sketches of equal precision merge into sketch of union of inputs, so
+ * threads and hosts count on their own and merge results. Dense merge
+ * is register-wise maximum and dense estimate sums registers, both take
+ * sixteen registers at once with SSE2.
+ *
+ * Serialized sketch is byte precision, byte representation (0 sparse,
+ * 1 dense), then varint count and varint deltas of sorted sparse
+ * entries, or dense registers.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_HLL_HEADER
+#define BAD_VALUE_HLL_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bvl
+{
+namespace hll
+{
+
+  /**
+   * Smallest and largest supported precision.
+   */
+  constexpr unsigned minPrecision = 4;
+  constexpr unsigned maxPrecision = 18;
+
+  /**
+   * Precision of sparse entries.
+   */
+  constexpr unsigned sparsePrecision = 25;
+
+  namespace detail
+  {
+
+    /**
+     * Spread value hash over all 64 bits.
+     */
+    inline std::uint64_t Mix(std::uint64_t hash) noexcept
+    {
+      hash ^= hash >> 30;
+      hash *= 0xbf58476d1ce4e5b9ULL;
+      hash ^= hash >> 27;
+      hash *= 0x94d049bb133111ebULL;
+      hash ^= hash >> 31;
+      return hash;
+    }
+
+    /**
+     * Position of first set bit of bits, counted from 1, or limit.
+     */
+    inline unsigned Rank(std::uint64_t bits, unsigned limit) noexcept
+    {
+      if (bits == 0)
+      {
+        return limit;
+      }
+      return std::min(limit, static_cast<unsigned>(__builtin_clzll(bits)) + 1);
+    }
+
+    /**
+     * Sparse entry: index of sparsePrecision bits and rank, 6 bits.
+     */
+    inline std::uint32_t SparseEntry(std::uint64_t hash) noexcept
+    {
+      const auto index = static_cast<std::uint32_t>(hash >> (64 - sparsePrecision));
+      const auto rank = Rank(hash << sparsePrecision, 64 - sparsePrecision + 1);
+      return (index << 6) | rank;
+    }
+
+    /**
+     * Sort entries and keep largest rank of every index.
+     */
+    inline void Normalize(std::vector<std::uint32_t>& entries)
+    {
+      std::sort(entries.begin(), entries.end());
+      std::size_t size = 0;
+      for (std::size_t i = 0; i < entries.size(); ++i)
+      {
+        // same index, larger rank comes later
+        if ((size != 0) && ((entries[size - 1] >> 6) == (entries[i] >> 6)))
+        {
+          entries[size - 1] = entries[i];
+        }
+        else
+        {
+          entries[size++] = entries[i];
+        }
+      }
+      entries.resize(size);
+    }
+
+    /**
+     * Register index and rank of sparse entry at given precision.
+     */
+    inline void Dense(std::uint32_t entry, unsigned precision, std::uint32_t& index, std::uint8_t& rank) noexcept
+    {
+      const auto extra = sparsePrecision - precision;
+      const auto sparseIndex = entry >> 6;
+      index = sparseIndex >> extra;
+      const auto low = sparseIndex & ((1u << extra) - 1);
+      if (low != 0)
+      {
+        // first set bit is among index bits, which dense precision does not use
+        rank = static_cast<std::uint8_t>(extra - (32 - static_cast<unsigned>(__builtin_clz(low))) + 1);
+      }
+      else
+      {
+        rank = static_cast<std::uint8_t>(extra + (entry & 0x3F));
+      }
+    }
+
+    /**
+     * Register-wise maximum, registers count is multiple of 16.
+     */
+    inline void MaxScalar(std::uint8_t* target, const std::uint8_t* source, std::size_t count) noexcept
+    {
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        target[i] = std::max(target[i], source[i]);
+      }
+    }
+
+    /**
+     * Sum of 2^-register and number of zero registers.
+     */
+    inline double SumScalar(const std::uint8_t* registers, std::size_t count, std::size_t& zeros) noexcept
+    {
+      double sum = 0.0;
+      zeros = 0;
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        sum += std::ldexp(1.0, -static_cast<int>(registers[i]));
+        zeros += (registers[i] == 0)? 1: 0;
+      }
+      return sum;
+    }
+
+#if defined(__SSE2__)
+
+    inline void MaxSimd(std::uint8_t* target, const std::uint8_t* source, std::size_t count) noexcept
+    {
+      for (std::size_t i = 0; i < count; i += 16)
+      {
+        const auto lhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + i));
+        const auto rhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), _mm_max_epu8(lhs, rhs));
+      }
+    }
+
+    /**
+     * Sum sixteen registers at once. Float 2^-r is made from exponent
+     * bits, lanes are summed as float and flushed into double often.
+     */
+    inline double SumSimd(const std::uint8_t* registers, std::size_t count, std::size_t& zeros) noexcept
+    {
+      const auto zero = _mm_setzero_si128();
+      const auto bias = _mm_set1_epi32(127);
+      double sum = 0.0;
+      zeros = 0;
+      for (std::size_t chunk = 0; chunk < count; chunk += 1024)
+      {
+        auto acc = _mm_setzero_ps();
+        const auto end = std::min(count, chunk + 1024);
+        for (std::size_t i = chunk; i < end; i += 16)
+        {
+          const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(registers + i));
+          zeros += static_cast<std::size_t>(__builtin_popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)))));
+          const auto low = _mm_unpacklo_epi8(bytes, zero);
+          const auto high = _mm_unpackhi_epi8(bytes, zero);
+          const __m128i words[4] = {
+            _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+            _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero)
+          };
+          for (const auto& word: words)
+          {
+            acc = _mm_add_ps(acc, _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(bias, word), 23)));
+          }
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        sum += static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+      }
+      return sum;
+    }
+
+#endif
+
+    inline void Max(std::uint8_t* target, const std::uint8_t* source, std::size_t count) noexcept
+    {
+#if defined(__SSE2__)
+      MaxSimd(target, source, count);
+#else
+      MaxScalar(target, source, count);
+#endif
+    }
+
+    inline double Sum(const std::uint8_t* registers, std::size_t count, std::size_t& zeros) noexcept
+    {
+#if defined(__SSE2__)
+      return SumSimd(registers, count, zeros);
+#else
+      return SumScalar(registers, count, zeros);
+#endif
+    }
+
+  } // namespace detail
+
+  /**
+   * HyperLogLog sketch.
+   */
+  class sketch_t final
+  {
+  public:
+
+    /**
+     * Create empty sparse sketch.
+     *
+     * @param [in] precision log2 of register count, from minPrecision to maxPrecision
+     *
+     * @throws std::invalid_argument for unsupported precision
+     */
+    explicit sketch_t(unsigned precision = 14)
+      : precision(precision)
+    {
+      if ((precision < minPrecision) || (precision > maxPrecision))
+      {
+        throw std::invalid_argument("Unsupported HyperLogLog precision");
+      }
+    }
+
+    /**
+     * Count value.
+     */
+    void Add(const value_t& value)
+    {
+      this->AddHash(detail::Mix(static_cast<std::uint64_t>(value.Hash())));
+    }
+
+    /**
+     * Count well mixed 64-bit hash.
+     */
+    void AddHash(std::uint64_t hash)
+    {
+      if (this->Sparse())
+      {
+        this->buffer.push_back(detail::SparseEntry(hash));
+        if (this->buffer.size() >= std::max<std::size_t>(64, this->entries.size() / 4))
+        {
+          this->Flush();
+        }
+        return;
+      }
+      const auto index = hash >> (64 - this->precision);
+      const auto rank = static_cast<std::uint8_t>(detail::Rank(hash << this->precision, 64 - this->precision + 1));
+      this->registers[index] = std::max(this->registers[index], rank);
+    }
+
+    /**
+     * Add all values of other sketch.
+     *
+     * @throws std::invalid_argument when precisions differ
+     */
+    void Merge(const sketch_t& other)
+    {
+      if (other.precision != this->precision)
+      {
+        throw std::invalid_argument("Can't merge HyperLogLog sketches of different precision");
+      }
+      if (&other == this)
+      {
+        // sketch already holds all its values, and buffer can't be appended to itself
+        return;
+      }
+      if (this->Sparse() && other.Sparse())
+      {
+        this->buffer.insert(this->buffer.end(), other.entries.begin(), other.entries.end());
+        this->buffer.insert(this->buffer.end(), other.buffer.begin(), other.buffer.end());
+        this->Flush();
+        return;
+      }
+      if (this->Sparse())
+      {
+        this->ToDense();
+      }
+      if (other.Sparse())
+      {
+        this->AddEntries(other.entries);
+        this->AddEntries(other.buffer);
+        return;
+      }
+      detail::Max(this->registers.data(), other.registers.data(), this->registers.size());
+    }
+
+    /**
+     * Estimated number of distinct values.
+     */
+    double Estimate() const
+    {
+      const auto m = static_cast<double>(std::size_t(1) << this->precision);
+      if (this->Sparse())
+      {
+        // linear counting over sparse registers
+        auto all = this->buffer;
+        all.insert(all.end(), this->entries.begin(), this->entries.end());
+        detail::Normalize(all);
+        const auto sparse = static_cast<double>(std::size_t(1) << sparsePrecision);
+        return sparse * std::log(sparse / (sparse - static_cast<double>(all.size())));
+      }
+
+      std::size_t zeros;
+      const auto sum = detail::Sum(this->registers.data(), this->registers.size(), zeros);
+      double alpha;
+      switch (this->precision)
+      {
+        case 4:
+          alpha = 0.673;
+          break;
+        case 5:
+          alpha = 0.697;
+          break;
+        case 6:
+          alpha = 0.709;
+          break;
+        default:
+          alpha = 0.7213 / (1.0 + 1.079 / m);
+          break;
+      }
+      const auto estimate = alpha * m * m / sum;
+      if ((estimate <= 2.5 * m) && (zeros != 0))
+      {
+        return m * std::log(m / static_cast<double>(zeros));
+      }
+      return estimate;
+    }
+
+    /**
+     * Relative standard error of estimate.
+     */
+    double StandardError() const noexcept
+    {
+      return 1.04 / std::sqrt(static_cast<double>(std::size_t(1) << this->precision));
+    }
+
+    unsigned Precision() const noexcept
+    {
+      return this->precision;
+    }
+
+    /**
+     * Sketch still keeps sparse entries.
+     */
+    bool Sparse() const noexcept
+    {
+      return this->registers.empty();
+    }
+
+    /**
+     * Memory used by entries or registers.
+     */
+    std::size_t Bytes() const noexcept
+    {
+      return this->registers.size() + sizeof(std::uint32_t) * (this->entries.capacity() + this->buffer.capacity());
+    }
+
+    /**
+     * Forget all values, sketch becomes sparse.
+     */
+    void Clear() noexcept
+    {
+      this->entries.clear();
+      this->buffer.clear();
+      std::vector<std::uint8_t>().swap(this->registers);
+    }
+
+    /**
+     * Append serialized sketch.
+     */
+    void Serialize(std::string& out) const
+    {
+      out.push_back(static_cast<char>(this->precision));
+      out.push_back(this->Sparse()? 0: 1);
+      if (!this->Sparse())
+      {
+        out.append(reinterpret_cast<const char*>(this->registers.data()), this->registers.size());
+        return;
+      }
+      auto all = this->buffer;
+      all.insert(all.end(), this->entries.begin(), this->entries.end());
+      detail::Normalize(all);
+      serial::PutVarint(out, all.size());
+      std::uint32_t prev = 0;
+      for (const auto entry: all)
+      {
+        serial::PutVarint(out, entry - prev);
+        prev = entry;
+      }
+    }
+
+    /**
+     * Read serialized sketch and move cursor past it.
+     *
+     * @throws std::runtime_error on malformed input
+     */
+    static sketch_t Deserialize(const char*& cursor, const char* end)
+    {
+      if (end - cursor < 2)
+      {
+        throw std::runtime_error("Serialized HyperLogLog is truncated");
+      }
+      const auto precision = static_cast<unsigned char>(*cursor++);
+      const auto dense = static_cast<unsigned char>(*cursor++);
+      if ((precision < minPrecision) || (precision > maxPrecision) || (dense > 1))
+      {
+        throw std::runtime_error("Serialized HyperLogLog is malformed");
+      }
+      sketch_t result(precision);
+      if (dense != 0)
+      {
+        const auto size = std::size_t(1) << precision;
+        if (static_cast<std::size_t>(end - cursor) < size)
+        {
+          throw std::runtime_error("Serialized HyperLogLog is truncated");
+        }
+        result.registers.assign(cursor, cursor + size);
+        cursor += size;
+        for (const auto rank: result.registers)
+        {
+          if (rank > 64 - precision + 1)
+          {
+            throw std::runtime_error("Serialized HyperLogLog is malformed");
+          }
+        }
+        return result;
+      }
+
+      std::uint64_t count;
+      if (!serial::GetVarint(cursor, end, count) || (count > static_cast<std::uint64_t>(end - cursor)))
+      {
+        throw std::runtime_error("Serialized HyperLogLog is truncated");
+      }
+      std::uint64_t entry = 0;
+      for (std::uint64_t i = 0; i < count; ++i)
+      {
+        std::uint64_t delta;
+        if (!serial::GetVarint(cursor, end, delta))
+        {
+          throw std::runtime_error("Serialized HyperLogLog is truncated");
+        }
+        entry += delta;
+        if ((entry >= (std::uint64_t(1) << (sparsePrecision + 6))) || ((entry & 0x3F) == 0) || ((entry & 0x3F) > 64 - sparsePrecision + 1))
+        {
+          throw std::runtime_error("Serialized HyperLogLog is malformed");
+        }
+        result.buffer.push_back(static_cast<std::uint32_t>(entry));
+      }
+      result.Flush();
+      return result;
+    }
+
+  private:
+
+    /**
+     * Merge buffer into sorted entries, turn dense when entries
+     * outgrow registers.
+     */
+    void Flush()
+    {
+      this->entries.insert(this->entries.end(), this->buffer.begin(), this->buffer.end());
+      this->buffer.clear();
+      detail::Normalize(this->entries);
+      if (sizeof(std::uint32_t) * this->entries.size() > (std::size_t(1) << this->precision))
+      {
+        this->ToDense();
+      }
+    }
+
+    void ToDense()
+    {
+      this->registers.assign(std::size_t(1) << this->precision, 0);
+      this->AddEntries(this->entries);
+      this->AddEntries(this->buffer);
+      std::vector<std::uint32_t>().swap(this->entries);
+      std::vector<std::uint32_t>().swap(this->buffer);
+    }
+
+    void AddEntries(const std::vector<std::uint32_t>& items)
+    {
+      for (const auto entry: items)
+      {
+        std::uint32_t index;
+        std::uint8_t rank;
+        detail::Dense(entry, this->precision, index, rank);
+        this->registers[index] = std::max(this->registers[index], rank);
+      }
+    }
+
+    unsigned precision;                   /**< log2 of register count */
+    std::vector<std::uint32_t> entries;   /**< Sorted sparse entries */
+    std::vector<std::uint32_t> buffer;    /**< Unsorted sparse entries */
+    std::vector<std::uint8_t> registers;  /**< Dense registers, empty while sparse */
+  };
+
+} // namespace hll
+} // namespace bvl
+
+#endif /* BAD_VALUE_HLL_HEADER */
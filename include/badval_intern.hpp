@@ -0,0 +1,539 @@
+/**
+ * @file badval_intern.hpp
+ * @author masscry
+ *
+ * Hash-consing of immutable values and documents.
+ *
+ * Factory returns canonical shared instance for every distinct term:
+ * equal leaves, arrays and objects built by one factory are one term,
+ * so duplicates are stored once and equality of terms is comparison of
+ * pointers. Array and object terms hold handles of their canonical
+ * children, so looking up new term compares children by pointers and
+ * hashes them by their cached hashes, it never walks subtrees.
+ *
+ * Table is split into shards by term hash, every shard is guarded by
+ * its own mutex. Table holds only weak entries: term is destroyed when
+ * its last handle is released, and its deleter drops its entry from
+ * table. Terms keep table alive, so handles may outlive factory.
+ *
+ * Numbers are compared by bits, so -0.0 and 0.0 are different terms
+ * and NaN is equal to NaN with same bits. Object members are sorted by
+ * key, so objects equal as documents (see bvl::doc::node_t) with any
+ * member order are one term.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_INTERN_HEADER
+#define BAD_VALUE_INTERN_HEADER
+
+#include <badval_doc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace intern
+{
+
+  using doc::node_t;
+
+  class term_t;
+  class factory_t;
+
+  /**
+   * Shared handle of canonical term.
+   */
+  using handle_t = std::shared_ptr<const term_t>;
+
+  namespace detail
+  {
+
+    class table_t;
+    struct release_t;
+
+    /**
+     * Same numbers by bits, same strings by contents.
+     */
+    inline bool Same(const value_t& lhs, const value_t& rhs) noexcept
+    {
+      if (lhs.Type() != rhs.Type())
+      {
+        return false;
+      }
+      if (lhs.Type() == value_t::number)
+      {
+        const auto left = lhs.As<value_t::number>();
+        const auto right = rhs.As<value_t::number>();
+        return std::memcmp(&left, &right, sizeof(double)) == 0;
+      }
+      return lhs == rhs;
+    }
+
+  } // namespace detail
+
+  /**
+   * Immutable canonical term.
+   *
+   * Term is either leaf with value, array of terms, or object of terms
+   * sorted by key. Hash of term is equal to hash of equal document.
+   */
+  class term_t final
+  {
+  public:
+
+    /**
+     * Term kind.
+     */
+    node_t::kind_t Kind() const noexcept
+    {
+      return this->kind;
+    }
+
+    /**
+     * Value of leaf.
+     *
+     * @throws std::logic_error when term is not leaf
+     */
+    const value_t& Value() const
+    {
+      if (this->kind != node_t::leaf)
+      {
+        throw std::logic_error("term is not leaf");
+      }
+      return this->value;
+    }
+
+    /**
+     * Number of array items or object members, 0 for leaf.
+     */
+    std::size_t Size() const noexcept
+    {
+      return this->children.size();
+    }
+
+    /**
+     * Array item or object member by position.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    const handle_t& At(std::size_t index) const
+    {
+      return this->children.at(index);
+    }
+
+    /**
+     * Key of object member by position, keys are sorted.
+     *
+     * @throws std::out_of_range when there is no such position
+     */
+    const std::string& Key(std::size_t index) const
+    {
+      return this->keys.at(index)->value.As<value_t::string>();
+    }
+
+    /**
+     * Find object member.
+     *
+     * @return member or nullptr when term is not object or has no such member
+     */
+    const term_t* Find(const std::string& name) const noexcept
+    {
+      const auto it = std::lower_bound(this->keys.begin(), this->keys.end(), name,
+        [](const handle_t& key, const std::string& name)
+        {
+          return key->value.As<value_t::string>() < name;
+        }
+      );
+      if ((it == this->keys.end()) || ((*it)->value.As<value_t::string>() != name))
+      {
+        return nullptr;
+      }
+      return this->children[static_cast<std::size_t>(it - this->keys.begin())].get();
+    }
+
+    /**
+     * Hash of term, equal to bvl::doc::node_t::Hash of equal document.
+     */
+    std::uint64_t Hash() const noexcept
+    {
+      return this->hash;
+    }
+
+    /**
+     * Build mutable document equal to term.
+     */
+    node_t Node() const
+    {
+      switch (this->kind)
+      {
+        case node_t::leaf:
+          return node_t(this->value);
+        case node_t::array:
+          {
+            auto result = node_t::Array();
+            for (const auto& child: this->children)
+            {
+              result.Push(child->Node());
+            }
+            return result;
+          }
+        case node_t::object:
+          break;
+      }
+      auto result = node_t::Object();
+      for (std::size_t i = 0; i < this->children.size(); ++i)
+      {
+        result.Set(this->Key(i), this->children[i]->Node());
+      }
+      return result;
+    }
+
+    term_t(const term_t&) = delete;
+    term_t& operator=(const term_t&) = delete;
+
+  private:
+    friend class factory_t;
+    friend class detail::table_t;
+    friend struct detail::release_t;
+
+    term_t(const detail::table_t* owner, node_t::kind_t kind, std::uint64_t hash)
+      : owner(owner), kind(kind), hash(hash), listed(false)
+    {
+      ;
+    }
+
+    ~term_t() = default;
+
+    /**
+     * Term has same contents, children are compared by pointers.
+     */
+    bool Same(node_t::kind_t kind, const value_t& value, const std::vector<handle_t>& children, const std::vector<handle_t>& keys) const noexcept
+    {
+      return (this->kind == kind)
+        && ((kind != node_t::leaf) || detail::Same(this->value, value))
+        && (this->children == children)
+        && (this->keys == keys);
+    }
+
+    const detail::table_t* owner;     /**< Table of factory which made term */
+    node_t::kind_t kind;              /**< Term kind */
+    value_t value;                    /**< Value of leaf */
+    std::vector<handle_t> children;   /**< Array items or object members */
+    std::vector<handle_t> keys;       /**< String leaves with member keys, sorted */
+    std::uint64_t hash;               /**< Hash of term */
+    bool listed;                      /**< Term has entry in table */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Sharded table of weak entries.
+     */
+    class table_t final
+    {
+    public:
+
+      /**
+       * Table entry, raw pointer tells entry of dying term from its replacement.
+       */
+      struct entry_t
+      {
+        const term_t* term;                 /**< Term address */
+        std::weak_ptr<const term_t> weak;   /**< Weak handle of term */
+      };
+
+      /**
+       * One shard of table.
+       */
+      struct shard_t
+      {
+        std::mutex mutex;                                         /**< Guards entries */
+        std::unordered_multimap<std::uint64_t, entry_t> entries;  /**< Entries by term hash */
+      };
+
+      explicit table_t(std::size_t shards)
+        : shardBits(0), hits(0), misses(0)
+      {
+        while ((std::size_t(1) << this->shardBits) < shards)
+        {
+          ++this->shardBits;
+        }
+        this->shards.reset(new shard_t[std::size_t(1) << this->shardBits]);
+      }
+
+      shard_t& ShardOf(std::uint64_t hash) noexcept
+      {
+        return this->shards[static_cast<std::size_t>(doc::detail::Mix(hash) & ((std::uint64_t(1) << this->shardBits) - 1))];
+      }
+
+      /**
+       * Drop entry of dying term.
+       */
+      void Drop(const term_t* term) noexcept
+      {
+        auto& shard = this->ShardOf(term->hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto range = shard.entries.equal_range(term->hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+          if (it->second.term == term)
+          {
+            shard.entries.erase(it);
+            return;
+          }
+        }
+      }
+
+      std::size_t Size() noexcept
+      {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < (std::size_t(1) << this->shardBits); ++i)
+        {
+          std::lock_guard<std::mutex> lock(this->shards[i].mutex);
+          result += this->shards[i].entries.size();
+        }
+        return result;
+      }
+
+      std::size_t shardBits;                  /**< Log2 of shard count */
+      std::unique_ptr<shard_t[]> shards;      /**< Shards */
+      std::atomic<std::uint64_t> hits;        /**< Lookups which found term */
+      std::atomic<std::uint64_t> misses;      /**< Lookups which made term */
+    };
+
+    /**
+     * Deleter of term, drops its entry before freeing it.
+     */
+    struct release_t
+    {
+      std::shared_ptr<table_t> table;   /**< Table of term */
+
+      void operator()(const term_t* term) const noexcept
+      {
+        if (term->listed)
+        {
+          this->table->Drop(term);
+        }
+        // children are released outside of shard lock, they may live in same shard
+        delete term;
+      }
+    };
+
+  } // namespace detail
+
+  /**
+   * Factory of canonical terms.
+   *
+   * Factory may be used from many threads. Handles passed to factory
+   * must be made by same factory.
+   */
+  class factory_t final
+  {
+  public:
+
+    /**
+     * Create empty factory.
+     *
+     * @param [in] shards number of table shards, rounded up to power of two
+     */
+    explicit factory_t(std::size_t shards = 64)
+      : table(std::make_shared<detail::table_t>(shards))
+    {
+      ;
+    }
+
+    /**
+     * Canonical leaf.
+     *
+     * @throws std::invalid_argument when value is pointer
+     */
+    handle_t Leaf(value_t value)
+    {
+      if (value.Type() == value_t::pointer)
+      {
+        throw std::invalid_argument("pointer can't be interned");
+      }
+      const auto hash = doc::detail::Mix(static_cast<std::uint64_t>(node_t::leaf) + 0x9E3779B97F4A7C15ULL)
+        ^ doc::detail::Mix(static_cast<std::uint64_t>(value.Hash()) + static_cast<std::uint64_t>(value.Type()));
+      return this->Make(node_t::leaf, doc::detail::Digest(hash), std::move(value), std::vector<handle_t>(), std::vector<handle_t>());
+    }
+
+    /**
+     * Canonical array.
+     *
+     * @throws std::invalid_argument when item is null or made by other factory
+     */
+    handle_t Array(std::vector<handle_t> items)
+    {
+      auto hash = doc::detail::Mix(static_cast<std::uint64_t>(node_t::array) + 0x9E3779B97F4A7C15ULL);
+      for (const auto& item: items)
+      {
+        this->Expect(item);
+        hash = doc::detail::Mix(hash ^ item->hash);
+      }
+      return this->Make(node_t::array, doc::detail::Digest(hash), value_t(), std::move(items), std::vector<handle_t>());
+    }
+
+    /**
+     * Canonical object, members are sorted by key.
+     *
+     * @throws std::invalid_argument when member is null, made by other factory, or key repeats
+     */
+    handle_t Object(std::vector<std::pair<std::string, handle_t>> members)
+    {
+      std::sort(members.begin(), members.end(),
+        [](const std::pair<std::string, handle_t>& lhs, const std::pair<std::string, handle_t>& rhs)
+        {
+          return lhs.first < rhs.first;
+        }
+      );
+      auto hash = doc::detail::Mix(static_cast<std::uint64_t>(node_t::object) + 0x9E3779B97F4A7C15ULL);
+      std::vector<handle_t> children;
+      std::vector<handle_t> keys;
+      children.reserve(members.size());
+      keys.reserve(members.size());
+      for (auto& member: members)
+      {
+        this->Expect(member.second);
+        if (!keys.empty() && (keys.back()->value.As<value_t::string>() == member.first))
+        {
+          throw std::invalid_argument("object key '" + member.first + "' repeats");
+        }
+        // same formula as node_t::Hash, so hashes of terms and documents agree
+        hash += doc::detail::Mix(static_cast<std::uint64_t>(doc::KeyHash(member.first)) * 0x9E3779B97F4A7C15ULL ^ member.second->hash);
+        keys.push_back(this->Leaf(value_t(std::move(member.first))));
+        children.push_back(std::move(member.second));
+      }
+      return this->Make(node_t::object, doc::detail::Digest(hash), value_t(), std::move(children), std::move(keys));
+    }
+
+    /**
+     * Canonical term equal to document.
+     *
+     * @throws std::invalid_argument when document holds pointers
+     */
+    handle_t Intern(const node_t& document)
+    {
+      switch (document.Kind())
+      {
+        case node_t::leaf:
+          if (document.Value().Type() == value_t::pointer)
+          {
+            throw std::invalid_argument("pointer can't be interned");
+          }
+          return this->Leaf(document.Value());
+        case node_t::array:
+          {
+            std::vector<handle_t> items;
+            items.reserve(document.Size());
+            for (std::size_t i = 0; i < document.Size(); ++i)
+            {
+              items.push_back(this->Intern(document.At(i)));
+            }
+            return this->Array(std::move(items));
+          }
+        case node_t::object:
+          break;
+      }
+      std::vector<std::pair<std::string, handle_t>> members;
+      members.reserve(document.Size());
+      for (std::size_t i = 0; i < document.Size(); ++i)
+      {
+        members.emplace_back(document.Key(i).name, this->Intern(document.At(i)));
+      }
+      return this->Object(std::move(members));
+    }
+
+    /**
+     * Number of live terms.
+     */
+    std::size_t Size() const
+    {
+      return this->table->Size();
+    }
+
+    /**
+     * Number of lookups which returned existing term.
+     */
+    std::uint64_t Hits() const noexcept
+    {
+      return this->table->hits.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of lookups which made new term.
+     */
+    std::uint64_t Misses() const noexcept
+    {
+      return this->table->misses.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    void Expect(const handle_t& handle) const
+    {
+      if ((handle == nullptr) || (handle->owner != this->table.get()))
+      {
+        throw std::invalid_argument("term is null or made by other factory");
+      }
+    }
+
+    /**
+     * Find live term with same contents or add new one.
+     */
+    handle_t Make(node_t::kind_t kind, std::uint64_t hash, value_t value, std::vector<handle_t> children, std::vector<handle_t> keys)
+    {
+      // declared before lock, so handles dropped here are released after unlock:
+      // last handle runs deleter, which locks shard and releases children
+      handle_t result;
+      std::vector<handle_t> others;
+      auto& shard = this->table->ShardOf(hash);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto range = shard.entries.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        // dying term fails to lock, its deleter waits for shard lock to drop entry
+        auto existing = it->second.weak.lock();
+        if (existing == nullptr)
+        {
+          continue;
+        }
+        if (existing->Same(kind, value, children, keys))
+        {
+          this->table->hits.fetch_add(1, std::memory_order_relaxed);
+          result = std::move(existing);
+          return result;
+        }
+        others.push_back(std::move(existing));
+      }
+
+      auto* term = new term_t(this->table.get(), kind, hash);
+      result = handle_t(term, detail::release_t{ this->table });
+      term->value = std::move(value);
+      term->children = std::move(children);
+      term->keys = std::move(keys);
+      shard.entries.emplace(hash, detail::table_t::entry_t{ term, result });
+      term->listed = true;
+      this->table->misses.fetch_add(1, std::memory_order_relaxed);
+      return result;
+    }
+
+    std::shared_ptr<detail::table_t> table;   /**< Shared with deleters of terms */
+  };
+
+} // namespace intern
+} // namespace bvl
+
+#endif /* BAD_VALUE_INTERN_HEADER */
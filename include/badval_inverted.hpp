@@ -0,0 +1,906 @@
+/**
+ * @file badval_inverted.hpp
+ * @author masscry
+ *
+ * Inverted index of tokens found in string values.
+ *
+ * Every added value gets next document number. String values are
+ * split into tokens: runs of ASCII letters and digits, lower-cased,
+ * and bytes above 0x7F, so UTF-8 words stay whole. For every token
+ * index keeps sorted list of documents containing it (posting list).
+ *
+ * New documents are collected in memory and sealed into immutable
+ * segments. Posting lists in segment are compressed in blocks of 128
+ * documents: difference to document four positions back, bit-packed
+ * with width of largest difference, interleaved in four 32-bit lanes,
+ * so SSE2 unpacks and sums four lanes at once. Last partial block of
+ * list is stored as varint differences. Segments of same size are
+ * merged, so number of segments stays logarithmic.
+ *
+ * Queries intersect (AND) or unite (OR) posting lists segment by segment.
+ * Intersection walks shortest list and gallops in others: exponential
+ * search over block bounds first, then inside decoded block.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_INVERTED_HEADER
+#define BAD_VALUE_INVERTED_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bvl
+{
+namespace inverted
+{
+
+  /**
+   * Documents in one compressed block.
+   */
+  constexpr std::size_t blockSize = 128;
+
+  /**
+   * Call visitor(const std::string& token) for every token of text.
+   */
+  template<typename visitor_t>
+  void Tokenize(const std::string& text, visitor_t&& visitor)
+  {
+    std::string token;
+    for (const auto item: text)
+    {
+      const auto byte = static_cast<unsigned char>(item);
+      if ((byte >= 'A') && (byte <= 'Z'))
+      {
+        token.push_back(static_cast<char>(byte - 'A' + 'a'));
+      }
+      else if (((byte >= 'a') && (byte <= 'z')) || ((byte >= '0') && (byte <= '9')) || (byte > 0x7F))
+      {
+        token.push_back(item);
+      }
+      else if (!token.empty())
+      {
+        visitor(token);
+        token.clear();
+      }
+    }
+    if (!token.empty())
+    {
+      visitor(token);
+    }
+  }
+
+  /**
+   * Token as it is stored in index, empty when text is not a single token.
+   */
+  inline std::string Normalize(const std::string& text)
+  {
+    std::string result;
+    std::size_t count = 0;
+    Tokenize(text,
+      [&result, &count](const std::string& token)
+      {
+        result = token;
+        ++count;
+      }
+    );
+    return (count == 1)? result: std::string();
+  }
+
+  namespace detail
+  {
+
+    /**
+     * Bits needed for number.
+     */
+    inline unsigned Width(std::uint32_t num) noexcept
+    {
+      return (num == 0)? 0: 32 - static_cast<unsigned>(__builtin_clz(num));
+    }
+
+    /**
+     * Pack block of sorted documents, return bit width.
+     *
+     * Difference of document i to document i - 4 (to base for first
+     * four) goes to lane i % 4. Each lane is packed into its own 32-bit
+     * words, words of four lanes are interleaved.
+     */
+    inline unsigned Pack(const std::uint32_t* docs, std::uint32_t base, std::string& out)
+    {
+      std::uint32_t deltas[blockSize];
+      std::uint32_t widest = 0;
+      for (std::size_t i = 0; i < blockSize; ++i)
+      {
+        deltas[i] = docs[i] - ((i < 4)? base: docs[i - 4]);
+        widest |= deltas[i];
+      }
+      const auto width = Width(widest);
+
+      std::uint32_t words[4 * 32] = { 0 };
+      for (unsigned lane = 0; lane < 4; ++lane)
+      {
+        unsigned bit = 0;
+        for (unsigned j = 0; j < blockSize / 4; ++j, bit += width)
+        {
+          const auto delta = static_cast<std::uint64_t>(deltas[4 * j + lane]);
+          const auto word = bit / 32;
+          const auto shift = bit % 32;
+          words[4 * word + lane] |= static_cast<std::uint32_t>(delta << shift);
+          if (shift + width > 32)
+          {
+            words[4 * (word + 1) + lane] |= static_cast<std::uint32_t>(delta >> (32 - shift));
+          }
+        }
+      }
+      for (unsigned i = 0; i < 4 * width; ++i)
+      {
+        serial::PutFixed32(out, words[i]);
+      }
+      return width;
+    }
+
+    /**
+     * Unpack block, one lane at a time.
+     */
+    inline void UnpackScalar(const char* data, unsigned width, std::uint32_t base, std::uint32_t* docs) noexcept
+    {
+      const std::uint32_t mask = (width == 32)? ~0u: ((1u << width) - 1);
+      for (unsigned lane = 0; lane < 4; ++lane)
+      {
+        auto doc = base;
+        unsigned bit = 0;
+        for (unsigned j = 0; j < blockSize / 4; ++j, bit += width)
+        {
+          std::uint32_t delta = 0;
+          if (width != 0)
+          {
+            const auto word = bit / 32;
+            const auto shift = bit % 32;
+            std::uint64_t bits = serial::DecodeFixed32(data + 4 * (4 * word + lane));
+            if (shift + width > 32)
+            {
+              bits |= static_cast<std::uint64_t>(serial::DecodeFixed32(data + 4 * (4 * (word + 1) + lane))) << 32;
+            }
+            delta = static_cast<std::uint32_t>(bits >> shift) & mask;
+          }
+          doc += delta;
+          docs[4 * j + lane] = doc;
+        }
+      }
+    }
+
+#if defined(__SSE2__)
+
+    /**
+     * Unpack block, four lanes at once.
+     */
+    inline void UnpackSimd(const char* data, unsigned width, std::uint32_t base, std::uint32_t* docs) noexcept
+    {
+      auto sum = _mm_set1_epi32(static_cast<int>(base));
+      auto out = reinterpret_cast<__m128i*>(docs);
+      if (width == 0)
+      {
+        for (unsigned j = 0; j < blockSize / 4; ++j)
+        {
+          _mm_storeu_si128(out + j, sum);
+        }
+        return;
+      }
+
+      const auto mask = _mm_set1_epi32((width == 32)? -1: static_cast<int>((1u << width) - 1));
+      auto in = reinterpret_cast<const __m128i*>(data);
+      auto word = _mm_loadu_si128(in++);
+      unsigned shift = 0;
+      for (unsigned j = 0; j < blockSize / 4; ++j)
+      {
+        if (shift == 32)
+        {
+          word = _mm_loadu_si128(in++);
+          shift = 0;
+        }
+        auto delta = _mm_srl_epi32(word, _mm_cvtsi32_si128(static_cast<int>(shift)));
+        if (shift + width > 32)
+        {
+          word = _mm_loadu_si128(in++);
+          delta = _mm_or_si128(delta, _mm_sll_epi32(word, _mm_cvtsi32_si128(static_cast<int>(32 - shift))));
+          shift = shift + width - 32;
+        }
+        else
+        {
+          shift += width;
+        }
+        sum = _mm_add_epi32(sum, _mm_and_si128(delta, mask));
+        _mm_storeu_si128(out + j, sum);
+      }
+    }
+
+#endif
+
+    /**
+     * Unpack block with fastest available routine.
+     */
+    inline void Unpack(const char* data, unsigned width, std::uint32_t base, std::uint32_t* docs) noexcept
+    {
+#if defined(__SSE2__)
+      UnpackSimd(data, width, base, docs);
+#else
+      UnpackScalar(data, width, base, docs);
+#endif
+    }
+
+    /**
+     * Compressed block of posting list.
+     */
+    struct block_t
+    {
+      std::uint32_t base;    /**< Previous document, or first document for first block */
+      std::uint32_t last;    /**< Last document in block */
+      std::uint32_t offset;  /**< Offset of block data in segment */
+      std::uint32_t width;   /**< Bit width of full block */
+    };
+
+    /**
+     * Posting list in segment.
+     */
+    struct posting_t
+    {
+      std::uint32_t count;   /**< Number of documents */
+      std::uint32_t first;   /**< First block in segment */
+    };
+
+    /**
+     * Immutable set of posting lists for range of documents.
+     */
+    struct segment_t
+    {
+      std::uint32_t begin;                /**< First document */
+      std::uint32_t end;                  /**< Document after last */
+      unsigned level;                     /**< Merge level */
+      std::vector<std::string> terms;     /**< Sorted terms */
+      std::vector<posting_t> postings;    /**< Posting of every term */
+      std::vector<block_t> blocks;        /**< Blocks of all postings */
+      std::string data;                   /**< Packed blocks */
+
+      /**
+       * Posting of term, or nullptr.
+       */
+      const posting_t* Find(const std::string& term) const
+      {
+        auto it = std::lower_bound(this->terms.begin(), this->terms.end(), term);
+        if ((it == this->terms.end()) || (*it != term))
+        {
+          return nullptr;
+        }
+        return &this->postings[static_cast<std::size_t>(it - this->terms.begin())];
+      }
+
+      /**
+       * Append posting list of sorted documents.
+       */
+      void Add(std::string term, const std::vector<std::uint32_t>& docs)
+      {
+        this->terms.push_back(std::move(term));
+        this->postings.push_back({ static_cast<std::uint32_t>(docs.size()), static_cast<std::uint32_t>(this->blocks.size()) });
+        for (std::size_t i = 0; i < docs.size(); i += blockSize)
+        {
+          block_t block;
+          block.base = (i == 0)? docs[0]: docs[i - 1];
+          block.last = docs[std::min(i + blockSize, docs.size()) - 1];
+          block.offset = static_cast<std::uint32_t>(this->data.size());
+          if (i + blockSize <= docs.size())
+          {
+            block.width = Pack(docs.data() + i, block.base, this->data);
+          }
+          else
+          {
+            block.width = 0;
+            auto prev = block.base;
+            for (std::size_t j = i; j < docs.size(); ++j)
+            {
+              serial::PutVarint(this->data, docs[j] - prev);
+              prev = docs[j];
+            }
+          }
+          this->blocks.push_back(block);
+        }
+      }
+    };
+
+    /**
+     * Cursor over compressed posting list.
+     */
+    class cursor_t final
+    {
+    public:
+
+      cursor_t(const segment_t& segment, const posting_t& posting) noexcept
+        : segment(&segment), count(posting.count), first(posting.first),
+          blocks((posting.count + blockSize - 1) / blockSize), block(0), pos(0), size(0)
+      {
+        this->Load(0);
+      }
+
+      /**
+       * Number of documents in list.
+       */
+      std::uint32_t Count() const noexcept
+      {
+        return this->count;
+      }
+
+      bool Valid() const noexcept
+      {
+        return this->pos < this->size;
+      }
+
+      std::uint32_t Doc() const noexcept
+      {
+        return this->docs[this->pos];
+      }
+
+      void Next() noexcept
+      {
+        if ((++this->pos == this->size) && (this->block + 1 < this->blocks))
+        {
+          this->Load(this->block + 1);
+        }
+      }
+
+      /**
+       * Move to first document not less than target.
+       */
+      void Seek(std::uint32_t target) noexcept
+      {
+        if (!this->Valid() || (this->Doc() >= target))
+        {
+          return;
+        }
+        const auto blockData = this->segment->blocks.data() + this->first;
+        if (blockData[this->block].last < target)
+        {
+          // gallop over blocks
+          std::size_t low = this->block + 1;
+          std::size_t step = 1;
+          while ((low + step < this->blocks) && (blockData[low + step].last < target))
+          {
+            low += step;
+            step *= 2;
+          }
+          const auto high = std::min<std::size_t>(low + step + 1, this->blocks);
+          const auto found = std::lower_bound(blockData + low, blockData + high, target,
+            [](const block_t& item, std::uint32_t target)
+            {
+              return item.last < target;
+            }
+          );
+          if (found == blockData + this->blocks)
+          {
+            this->pos = this->size;
+            return;
+          }
+          this->Load(static_cast<std::size_t>(found - blockData));
+        }
+
+        // gallop inside block
+        std::size_t low = this->pos;
+        std::size_t step = 1;
+        while ((low + step < this->size) && (this->docs[low + step] < target))
+        {
+          low += step;
+          step *= 2;
+        }
+        const auto high = std::min(low + step + 1, this->size);
+        this->pos = static_cast<std::size_t>(std::lower_bound(this->docs + low, this->docs + high, target) - this->docs);
+      }
+
+    private:
+
+      void Load(std::size_t index) noexcept
+      {
+        const auto& item = this->segment->blocks[this->first + index];
+        const auto data = this->segment->data.data() + item.offset;
+        this->block = index;
+        this->pos = 0;
+        this->size = std::min<std::size_t>(blockSize, this->count - index * blockSize);
+        if (this->size == blockSize)
+        {
+          Unpack(data, item.width, item.base, this->docs);
+          return;
+        }
+        const auto end = this->segment->data.data() + this->segment->data.size();
+        auto cursor = data;
+        auto doc = item.base;
+        for (std::size_t i = 0; i < this->size; ++i)
+        {
+          std::uint64_t delta = 0;
+          serial::GetVarint(cursor, end, delta);
+          doc += static_cast<std::uint32_t>(delta);
+          this->docs[i] = doc;
+        }
+      }
+
+      const segment_t* segment;        /**< Owner of list */
+      std::uint32_t count;             /**< Documents in list */
+      std::uint32_t first;             /**< First block of list in segment */
+      std::size_t blocks;              /**< Blocks in list */
+      std::size_t block;               /**< Current block */
+      std::size_t pos;                 /**< Position in decoded block */
+      std::size_t size;                /**< Documents in decoded block */
+      std::uint32_t docs[blockSize];   /**< Decoded block */
+    };
+
+    /**
+     * Cursor over not yet sealed list.
+     */
+    class vectorCursor_t final
+    {
+    public:
+
+      explicit vectorCursor_t(const std::vector<std::uint32_t>& docs) noexcept
+        : docs(&docs), pos(0)
+      {
+        ;
+      }
+
+      std::uint32_t Count() const noexcept
+      {
+        return static_cast<std::uint32_t>(this->docs->size());
+      }
+
+      bool Valid() const noexcept
+      {
+        return this->pos < this->docs->size();
+      }
+
+      std::uint32_t Doc() const noexcept
+      {
+        return (*this->docs)[this->pos];
+      }
+
+      void Next() noexcept
+      {
+        ++this->pos;
+      }
+
+      void Seek(std::uint32_t target) noexcept
+      {
+        std::size_t low = this->pos;
+        std::size_t step = 1;
+        const auto size = this->docs->size();
+        if ((low >= size) || ((*this->docs)[low] >= target))
+        {
+          return;
+        }
+        while ((low + step < size) && ((*this->docs)[low + step] < target))
+        {
+          low += step;
+          step *= 2;
+        }
+        const auto begin = this->docs->begin();
+        const auto high = std::min(low + step + 1, size);
+        this->pos = static_cast<std::size_t>(std::lower_bound(begin + low, begin + high, target) - begin);
+      }
+
+    private:
+
+      const std::vector<std::uint32_t>* docs;  /**< List */
+      std::size_t pos;                         /**< Current document */
+    };
+
+    /**
+     * Append documents present in all cursors.
+     */
+    template<typename cursor_t>
+    void Intersect(std::vector<cursor_t>& cursors, std::vector<std::uint32_t>& out)
+    {
+      std::sort(cursors.begin(), cursors.end(),
+        [](const cursor_t& lhs, const cursor_t& rhs)
+        {
+          return lhs.Count() < rhs.Count();
+        }
+      );
+      auto& lead = cursors.front();
+      while (lead.Valid())
+      {
+        auto target = lead.Doc();
+        bool matched = true;
+        for (std::size_t i = 1; i < cursors.size(); ++i)
+        {
+          cursors[i].Seek(target);
+          if (!cursors[i].Valid())
+          {
+            return;
+          }
+          if (cursors[i].Doc() != target)
+          {
+            lead.Seek(cursors[i].Doc());
+            matched = false;
+            break;
+          }
+        }
+        if (matched)
+        {
+          out.push_back(target);
+          lead.Next();
+        }
+      }
+    }
+
+    /**
+     * Append documents present in any cursor.
+     */
+    template<typename cursor_t>
+    void Unite(std::vector<cursor_t>& cursors, std::vector<std::uint32_t>& out)
+    {
+      // cursors are kept as heap by current document
+      auto later = [](const cursor_t* lhs, const cursor_t* rhs)
+      {
+        return lhs->Doc() > rhs->Doc();
+      };
+      std::vector<cursor_t*> heap;
+      for (auto& cursor: cursors)
+      {
+        if (cursor.Valid())
+        {
+          heap.push_back(&cursor);
+        }
+      }
+      std::make_heap(heap.begin(), heap.end(), later);
+      while (!heap.empty())
+      {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        auto cursor = heap.back();
+        if (out.empty() || (out.back() != cursor->Doc()))
+        {
+          out.push_back(cursor->Doc());
+        }
+        cursor->Next();
+        if (cursor->Valid())
+        {
+          std::push_heap(heap.begin(), heap.end(), later);
+        }
+        else
+        {
+          heap.pop_back();
+        }
+      }
+    }
+
+  } // namespace detail
+
+  /**
+   * Index options.
+   */
+  struct options_t
+  {
+    std::size_t segmentDocuments = 65536;  /**< Documents collected before sealing segment */
+    std::size_t mergeFactor = 8;           /**< Segments of same level merged together */
+  };
+
+  /**
+   * Query kind.
+   */
+  enum match_t
+  {
+    all, /**< Documents with every term (AND) */
+    any  /**< Documents with at least one term (OR) */
+  };
+
+  /**
+   * Inverted index over added values.
+   *
+   * Not thread-safe: concurrent const calls are fine, any non-const
+   * call needs exclusive access.
+   */
+  class index_t final
+  {
+  public:
+
+    explicit index_t(options_t options = options_t())
+      : options(options), next(0), pendingBegin(0)
+    {
+      if (this->options.mergeFactor < 2)
+      {
+        this->options.mergeFactor = 2;
+      }
+    }
+
+    /**
+     * Add value as next document. Only string values have tokens.
+     *
+     * @return document number
+     */
+    std::uint32_t Add(const value_t& value)
+    {
+      const auto doc = this->next++;
+      if (value.Type() == value_t::string)
+      {
+        Tokenize(value.As<value_t::string>(),
+          [this, doc](const std::string& token)
+          {
+            auto& docs = this->pending[token];
+            if (docs.empty() || (docs.back() != doc))
+            {
+              docs.push_back(doc);
+            }
+          }
+        );
+      }
+      if (this->next - this->pendingBegin >= this->options.segmentDocuments)
+      {
+        this->Flush();
+      }
+      return doc;
+    }
+
+    /**
+     * Seal collected documents into segment.
+     */
+    void Flush()
+    {
+      if (this->next == this->pendingBegin)
+      {
+        return;
+      }
+      std::vector<std::pair<std::string, std::vector<std::uint32_t>>> lists;
+      lists.reserve(this->pending.size());
+      for (auto& item: this->pending)
+      {
+        lists.emplace_back(item.first, std::move(item.second));
+      }
+      this->pending.clear();
+      std::sort(lists.begin(), lists.end(),
+        [](const std::pair<std::string, std::vector<std::uint32_t>>& lhs, const std::pair<std::string, std::vector<std::uint32_t>>& rhs)
+        {
+          return lhs.first < rhs.first;
+        }
+      );
+
+      std::unique_ptr<detail::segment_t> segment(new detail::segment_t());
+      segment->begin = this->pendingBegin;
+      segment->end = this->next;
+      segment->level = 0;
+      for (auto& list: lists)
+      {
+        segment->Add(std::move(list.first), list.second);
+      }
+      this->segments.push_back(std::move(segment));
+      this->pendingBegin = this->next;
+
+      // merge tail segments of one level, like carry in counter
+      for (;;)
+      {
+        const auto factor = this->options.mergeFactor;
+        if (this->segments.size() < factor)
+        {
+          break;
+        }
+        const auto level = this->segments.back()->level;
+        const auto from = this->segments.size() - factor;
+        bool same = true;
+        for (auto i = from; i < this->segments.size(); ++i)
+        {
+          same = same && (this->segments[i]->level == level);
+        }
+        if (!same)
+        {
+          break;
+        }
+        this->Merge(from, level + 1);
+      }
+    }
+
+    /**
+     * Seal collected documents and merge everything into one segment.
+     */
+    void Optimize()
+    {
+      this->Flush();
+      if (this->segments.size() > 1)
+      {
+        this->Merge(0, this->segments.back()->level + 1);
+      }
+    }
+
+    /**
+     * Documents matching terms. Terms are normalized as tokens.
+     *
+     * Empty term list matches nothing.
+     *
+     * @return sorted document numbers
+     */
+    std::vector<std::uint32_t> Search(const std::vector<std::string>& terms, match_t match) const
+    {
+      std::vector<std::string> tokens;
+      for (const auto& term: terms)
+      {
+        tokens.push_back(Normalize(term));
+      }
+      std::vector<std::uint32_t> result;
+      if (tokens.empty())
+      {
+        return result;
+      }
+
+      for (const auto& segment: this->segments)
+      {
+        std::vector<detail::cursor_t> cursors;
+        cursors.reserve(tokens.size());
+        bool missing = false;
+        for (const auto& token: tokens)
+        {
+          auto posting = segment->Find(token);
+          if (posting != nullptr)
+          {
+            cursors.emplace_back(*segment, *posting);
+          }
+          else
+          {
+            missing = true;
+          }
+        }
+        Run(cursors, missing, match, result);
+      }
+
+      std::vector<detail::vectorCursor_t> cursors;
+      bool missing = false;
+      for (const auto& token: tokens)
+      {
+        auto it = this->pending.find(token);
+        if (it != this->pending.end())
+        {
+          cursors.emplace_back(it->second);
+        }
+        else
+        {
+          missing = true;
+        }
+      }
+      Run(cursors, missing, match, result);
+      return result;
+    }
+
+    /**
+     * Documents containing every term.
+     */
+    std::vector<std::uint32_t> And(const std::vector<std::string>& terms) const
+    {
+      return this->Search(terms, all);
+    }
+
+    /**
+     * Documents containing any term.
+     */
+    std::vector<std::uint32_t> Or(const std::vector<std::string>& terms) const
+    {
+      return this->Search(terms, any);
+    }
+
+    /**
+     * Number of added documents.
+     */
+    std::uint32_t Documents() const noexcept
+    {
+      return this->next;
+    }
+
+    /**
+     * Number of sealed segments.
+     */
+    std::size_t Segments() const noexcept
+    {
+      return this->segments.size();
+    }
+
+    /**
+     * Bytes of compressed posting lists.
+     */
+    std::size_t PostingBytes() const noexcept
+    {
+      std::size_t result = 0;
+      for (const auto& segment: this->segments)
+      {
+        result += segment->data.size() + segment->blocks.size() * sizeof(detail::block_t);
+      }
+      return result;
+    }
+
+  private:
+
+    template<typename cursor_t>
+    static void Run(std::vector<cursor_t>& cursors, bool missing, match_t match, std::vector<std::uint32_t>& result)
+    {
+      if (cursors.empty() || (missing && (match == all)))
+      {
+        return;
+      }
+      if (match == all)
+      {
+        detail::Intersect(cursors, result);
+      }
+      else
+      {
+        detail::Unite(cursors, result);
+      }
+    }
+
+    /**
+     * Replace segments [from, end) with one segment.
+     */
+    void Merge(std::size_t from, unsigned level)
+    {
+      using term_t = std::pair<const std::string*, std::size_t>;
+
+      std::unique_ptr<detail::segment_t> merged(new detail::segment_t());
+      merged->begin = this->segments[from]->begin;
+      merged->end = this->segments.back()->end;
+      merged->level = level;
+
+      // k-way merge of sorted term lists, documents of segments follow each other
+      auto later = [](const term_t& lhs, const term_t& rhs)
+      {
+        return (*lhs.first > *rhs.first) || ((*lhs.first == *rhs.first) && (lhs.second > rhs.second));
+      };
+      std::vector<term_t> heap;
+      std::vector<std::size_t> positions(this->segments.size(), 0);
+      for (auto i = from; i < this->segments.size(); ++i)
+      {
+        if (!this->segments[i]->terms.empty())
+        {
+          heap.emplace_back(&this->segments[i]->terms[0], i);
+        }
+      }
+      std::make_heap(heap.begin(), heap.end(), later);
+
+      std::vector<std::uint32_t> docs;
+      while (!heap.empty())
+      {
+        const auto term = *heap.front().first;
+        docs.clear();
+        while (!heap.empty() && (*heap.front().first == term))
+        {
+          std::pop_heap(heap.begin(), heap.end(), later);
+          const auto index = heap.back().second;
+          heap.pop_back();
+          const auto& segment = *this->segments[index];
+          auto& pos = positions[index];
+          for (detail::cursor_t cursor(segment, segment.postings[pos]); cursor.Valid(); cursor.Next())
+          {
+            docs.push_back(cursor.Doc());
+          }
+          if (++pos < segment.terms.size())
+          {
+            heap.emplace_back(&segment.terms[pos], index);
+            std::push_heap(heap.begin(), heap.end(), later);
+          }
+        }
+        merged->Add(term, docs);
+      }
+
+      this->segments.resize(from);
+      this->segments.push_back(std::move(merged));
+    }
+
+    options_t options;                                                       /**< Index options */
+    std::uint32_t next;                                                      /**< Next document number */
+    std::uint32_t pendingBegin;                                              /**< First not sealed document */
+    std::unordered_map<std::string, std::vector<std::uint32_t>> pending;     /**< Not sealed lists */
+    std::vector<std::unique_ptr<detail::segment_t>> segments;                /**< Sealed segments, oldest first */
+  };
+
+} // namespace inverted
+} // namespace bvl
+
+#endif /* BAD_VALUE_INVERTED_HEADER */
@@ -0,0 +1,420 @@
+/**
+ * @file badval_join.hpp
+ * @author masscry
+ *
+ * Hash join of two arrays of values by key equality.
+ *
+ * Join emits pairs of row indices (build row, probe row) for every pair
+ * of equal keys, values are never copied. Keys are compared with
+ * bvl::value_t::operator==, so numbers never match strings and NaN
+ * never matches anything.
+ *
+ * Small build side is put into one hash table. When build side is
+ * larger than cache, both sides are first radix partitioned by high
+ * bits of key hash, so every partition table fits into cache and is
+ * probed only by rows of same partition. Partitioning, building of
+ * partition tables and probing are spread over worker threads.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_JOIN_HEADER
+#define BAD_VALUE_JOIN_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace bvl
+{
+namespace join
+{
+
+  /**
+   * Matched rows.
+   */
+  struct pair_t
+  {
+    std::size_t build; /**< Index of build row */
+    std::size_t probe; /**< Index of probe row */
+  };
+
+  /**
+   * Join options.
+   */
+  struct options_t
+  {
+    std::size_t threads = 0;                /**< Worker threads, 0 for one per hardware thread */
+    std::size_t radixThreshold = 1 << 16;   /**< Smallest build side which is radix partitioned */
+    unsigned radixBits = 0;                 /**< Partition bits, 0 to pick by build side size */
+  };
+
+  namespace detail
+  {
+
+    const std::size_t partitionRows = 1 << 13;  /**< Build rows per partition picked by default */
+    const std::size_t probeChunk = 1 << 16;     /**< Probe rows per task */
+    const unsigned maxRadixBits = 14;           /**< Most partition bits */
+
+    /**
+     * Finalizer of splitmix64, spreads bits of std::hash results.
+     */
+    inline std::uint64_t Mix(std::uint64_t hash) noexcept
+    {
+      hash ^= hash >> 30;
+      hash *= 0xbf58476d1ce4e5b9ULL;
+      hash ^= hash >> 27;
+      hash *= 0x94d049bb133111ebULL;
+      hash ^= hash >> 31;
+      return hash;
+    }
+
+    /**
+     * Row of one side with its key hash.
+     */
+    struct entry_t
+    {
+      std::uint64_t hash; /**< Mixed key hash */
+      std::size_t row;    /**< Row index */
+    };
+
+    /**
+     * Run tasks on worker threads, task gets its index and worker index.
+     *
+     * Exception of task stops handing out tasks, and is rethrown after
+     * all workers are joined.
+     *
+     * @throws exception of first failed worker, std::system_error when thread can't start
+     */
+    template<typename task_t>
+    void Parallel(std::size_t threads, std::size_t tasks, const task_t& task)
+    {
+      threads = std::min(threads, tasks);
+      if (threads <= 1)
+      {
+        for (std::size_t i = 0; i < tasks; ++i)
+        {
+          task(i, 0);
+        }
+        return;
+      }
+
+      std::atomic<std::size_t> next(0);
+      // last slot is for failure to start workers
+      std::vector<std::exception_ptr> errors(threads + 1);
+      auto worker = [&next, &errors, &task, tasks](std::size_t id)
+      {
+        try
+        {
+          for (auto i = next.fetch_add(1); i < tasks; i = next.fetch_add(1))
+          {
+            task(i, id);
+          }
+        }
+        catch (...)
+        {
+          errors[id] = std::current_exception();
+          next.store(tasks);
+        }
+      };
+      std::vector<std::thread> workers;
+      try
+      {
+        workers.reserve(threads - 1);
+        for (std::size_t id = 1; id < threads; ++id)
+        {
+          workers.emplace_back(worker, id);
+        }
+      }
+      catch (...)
+      {
+        errors[threads] = std::current_exception();
+        next.store(tasks);
+      }
+      worker(0);
+      for (auto& item: workers)
+      {
+        item.join();
+      }
+      for (const auto& error: errors)
+      {
+        if (error)
+        {
+          std::rethrow_exception(error);
+        }
+      }
+    }
+
+    /**
+     * Hash keys and scatter rows into partitions by high hash bits.
+     *
+     * Every thread histograms and scatters own contiguous chunk, so rows
+     * of partition keep their original order.
+     *
+     * @param [in] keys keys of side
+     * @param [in] size number of keys
+     * @param [in] bits partition bits
+     * @param [in] threads worker threads
+     * @param [out] entries rows grouped by partition
+     * @param [out] bounds 2^bits + 1 partition offsets in entries
+     */
+    inline void Partition(const value_t* keys, std::size_t size, unsigned bits, std::size_t threads,
+      std::vector<entry_t>& entries, std::vector<std::size_t>& bounds)
+    {
+      const std::size_t partitions = std::size_t(1) << bits;
+      const auto shift = 64 - bits;
+      const auto chunks = std::max<std::size_t>(1, std::min(threads, (size + probeChunk - 1) / probeChunk));
+      const auto chunk = (size + chunks - 1) / chunks;
+      auto part = [shift, bits](std::uint64_t hash)
+      {
+        return (bits == 0)? 0: static_cast<std::size_t>(hash >> shift);
+      };
+
+      std::vector<entry_t> hashed(size);
+      std::vector<std::size_t> counts(chunks * partitions, 0);
+      Parallel(threads, chunks, [&](std::size_t c, std::size_t)
+      {
+        auto* count = counts.data() + c * partitions;
+        const auto end = std::min(size, (c + 1) * chunk);
+        for (auto i = c * chunk; i < end; ++i)
+        {
+          hashed[i].hash = Mix(static_cast<std::uint64_t>(keys[i].Hash()));
+          hashed[i].row = i;
+          ++count[part(hashed[i].hash)];
+        }
+      });
+
+      // offset of every chunk inside every partition
+      bounds.assign(partitions + 1, 0);
+      std::size_t total = 0;
+      for (std::size_t p = 0; p < partitions; ++p)
+      {
+        bounds[p] = total;
+        for (std::size_t c = 0; c < chunks; ++c)
+        {
+          const auto count = counts[c * partitions + p];
+          counts[c * partitions + p] = total;
+          total += count;
+        }
+      }
+      bounds[partitions] = total;
+
+      if (bits == 0)
+      {
+        entries.swap(hashed);
+        return;
+      }
+      entries.resize(size);
+      Parallel(threads, chunks, [&](std::size_t c, std::size_t)
+      {
+        auto* offset = counts.data() + c * partitions;
+        const auto end = std::min(size, (c + 1) * chunk);
+        for (auto i = c * chunk; i < end; ++i)
+        {
+          entries[offset[part(hashed[i].hash)]++] = hashed[i];
+        }
+      });
+    }
+
+    /**
+     * Chained hash table over build rows of one partition.
+     */
+    class table_t final
+    {
+    public:
+
+      table_t()
+        : mask(0)
+      {
+        ;
+      }
+
+      /**
+       * Put partition rows into table.
+       *
+       * @param [in] entries build rows of partition
+       * @param [in] size number of rows
+       *
+       * @throws std::length_error when partition is too large
+       */
+      void Build(const entry_t* entries, std::size_t size)
+      {
+        if (size >= std::numeric_limits<std::uint32_t>::max())
+        {
+          throw std::length_error("join partition too large");
+        }
+        std::size_t buckets = 1;
+        while (buckets < 2 * size)
+        {
+          buckets <<= 1;
+        }
+        this->mask = buckets - 1;
+        this->heads.assign(buckets, 0);
+        this->next.resize(size);
+        // insert backwards, so chains list rows in build order
+        for (auto i = size; i-- > 0;)
+        {
+          auto& head = this->heads[entries[i].hash & this->mask];
+          this->next[i] = head;
+          head = static_cast<std::uint32_t>(i + 1);
+        }
+      }
+
+      /**
+       * Emit pairs for probe rows.
+       *
+       * @param [in] build keys of build side
+       * @param [in] entries build rows of partition, same as given to Build
+       * @param [in] probe keys of probe side
+       * @param [in] rows probe rows
+       * @param [in] size number of probe rows
+       * @param [out] out matched pairs
+       */
+      void Probe(const value_t* build, const entry_t* entries,
+        const value_t* probe, const entry_t* rows, std::size_t size, std::vector<pair_t>& out) const
+      {
+        if (this->heads.empty())
+        {
+          return;
+        }
+        for (std::size_t i = 0; i < size; ++i)
+        {
+          const auto& row = rows[i];
+          for (auto pos = this->heads[row.hash & this->mask]; pos != 0; pos = this->next[pos - 1])
+          {
+            const auto& entry = entries[pos - 1];
+            if ((entry.hash == row.hash) && (build[entry.row] == probe[row.row]))
+            {
+              out.push_back({ entry.row, row.row });
+            }
+          }
+        }
+      }
+
+    private:
+      std::size_t mask;                   /**< Bucket mask */
+      std::vector<std::uint32_t> heads;   /**< First row of bucket chain plus one, 0 for empty */
+      std::vector<std::uint32_t> next;    /**< Next row of chain plus one, 0 for end */
+    };
+
+    /**
+     * Partition bits for build side size.
+     */
+    inline unsigned RadixBits(std::size_t size, const options_t& options) noexcept
+    {
+      if (size < options.radixThreshold)
+      {
+        return 0;
+      }
+      if (options.radixBits != 0)
+      {
+        return std::min(options.radixBits, maxRadixBits);
+      }
+      unsigned bits = 1;
+      while ((bits < maxRadixBits) && ((size >> bits) > partitionRows))
+      {
+        ++bits;
+      }
+      return bits;
+    }
+
+  } // namespace detail
+
+  /**
+   * Join two sides by key equality.
+   *
+   * Pairs are grouped by partition, inside partition probe rows keep
+   * their order and build rows of each probe row are in build order.
+   *
+   * @param [in] build keys of build side, usually smaller one
+   * @param [in] buildSize number of build keys
+   * @param [in] probe keys of probe side
+   * @param [in] probeSize number of probe keys
+   * @param [in] options join options
+   *
+   * @return pairs of matched row indices
+   *
+   * @throws std::length_error when one partition holds too many build rows
+   * @throws std::system_error when worker thread can't start
+   */
+  inline std::vector<pair_t> Join(const value_t* build, std::size_t buildSize,
+    const value_t* probe, std::size_t probeSize, const options_t& options = options_t())
+  {
+    const auto threads = std::max<std::size_t>(1,
+      (options.threads != 0)? options.threads: std::thread::hardware_concurrency());
+    const auto bits = detail::RadixBits(buildSize, options);
+    const std::size_t partitions = std::size_t(1) << bits;
+
+    std::vector<detail::entry_t> buildRows;
+    std::vector<std::size_t> buildBounds;
+    detail::Partition(build, buildSize, bits, threads, buildRows, buildBounds);
+    std::vector<detail::entry_t> probeRows;
+    std::vector<std::size_t> probeBounds;
+    detail::Partition(probe, probeSize, bits, threads, probeRows, probeBounds);
+
+    std::vector<detail::table_t> tables(partitions);
+    detail::Parallel(threads, partitions, [&](std::size_t p, std::size_t)
+    {
+      tables[p].Build(buildRows.data() + buildBounds[p], buildBounds[p + 1] - buildBounds[p]);
+    });
+
+    // split large partitions of probe side, so single table is probed in parallel
+    struct task_t
+    {
+      std::size_t partition;
+      std::size_t begin;
+      std::size_t end;
+    };
+    std::vector<task_t> tasks;
+    for (std::size_t p = 0; p < partitions; ++p)
+    {
+      for (auto begin = probeBounds[p]; begin < probeBounds[p + 1]; begin += detail::probeChunk)
+      {
+        tasks.push_back({ p, begin, std::min(probeBounds[p + 1], begin + detail::probeChunk) });
+      }
+    }
+
+    std::vector<std::vector<pair_t>> found(tasks.size());
+    detail::Parallel(threads, tasks.size(), [&](std::size_t t, std::size_t)
+    {
+      const auto& task = tasks[t];
+      tables[task.partition].Probe(build, buildRows.data() + buildBounds[task.partition],
+        probe, probeRows.data() + task.begin, task.end - task.begin, found[t]);
+    });
+
+    std::size_t total = 0;
+    for (const auto& item: found)
+    {
+      total += item.size();
+    }
+    std::vector<pair_t> result;
+    result.reserve(total);
+    for (const auto& item: found)
+    {
+      result.insert(result.end(), item.begin(), item.end());
+    }
+    return result;
+  }
+
+  /**
+   * Join two vectors of keys.
+   *
+   * @see bvl::join::Join
+   */
+  inline std::vector<pair_t> Join(const std::vector<value_t>& build, const std::vector<value_t>& probe,
+    const options_t& options = options_t())
+  {
+    return Join(build.data(), build.size(), probe.data(), probe.size(), options);
+  }
+
+} // namespace join
+} // namespace bvl
+
+#endif /* BAD_VALUE_JOIN_HEADER */
@@ -0,0 +1,767 @@
+/**
+ * @file badval_log.hpp
+ * @author masscry
+ *
+ * Structured logging of values without allocations.
+ *
+ * Record is formatted as one line of JSON into thread local fixed buffer,
+ * then copied into lock-free bounded queue. Single writer thread drains
+ * queue and passes batches of records to output.
+ *
+ *     {"ts":1602000000000000000,"level":"info","msg":"request","path":"/a","ms":1.25}
+ *
+ * Numbers are printed in shortest form which reads back to the same double,
+ * strings are escaped, pointers are printed as hex strings.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_LOG_HEADER
+#define BAD_VALUE_LOG_HEADER
+
+#include <badval.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <thread>
+
+namespace bvl
+{
+namespace logging
+{
+
+  /**
+   * Record severity.
+   */
+  enum level_t
+  {
+    debug = 0,
+    info,
+    warning,
+    error
+  };
+
+  /**
+   * Named value of record. Holds references only.
+   */
+  struct field_t
+  {
+    const char* name;     /**< Field name, must be valid JSON string without escapes */
+    const value_t& value; /**< Field value */
+
+    field_t(const char* name, const value_t& value) noexcept
+      : name(name), value(value)
+    {
+      ;
+    }
+  };
+
+  /**
+   * Formatter into fixed size memory.
+   *
+   * Never allocates. When data does not fit, it is cut and buffer is
+   * marked as truncated.
+   */
+  class buffer_t final
+  {
+  public:
+
+    /**
+     * Wrap memory.
+     *
+     * @param [in] data memory to write to
+     * @param [in] capacity size of memory
+     */
+    buffer_t(char* data, std::size_t capacity) noexcept
+      : data(data), capacity(capacity), size(0), truncated(false)
+    {
+      ;
+    }
+
+    /**
+     * Written data.
+     */
+    const char* Data() const noexcept
+    {
+      return this->data;
+    }
+
+    /**
+     * Written bytes count.
+     */
+    std::size_t Size() const noexcept
+    {
+      return this->size;
+    }
+
+    /**
+     * Was anything cut.
+     */
+    bool Truncated() const noexcept
+    {
+      return this->truncated;
+    }
+
+    /**
+     * Current capacity.
+     */
+    std::size_t Capacity() const noexcept
+    {
+      return this->capacity;
+    }
+
+    /**
+     * Space left.
+     */
+    std::size_t Left() const noexcept
+    {
+      return this->capacity - this->size;
+    }
+
+    /**
+     * Forget written data.
+     */
+    void Clear() noexcept
+    {
+      this->size = 0;
+      this->truncated = false;
+    }
+
+    /**
+     * Drop data written after given size.
+     */
+    void Rewind(std::size_t size) noexcept
+    {
+      if (size < this->size)
+      {
+        this->size = size;
+      }
+    }
+
+    /**
+     * Make buffer smaller, to reserve space at the end.
+     *
+     * @return previous capacity
+     */
+    std::size_t Limit(std::size_t capacity) noexcept
+    {
+      auto prev = this->capacity;
+      this->capacity = (capacity < this->size)? this->size: capacity;
+      return prev;
+    }
+
+    /**
+     * Append one character.
+     */
+    bool Append(char ch) noexcept
+    {
+      if (this->size == this->capacity)
+      {
+        this->truncated = true;
+        return false;
+      }
+      this->data[this->size++] = ch;
+      return true;
+    }
+
+    /**
+     * Append raw bytes. Nothing is written if they don't fit.
+     */
+    bool Append(const char* text, std::size_t length) noexcept
+    {
+      if (length > this->Left())
+      {
+        this->truncated = true;
+        return false;
+      }
+      std::memcpy(this->data + this->size, text, length);
+      this->size += length;
+      return true;
+    }
+
+    /**
+     * Append null-terminated string as is.
+     */
+    bool Append(const char* text) noexcept
+    {
+      return this->Append(text, std::strlen(text));
+    }
+
+    /**
+     * Append unsigned integer in decimal.
+     */
+    bool Integer(std::uint64_t num) noexcept
+    {
+      char digits[20];
+      auto end = FormatInteger(num, digits + sizeof(digits));
+      return this->Append(end, static_cast<std::size_t>(digits + sizeof(digits) - end));
+    }
+
+    /**
+     * Append number in shortest form which reads back to same double.
+     *
+     * NaN and infinities are written as JSON strings.
+     */
+    bool Number(double num) noexcept
+    {
+      if (std::isnan(num))
+      {
+        return this->Append("\"nan\"", 5);
+      }
+      if (std::isinf(num))
+      {
+        return (num > 0)? this->Append("\"inf\"", 5): this->Append("\"-inf\"", 6);
+      }
+
+      char text[32];
+      auto length = FormatNumber(num, text);
+      return this->Append(text, length);
+    }
+
+    /**
+     * Append string in quotes, escaping it for JSON.
+     *
+     * Long string is cut to fit into buffer.
+     */
+    bool String(const char* text, std::size_t length) noexcept
+    {
+      static const char hex[] = "0123456789abcdef";
+
+      // keep space for closing quote
+      if (this->Left() < 2)
+      {
+        this->truncated = true;
+        return false;
+      }
+      auto prev = this->Limit(this->capacity - 1);
+      this->Append('"');
+
+      bool complete = true;
+      for (std::size_t i = 0; (i < length) && complete; ++i)
+      {
+        const auto ch = static_cast<unsigned char>(text[i]);
+        switch (ch)
+        {
+          case '"':
+            complete = this->Append("\\\"", 2);
+            break;
+          case '\\':
+            complete = this->Append("\\\\", 2);
+            break;
+          case '\n':
+            complete = this->Append("\\n", 2);
+            break;
+          case '\r':
+            complete = this->Append("\\r", 2);
+            break;
+          case '\t':
+            complete = this->Append("\\t", 2);
+            break;
+          default:
+            if (ch < 0x20)
+            {
+              const char escaped[6] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF] };
+              complete = this->Append(escaped, sizeof(escaped));
+            }
+            else
+            {
+              complete = this->Append(static_cast<char>(ch));
+            }
+        }
+      }
+
+      this->Limit(prev);
+      this->Append('"');
+      return complete;
+    }
+
+    /**
+     * Append pointer as JSON string with hex number.
+     */
+    bool Pointer(const void* ptr) noexcept
+    {
+      static const char hex[] = "0123456789abcdef";
+      char text[2 + 2 * sizeof(std::uintptr_t) + 2];
+      auto end = text + sizeof(text);
+      auto cursor = end;
+      *--cursor = '"';
+      auto bits = reinterpret_cast<std::uintptr_t>(ptr);
+      do
+      {
+        *--cursor = hex[bits & 0xF];
+        bits >>= 4;
+      }
+      while (bits != 0);
+      *--cursor = 'x';
+      *--cursor = '0';
+      *--cursor = '"';
+      return this->Append(cursor, static_cast<std::size_t>(end - cursor));
+    }
+
+    /**
+     * Append value as JSON.
+     */
+    bool Value(const value_t& value) noexcept
+    {
+      switch (value.Type())
+      {
+        case value_t::number:
+          return this->Number(value.As<value_t::number>());
+        case value_t::string:
+          {
+            const auto& text = value.As<value_t::string>();
+            return this->String(text.data(), text.size());
+          }
+        case value_t::pointer:
+          return this->Pointer(value.As<value_t::pointer>());
+        default:
+          assert(0);
+      }
+      return false;
+    }
+
+    /**
+     * Write digits of integer backwards, ending at end.
+     *
+     * @return pointer to first digit
+     */
+    static char* FormatInteger(std::uint64_t num, char* end) noexcept
+    {
+      static const char pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+      while (num >= 100)
+      {
+        const auto pair = static_cast<std::size_t>(num % 100) * 2;
+        num /= 100;
+        *--end = pairs[pair + 1];
+        *--end = pairs[pair];
+      }
+      if (num >= 10)
+      {
+        const auto pair = static_cast<std::size_t>(num) * 2;
+        *--end = pairs[pair + 1];
+        *--end = pairs[pair];
+      }
+      else
+      {
+        *--end = static_cast<char>('0' + num);
+      }
+      return end;
+    }
+
+    /**
+     * Format finite number.
+     *
+     * Fast path handles numbers with few decimal digits: it looks for
+     * smallest count of fractional digits k, so that integer m satisfies
+     * m / 10^k == num exactly in double arithmetic. Division of exact
+     * integers is correctly rounded, so decimal m / 10^k reads back to num,
+     * and smallest k gives shortest text. Other numbers go through printf
+     * with increasing precision until they read back.
+     *
+     * @param [out] text at least 32 characters
+     *
+     * @return length of text
+     */
+    static std::size_t FormatNumber(double num, char* text) noexcept
+    {
+      static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+      const double exactLimit = 9007199254740992.0; // 2^53
+
+      std::size_t length = 0;
+      if (std::signbit(num))
+      {
+        text[length++] = '-';
+        num = -num;
+      }
+
+      for (std::size_t k = 0; k < sizeof(pow10) / sizeof(pow10[0]); ++k)
+      {
+        const double scaled = num * pow10[k];
+        if (scaled >= exactLimit)
+        {
+          break;
+        }
+        const auto mantissa = static_cast<std::uint64_t>(scaled + 0.5);
+        if (static_cast<double>(mantissa) / pow10[k] != num)
+        {
+          continue;
+        }
+
+        char digits[20];
+        auto end = digits + sizeof(digits);
+        auto first = FormatInteger(mantissa, end);
+        auto count = static_cast<std::size_t>(end - first);
+        if (k == 0)
+        {
+          std::memcpy(text + length, first, count);
+          return length + count;
+        }
+        if (count <= k)
+        {
+          text[length++] = '0';
+          text[length++] = '.';
+          for (auto zeros = k - count; zeros != 0; --zeros)
+          {
+            text[length++] = '0';
+          }
+          std::memcpy(text + length, first, count);
+          return length + count;
+        }
+        std::memcpy(text + length, first, count - k);
+        length += count - k;
+        text[length++] = '.';
+        std::memcpy(text + length, first + count - k, k);
+        return length + k;
+      }
+
+      for (int precision = 15; precision <= 17; ++precision)
+      {
+        auto written = std::snprintf(text + length, 31 - length, "%.*g", precision, num);
+        if ((precision == 17) || (std::strtod(text + length, nullptr) == num))
+        {
+          return length + static_cast<std::size_t>(written);
+        }
+      }
+      return length;
+    }
+
+  private:
+    char* data;
+    std::size_t capacity;
+    std::size_t size;
+    bool truncated;
+  };
+
+  /**
+   * Format record as single JSON line.
+   *
+   * Fields which do not fit are dropped, record always ends with "}\n".
+   */
+  inline void FormatRecord(buffer_t& buffer, level_t level, const char* message, std::initializer_list<field_t> fields) noexcept
+  {
+    static const char* const levels[] = { "debug", "info", "warning", "error" };
+    // closing brace, newline and truncation marker
+    static const char tail[] = ",\"truncated\":true}\n";
+
+    const auto capacity = buffer.Limit(buffer.Capacity() - sizeof(tail));
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+
+    buffer.Append("{\"ts\":", 6);
+    buffer.Integer(static_cast<std::uint64_t>(now));
+    buffer.Append(",\"level\":\"", 10);
+    buffer.Append(levels[level]);
+    buffer.Append("\",\"msg\":", 8);
+    buffer.String(message, std::strlen(message));
+
+    for (const auto& field: fields)
+    {
+      const auto mark = buffer.Size();
+      if (!buffer.Append(',') || !buffer.Append('"') || !buffer.Append(field.name) || !buffer.Append("\":", 2))
+      {
+        buffer.Rewind(mark);
+        break;
+      }
+      const auto valueMark = buffer.Size();
+      if (!buffer.Value(field.value))
+      {
+        // string cut to fit is still closed, so it is kept
+        if (buffer.Size() == valueMark)
+        {
+          buffer.Rewind(mark);
+        }
+        break;
+      }
+    }
+
+    buffer.Limit(capacity);
+    if (buffer.Truncated())
+    {
+      buffer.Append(tail, sizeof(tail) - 1);
+    }
+    else
+    {
+      buffer.Append("}\n", 2);
+    }
+  }
+
+  /**
+   * Asynchronous log sink.
+   *
+   * Log can be called from any thread, it never locks and never allocates.
+   * Records are written by background thread in order they were queued.
+   */
+  class sink_t final
+  {
+  public:
+
+    /**
+     * Maximal record length, longer ones are truncated.
+     */
+    static constexpr std::size_t recordSize = 512;
+
+    /**
+     * Output function, receives batches of complete lines.
+     */
+    using output_t = std::function<void(const char* data, std::size_t size)>;
+
+    /**
+     * What to do when queue is full.
+     */
+    enum overflow_t
+    {
+      block, /**< Wait for writer */
+      drop   /**< Drop record and count it */
+    };
+
+    /**
+     * Create sink.
+     *
+     * @param [in] output where to write records
+     * @param [in] slots queue length, rounded up to power of two
+     * @param [in] overflow what to do when queue is full
+     */
+    explicit sink_t(output_t output, std::size_t slots = 4096, overflow_t overflow = block)
+      : output(std::move(output)), overflow(overflow), mask(0),
+        enqueuePos(0), dequeuePos(0), queued(0), written(0), dropped(0), stop(false)
+    {
+      std::size_t count = 2;
+      while (count < slots)
+      {
+        count *= 2;
+      }
+      this->mask = count - 1;
+      this->cells.reset(new cell_t[count]);
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        this->cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      this->writer = std::thread(&sink_t::Run, this);
+    }
+
+    /**
+     * Create sink writing to file.
+     *
+     * File is flushed after every batch, but not closed.
+     */
+    explicit sink_t(std::FILE* file, std::size_t slots = 4096, overflow_t overflow = block)
+      : sink_t(
+          [file](const char* data, std::size_t size)
+          {
+            std::fwrite(data, 1, size, file);
+            std::fflush(file);
+          },
+          slots,
+          overflow
+        )
+    {
+      ;
+    }
+
+    sink_t(const sink_t&) = delete;
+    sink_t& operator=(const sink_t&) = delete;
+
+    /**
+     * Destructor. Writes everything queued.
+     */
+    ~sink_t()
+    {
+      this->stop.store(true, std::memory_order_release);
+      this->writer.join();
+    }
+
+    /**
+     * Queue record.
+     *
+     * @return false when record was dropped
+     */
+    bool Log(level_t level, const char* message, std::initializer_list<field_t> fields = {}) noexcept
+    {
+      static thread_local char local[recordSize];
+      buffer_t buffer(local, recordSize);
+      FormatRecord(buffer, level, message, fields);
+      return this->Push(buffer.Data(), buffer.Size());
+    }
+
+    /**
+     * Wait until records queued before this call are passed to output.
+     */
+    void Flush() const noexcept
+    {
+      const auto target = this->queued.load(std::memory_order_acquire);
+      unsigned spins = 0;
+      while (this->written.load(std::memory_order_acquire) < target)
+      {
+        Idle(spins);
+      }
+    }
+
+    /**
+     * Number of records dropped because queue was full.
+     */
+    std::uint64_t Dropped() const noexcept
+    {
+      return this->dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    /**
+     * Queue cell (bounded MPMC queue by Dmitry Vyukov).
+     *
+     * Cell with sequence == pos is free for producer of pos,
+     * cell with sequence == pos + 1 is ready for consumer of pos.
+     */
+    struct cell_t
+    {
+      std::atomic<std::size_t> sequence;
+      std::size_t size;
+      char data[recordSize];
+    };
+
+    static void Idle(unsigned& spins) noexcept
+    {
+      ++spins;
+      if (spins < 64)
+      {
+        ;
+      }
+      else if (spins < 128)
+      {
+        std::this_thread::yield();
+      }
+      else
+      {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+
+    bool Push(const char* data, std::size_t size) noexcept
+    {
+      unsigned spins = 0;
+      auto pos = this->enqueuePos.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        auto& cell = this->cells[pos & this->mask];
+        const auto seq = cell.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (diff == 0)
+        {
+          if (this->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            std::memcpy(cell.data, data, size);
+            cell.size = size;
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            this->queued.fetch_add(1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (diff < 0)
+        {
+          if (this->overflow == drop)
+          {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          Idle(spins);
+          pos = this->enqueuePos.load(std::memory_order_relaxed);
+        }
+        else
+        {
+          pos = this->enqueuePos.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    /**
+     * Writer thread: drain queue into batch buffer, pass batch to output.
+     */
+    void Run()
+    {
+      const std::size_t batchSize = 64 * 1024;
+      std::unique_ptr<char[]> batch(new char[batchSize]);
+      std::size_t used = 0;
+      std::uint64_t pending = 0;
+      unsigned spins = 0;
+
+      for (;;)
+      {
+        auto& cell = this->cells[this->dequeuePos & this->mask];
+        const auto seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq == this->dequeuePos + 1)
+        {
+          if (used + cell.size > batchSize)
+          {
+            this->output(batch.get(), used);
+            this->written.fetch_add(pending, std::memory_order_release);
+            used = 0;
+            pending = 0;
+          }
+          std::memcpy(batch.get() + used, cell.data, cell.size);
+          used += cell.size;
+          ++pending;
+          cell.sequence.store(this->dequeuePos + this->mask + 1, std::memory_order_release);
+          ++this->dequeuePos;
+          spins = 0;
+          continue;
+        }
+
+        if (used != 0)
+        {
+          this->output(batch.get(), used);
+          this->written.fetch_add(pending, std::memory_order_release);
+          used = 0;
+          pending = 0;
+        }
+
+        // queue is empty: stop only when no producer is in the middle of push
+        if (this->stop.load(std::memory_order_acquire)
+          && (this->enqueuePos.load(std::memory_order_acquire) == this->dequeuePos))
+        {
+          return;
+        }
+        Idle(spins);
+      }
+    }
+
+    output_t output;                        /**< Where records go */
+    const overflow_t overflow;              /**< Full queue policy */
+    std::size_t mask;                       /**< Queue length minus one */
+    std::unique_ptr<cell_t[]> cells;        /**< Queue */
+    char padding0[64];
+    std::atomic<std::size_t> enqueuePos;    /**< Next position for producers */
+    char padding1[64];
+    std::size_t dequeuePos;                 /**< Next position for writer */
+    std::atomic<std::uint64_t> queued;      /**< Records pushed */
+    std::atomic<std::uint64_t> written;     /**< Records passed to output */
+    std::atomic<std::uint64_t> dropped;     /**< Records dropped */
+    std::atomic<bool> stop;                 /**< Writer must exit when queue is empty */
+    std::thread writer;                     /**< Writer thread */
+  };
+
+} // namespace logging
+} // namespace bvl
+
+#endif /* BAD_VALUE_LOG_HEADER */
@@ -0,0 +1,1495 @@
+/**
+ * @file badval_lsm.hpp
+ * @author masscry
+ *
+ * Embedded log-structured store of string keys and values.
+ *
+ * Writes go to memtable, concurrent skiplist in memory. Full memtable
+ * is frozen and background thread writes it to disk as sorted table
+ * (bvl::sstable) of level 0. Tables of level 0 may overlap, tables of
+ * every deeper level hold disjoint key ranges. When level 0 has too
+ * many tables, or deeper level grows over its size limit, background
+ * thread merges tables into next level (leveled compaction).
+ *
+ * Reads look through memtable, frozen memtables, level 0 from newest
+ * table and one table per deeper level, first entry found wins. Erased
+ * key is kept as tombstone until compaction reaches last used level.
+ *
+ * Directory holds tables named NNNNNN.sst and MANIFEST, text file
+ * with list of live tables per level, which is replaced atomically
+ * after every flush and compaction.
+ *
+ * Unflushed memtable is written on destruction, but is lost on crash.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_LSM_HEADER
+#define BAD_VALUE_LSM_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+#include <badval_sstable.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bvl
+{
+namespace lsm
+{
+
+  /**
+   * Store options.
+   */
+  struct options_t
+  {
+    std::size_t memtableSize = 4 << 20;       /**< Memtable is frozen after this many bytes */
+    std::size_t frozenLimit = 2;              /**< Writers wait when that many memtables wait for flush */
+    std::size_t l0CompactionTrigger = 4;      /**< Level 0 tables which start compaction */
+    std::size_t l0StopWrites = 12;            /**< Level 0 tables which stop writers */
+    std::uint64_t levelBaseSize = 16 << 20;   /**< Size limit of level 1 */
+    std::size_t levelMultiplier = 10;         /**< Size ratio of neighbour levels */
+    std::uint64_t targetFileSize = 2 << 20;   /**< Size of tables written by compaction */
+    std::size_t levels = 7;                   /**< Number of levels */
+    sstable::options_t table;                 /**< Table building options */
+  };
+
+  /**
+   * Store counters.
+   */
+  struct stats_t
+  {
+    std::uint64_t gets = 0;                /**< Point reads */
+    std::uint64_t tablesChecked = 0;       /**< Tables, which key range covered read key */
+    std::uint64_t tablesRead = 0;          /**< Tables, which bloom filter did not reject key */
+    std::uint64_t bytesPut = 0;            /**< Serialized keys and values given by writers */
+    std::uint64_t bytesFlushed = 0;        /**< Bytes written by memtable flushes */
+    std::uint64_t bytesCompacted = 0;      /**< Bytes written by compactions */
+    std::uint64_t flushes = 0;             /**< Memtables written */
+    std::uint64_t compactions = 0;         /**< Tables merged into next level */
+    std::uint64_t moves = 0;               /**< Tables moved to next level without rewrite */
+    std::uint64_t stalls = 0;              /**< Times writer waited for background thread */
+    std::vector<std::size_t> files;        /**< Tables per level */
+    std::vector<std::uint64_t> levelBytes; /**< Bytes per level */
+  };
+
+  /**
+   * Sorted skiplist of key versions.
+   *
+   * Single writer adds entries, any number of readers traverse list at
+   * the same time without locks. Entries are ordered by key, then by
+   * sequence number descending, so newest version of key comes first.
+   * Entries are never removed until memtable is destroyed.
+   */
+  class memtable_t final
+  {
+    struct node_t;
+
+  public:
+
+    /**
+     * Height of skiplist head.
+     */
+    static constexpr int maxHeight = 12;
+
+    /**
+     * Iterator over all entries, including older versions of keys.
+     */
+    class iterator_t final
+    {
+    public:
+
+      explicit iterator_t(const memtable_t* table) noexcept
+        : table(table), node(nullptr)
+      {
+        ;
+      }
+
+      bool Valid() const noexcept
+      {
+        return this->node != nullptr;
+      }
+
+      void SeekToFirst() noexcept
+      {
+        this->node = this->table->head->Next(0);
+      }
+
+      /**
+       * Move to newest version of first key not less than given one.
+       */
+      void Seek(const std::string& key) noexcept
+      {
+        this->node = this->table->FindGreaterOrEqual(key, ~std::uint64_t(0), nullptr);
+      }
+
+      void Next() noexcept
+      {
+        this->node = this->node->Next(0);
+      }
+
+      /**
+       * Current key, stays valid while memtable is alive.
+       */
+      const std::string& Key() const noexcept
+      {
+        return this->node->key;
+      }
+
+      std::uint64_t Sequence() const noexcept
+      {
+        return this->node->seq;
+      }
+
+      /**
+       * Current entry is tombstone.
+       */
+      bool Erased() const noexcept
+      {
+        return this->node->erased;
+      }
+
+      const value_t& Value() const noexcept
+      {
+        return this->node->value;
+      }
+
+    private:
+      const memtable_t* table; /**< Iterated memtable */
+      const node_t* node;      /**< Current entry */
+    };
+
+    memtable_t()
+      : head(NewNode(std::string(), 0, nullptr, maxHeight)), height(1), bytes(0), count(0), rng(0x9E3779B97F4A7C15ULL)
+    {
+      ;
+    }
+
+    memtable_t(const memtable_t&) = delete;
+    memtable_t& operator=(const memtable_t&) = delete;
+
+    ~memtable_t()
+    {
+      auto node = this->head;
+      while (node != nullptr)
+      {
+        auto next = node->Next(0);
+        DeleteNode(node);
+        node = next;
+      }
+    }
+
+    /**
+     * Add entry. Only one thread may add entries at a time.
+     *
+     * @param seq sequence number, greater than all previous ones for key
+     * @param key key
+     * @param value value or nullptr for tombstone
+     *
+     * @throws std::runtime_error for pointers
+     */
+    void Add(std::uint64_t seq, const std::string& key, const value_t* value)
+    {
+      const auto valueSize = (value != nullptr)? serial::EncodedSize(*value): 0;
+      node_t* prev[maxHeight];
+      this->FindGreaterOrEqual(key, seq, prev);
+
+      const auto nodeHeight = this->RandomHeight();
+      const auto current = this->height.load(std::memory_order_relaxed);
+      if (nodeHeight > current)
+      {
+        for (int i = current; i < nodeHeight; ++i)
+        {
+          prev[i] = this->head;
+        }
+        // readers, which see new height before node is linked, just
+        // find null in head and go down
+        this->height.store(nodeHeight, std::memory_order_relaxed);
+      }
+
+      auto node = NewNode(key, seq, value, nodeHeight);
+      for (int i = 0; i < nodeHeight; ++i)
+      {
+        node->next[i].store(prev[i]->next[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        prev[i]->next[i].store(node, std::memory_order_release);
+      }
+
+      this->bytes += sizeof(node_t) + static_cast<std::size_t>(nodeHeight - 1) * sizeof(node->next[0]) + key.size() + valueSize;
+      ++this->count;
+    }
+
+    /**
+     * Find newest version of key.
+     *
+     * @param key searched key
+     * @param value set to stored value or to nullptr for tombstone, stays valid while memtable is alive
+     *
+     * @return false when memtable has no entry for key
+     */
+    bool Get(const std::string& key, const value_t*& value) const noexcept
+    {
+      auto node = this->FindGreaterOrEqual(key, ~std::uint64_t(0), nullptr);
+      if ((node == nullptr) || (node->key != key))
+      {
+        return false;
+      }
+      value = node->erased? nullptr: &node->value;
+      return true;
+    }
+
+    /**
+     * Approximate memory used by entries. Read by writer only.
+     */
+    std::size_t Bytes() const noexcept
+    {
+      return this->bytes;
+    }
+
+    /**
+     * Number of entries. Read by writer only.
+     */
+    std::size_t Count() const noexcept
+    {
+      return this->count;
+    }
+
+    iterator_t Begin() const noexcept
+    {
+      iterator_t it(this);
+      it.SeekToFirst();
+      return it;
+    }
+
+  private:
+
+    /**
+     * Skiplist node, allocated with room for height next pointers.
+     */
+    struct node_t
+    {
+      const std::string key;             /**< Key */
+      const std::uint64_t seq;           /**< Sequence number */
+      const bool erased;                 /**< Tombstone */
+      const value_t value;               /**< Value, empty for tombstone */
+      std::atomic<node_t*> next[1];      /**< Next nodes per level */
+
+      node_t(const std::string& key, std::uint64_t seq, const value_t* value)
+        : key(key), seq(seq), erased(value == nullptr), value((value != nullptr)? *value: value_t())
+      {
+        ;
+      }
+
+      node_t* Next(int level) const noexcept
+      {
+        return this->next[level].load(std::memory_order_acquire);
+      }
+    };
+
+    static node_t* NewNode(const std::string& key, std::uint64_t seq, const value_t* value, int height)
+    {
+      auto memory = ::operator new(sizeof(node_t) + (height - 1) * sizeof(std::atomic<node_t*>));
+      node_t* node;
+      try
+      {
+        node = new (memory) node_t(key, seq, value);
+      }
+      catch (...)
+      {
+        ::operator delete(memory);
+        throw;
+      }
+      for (int i = 0; i < height; ++i)
+      {
+        new (&node->next[i]) std::atomic<node_t*>(nullptr);
+      }
+      return node;
+    }
+
+    static void DeleteNode(node_t* node) noexcept
+    {
+      node->~node_t();
+      ::operator delete(node);
+    }
+
+    /**
+     * Compare node with (key, seq) pair.
+     */
+    static int CompareNode(const node_t* node, const std::string& key, std::uint64_t seq) noexcept
+    {
+      const auto order = sstable::Compare(node->key.data(), node->key.size(), key.data(), key.size());
+      if (order != 0)
+      {
+        return order;
+      }
+      return (node->seq > seq)? -1: ((node->seq < seq)? 1: 0);
+    }
+
+    /**
+     * First node not less than (key, seq), fills prev with last smaller nodes per level.
+     */
+    node_t* FindGreaterOrEqual(const std::string& key, std::uint64_t seq, node_t** prev) const noexcept
+    {
+      auto node = this->head;
+      auto level = this->height.load(std::memory_order_relaxed) - 1;
+      while (true)
+      {
+        auto next = node->Next(level);
+        if ((next != nullptr) && (CompareNode(next, key, seq) < 0))
+        {
+          node = next;
+          continue;
+        }
+        if (prev != nullptr)
+        {
+          prev[level] = node;
+        }
+        if (level == 0)
+        {
+          return next;
+        }
+        --level;
+      }
+    }
+
+    /**
+     * Height with probability 1/4 to grow on every level.
+     */
+    int RandomHeight() noexcept
+    {
+      int result = 1;
+      while (result < maxHeight)
+      {
+        this->rng ^= this->rng << 13;
+        this->rng ^= this->rng >> 7;
+        this->rng ^= this->rng << 17;
+        if ((this->rng & 3) != 0)
+        {
+          break;
+        }
+        ++result;
+      }
+      return result;
+    }
+
+    node_t* const head;      /**< Sentinel of maxHeight */
+    std::atomic<int> height; /**< Current list height */
+    std::size_t bytes;       /**< Memory used by entries */
+    std::size_t count;       /**< Number of entries */
+    std::uint64_t rng;       /**< Height generator state */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Serialized tombstone: single byte, which no serialized value has.
+     */
+    constexpr unsigned char erasedTag = 0xFF;
+
+    inline bool IsErased(const char* data, std::size_t size) noexcept
+    {
+      return (size == 1) && (static_cast<unsigned char>(data[0]) == erasedTag);
+    }
+
+    inline int Compare(const std::string& lhs, const std::string& rhs) noexcept
+    {
+      return sstable::Compare(lhs.data(), lhs.size(), rhs.data(), rhs.size());
+    }
+
+    /**
+     * Table on disk. File is removed after last reference to obsolete table is gone.
+     */
+    struct file_t
+    {
+      const std::uint64_t number;   /**< File number */
+      const std::string path;       /**< File path */
+      sstable::table_t table;       /**< Mapped table */
+      const std::string smallest;   /**< First key */
+      const std::string largest;    /**< Last key */
+      std::atomic<bool> obsolete;   /**< Table is not used by store anymore */
+
+      file_t(std::uint64_t number, const std::string& path)
+        : number(number), path(path), table(path), smallest(table.Begin().Valid()? table.Begin().Key(): std::string()),
+          largest(table.LastKey()), obsolete(false)
+      {
+        ;
+      }
+
+      ~file_t()
+      {
+        if (this->obsolete)
+        {
+          std::remove(this->path.c_str());
+        }
+      }
+
+      bool Covers(const std::string& key) const noexcept
+      {
+        return (Compare(this->smallest, key) <= 0) && (Compare(key, this->largest) <= 0);
+      }
+
+      bool Overlaps(const std::string& from, const std::string& to) const noexcept
+      {
+        return (Compare(this->largest, from) >= 0) && (Compare(this->smallest, to) <= 0);
+      }
+    };
+
+    using fileList_t = std::vector<std::shared_ptr<file_t>>;
+
+    /**
+     * Live tables. Level 0 is ordered from newest, deeper levels by key.
+     */
+    struct version_t
+    {
+      std::vector<fileList_t> levels;
+    };
+
+    /**
+     * Everything reader needs, replaced as a whole on every change.
+     */
+    struct view_t
+    {
+      std::shared_ptr<memtable_t> active;               /**< Memtable receiving writes */
+      std::vector<std::shared_ptr<memtable_t>> frozen;  /**< Memtables waiting for flush, newest first */
+      std::shared_ptr<const version_t> version;         /**< Live tables */
+    };
+
+    /**
+     * Sorted stream of unique keys for merge.
+     */
+    class source_t
+    {
+    public:
+      virtual ~source_t() = default;
+      virtual bool Valid() const = 0;
+      virtual void Next() = 0;
+      virtual const std::string& Key() const = 0;
+      virtual bool Erased() const = 0;
+      virtual value_t Value() const = 0;
+
+      /**
+       * Serialized value or tombstone, scratch is used when entry is not serialized yet.
+       */
+      virtual void Raw(std::string& scratch, const char*& data, std::size_t& size) const = 0;
+    };
+
+    /**
+     * Newest versions of memtable keys.
+     */
+    class memSource_t final: public source_t
+    {
+    public:
+
+      memSource_t(std::shared_ptr<memtable_t> table, const std::string& from)
+        : table(std::move(table)), it(this->table.get())
+      {
+        this->it.Seek(from);
+      }
+
+      bool Valid() const override
+      {
+        return this->it.Valid();
+      }
+
+      void Next() override
+      {
+        const auto& key = this->it.Key();
+        do
+        {
+          this->it.Next();
+        }
+        while (this->it.Valid() && (this->it.Key() == key));
+      }
+
+      const std::string& Key() const override
+      {
+        return this->it.Key();
+      }
+
+      bool Erased() const override
+      {
+        return this->it.Erased();
+      }
+
+      value_t Value() const override
+      {
+        return this->it.Value();
+      }
+
+      void Raw(std::string& scratch, const char*& data, std::size_t& size) const override
+      {
+        scratch.clear();
+        if (this->it.Erased())
+        {
+          scratch.push_back(static_cast<char>(erasedTag));
+        }
+        else
+        {
+          serial::Encode(this->it.Value(), scratch);
+        }
+        data = scratch.data();
+        size = scratch.size();
+      }
+
+    private:
+      std::shared_ptr<memtable_t> table;
+      memtable_t::iterator_t it;
+    };
+
+    /**
+     * Concatenation of tables with disjoint sorted key ranges.
+     */
+    class tableSource_t final: public source_t
+    {
+    public:
+
+      tableSource_t(fileList_t files, const std::string& from)
+        : files(std::move(files)), index(0)
+      {
+        auto it = std::lower_bound(this->files.begin(), this->files.end(), from,
+          [](const std::shared_ptr<file_t>& file, const std::string& key)
+          {
+            return Compare(file->largest, key) < 0;
+          }
+        );
+        this->index = static_cast<std::size_t>(it - this->files.begin());
+        if (this->index < this->files.size())
+        {
+          this->it.reset(new sstable::table_t::iterator_t(this->files[this->index]->table.Seek(from)));
+          this->Skip();
+        }
+      }
+
+      bool Valid() const override
+      {
+        return this->index < this->files.size();
+      }
+
+      void Next() override
+      {
+        this->it->Next();
+        this->Skip();
+      }
+
+      const std::string& Key() const override
+      {
+        return this->it->Key();
+      }
+
+      bool Erased() const override
+      {
+        return IsErased(this->it->RawValue(), this->it->RawValueSize());
+      }
+
+      value_t Value() const override
+      {
+        return this->it->Value();
+      }
+
+      void Raw(std::string&, const char*& data, std::size_t& size) const override
+      {
+        data = this->it->RawValue();
+        size = this->it->RawValueSize();
+      }
+
+    private:
+
+      /**
+       * Move to next table, when current one ended.
+       */
+      void Skip()
+      {
+        while (!this->it->Valid())
+        {
+          if (++this->index == this->files.size())
+          {
+            this->it.reset();
+            return;
+          }
+          this->it.reset(new sstable::table_t::iterator_t(this->files[this->index]->table.Begin()));
+        }
+      }
+
+      fileList_t files;
+      std::size_t index;
+      std::unique_ptr<sstable::table_t::iterator_t> it;
+    };
+
+    /**
+     * Merge of sources, which are ordered from newest. For equal keys
+     * only entry of newest source is visible. Number of sources is small,
+     * so smallest key is found by linear scan.
+     */
+    class merger_t final
+    {
+    public:
+
+      explicit merger_t(std::vector<std::unique_ptr<source_t>> sources)
+        : sources(std::move(sources)), current(nullptr)
+      {
+        this->Pick();
+      }
+
+      bool Valid() const noexcept
+      {
+        return this->current != nullptr;
+      }
+
+      source_t& Current() const noexcept
+      {
+        return *this->current;
+      }
+
+      void Next()
+      {
+        for (auto& source: this->sources)
+        {
+          if ((source.get() != this->current) && source->Valid() && (source->Key() == this->current->Key()))
+          {
+            source->Next();
+          }
+        }
+        this->current->Next();
+        this->Pick();
+      }
+
+    private:
+
+      void Pick()
+      {
+        this->current = nullptr;
+        for (auto& source: this->sources)
+        {
+          if (source->Valid() && ((this->current == nullptr) || (Compare(source->Key(), this->current->Key()) < 0)))
+          {
+            this->current = source.get();
+          }
+        }
+      }
+
+      std::vector<std::unique_ptr<source_t>> sources;
+      source_t* current;
+    };
+
+  } // namespace detail
+
+  /**
+   * Remove store files and directory.
+   */
+  inline void Destroy(const std::string& path)
+  {
+    auto dir = ::opendir(path.c_str());
+    if (dir == nullptr)
+    {
+      return;
+    }
+    std::vector<std::string> names;
+    while (auto entry = ::readdir(dir))
+    {
+      std::string name(entry->d_name);
+      if ((name.size() > 4 && name.compare(name.size() - 4, 4, ".sst") == 0)
+        || (name == "MANIFEST") || (name == "MANIFEST.tmp"))
+      {
+        names.push_back(name);
+      }
+    }
+    ::closedir(dir);
+    for (const auto& name: names)
+    {
+      std::remove((path + "/" + name).c_str());
+    }
+    ::rmdir(path.c_str());
+  }
+
+  /**
+   * Log-structured store.
+   *
+   * Writers are serialized, readers never wait for writers or
+   * background thread. Pointer values can't be stored.
+   */
+  class store_t final
+  {
+  public:
+
+    /**
+     * Open store in directory, create it when missing.
+     *
+     * @throws std::runtime_error when store can't be opened
+     */
+    explicit store_t(const std::string& path, options_t options = options_t())
+      : path(path), options(options), seq(0), nextFile(1), stopping(false), busy(false), gets(0), tablesChecked(0), tablesRead(0)
+    {
+      this->options.levels = std::max<std::size_t>(2, this->options.levels);
+      this->options.frozenLimit = std::max<std::size_t>(1, this->options.frozenLimit);
+      this->options.l0CompactionTrigger = std::max<std::size_t>(1, this->options.l0CompactionTrigger);
+      this->compactPointers.resize(this->options.levels);
+      this->stats.files.resize(this->options.levels);
+      this->stats.levelBytes.resize(this->options.levels);
+
+      if ((::mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST))
+      {
+        throw std::runtime_error("Can't create store " + path);
+      }
+
+      auto view = std::make_shared<detail::view_t>();
+      view->active = std::make_shared<memtable_t>();
+      view->version = this->Recover();
+      std::atomic_store(&this->view, std::shared_ptr<const detail::view_t>(std::move(view)));
+
+      this->background = std::thread(&store_t::Background, this);
+    }
+
+    store_t(const store_t&) = delete;
+    store_t& operator=(const store_t&) = delete;
+
+    /**
+     * Destructor. Writes memtable and stops background thread.
+     */
+    ~store_t()
+    {
+      try
+      {
+        this->Flush();
+      }
+      catch (...)
+      {
+        ;
+      }
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+      }
+      this->work.notify_all();
+      this->background.join();
+    }
+
+    /**
+     * Set value of key.
+     *
+     * @throws std::runtime_error for pointers, or when background thread failed
+     */
+    void Put(const std::string& key, const value_t& value)
+    {
+      const auto size = serial::EncodedSize(value);
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->MakeRoom(lock);
+      this->View()->active->Add(++this->seq, key, &value);
+      this->stats.bytesPut += key.size() + size;
+    }
+
+    /**
+     * Remove key.
+     *
+     * @throws std::runtime_error when background thread failed
+     */
+    void Erase(const std::string& key)
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->MakeRoom(lock);
+      this->View()->active->Add(++this->seq, key, nullptr);
+      this->stats.bytesPut += key.size() + 1;
+    }
+
+    /**
+     * Find value of key.
+     *
+     * @return false when key is not in store
+     */
+    bool Get(const std::string& key, value_t& out) const
+    {
+      this->gets.fetch_add(1, std::memory_order_relaxed);
+      const auto view = this->View();
+
+      const value_t* found;
+      if (view->active->Get(key, found))
+      {
+        return Output(found, out);
+      }
+      for (const auto& table: view->frozen)
+      {
+        if (table->Get(key, found))
+        {
+          return Output(found, out);
+        }
+      }
+
+      const char* data;
+      std::size_t size;
+      const auto& levels = view->version->levels;
+      for (const auto& file: levels[0])
+      {
+        if (file->Covers(key) && this->Probe(*file, key, data, size))
+        {
+          return Output(data, size, out);
+        }
+      }
+      for (std::size_t level = 1; level < levels.size(); ++level)
+      {
+        const auto& files = levels[level];
+        auto it = std::lower_bound(files.begin(), files.end(), key,
+          [](const std::shared_ptr<detail::file_t>& file, const std::string& item)
+          {
+            return detail::Compare(file->largest, item) < 0;
+          }
+        );
+        if ((it != files.end()) && (*it)->Covers(key) && this->Probe(**it, key, data, size))
+        {
+          return Output(data, size, out);
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Visit keys in range [from, to) in order. Empty to means no upper bound.
+     *
+     * @param visitor called as visitor(const std::string& key, const value_t& value), returns false to stop
+     */
+    template<typename visitor_t>
+    void Scan(const std::string& from, const std::string& to, visitor_t&& visitor) const
+    {
+      const auto view = this->View();
+      std::vector<std::unique_ptr<detail::source_t>> sources;
+      sources.emplace_back(new detail::memSource_t(view->active, from));
+      for (const auto& table: view->frozen)
+      {
+        sources.emplace_back(new detail::memSource_t(table, from));
+      }
+      const auto& levels = view->version->levels;
+      for (const auto& file: levels[0])
+      {
+        sources.emplace_back(new detail::tableSource_t(detail::fileList_t(1, file), from));
+      }
+      for (std::size_t level = 1; level < levels.size(); ++level)
+      {
+        if (!levels[level].empty())
+        {
+          sources.emplace_back(new detail::tableSource_t(levels[level], from));
+        }
+      }
+
+      for (detail::merger_t merger(std::move(sources)); merger.Valid(); merger.Next())
+      {
+        const auto& source = merger.Current();
+        if (!to.empty() && (detail::Compare(source.Key(), to) >= 0))
+        {
+          break;
+        }
+        if (source.Erased())
+        {
+          continue;
+        }
+        if (!visitor(source.Key(), source.Value()))
+        {
+          break;
+        }
+      }
+    }
+
+    /**
+     * Write memtable to disk and wait until it is done.
+     *
+     * @throws std::runtime_error when background thread failed
+     */
+    void Flush()
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->ThrowIfFailed();
+      if (this->View()->active->Count() != 0)
+      {
+        this->Freeze();
+      }
+      this->changed.wait(lock, [this]()
+      {
+        return this->View()->frozen.empty() || this->error;
+      });
+      this->ThrowIfFailed();
+    }
+
+    /**
+     * Wait until flushes and compactions are done.
+     *
+     * @throws std::runtime_error when background thread failed
+     */
+    void WaitForCompaction()
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->changed.wait(lock, [this]()
+      {
+        return (this->View()->frozen.empty() && !this->busy && (this->PickLevel() == 0)) || this->error;
+      });
+      this->ThrowIfFailed();
+    }
+
+    /**
+     * Current counters.
+     */
+    stats_t Stats() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto result = this->stats;
+      result.gets = this->gets.load(std::memory_order_relaxed);
+      result.tablesChecked = this->tablesChecked.load(std::memory_order_relaxed);
+      result.tablesRead = this->tablesRead.load(std::memory_order_relaxed);
+      const auto& levels = this->View()->version->levels;
+      for (std::size_t level = 0; level < levels.size(); ++level)
+      {
+        result.files[level] = levels[level].size();
+        result.levelBytes[level] = LevelBytes(levels[level]);
+      }
+      return result;
+    }
+
+  private:
+
+    /**
+     * Inputs of compaction from level to level + 1.
+     */
+    struct compaction_t
+    {
+      std::size_t level;
+      detail::fileList_t inputs[2];
+    };
+
+    std::shared_ptr<const detail::view_t> View() const
+    {
+      return std::atomic_load(&this->view);
+    }
+
+    static bool Output(const value_t* found, value_t& out)
+    {
+      if (found == nullptr)
+      {
+        return false;
+      }
+      out = *found;
+      return true;
+    }
+
+    static bool Output(const char* data, std::size_t size, value_t& out)
+    {
+      if (detail::IsErased(data, size))
+      {
+        return false;
+      }
+      out = serial::Decode(data, data + size);
+      return true;
+    }
+
+    bool Probe(const detail::file_t& file, const std::string& key, const char*& data, std::size_t& size) const
+    {
+      this->tablesChecked.fetch_add(1, std::memory_order_relaxed);
+      if (!file.table.MayContain(key))
+      {
+        return false;
+      }
+      this->tablesRead.fetch_add(1, std::memory_order_relaxed);
+      return file.table.FindRaw(key, data, size);
+    }
+
+    static std::uint64_t LevelBytes(const detail::fileList_t& files) noexcept
+    {
+      std::uint64_t result = 0;
+      for (const auto& file: files)
+      {
+        result += file->table.FileSize();
+      }
+      return result;
+    }
+
+    std::uint64_t LevelLimit(std::size_t level) const noexcept
+    {
+      auto result = this->options.levelBaseSize;
+      for (std::size_t i = 1; i < level; ++i)
+      {
+        result *= this->options.levelMultiplier;
+      }
+      return result;
+    }
+
+    std::string FileName(std::uint64_t number) const
+    {
+      char name[32];
+      std::snprintf(name, sizeof(name), "/%06llu.sst", static_cast<unsigned long long>(number));
+      return this->path + name;
+    }
+
+    void ThrowIfFailed() const
+    {
+      if (this->error)
+      {
+        std::rethrow_exception(this->error);
+      }
+    }
+
+    /**
+     * Replace view, mutex must be held.
+     */
+    void Publish(std::shared_ptr<memtable_t> active, std::vector<std::shared_ptr<memtable_t>> frozen, std::shared_ptr<const detail::version_t> version)
+    {
+      auto next = std::make_shared<detail::view_t>();
+      next->active = std::move(active);
+      next->frozen = std::move(frozen);
+      next->version = std::move(version);
+      std::atomic_store(&this->view, std::shared_ptr<const detail::view_t>(std::move(next)));
+      this->changed.notify_all();
+    }
+
+    /**
+     * Move active memtable to frozen ones, mutex must be held.
+     */
+    void Freeze()
+    {
+      const auto current = this->View();
+      auto frozen = current->frozen;
+      frozen.insert(frozen.begin(), current->active);
+      this->Publish(std::make_shared<memtable_t>(), std::move(frozen), current->version);
+      this->work.notify_one();
+    }
+
+    /**
+     * Freeze full memtable, wait while background thread is behind.
+     */
+    void MakeRoom(std::unique_lock<std::mutex>& lock)
+    {
+      while (true)
+      {
+        this->ThrowIfFailed();
+        const auto current = this->View();
+        if (current->active->Bytes() < this->options.memtableSize)
+        {
+          return;
+        }
+        if ((current->frozen.size() >= this->options.frozenLimit)
+          || (current->version->levels[0].size() >= this->options.l0StopWrites))
+        {
+          ++this->stats.stalls;
+          this->changed.wait(lock);
+          continue;
+        }
+        this->Freeze();
+      }
+    }
+
+    /**
+     * Level which needs compaction most plus one, or 0 when none does.
+     */
+    std::size_t PickLevel() const
+    {
+      const auto& levels = this->View()->version->levels;
+      double best = static_cast<double>(levels[0].size()) / this->options.l0CompactionTrigger;
+      std::size_t result = (best >= 1.0)? 1: 0;
+      for (std::size_t level = 1; level + 1 < levels.size(); ++level)
+      {
+        const auto score = static_cast<double>(LevelBytes(levels[level])) / this->LevelLimit(level);
+        if ((score >= 1.0) && (score > best))
+        {
+          best = score;
+          result = level + 1;
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Choose tables to merge, mutex must be held.
+     */
+    bool PickCompaction(compaction_t& compaction)
+    {
+      const auto picked = this->PickLevel();
+      if (picked == 0)
+      {
+        return false;
+      }
+      compaction.level = picked - 1;
+      const auto& levels = this->View()->version->levels;
+      const auto& source = levels[compaction.level];
+
+      if (compaction.level == 0)
+      {
+        compaction.inputs[0] = source;
+      }
+      else
+      {
+        // round robin over key space of level
+        auto& pointer = this->compactPointers[compaction.level];
+        auto it = std::find_if(source.begin(), source.end(),
+          [&pointer](const std::shared_ptr<detail::file_t>& file)
+          {
+            return detail::Compare(file->smallest, pointer) > 0;
+          }
+        );
+        if (it == source.end())
+        {
+          it = source.begin();
+        }
+        compaction.inputs[0].push_back(*it);
+        pointer = (*it)->largest;
+      }
+
+      auto from = compaction.inputs[0].front()->smallest;
+      auto to = compaction.inputs[0].front()->largest;
+      for (const auto& file: compaction.inputs[0])
+      {
+        if (detail::Compare(file->smallest, from) < 0)
+        {
+          from = file->smallest;
+        }
+        if (detail::Compare(file->largest, to) > 0)
+        {
+          to = file->largest;
+        }
+      }
+      for (const auto& file: levels[compaction.level + 1])
+      {
+        if (file->Overlaps(from, to))
+        {
+          compaction.inputs[1].push_back(file);
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Create table from merged sources, split by target size when limit is set.
+     */
+    detail::fileList_t WriteTables(detail::merger_t& merger, bool dropErased, std::uint64_t limit, std::unique_lock<std::mutex>& lock, std::uint64_t& written)
+    {
+      detail::fileList_t result;
+      std::unique_ptr<sstable::builder_t> builder;
+      std::uint64_t number = 0;
+      std::string scratch;
+
+      auto finish = [&]()
+      {
+        builder->Finish();
+        builder->Sync();
+        written += builder->FileSize();
+        builder.reset();
+        result.push_back(std::make_shared<detail::file_t>(number, this->FileName(number)));
+      };
+
+      for (; merger.Valid(); merger.Next())
+      {
+        const auto& source = merger.Current();
+        const char* data;
+        std::size_t size;
+        source.Raw(scratch, data, size);
+        if (dropErased && detail::IsErased(data, size))
+        {
+          continue;
+        }
+        if (!builder)
+        {
+          lock.lock();
+          number = this->nextFile++;
+          lock.unlock();
+          builder.reset(new sstable::builder_t(this->FileName(number), this->options.table));
+        }
+        builder->AddRaw(source.Key(), data, size);
+        if ((limit != 0) && (builder->FileSize() >= limit))
+        {
+          finish();
+        }
+      }
+      if (builder)
+      {
+        finish();
+      }
+      return result;
+    }
+
+    /**
+     * Write oldest frozen memtable as level 0 table, mutex is held on entry and exit.
+     */
+    void FlushFrozen(std::unique_lock<std::mutex>& lock)
+    {
+      const auto table = this->View()->frozen.back();
+      lock.unlock();
+
+      std::vector<std::unique_ptr<detail::source_t>> sources;
+      sources.emplace_back(new detail::memSource_t(table, std::string()));
+      detail::merger_t merger(std::move(sources));
+      std::uint64_t written = 0;
+      auto files = this->WriteTables(merger, false, 0, lock, written);
+
+      lock.lock();
+      const auto current = this->View();
+      auto version = std::make_shared<detail::version_t>(*current->version);
+      version->levels[0].insert(version->levels[0].begin(), files.begin(), files.end());
+      this->WriteManifest(*version);
+
+      auto frozen = current->frozen;
+      frozen.pop_back();
+      this->Publish(current->active, std::move(frozen), std::move(version));
+      ++this->stats.flushes;
+      this->stats.bytesFlushed += written;
+    }
+
+    /**
+     * Merge tables into next level, mutex is held on entry and exit.
+     */
+    void Compact(const compaction_t& compaction, std::unique_lock<std::mutex>& lock)
+    {
+      const auto output = compaction.level + 1;
+      const bool move = (compaction.inputs[0].size() == 1) && compaction.inputs[1].empty();
+      detail::fileList_t files;
+
+      if (move)
+      {
+        files = compaction.inputs[0];
+        ++this->stats.moves;
+      }
+      else
+      {
+        // tombstone is not needed when there is nothing under it
+        bool dropErased = true;
+        const auto& levels = this->View()->version->levels;
+        for (auto level = output + 1; level < levels.size(); ++level)
+        {
+          dropErased = dropErased && levels[level].empty();
+        }
+        lock.unlock();
+
+        std::vector<std::unique_ptr<detail::source_t>> sources;
+        if (compaction.level == 0)
+        {
+          for (const auto& file: compaction.inputs[0])
+          {
+            sources.emplace_back(new detail::tableSource_t(detail::fileList_t(1, file), std::string()));
+          }
+        }
+        else
+        {
+          sources.emplace_back(new detail::tableSource_t(compaction.inputs[0], std::string()));
+        }
+        sources.emplace_back(new detail::tableSource_t(compaction.inputs[1], std::string()));
+        detail::merger_t merger(std::move(sources));
+        std::uint64_t written = 0;
+        files = this->WriteTables(merger, dropErased, this->options.targetFileSize, lock, written);
+
+        lock.lock();
+        ++this->stats.compactions;
+        this->stats.bytesCompacted += written;
+      }
+
+      const auto current = this->View();
+      auto version = std::make_shared<detail::version_t>(*current->version);
+      for (std::size_t i = 0; i < 2; ++i)
+      {
+        auto& level = version->levels[compaction.level + i];
+        for (const auto& file: compaction.inputs[i])
+        {
+          level.erase(std::find(level.begin(), level.end(), file));
+        }
+      }
+      auto& level = version->levels[output];
+      level.insert(level.end(), files.begin(), files.end());
+      std::sort(level.begin(), level.end(),
+        [](const std::shared_ptr<detail::file_t>& lhs, const std::shared_ptr<detail::file_t>& rhs)
+        {
+          return detail::Compare(lhs->smallest, rhs->smallest) < 0;
+        }
+      );
+      this->WriteManifest(*version);
+
+      if (!move)
+      {
+        for (const auto& inputs: compaction.inputs)
+        {
+          for (const auto& file: inputs)
+          {
+            file->obsolete = true;
+          }
+        }
+      }
+      this->Publish(current->active, current->frozen, std::move(version));
+    }
+
+    /**
+     * Background thread: flush frozen memtables first, then compact.
+     */
+    void Background()
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      while (!this->error)
+      {
+        try
+        {
+          if (!this->View()->frozen.empty())
+          {
+            this->busy = true;
+            this->FlushFrozen(lock);
+            this->busy = false;
+            continue;
+          }
+          if (this->stopping)
+          {
+            break;
+          }
+          compaction_t compaction;
+          if (this->PickCompaction(compaction))
+          {
+            this->busy = true;
+            this->Compact(compaction, lock);
+            this->busy = false;
+            continue;
+          }
+        }
+        catch (...)
+        {
+          if (!lock.owns_lock())
+          {
+            lock.lock();
+          }
+          this->error = std::current_exception();
+          this->busy = false;
+          this->changed.notify_all();
+          break;
+        }
+        this->changed.notify_all();
+        this->work.wait(lock);
+      }
+    }
+
+    /**
+     * Replace manifest with list of given tables, mutex must be held.
+     */
+    void WriteManifest(const detail::version_t& version)
+    {
+      std::string text = "badval-lsm 1\n";
+      text += "next " + std::to_string(this->nextFile) + "\n";
+      for (std::size_t level = 0; level < version.levels.size(); ++level)
+      {
+        for (const auto& file: version.levels[level])
+        {
+          text += std::to_string(level) + " " + std::to_string(file->number) + "\n";
+        }
+      }
+
+      const auto temp = this->path + "/MANIFEST.tmp";
+      auto file = std::fopen(temp.c_str(), "wb");
+      if (file == nullptr)
+      {
+        throw std::runtime_error("Can't create manifest " + temp);
+      }
+      const bool written = (std::fwrite(text.data(), 1, text.size(), file) == text.size())
+        && (std::fflush(file) == 0) && (::fsync(::fileno(file)) == 0);
+      std::fclose(file);
+      if (!written || (std::rename(temp.c_str(), (this->path + "/MANIFEST").c_str()) != 0))
+      {
+        throw std::runtime_error("Can't write manifest " + temp);
+      }
+      auto dir = ::open(this->path.c_str(), O_RDONLY);
+      if (dir >= 0)
+      {
+        ::fsync(dir);
+        ::close(dir);
+      }
+    }
+
+    /**
+     * Load tables listed in manifest, remove files not listed there.
+     */
+    std::shared_ptr<const detail::version_t> Recover()
+    {
+      auto version = std::make_shared<detail::version_t>();
+      version->levels.resize(this->options.levels);
+      std::vector<std::string> live;
+
+      auto file = std::fopen((this->path + "/MANIFEST").c_str(), "rb");
+      if (file != nullptr)
+      {
+        char line[128];
+        bool valid = (std::fgets(line, sizeof(line), file) != nullptr) && (std::string(line) == "badval-lsm 1\n");
+        unsigned long long next = 0;
+        valid = valid && (std::fscanf(file, "next %llu\n", &next) == 1);
+        unsigned long long level;
+        unsigned long long number;
+        while (valid && (std::fscanf(file, "%llu %llu\n", &level, &number) == 2))
+        {
+          if (level >= version->levels.size())
+          {
+            valid = false;
+            break;
+          }
+          auto table = std::make_shared<detail::file_t>(number, this->FileName(number));
+          version->levels[level].push_back(table);
+          live.push_back(table->path);
+          this->nextFile = std::max<std::uint64_t>(this->nextFile, number + 1);
+        }
+        valid = valid && std::feof(file);
+        std::fclose(file);
+        if (!valid)
+        {
+          throw std::runtime_error("Store manifest is malformed " + this->path);
+        }
+        this->nextFile = std::max<std::uint64_t>(this->nextFile, next);
+      }
+
+      // tables written before crash, but never listed in manifest
+      auto dir = ::opendir(this->path.c_str());
+      if (dir != nullptr)
+      {
+        std::vector<std::string> stale;
+        while (auto entry = ::readdir(dir))
+        {
+          std::string name(entry->d_name);
+          if (name.size() > 4 && name.compare(name.size() - 4, 4, ".sst") == 0)
+          {
+            const auto full = this->path + "/" + name;
+            if (std::find(live.begin(), live.end(), full) == live.end())
+            {
+              stale.push_back(full);
+            }
+          }
+        }
+        ::closedir(dir);
+        for (const auto& name: stale)
+        {
+          std::remove(name.c_str());
+        }
+      }
+      return version;
+    }
+
+    const std::string path;                          /**< Store directory */
+    options_t options;                               /**< Store options */
+    mutable std::mutex mutex;                        /**< Guards writers and everything below */
+    std::condition_variable work;                    /**< Wakes background thread */
+    mutable std::condition_variable changed;         /**< Signals view change */
+    std::shared_ptr<const detail::view_t> view;      /**< Current view, accessed atomically */
+    std::uint64_t seq;                               /**< Last sequence number */
+    std::uint64_t nextFile;                          /**< Next table number */
+    std::vector<std::string> compactPointers;        /**< Last compacted key per level */
+    bool stopping;                                   /**< Destructor waits for background thread */
+    bool busy;                                       /**< Background thread is writing tables */
+    std::exception_ptr error;                        /**< Failure of background thread */
+    stats_t stats;                                   /**< Counters changed by writers and background thread */
+    mutable std::atomic<std::uint64_t> gets;         /**< Point reads */
+    mutable std::atomic<std::uint64_t> tablesChecked;/**< Tables checked by point reads */
+    mutable std::atomic<std::uint64_t> tablesRead;   /**< Tables searched by point reads */
+    std::thread background;                          /**< Flush and compaction thread */
+  };
+
+} // namespace lsm
+} // namespace bvl
+
+#endif /* BAD_VALUE_LSM_HEADER */
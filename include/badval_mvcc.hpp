@@ -0,0 +1,792 @@
+/**
+ * @file badval_mvcc.hpp
+ * @author masscry
+ *
+ * Multi-version table of values with snapshot transactions.
+ *
+ * Every key holds chain of versions from newest to oldest, each tagged
+ * with timestamp of transaction which committed it. Table clock is
+ * timestamp of last commit. Reader takes clock value as its snapshot
+ * and sees newest version not younger than snapshot, so it never waits
+ * for writers and sees all keys as of one moment.
+ *
+ * Write transaction buffers its changes. Commit validates that no key
+ * it read or wrote got newer version after its snapshot (first
+ * committer wins), puts new versions in front of chains and only then
+ * advances clock, so whole transaction becomes visible at once.
+ * Commits are serialized by table mutex, validation and install take
+ * only time proportional to transaction size.
+ *
+ * Garbage collector finds oldest snapshot still in use (watermark) and
+ * cuts versions older than newest one visible at watermark. Key, which
+ * newest version is erase visible to everyone, is removed completely.
+ * Everything removed is retired to reclamation domain, because readers
+ * may still look at it.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_MVCC_HEADER
+#define BAD_VALUE_MVCC_HEADER
+
+#include <badval.hpp>
+#include <badval_ebr.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace bvl
+{
+namespace mvcc
+{
+
+  class table_t;
+
+  namespace detail
+  {
+
+    /**
+     * Value of key as committed at given timestamp.
+     */
+    struct version_t
+    {
+      const std::uint64_t ts;           /**< Commit timestamp */
+      const bool erased;                /**< Key was erased */
+      const value_t value;              /**< Value, empty for erase */
+      std::atomic<version_t*> next;     /**< Older version */
+
+      version_t(std::uint64_t ts, bool erased, value_t&& value, version_t* next) noexcept
+        : ts(ts), erased(erased), value(std::move(value)), next(next)
+      {
+        ;
+      }
+    };
+
+    /**
+     * Key with its version chain.
+     */
+    struct record_t
+    {
+      const std::string key;            /**< Key */
+      std::atomic<version_t*> head;     /**< Newest version */
+
+      explicit record_t(const std::string& key)
+        : key(key), head(nullptr)
+      {
+        ;
+      }
+
+      ~record_t()
+      {
+        auto version = this->head.load(std::memory_order_relaxed);
+        while (version != nullptr)
+        {
+          auto next = version->next.load(std::memory_order_relaxed);
+          delete version;
+          version = next;
+        }
+      }
+
+      /**
+       * Newest version with timestamp not greater than ts.
+       */
+      const version_t* VisibleAt(std::uint64_t ts) const noexcept
+      {
+        auto version = this->head.load(std::memory_order_acquire);
+        while ((version != nullptr) && (version->ts > ts))
+        {
+          version = version->next.load(std::memory_order_acquire);
+        }
+        return version;
+      }
+    };
+
+    /**
+     * Hash chain entry. Entries are owned by index, records are shared
+     * between old and new index during resize.
+     */
+    struct entry_t
+    {
+      const std::size_t hash;           /**< Key hash */
+      record_t* const record;           /**< Key record */
+      std::atomic<entry_t*> next;       /**< Next entry in bucket */
+
+      entry_t(std::size_t hash, record_t* record, entry_t* next) noexcept
+        : hash(hash), record(record), next(next)
+      {
+        ;
+      }
+    };
+
+    /**
+     * Chained hash table of records. Changed by single writer, read
+     * without locks.
+     */
+    struct index_t
+    {
+      const std::size_t mask;                              /**< Buckets - 1 */
+      std::unique_ptr<std::atomic<entry_t*>[]> buckets;    /**< Bucket heads */
+
+      explicit index_t(std::size_t buckets)
+        : mask(buckets - 1), buckets(new std::atomic<entry_t*>[buckets])
+      {
+        for (std::size_t i = 0; i < buckets; ++i)
+        {
+          this->buckets[i].store(nullptr, std::memory_order_relaxed);
+        }
+      }
+
+      ~index_t()
+      {
+        for (std::size_t i = 0; i <= this->mask; ++i)
+        {
+          auto entry = this->buckets[i].load(std::memory_order_relaxed);
+          while (entry != nullptr)
+          {
+            auto next = entry->next.load(std::memory_order_relaxed);
+            delete entry;
+            entry = next;
+          }
+        }
+      }
+
+      record_t* Find(const std::string& key, std::size_t hash) const noexcept
+      {
+        auto entry = this->buckets[hash & this->mask].load(std::memory_order_acquire);
+        while (entry != nullptr)
+        {
+          if ((entry->hash == hash) && (entry->record->key == key))
+          {
+            return entry->record;
+          }
+          entry = entry->next.load(std::memory_order_acquire);
+        }
+        return nullptr;
+      }
+
+      void Add(std::size_t hash, record_t* record)
+      {
+        auto& bucket = this->buckets[hash & this->mask];
+        bucket.store(new entry_t(hash, record, bucket.load(std::memory_order_relaxed)), std::memory_order_release);
+      }
+    };
+
+    /**
+     * Published snapshot timestamp, 0 when slot is free.
+     */
+    struct slot_t
+    {
+      std::atomic<std::uint64_t> ts;    /**< Snapshot of owner */
+      slot_t* next;                     /**< Next slot, list only grows */
+      char padding[64];                 /**< Keeps slots on separate cache lines */
+
+      explicit slot_t(std::uint64_t ts) noexcept
+        : ts(ts), next(nullptr)
+      {
+        ;
+      }
+    };
+
+  } // namespace detail
+
+  /**
+   * Table options.
+   */
+  struct options_t
+  {
+    std::size_t buckets = 1024;                              /**< Initial hash buckets, rounded up to power of two */
+    std::chrono::milliseconds gcInterval = std::chrono::milliseconds(100); /**< Background collection period, 0 disables thread */
+  };
+
+  /**
+   * Read-only view of table at one moment.
+   *
+   * Holding snapshot keeps versions it can see from collection.
+   */
+  class snapshot_t final
+  {
+  public:
+
+    snapshot_t(snapshot_t&& src) noexcept
+      : table(src.table), slot(src.slot), ts(src.ts)
+    {
+      src.slot = nullptr;
+    }
+
+    snapshot_t& operator=(snapshot_t&& src) noexcept
+    {
+      if (this != &src)
+      {
+        this->Release();
+        this->table = src.table;
+        this->slot = src.slot;
+        this->ts = src.ts;
+        src.slot = nullptr;
+      }
+      return *this;
+    }
+
+    snapshot_t(const snapshot_t&) = delete;
+    snapshot_t& operator=(const snapshot_t&) = delete;
+
+    ~snapshot_t()
+    {
+      this->Release();
+    }
+
+    /**
+     * Pass value of key to visitor, without copy.
+     *
+     * @param visitor called as visitor(const value_t&), value is valid only during call
+     *
+     * @return false when key had no value at snapshot
+     */
+    template<typename visitor_t>
+    bool Visit(const std::string& key, visitor_t&& visitor) const;
+
+    /**
+     * Copy value of key.
+     *
+     * @throws std::runtime_error when value is a pointer
+     *
+     * @return false when key had no value at snapshot
+     */
+    bool Get(const std::string& key, value_t& out) const
+    {
+      return this->Visit(key,
+        [&out](const value_t& value)
+        {
+          out = value;
+        }
+      );
+    }
+
+    /**
+     * Snapshot timestamp.
+     */
+    std::uint64_t Timestamp() const noexcept
+    {
+      return this->ts;
+    }
+
+  private:
+    friend class table_t;
+    friend class transaction_t;
+
+    snapshot_t(const table_t* table, detail::slot_t* slot, std::uint64_t ts) noexcept
+      : table(table), slot(slot), ts(ts)
+    {
+      ;
+    }
+
+    void Release() noexcept
+    {
+      if (this->slot != nullptr)
+      {
+        this->slot->ts.store(0, std::memory_order_release);
+        this->slot = nullptr;
+      }
+    }
+
+    const table_t* table;      /**< Owner table */
+    detail::slot_t* slot;      /**< Published timestamp, nullptr when released */
+    std::uint64_t ts;          /**< Snapshot timestamp */
+  };
+
+  /**
+   * Optimistic read-write transaction.
+   *
+   * Reads see snapshot taken at begin plus own writes. Writes are
+   * buffered until commit.
+   */
+  class transaction_t final
+  {
+  public:
+
+    transaction_t(transaction_t&&) = default;
+    transaction_t& operator=(transaction_t&&) = default;
+
+    /**
+     * Copy value of key, remember key for validation.
+     *
+     * @throws std::runtime_error when value is a pointer
+     *
+     * @return false when key has no value
+     */
+    bool Get(const std::string& key, value_t& out)
+    {
+      this->CheckActive();
+      auto it = this->writes.find(key);
+      if (it != this->writes.end())
+      {
+        if (!it->second)
+        {
+          return false;
+        }
+        out = *it->second;
+        return true;
+      }
+      this->reads.push_back(key);
+      return this->snapshot.Get(key, out);
+    }
+
+    /**
+     * Set value of key at commit.
+     */
+    void Put(const std::string& key, value_t value)
+    {
+      this->CheckActive();
+      this->writes[key].reset(new value_t(std::move(value)));
+    }
+
+    /**
+     * Erase key at commit.
+     */
+    void Erase(const std::string& key)
+    {
+      this->CheckActive();
+      this->writes[key].reset();
+    }
+
+    /**
+     * Apply writes, unless some key read or written here was changed
+     * by other transaction after snapshot. Transaction ends either way.
+     *
+     * @return false on conflict, nothing is applied then
+     */
+    bool Commit();
+
+    /**
+     * Drop writes and end transaction.
+     */
+    void Abort() noexcept
+    {
+      this->writes.clear();
+      this->reads.clear();
+      this->snapshot.Release();
+    }
+
+    /**
+     * Snapshot timestamp.
+     */
+    std::uint64_t Timestamp() const noexcept
+    {
+      return this->snapshot.Timestamp();
+    }
+
+  private:
+    friend class table_t;
+
+    transaction_t(table_t* owner, snapshot_t&& snapshot) noexcept
+      : owner(owner), snapshot(std::move(snapshot))
+    {
+      ;
+    }
+
+    void CheckActive() const
+    {
+      if (this->snapshot.slot == nullptr)
+      {
+        throw std::logic_error("Transaction is already finished");
+      }
+    }
+
+    table_t* owner;                                                      /**< Table to commit to */
+    snapshot_t snapshot;                                                 /**< Read view */
+    std::vector<std::string> reads;                                      /**< Keys read from snapshot */
+    std::unordered_map<std::string, std::unique_ptr<value_t>> writes;    /**< Buffered writes, nullptr erases */
+  };
+
+  /**
+   * Multi-version table from string keys to values.
+   */
+  class table_t final
+  {
+  public:
+
+    /**
+     * Create empty table.
+     *
+     * @param options table options
+     * @param domain reclamation domain for removed versions
+     */
+    explicit table_t(options_t options = options_t(), ebr::domain_t& domain = ebr::DefaultDomain())
+      : domain(domain), clock(1), slots(nullptr), count(0), versions(0), collected(0), stopping(false)
+    {
+      std::size_t buckets = 16;
+      while (buckets < options.buckets)
+      {
+        buckets *= 2;
+      }
+      this->index.store(new detail::index_t(buckets), std::memory_order_relaxed);
+      if (options.gcInterval.count() > 0)
+      {
+        this->collector = std::thread(&table_t::Background, this, options.gcInterval);
+      }
+    }
+
+    table_t(const table_t&) = delete;
+    table_t& operator=(const table_t&) = delete;
+
+    /**
+     * Destructor. All snapshots and transactions must be finished.
+     */
+    ~table_t()
+    {
+      if (this->collector.joinable())
+      {
+        {
+          std::lock_guard<std::mutex> lock(this->mutex);
+          this->stopping = true;
+        }
+        this->wake.notify_all();
+        this->collector.join();
+      }
+
+      auto index = this->index.load(std::memory_order_relaxed);
+      for (std::size_t i = 0; i <= index->mask; ++i)
+      {
+        for (auto entry = index->buckets[i].load(std::memory_order_relaxed); entry != nullptr; entry = entry->next.load(std::memory_order_relaxed))
+        {
+          delete entry->record;
+        }
+      }
+      delete index;
+
+      auto slot = this->slots.load(std::memory_order_relaxed);
+      while (slot != nullptr)
+      {
+        auto next = slot->next;
+        delete slot;
+        slot = next;
+      }
+    }
+
+    /**
+     * Start read-only view of current state. Never waits.
+     */
+    snapshot_t Snapshot() const
+    {
+      // slot is published before snapshot is read, so collector either
+      // sees slot, or has read clock which is not greater than snapshot
+      auto slot = this->AcquireSlot(this->clock.load());
+      return snapshot_t(this, slot, this->clock.load());
+    }
+
+    /**
+     * Start read-write transaction.
+     */
+    transaction_t Begin()
+    {
+      return transaction_t(this, this->Snapshot());
+    }
+
+    /**
+     * Timestamp of last commit.
+     */
+    std::uint64_t Clock() const noexcept
+    {
+      return this->clock.load();
+    }
+
+    /**
+     * Number of keys, including keys erased but not collected yet.
+     */
+    std::size_t Size() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->count;
+    }
+
+    /**
+     * Number of versions in all chains.
+     */
+    std::size_t Versions() const noexcept
+    {
+      return this->versions.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Remove versions nobody can see anymore.
+     *
+     * @return number of removed versions
+     */
+    std::size_t Collect()
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      const auto watermark = this->Watermark();
+      auto index = this->index.load(std::memory_order_relaxed);
+      std::size_t removed = 0;
+
+      for (std::size_t i = 0; i <= index->mask; ++i)
+      {
+        auto link = &index->buckets[i];
+        auto entry = link->load(std::memory_order_relaxed);
+        while (entry != nullptr)
+        {
+          auto record = entry->record;
+          auto head = record->head.load(std::memory_order_relaxed);
+          auto keep = head;
+          while ((keep != nullptr) && (keep->ts > watermark))
+          {
+            keep = keep->next.load(std::memory_order_relaxed);
+          }
+          auto next = entry->next.load(std::memory_order_relaxed);
+          if (keep == nullptr)
+          {
+            link = &entry->next;
+            entry = next;
+            continue;
+          }
+
+          // every reader stops at kept version or before it
+          auto tail = keep->next.exchange(nullptr, std::memory_order_relaxed);
+          while (tail != nullptr)
+          {
+            auto older = tail->next.load(std::memory_order_relaxed);
+            this->domain.Retire(tail);
+            ++removed;
+            tail = older;
+          }
+
+          if ((keep == head) && keep->erased)
+          {
+            link->store(next, std::memory_order_release);
+            this->domain.Retire(entry);
+            this->domain.Retire(record);
+            --this->count;
+            ++removed;
+          }
+          else
+          {
+            link = &entry->next;
+          }
+          entry = next;
+        }
+      }
+      this->versions.fetch_sub(removed, std::memory_order_relaxed);
+      this->collected.fetch_add(removed, std::memory_order_relaxed);
+      return removed;
+    }
+
+    /**
+     * Number of versions removed by collector since creation.
+     */
+    std::uint64_t Collected() const noexcept
+    {
+      return this->collected.load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class snapshot_t;
+    friend class transaction_t;
+
+    static std::size_t Hash(const std::string& key) noexcept
+    {
+      return std::hash<std::string>()(key);
+    }
+
+    /**
+     * Take free slot or add new one, publish ts in it.
+     */
+    detail::slot_t* AcquireSlot(std::uint64_t ts) const
+    {
+      for (auto slot = this->slots.load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+      {
+        std::uint64_t expected = 0;
+        if ((slot->ts.load(std::memory_order_relaxed) == 0) && slot->ts.compare_exchange_strong(expected, ts))
+        {
+          return slot;
+        }
+      }
+      auto slot = new detail::slot_t(ts);
+      auto head = this->slots.load(std::memory_order_relaxed);
+      do
+      {
+        slot->next = head;
+      }
+      while (!this->slots.compare_exchange_weak(head, slot));
+      return slot;
+    }
+
+    /**
+     * Oldest timestamp any snapshot can read at.
+     */
+    std::uint64_t Watermark() const noexcept
+    {
+      auto result = this->clock.load();
+      for (auto slot = this->slots.load(); slot != nullptr; slot = slot->next)
+      {
+        const auto ts = slot->ts.load();
+        if ((ts != 0) && (ts < result))
+        {
+          result = ts;
+        }
+      }
+      return result;
+    }
+
+    template<typename visitor_t>
+    bool Visit(const std::string& key, std::uint64_t ts, visitor_t&& visitor) const
+    {
+      auto guard = this->domain.Pin();
+      auto record = this->index.load(std::memory_order_acquire)->Find(key, Hash(key));
+      if (record == nullptr)
+      {
+        return false;
+      }
+      auto version = record->VisibleAt(ts);
+      if ((version == nullptr) || version->erased)
+      {
+        return false;
+      }
+      visitor(version->value);
+      return true;
+    }
+
+    /**
+     * Key was changed after ts, mutex must be held.
+     */
+    bool Changed(const std::string& key, std::uint64_t ts) const noexcept
+    {
+      auto record = this->index.load(std::memory_order_relaxed)->Find(key, Hash(key));
+      if (record == nullptr)
+      {
+        return false;
+      }
+      auto head = record->head.load(std::memory_order_relaxed);
+      return (head != nullptr) && (head->ts > ts);
+    }
+
+    /**
+     * Record of key, created when missing, mutex must be held.
+     */
+    detail::record_t* Record(const std::string& key)
+    {
+      const auto hash = Hash(key);
+      auto index = this->index.load(std::memory_order_relaxed);
+      auto record = index->Find(key, hash);
+      if (record != nullptr)
+      {
+        return record;
+      }
+
+      if (this->count >= 2 * (index->mask + 1))
+      {
+        auto grown = new detail::index_t(4 * (index->mask + 1));
+        for (std::size_t i = 0; i <= index->mask; ++i)
+        {
+          for (auto entry = index->buckets[i].load(std::memory_order_relaxed); entry != nullptr; entry = entry->next.load(std::memory_order_relaxed))
+          {
+            grown->Add(entry->hash, entry->record);
+          }
+        }
+        this->index.store(grown, std::memory_order_release);
+        this->domain.Retire(index);
+        index = grown;
+      }
+
+      std::unique_ptr<detail::record_t> created(new detail::record_t(key));
+      index->Add(hash, created.get());
+      ++this->count;
+      return created.release();
+    }
+
+    bool Commit(transaction_t& txn)
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      const auto ts = txn.snapshot.Timestamp();
+      for (const auto& key: txn.reads)
+      {
+        if (this->Changed(key, ts))
+        {
+          return false;
+        }
+      }
+      for (const auto& write: txn.writes)
+      {
+        if (this->Changed(write.first, ts))
+        {
+          return false;
+        }
+      }
+
+      // versions are invisible until clock reaches commit timestamp
+      const auto commit = this->clock.load(std::memory_order_relaxed) + 1;
+      for (auto& write: txn.writes)
+      {
+        auto record = this->Record(write.first);
+        const bool erased = !write.second;
+        auto version = new detail::version_t(commit, erased, erased? value_t(): std::move(*write.second),
+          record->head.load(std::memory_order_relaxed));
+        record->head.store(version, std::memory_order_release);
+      }
+      this->versions.fetch_add(txn.writes.size(), std::memory_order_relaxed);
+      this->clock.store(commit);
+      return true;
+    }
+
+    void Background(std::chrono::milliseconds interval)
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      while (!this->stopping)
+      {
+        this->wake.wait_for(lock, interval);
+        if (this->stopping)
+        {
+          break;
+        }
+        lock.unlock();
+        this->Collect();
+        lock.lock();
+      }
+    }
+
+    ebr::domain_t& domain;                             /**< Reclamation domain */
+    std::atomic<std::uint64_t> clock;                  /**< Last commit timestamp */
+    std::atomic<detail::index_t*> index;               /**< Key index */
+    mutable std::atomic<detail::slot_t*> slots;        /**< Snapshot slots */
+    mutable std::mutex mutex;                          /**< Serializes commits and collection */
+    std::size_t count;                                 /**< Records in index */
+    std::atomic<std::size_t> versions;                 /**< Versions in chains */
+    std::atomic<std::uint64_t> collected;              /**< Versions removed by collector */
+    bool stopping;                                     /**< Collector thread must exit */
+    std::condition_variable wake;                      /**< Wakes collector thread */
+    std::thread collector;                             /**< Background collector */
+  };
+
+  template<typename visitor_t>
+  bool snapshot_t::Visit(const std::string& key, visitor_t&& visitor) const
+  {
+    if (this->slot == nullptr)
+    {
+      throw std::logic_error("Snapshot is already released");
+    }
+    return this->table->Visit(key, this->ts, std::forward<visitor_t>(visitor));
+  }
+
+  inline bool transaction_t::Commit()
+  {
+    this->CheckActive();
+    bool result = true;
+    if (!this->writes.empty())
+    {
+      result = this->owner->Commit(*this);
+    }
+    this->Abort();
+    return result;
+  }
+
+} // namespace mvcc
+} // namespace bvl
+
+#endif /* BAD_VALUE_MVCC_HEADER */
@@ -0,0 +1,349 @@
+/**
+ * @file badval_path.hpp
+ * @author masscry
+ *
+ * Compiled path queries over documents.
+ *
+ * Path expression like `a.b[3].c` is compiled once into sequence of
+ * steps: object steps keep key with its precomputed hash, array steps
+ * keep index. Evaluation walks document by steps, it neither parses
+ * nor hashes nor allocates. Compiled paths are immutable, so one path
+ * is shared by any number of threads, and cache_t keeps recently used
+ * paths by expression.
+ *
+ * Grammar:
+ *
+ *     path  := [ name ] { '.' name | '[' index ']' | '[' quoted ']' }
+ *     name  := one or more of letters, digits, '_', '-', '$', '@'
+ *     index := [ '-' ] digits, negative index counts from array end
+ *     quoted := '"' characters, '\' escapes next one '"'
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_PATH_HEADER
+#define BAD_VALUE_PATH_HEADER
+
+#include <badval_doc.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace path
+{
+
+  using doc::node_t;
+
+  /**
+   * One step of path.
+   */
+  struct step_t
+  {
+    bool member;          /**< Object member step, otherwise array item step */
+    std::string key;      /**< Member key */
+    std::size_t hash;     /**< KeyHash of key */
+    std::int64_t index;   /**< Item index, negative counts from end */
+  };
+
+  namespace detail
+  {
+
+    inline bool NameChar(char c) noexcept
+    {
+      return (std::isalnum(static_cast<unsigned char>(c)) != 0) || (c == '_') || (c == '-') || (c == '$') || (c == '@');
+    }
+
+    [[noreturn]] inline void Fail(const std::string& expression, std::size_t pos, const char* what)
+    {
+      throw std::invalid_argument("bad path '" + expression + "' at " + std::to_string(pos) + ": " + what);
+    }
+
+  } // namespace detail
+
+  /**
+   * Compiled path.
+   */
+  class path_t final
+  {
+  public:
+
+    /**
+     * Compile path expression.
+     *
+     * @throws std::invalid_argument when expression is malformed
+     */
+    explicit path_t(const std::string& expression)
+      : expression(expression)
+    {
+      std::size_t pos = 0;
+      const auto size = expression.size();
+      auto name = [this, &expression, &pos, size]()
+      {
+        const auto begin = pos;
+        while ((pos < size) && detail::NameChar(expression[pos]))
+        {
+          ++pos;
+        }
+        if (pos == begin)
+        {
+          detail::Fail(expression, pos, "expected name");
+        }
+        this->Member(expression.substr(begin, pos - begin));
+      };
+
+      if ((pos < size) && (expression[pos] != '['))
+      {
+        name();
+      }
+      while (pos < size)
+      {
+        if (expression[pos] == '.')
+        {
+          ++pos;
+          name();
+          continue;
+        }
+        if (expression[pos] != '[')
+        {
+          detail::Fail(expression, pos, "expected '.' or '['");
+        }
+        ++pos;
+        if ((pos < size) && (expression[pos] == '"'))
+        {
+          std::string key;
+          for (++pos; (pos < size) && (expression[pos] != '"'); ++pos)
+          {
+            if ((expression[pos] == '\\') && (pos + 1 < size))
+            {
+              ++pos;
+            }
+            key.push_back(expression[pos]);
+          }
+          if (pos == size)
+          {
+            detail::Fail(expression, pos, "unterminated key");
+          }
+          ++pos;
+          this->Member(key);
+        }
+        else
+        {
+          const auto negative = (pos < size) && (expression[pos] == '-');
+          pos += negative? 1: 0;
+          const auto begin = pos;
+          std::int64_t index = 0;
+          for (; (pos < size) && (std::isdigit(static_cast<unsigned char>(expression[pos])) != 0); ++pos)
+          {
+            if (index > (std::numeric_limits<std::int64_t>::max() - 9) / 10)
+            {
+              detail::Fail(expression, pos, "index too large");
+            }
+            index = index * 10 + (expression[pos] - '0');
+          }
+          if (pos == begin)
+          {
+            detail::Fail(expression, pos, "expected index or quoted key");
+          }
+          this->steps.push_back({ false, std::string(), 0, negative? -index: index });
+        }
+        if ((pos == size) || (expression[pos] != ']'))
+        {
+          detail::Fail(expression, pos, "expected ']'");
+        }
+        ++pos;
+      }
+    }
+
+    /**
+     * Find node addressed by path.
+     *
+     * @return node or nullptr when document has no such node
+     */
+    const node_t* Eval(const node_t& document) const noexcept
+    {
+      const node_t* current = &document;
+      for (const auto& step: this->steps)
+      {
+        if (step.member)
+        {
+          current = current->Find(step.key, step.hash);
+          if (current == nullptr)
+          {
+            return nullptr;
+          }
+          continue;
+        }
+        if (current->Kind() != node_t::array)
+        {
+          return nullptr;
+        }
+        const auto size = static_cast<std::int64_t>(current->Size());
+        const auto index = (step.index < 0)? size + step.index: step.index;
+        if ((index < 0) || (index >= size))
+        {
+          return nullptr;
+        }
+        current = &current->At(static_cast<std::size_t>(index));
+      }
+      return current;
+    }
+
+    /**
+     * Evaluate path over batch of documents.
+     *
+     * @param [in] documents documents
+     * @param [in] size number of documents
+     * @param [out] out found nodes or nullptr, one per document
+     *
+     * @return number of found nodes
+     */
+    std::size_t Eval(const node_t* documents, std::size_t size, const node_t** out) const noexcept
+    {
+      std::size_t found = 0;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        out[i] = this->Eval(documents[i]);
+        found += (out[i] != nullptr)? 1: 0;
+      }
+      return found;
+    }
+
+    /**
+     * Compiled steps.
+     */
+    const std::vector<step_t>& Steps() const noexcept
+    {
+      return this->steps;
+    }
+
+    /**
+     * Source expression.
+     */
+    const std::string& Expression() const noexcept
+    {
+      return this->expression;
+    }
+
+  private:
+
+    void Member(std::string key)
+    {
+      const auto hash = doc::KeyHash(key);
+      this->steps.push_back({ true, std::move(key), hash, 0 });
+    }
+
+    std::string expression;       /**< Source expression */
+    std::vector<step_t> steps;    /**< Compiled steps */
+  };
+
+  /**
+   * Cache of compiled paths, least recently used path is evicted.
+   *
+   * Cache may be used from many threads.
+   */
+  class cache_t final
+  {
+  public:
+
+    /**
+     * Create empty cache.
+     *
+     * @param [in] capacity most paths kept, at least 1
+     */
+    explicit cache_t(std::size_t capacity = 1024)
+      : capacity(std::max<std::size_t>(1, capacity)), hits(0), misses(0)
+    {
+      ;
+    }
+
+    /**
+     * Get compiled path, compile it on miss.
+     *
+     * @throws std::invalid_argument when expression is malformed
+     */
+    std::shared_ptr<const path_t> Get(const std::string& expression)
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        const auto it = this->index.find(expression);
+        if (it != this->index.end())
+        {
+          ++this->hits;
+          this->order.splice(this->order.begin(), this->order, it->second);
+          return *it->second;
+        }
+        ++this->misses;
+      }
+
+      // compile outside of lock, racing threads may compile same path twice
+      auto path = std::make_shared<const path_t>(expression);
+      std::lock_guard<std::mutex> lock(this->mutex);
+      const auto it = this->index.find(expression);
+      if (it != this->index.end())
+      {
+        return *it->second;
+      }
+      this->order.push_front(path);
+      this->index.emplace(expression, this->order.begin());
+      if (this->order.size() > this->capacity)
+      {
+        this->index.erase(this->order.back()->Expression());
+        this->order.pop_back();
+      }
+      return path;
+    }
+
+    /**
+     * Number of cached paths.
+     */
+    std::size_t Size() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->order.size();
+    }
+
+    /**
+     * Number of lookups found in cache.
+     */
+    std::uint64_t Hits() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->hits;
+    }
+
+    /**
+     * Number of lookups which compiled path.
+     */
+    std::uint64_t Misses() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->misses;
+    }
+
+  private:
+    using order_t = std::list<std::shared_ptr<const path_t>>;
+
+    std::size_t capacity;                                         /**< Most paths kept */
+    std::uint64_t hits;                                           /**< Lookups found in cache */
+    std::uint64_t misses;                                         /**< Lookups compiled */
+    mutable std::mutex mutex;                                     /**< Guards cache */
+    order_t order;                                                /**< Paths, most recently used first */
+    std::unordered_map<std::string, order_t::iterator> index;     /**< Paths by expression */
+  };
+
+} // namespace path
+} // namespace bvl
+
+#endif /* BAD_VALUE_PATH_HEADER */
@@ -0,0 +1,452 @@
+/**
+ * @file badval_quantile.hpp
+ * @author masscry
+ *
+ * KLL quantile sketch of number values.
+ *
+ * Sketch keeps levels of sampled numbers, number on level h stands
+ * for 2^h input numbers. New numbers go to level 0. When sketch holds
+ * more numbers than its capacity, lowest full level is sorted and every
+ * other number of it, starting from random one, moves one level up,
+ * rest is dropped. Capacity of levels shrinks geometrically (by 2/3)
+ * from top level down, so memory is O(k) beyond logarithmic number of
+ * levels, and rank error is about 1.7% for k = 200 and falls as 1/k.
+ *
+ * Sketches merge by concatenation of levels and compaction, so result
+ * has same guarantees as sketch of all numbers. sharded_t lets many
+ * threads ingest into own shards without contention and merges shards
+ * at query time.
+ *
+ * Values other than numbers, and NaN, are skipped.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_QUANTILE_HEADER
+#define BAD_VALUE_QUANTILE_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace quantile
+{
+
+  /**
+   * KLL sketch.
+   */
+  class sketch_t final
+  {
+  public:
+
+    /**
+     * Create empty sketch.
+     *
+     * @param [in] k accuracy parameter, at least 8, rank error falls about as 1 / k
+     * @param [in] seed seed of compaction coin
+     *
+     * @throws std::invalid_argument when k is too small
+     */
+    explicit sketch_t(std::size_t k = 200, std::uint64_t seed = 0x9E3779B97F4A7C15ULL)
+      : k(k), count(0), skipped(0), retained(0), limit(0),
+        min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()),
+        coin(seed | 1)
+    {
+      if (k < 8)
+      {
+        throw std::invalid_argument("KLL sketch needs k of at least 8");
+      }
+      this->Grow();
+    }
+
+    /**
+     * Add number value, skip others.
+     *
+     * @return true when value was added
+     */
+    bool Add(const value_t& value)
+    {
+      if ((value.Type() != value_t::number) || std::isnan(value.As<value_t::number>()))
+      {
+        ++this->skipped;
+        return false;
+      }
+      this->Add(value.As<value_t::number>());
+      return true;
+    }
+
+    /**
+     * Add number, NaN is skipped.
+     */
+    void Add(double number)
+    {
+      if (std::isnan(number))
+      {
+        ++this->skipped;
+        return;
+      }
+      this->Note(number);
+      this->levels[0].push_back(number);
+      if (++this->retained >= this->limit)
+      {
+        this->Compress();
+      }
+    }
+
+    /**
+     * Add batch of values, skip non-numbers.
+     *
+     * Numbers are appended to level 0 in bulk and compacted when level
+     * 0 overflows, instead of after every number.
+     *
+     * @return numbers added
+     */
+    std::size_t Add(const value_t* values, std::size_t size)
+    {
+      std::size_t added = 0;
+      for (std::size_t i = 0; i < size;)
+      {
+        auto& bottom = this->levels[0];
+        const auto room = (this->limit > this->retained)? this->limit - this->retained: 1;
+        const auto end = std::min(size, i + room);
+        for (; i < end; ++i)
+        {
+          if ((values[i].Type() != value_t::number) || std::isnan(values[i].As<value_t::number>()))
+          {
+            ++this->skipped;
+            continue;
+          }
+          const auto number = values[i].As<value_t::number>();
+          this->Note(number);
+          bottom.push_back(number);
+          ++this->retained;
+          ++added;
+        }
+        if (this->retained >= this->limit)
+        {
+          this->Compress();
+        }
+      }
+      return added;
+    }
+
+    /**
+     * Add numbers of other sketch.
+     */
+    void Merge(const sketch_t& other)
+    {
+      while (this->levels.size() < other.levels.size())
+      {
+        this->Grow();
+      }
+      for (std::size_t h = 0; h < other.levels.size(); ++h)
+      {
+        this->levels[h].insert(this->levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+      }
+      this->count += other.count;
+      this->skipped += other.skipped;
+      this->retained += other.retained;
+      this->min = std::min(this->min, other.min);
+      this->max = std::max(this->max, other.max);
+      while (this->retained >= this->limit)
+      {
+        this->Compress();
+      }
+    }
+
+    /**
+     * Fraction of added numbers not greater than given one.
+     */
+    double Rank(double number) const
+    {
+      if (this->count == 0)
+      {
+        return 0.0;
+      }
+      std::uint64_t weight = 0;
+      for (std::size_t h = 0; h < this->levels.size(); ++h)
+      {
+        for (const auto item: this->levels[h])
+        {
+          weight += (item <= number)? (std::uint64_t(1) << h): 0;
+        }
+      }
+      return static_cast<double>(weight) / static_cast<double>(this->count);
+    }
+
+    /**
+     * Number of given rank, from 0 (minimum) to 1 (maximum).
+     *
+     * @return NaN for empty sketch
+     */
+    double Quantile(double fraction) const
+    {
+      return this->Quantiles({ fraction }).front();
+    }
+
+    /**
+     * Numbers of given ranks, sorted view of sketch is built once.
+     */
+    std::vector<double> Quantiles(const std::vector<double>& fractions) const
+    {
+      std::vector<double> result;
+      if (this->count == 0)
+      {
+        result.assign(fractions.size(), std::numeric_limits<double>::quiet_NaN());
+        return result;
+      }
+
+      std::vector<std::pair<double, std::uint64_t>> view;
+      view.reserve(this->retained);
+      for (std::size_t h = 0; h < this->levels.size(); ++h)
+      {
+        for (const auto item: this->levels[h])
+        {
+          view.emplace_back(item, std::uint64_t(1) << h);
+        }
+      }
+      std::sort(view.begin(), view.end());
+      std::uint64_t total = 0;
+      for (auto& item: view)
+      {
+        total += item.second;
+        item.second = total;
+      }
+
+      for (const auto fraction: fractions)
+      {
+        if (fraction <= 0.0)
+        {
+          result.push_back(this->min);
+          continue;
+        }
+        if (fraction >= 1.0)
+        {
+          result.push_back(this->max);
+          continue;
+        }
+        const auto target = static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(total)));
+        const auto it = std::lower_bound(view.begin(), view.end(), target,
+          [](const std::pair<double, std::uint64_t>& item, std::uint64_t weight)
+          {
+            return item.second < weight;
+          }
+        );
+        result.push_back((it == view.end())? this->max: it->first);
+      }
+      return result;
+    }
+
+    /**
+     * Expected rank error with 99% confidence, as fraction.
+     */
+    double RankError() const noexcept
+    {
+      return 2.296 / std::pow(static_cast<double>(this->k), 0.9723);
+    }
+
+    /**
+     * Number of added numbers.
+     */
+    std::uint64_t Count() const noexcept
+    {
+      return this->count;
+    }
+
+    /**
+     * Number of skipped values.
+     */
+    std::uint64_t Skipped() const noexcept
+    {
+      return this->skipped;
+    }
+
+    /**
+     * Smallest added number, infinity for empty sketch.
+     */
+    double Min() const noexcept
+    {
+      return this->min;
+    }
+
+    /**
+     * Largest added number, minus infinity for empty sketch.
+     */
+    double Max() const noexcept
+    {
+      return this->max;
+    }
+
+    /**
+     * Numbers kept by sketch.
+     */
+    std::size_t Retained() const noexcept
+    {
+      return this->retained;
+    }
+
+  private:
+
+    void Note(double number) noexcept
+    {
+      ++this->count;
+      this->min = std::min(this->min, number);
+      this->max = std::max(this->max, number);
+    }
+
+    /**
+     * Add top level, capacity of level is k * (2/3)^depth below top.
+     */
+    void Grow()
+    {
+      this->levels.emplace_back();
+      this->capacities.resize(this->levels.size());
+      this->limit = 0;
+      for (std::size_t h = 0; h < this->levels.size(); ++h)
+      {
+        const auto depth = static_cast<double>(this->levels.size() - 1 - h);
+        this->capacities[h] = 2 + static_cast<std::size_t>(std::ceil(static_cast<double>(this->k) * std::pow(2.0 / 3.0, depth)));
+        this->limit += this->capacities[h];
+      }
+    }
+
+    /**
+     * Compact lowest full level into next one.
+     */
+    void Compress()
+    {
+      for (std::size_t h = 0; h < this->levels.size(); ++h)
+      {
+        if (this->levels[h].size() < this->capacities[h])
+        {
+          continue;
+        }
+        if (h + 1 == this->levels.size())
+        {
+          this->Grow();
+        }
+        auto& level = this->levels[h];
+        auto& next = this->levels[h + 1];
+        std::sort(level.begin(), level.end());
+
+        // smallest number stays on level, when there are odd numbers
+        const auto odd = level.size() % 2;
+        this->coin ^= this->coin << 13;
+        this->coin ^= this->coin >> 7;
+        this->coin ^= this->coin << 17;
+        for (auto i = odd + static_cast<std::size_t>(this->coin & 1); i < level.size(); i += 2)
+        {
+          next.push_back(level[i]);
+        }
+        this->retained -= (level.size() - odd) / 2;
+        level.resize(odd);
+        return;
+      }
+    }
+
+    std::size_t k;                              /**< Accuracy parameter */
+    std::uint64_t count;                        /**< Added numbers */
+    std::uint64_t skipped;                      /**< Skipped values */
+    std::size_t retained;                       /**< Numbers on all levels */
+    std::size_t limit;                          /**< Capacity of all levels */
+    double min;                                 /**< Smallest number */
+    double max;                                 /**< Largest number */
+    std::uint64_t coin;                         /**< Xorshift state */
+    std::vector<std::vector<double>> levels;    /**< Levels, number on level h weights 2^h */
+    std::vector<std::size_t> capacities;        /**< Capacity of every level */
+  };
+
+  /**
+   * Sketch split into shards for concurrent ingest.
+   *
+   * Every thread adds into shard picked by its id, shards are merged
+   * into one sketch at query time.
+   */
+  class sharded_t final
+  {
+  public:
+
+    /**
+     * Create empty shards.
+     *
+     * @param [in] shards number of shards, 0 for one per hardware thread
+     * @param [in] k accuracy parameter of every shard
+     */
+    explicit sharded_t(std::size_t shards = 0, std::size_t k = 200)
+    {
+      if (shards == 0)
+      {
+        shards = std::max(1u, std::thread::hardware_concurrency());
+      }
+      for (std::size_t i = 0; i < shards; ++i)
+      {
+        this->shards.emplace_back(new shard_t(k, i));
+      }
+    }
+
+    /**
+     * Add batch of values from any thread.
+     *
+     * @return numbers added
+     */
+    std::size_t Add(const value_t* values, std::size_t size)
+    {
+      auto& shard = *this->shards[std::hash<std::thread::id>()(std::this_thread::get_id()) % this->shards.size()];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      return shard.sketch.Add(values, size);
+    }
+
+    /**
+     * Merge all shards.
+     */
+    sketch_t Snapshot() const
+    {
+      std::unique_ptr<sketch_t> result;
+      for (const auto& shard: this->shards)
+      {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (result == nullptr)
+        {
+          result.reset(new sketch_t(shard->sketch));
+        }
+        else
+        {
+          result->Merge(shard->sketch);
+        }
+      }
+      return *result;
+    }
+
+  private:
+
+    struct shard_t
+    {
+      shard_t(std::size_t k, std::uint64_t seed)
+        : sketch(k, 0x9E3779B97F4A7C15ULL * (seed + 1))
+      {
+        ;
+      }
+
+      mutable std::mutex mutex;   /**< Guards sketch */
+      sketch_t sketch;            /**< Numbers added by threads of shard */
+    };
+
+    std::vector<std::unique_ptr<shard_t>> shards; /**< Shards */
+  };
+
+} // namespace quantile
+} // namespace bvl
+
+#endif /* BAD_VALUE_QUANTILE_HEADER */
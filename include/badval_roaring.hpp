@@ -0,0 +1,1067 @@
+/**
+ * @file badval_roaring.hpp
+ * @author masscry
+ *
+ * Compressed row bitmaps and value column with bitmap indexes.
+ *
+ * Bitmap splits 32-bit row numbers by high 16 bits. Low 16 bits of
+ * rows with same high bits go to one container, which is one of:
+ *
+ *  - array: sorted values, up to 4096 of them;
+ *  - bitmap: 65536 bits, for more than 4096 values;
+ *  - run: sorted (start, length - 1) pairs, for long ranges of rows.
+ *
+ * Set operations work container by container and pick cheapest routine
+ * for every pair of container kinds. Array intersection compares eight
+ * values at once with SSE2, or gallops when one array is much shorter,
+ * bitmap intersection and union process 128 bits per instruction.
+ *
+ * Column keeps values and, once index is built, bitmap of rows for
+ * every type and every distinct number and string. Filtered scans take
+ * rows from index instead of checking every value.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_ROARING_HEADER
+#define BAD_VALUE_ROARING_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace bvl
+{
+namespace roaring
+{
+
+  namespace detail
+  {
+
+    /**
+     * Most values in array container.
+     */
+    constexpr std::uint32_t arrayLimit = 4096;
+
+    /**
+     * 64-bit words in bitmap container.
+     */
+    constexpr std::size_t bitmapWords = 1024;
+
+    enum kind_t : unsigned char
+    {
+      arrayKind = 0,
+      bitmapKind = 1,
+      runKind = 2
+    };
+
+    /**
+     * Set of 16-bit values.
+     */
+    struct container_t
+    {
+      kind_t kind = arrayKind;                /**< Layout */
+      std::uint32_t cardinality = 0;          /**< Number of values */
+      std::vector<std::uint16_t> values;      /**< Array values, or run start and length - 1 pairs */
+      std::vector<std::uint64_t> words;       /**< Bitmap words */
+    };
+
+    inline std::uint32_t Popcount(std::uint64_t word) noexcept
+    {
+      return static_cast<std::uint32_t>(__builtin_popcountll(word));
+    }
+
+    /**
+     * Set bits [begin, end) of bitmap.
+     */
+    inline void SetRange(std::uint64_t* words, std::uint32_t begin, std::uint32_t end) noexcept
+    {
+      if (begin >= end)
+      {
+        return;
+      }
+      const auto first = begin / 64;
+      const auto last = (end - 1) / 64;
+      const auto head = ~std::uint64_t(0) << (begin % 64);
+      const auto tail = ~std::uint64_t(0) >> (63 - (end - 1) % 64);
+      if (first == last)
+      {
+        words[first] |= head & tail;
+        return;
+      }
+      words[first] |= head;
+      for (auto i = first + 1; i < last; ++i)
+      {
+        words[i] = ~std::uint64_t(0);
+      }
+      words[last] |= tail;
+    }
+
+    /**
+     * Call fn(value) for values in order, stop when fn returns false.
+     */
+    template<typename fn_t>
+    bool ForEach(const container_t& container, fn_t&& fn)
+    {
+      switch (container.kind)
+      {
+        case arrayKind:
+          for (const auto value: container.values)
+          {
+            if (!fn(value))
+            {
+              return false;
+            }
+          }
+          return true;
+        case bitmapKind:
+          for (std::size_t i = 0; i < bitmapWords; ++i)
+          {
+            auto word = container.words[i];
+            while (word != 0)
+            {
+              const auto bit = static_cast<std::uint32_t>(__builtin_ctzll(word));
+              if (!fn(static_cast<std::uint16_t>(i * 64 + bit)))
+              {
+                return false;
+              }
+              word &= word - 1;
+            }
+          }
+          return true;
+        default:
+          for (std::size_t i = 0; i < container.values.size(); i += 2)
+          {
+            const std::uint32_t start = container.values[i];
+            for (std::uint32_t value = start; value <= start + container.values[i + 1]; ++value)
+            {
+              if (!fn(static_cast<std::uint16_t>(value)))
+              {
+                return false;
+              }
+            }
+          }
+          return true;
+      }
+    }
+
+    inline bool Contains(const container_t& container, std::uint16_t value) noexcept
+    {
+      switch (container.kind)
+      {
+        case arrayKind:
+          return std::binary_search(container.values.begin(), container.values.end(), value);
+        case bitmapKind:
+          return ((container.words[value / 64] >> (value % 64)) & 1) != 0;
+        default:
+          {
+            // last run starting not after value
+            std::size_t low = 0;
+            std::size_t high = container.values.size() / 2;
+            while (low < high)
+            {
+              const auto mid = (low + high) / 2;
+              if (container.values[2 * mid] <= value)
+              {
+                low = mid + 1;
+              }
+              else
+              {
+                high = mid;
+              }
+            }
+            return (low != 0)
+              && (value <= std::uint32_t(container.values[2 * (low - 1)]) + container.values[2 * (low - 1) + 1]);
+          }
+      }
+    }
+
+    /**
+     * Same values in bitmap layout.
+     */
+    inline container_t ToBitmap(const container_t& container)
+    {
+      container_t result;
+      result.kind = bitmapKind;
+      result.cardinality = container.cardinality;
+      if (container.kind == bitmapKind)
+      {
+        result.words = container.words;
+        return result;
+      }
+      result.words.assign(bitmapWords, 0);
+      if (container.kind == arrayKind)
+      {
+        for (const auto value: container.values)
+        {
+          result.words[value / 64] |= std::uint64_t(1) << (value % 64);
+        }
+      }
+      else
+      {
+        for (std::size_t i = 0; i < container.values.size(); i += 2)
+        {
+          SetRange(result.words.data(), container.values[i], std::uint32_t(container.values[i]) + container.values[i + 1] + 1);
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Same values in array layout.
+     */
+    inline container_t ToArray(const container_t& container)
+    {
+      container_t result;
+      result.cardinality = container.cardinality;
+      result.values.reserve(container.cardinality);
+      ForEach(container,
+        [&result](std::uint16_t value)
+        {
+          result.values.push_back(value);
+          return true;
+        }
+      );
+      return result;
+    }
+
+    /**
+     * Convert bitmap or array to layout required by cardinality.
+     */
+    inline void Normalize(container_t& container)
+    {
+      if ((container.kind == bitmapKind) && (container.cardinality <= arrayLimit))
+      {
+        container = ToArray(container);
+      }
+      else if ((container.kind == arrayKind) && (container.cardinality > arrayLimit))
+      {
+        container = ToBitmap(container);
+      }
+    }
+
+    /**
+     * Number of ranges of consecutive values.
+     */
+    inline std::size_t CountRuns(const container_t& container)
+    {
+      if (container.kind == runKind)
+      {
+        return container.values.size() / 2;
+      }
+      std::size_t runs = 0;
+      std::int32_t prev = -2;
+      ForEach(container,
+        [&runs, &prev](std::uint16_t value)
+        {
+          runs += (value != prev + 1)? 1: 0;
+          prev = value;
+          return true;
+        }
+      );
+      return runs;
+    }
+
+    /**
+     * Store container in smallest of three layouts.
+     */
+    inline void RunOptimize(container_t& container)
+    {
+      const auto runs = CountRuns(container);
+      const auto runBytes = 4 * runs;
+      const auto otherBytes = (container.cardinality <= arrayLimit)? 2 * std::size_t(container.cardinality): 8 * bitmapWords;
+      if (runBytes < otherBytes)
+      {
+        if (container.kind == runKind)
+        {
+          return;
+        }
+        container_t result;
+        result.kind = runKind;
+        result.cardinality = container.cardinality;
+        result.values.reserve(2 * runs);
+        ForEach(container,
+          [&result](std::uint16_t value)
+          {
+            auto& values = result.values;
+            if (!values.empty() && (std::uint32_t(values[values.size() - 2]) + values.back() + 1 == value))
+            {
+              ++values.back();
+            }
+            else
+            {
+              values.push_back(value);
+              values.push_back(0);
+            }
+            return true;
+          }
+        );
+        container = std::move(result);
+      }
+      else if (container.kind == runKind)
+      {
+        container = (container.cardinality <= arrayLimit)? ToArray(container): ToBitmap(container);
+      }
+    }
+
+    /**
+     * Add value, container must not be run.
+     */
+    inline void Add(container_t& container, std::uint16_t value)
+    {
+      if (container.kind == bitmapKind)
+      {
+        auto& word = container.words[value / 64];
+        const auto bit = std::uint64_t(1) << (value % 64);
+        container.cardinality += ((word & bit) == 0)? 1: 0;
+        word |= bit;
+        return;
+      }
+      auto& values = container.values;
+      if (values.empty() || (values.back() < value))
+      {
+        values.push_back(value);
+      }
+      else
+      {
+        auto it = std::lower_bound(values.begin(), values.end(), value);
+        if (*it == value)
+        {
+          return;
+        }
+        values.insert(it, value);
+      }
+      ++container.cardinality;
+      Normalize(container);
+    }
+
+    /**
+     * Intersect sorted arrays, return size of result.
+     */
+    inline std::size_t IntersectArrays(const std::uint16_t* a, std::size_t na,
+      const std::uint16_t* b, std::size_t nb, std::uint16_t* out) noexcept
+    {
+      if (na > nb)
+      {
+        std::swap(a, b);
+        std::swap(na, nb);
+      }
+      std::size_t count = 0;
+      std::size_t i = 0;
+      std::size_t j = 0;
+
+      if (na * 32 < nb)
+      {
+        // gallop in long array for every value of short one
+        for (; (i < na) && (j < nb); ++i)
+        {
+          std::size_t step = 1;
+          while ((j + step < nb) && (b[j + step] < a[i]))
+          {
+            j += step;
+            step *= 2;
+          }
+          j = static_cast<std::size_t>(std::lower_bound(b + j, b + std::min(j + step + 1, nb), a[i]) - b);
+          if ((j < nb) && (b[j] == a[i]))
+          {
+            out[count++] = a[i];
+          }
+        }
+        return count;
+      }
+
+#if defined(__SSE2__)
+      // compare value of a with eight values of b at once
+      while ((i < na) && (j + 8 <= nb))
+      {
+        const auto value = a[i];
+        if (b[j + 7] < value)
+        {
+          j += 8;
+          continue;
+        }
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        const auto equal = _mm_cmpeq_epi16(block, _mm_set1_epi16(static_cast<short>(value)));
+        if (_mm_movemask_epi8(equal) != 0)
+        {
+          out[count++] = value;
+        }
+        ++i;
+      }
+#endif
+
+      while ((i < na) && (j < nb))
+      {
+        if (a[i] < b[j])
+        {
+          ++i;
+        }
+        else if (b[j] < a[i])
+        {
+          ++j;
+        }
+        else
+        {
+          out[count++] = a[i];
+          ++i;
+          ++j;
+        }
+      }
+      return count;
+    }
+
+    /**
+     * words = words op other for whole bitmap, return cardinality.
+     */
+    template<bool unite>
+    std::uint32_t CombineBitmaps(std::uint64_t* words, const std::uint64_t* other) noexcept
+    {
+      std::uint32_t cardinality = 0;
+#if defined(__SSE2__)
+      for (std::size_t i = 0; i < bitmapWords; i += 2)
+      {
+        const auto lhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        const auto rhs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(words + i), unite? _mm_or_si128(lhs, rhs): _mm_and_si128(lhs, rhs));
+        cardinality += Popcount(words[i]) + Popcount(words[i + 1]);
+      }
+#else
+      for (std::size_t i = 0; i < bitmapWords; ++i)
+      {
+        words[i] = unite? (words[i] | other[i]): (words[i] & other[i]);
+        cardinality += Popcount(words[i]);
+      }
+#endif
+      return cardinality;
+    }
+
+    inline container_t And(const container_t& lhs, const container_t& rhs)
+    {
+      container_t result;
+      if ((lhs.kind == arrayKind) && (rhs.kind == arrayKind))
+      {
+        result.values.resize(std::min(lhs.cardinality, rhs.cardinality));
+        const auto count = IntersectArrays(lhs.values.data(), lhs.values.size(), rhs.values.data(), rhs.values.size(), result.values.data());
+        result.values.resize(count);
+        result.cardinality = static_cast<std::uint32_t>(count);
+        return result;
+      }
+      if ((lhs.kind == arrayKind) || (rhs.kind == arrayKind))
+      {
+        // probe every array value in other container
+        const auto& array = (lhs.kind == arrayKind)? lhs: rhs;
+        const auto& other = (lhs.kind == arrayKind)? rhs: lhs;
+        for (const auto value: array.values)
+        {
+          if (Contains(other, value))
+          {
+            result.values.push_back(value);
+          }
+        }
+        result.cardinality = static_cast<std::uint32_t>(result.values.size());
+        return result;
+      }
+      if ((lhs.kind == runKind) && (rhs.kind == runKind))
+      {
+        // intersect sorted ranges
+        result.kind = runKind;
+        std::size_t i = 0;
+        std::size_t j = 0;
+        while ((i < lhs.values.size()) && (j < rhs.values.size()))
+        {
+          const std::uint32_t lhsEnd = std::uint32_t(lhs.values[i]) + lhs.values[i + 1];
+          const std::uint32_t rhsEnd = std::uint32_t(rhs.values[j]) + rhs.values[j + 1];
+          const std::uint32_t start = std::max(lhs.values[i], rhs.values[j]);
+          const auto end = std::min(lhsEnd, rhsEnd);
+          if (start <= end)
+          {
+            result.values.push_back(static_cast<std::uint16_t>(start));
+            result.values.push_back(static_cast<std::uint16_t>(end - start));
+            result.cardinality += end - start + 1;
+          }
+          if (lhsEnd < rhsEnd)
+          {
+            i += 2;
+          }
+          else
+          {
+            j += 2;
+          }
+        }
+        RunOptimize(result);
+        return result;
+      }
+      result = ToBitmap(lhs);
+      if (rhs.kind == bitmapKind)
+      {
+        result.cardinality = CombineBitmaps<false>(result.words.data(), rhs.words.data());
+      }
+      else
+      {
+        result.cardinality = CombineBitmaps<false>(result.words.data(), ToBitmap(rhs).words.data());
+      }
+      Normalize(result);
+      return result;
+    }
+
+    inline container_t Or(const container_t& lhs, const container_t& rhs)
+    {
+      container_t result;
+      if ((lhs.kind == arrayKind) && (rhs.kind == arrayKind) && (lhs.cardinality + rhs.cardinality <= arrayLimit))
+      {
+        result.values.resize(lhs.cardinality + rhs.cardinality);
+        const auto end = std::set_union(lhs.values.begin(), lhs.values.end(), rhs.values.begin(), rhs.values.end(), result.values.begin());
+        result.values.erase(end, result.values.end());
+        result.cardinality = static_cast<std::uint32_t>(result.values.size());
+        return result;
+      }
+      if ((lhs.kind != bitmapKind) && (rhs.kind == bitmapKind))
+      {
+        return Or(rhs, lhs);
+      }
+      result = ToBitmap(lhs);
+      if (rhs.kind == arrayKind)
+      {
+        for (const auto value: rhs.values)
+        {
+          auto& word = result.words[value / 64];
+          const auto bit = std::uint64_t(1) << (value % 64);
+          result.cardinality += ((word & bit) == 0)? 1: 0;
+          word |= bit;
+        }
+      }
+      else if (rhs.kind == bitmapKind)
+      {
+        result.cardinality = CombineBitmaps<true>(result.words.data(), rhs.words.data());
+      }
+      else
+      {
+        result.cardinality = CombineBitmaps<true>(result.words.data(), ToBitmap(rhs).words.data());
+      }
+      if ((lhs.kind == runKind) || (rhs.kind == runKind))
+      {
+        RunOptimize(result);
+      }
+      Normalize(result);
+      return result;
+    }
+
+  } // namespace detail
+
+  /**
+   * Compressed set of 32-bit row numbers.
+   */
+  class bitmap_t final
+  {
+  public:
+
+    bitmap_t() = default;
+
+    /**
+     * Add row.
+     */
+    void Add(std::uint32_t row)
+    {
+      const auto high = static_cast<std::uint16_t>(row >> 16);
+      std::size_t pos;
+      if (!this->keys.empty() && (this->keys.back() == high))
+      {
+        pos = this->keys.size() - 1;
+      }
+      else
+      {
+        pos = static_cast<std::size_t>(std::lower_bound(this->keys.begin(), this->keys.end(), high) - this->keys.begin());
+        if ((pos == this->keys.size()) || (this->keys[pos] != high))
+        {
+          this->keys.insert(this->keys.begin() + static_cast<std::ptrdiff_t>(pos), high);
+          this->containers.insert(this->containers.begin() + static_cast<std::ptrdiff_t>(pos), detail::container_t());
+        }
+      }
+      auto& container = this->containers[pos];
+      if (container.kind == detail::runKind)
+      {
+        container = (container.cardinality < detail::arrayLimit)? detail::ToArray(container): detail::ToBitmap(container);
+      }
+      detail::Add(container, static_cast<std::uint16_t>(row));
+    }
+
+    /**
+     * Add rows [begin, end).
+     */
+    void AddRange(std::uint32_t begin, std::uint32_t end)
+    {
+      while (begin < end)
+      {
+        const auto high = begin >> 16;
+        const auto stop = std::min<std::uint64_t>(end, (std::uint64_t(high) + 1) << 16);
+        detail::container_t range;
+        range.kind = detail::runKind;
+        range.values = { static_cast<std::uint16_t>(begin), static_cast<std::uint16_t>(stop - begin - 1) };
+        range.cardinality = static_cast<std::uint32_t>(stop - begin);
+        bitmap_t part;
+        part.keys.push_back(static_cast<std::uint16_t>(high));
+        part.containers.push_back(std::move(range));
+        *this = Or(*this, part);
+        begin = static_cast<std::uint32_t>(stop);
+        if (stop == (std::uint64_t(1) << 32))
+        {
+          break;
+        }
+      }
+    }
+
+    bool Contains(std::uint32_t row) const noexcept
+    {
+      const auto high = static_cast<std::uint16_t>(row >> 16);
+      auto it = std::lower_bound(this->keys.begin(), this->keys.end(), high);
+      if ((it == this->keys.end()) || (*it != high))
+      {
+        return false;
+      }
+      return detail::Contains(this->containers[static_cast<std::size_t>(it - this->keys.begin())], static_cast<std::uint16_t>(row));
+    }
+
+    /**
+     * Number of rows.
+     */
+    std::uint64_t Cardinality() const noexcept
+    {
+      std::uint64_t result = 0;
+      for (const auto& container: this->containers)
+      {
+        result += container.cardinality;
+      }
+      return result;
+    }
+
+    bool Empty() const noexcept
+    {
+      return this->containers.empty();
+    }
+
+    /**
+     * Call visitor(std::uint32_t row) for rows in order, stop when it returns false.
+     */
+    template<typename visitor_t>
+    void ForEach(visitor_t&& visitor) const
+    {
+      for (std::size_t i = 0; i < this->keys.size(); ++i)
+      {
+        const auto high = std::uint32_t(this->keys[i]) << 16;
+        const bool proceed = detail::ForEach(this->containers[i],
+          [&visitor, high](std::uint16_t low)
+          {
+            return static_cast<bool>(visitor(high | low));
+          }
+        );
+        if (!proceed)
+        {
+          return;
+        }
+      }
+    }
+
+    /**
+     * Rows as sorted vector.
+     */
+    std::vector<std::uint32_t> Rows() const
+    {
+      std::vector<std::uint32_t> result;
+      result.reserve(static_cast<std::size_t>(this->Cardinality()));
+      this->ForEach(
+        [&result](std::uint32_t row)
+        {
+          result.push_back(row);
+          return true;
+        }
+      );
+      return result;
+    }
+
+    /**
+     * Convert containers to run layout where it is smaller.
+     */
+    void RunOptimize()
+    {
+      for (auto& container: this->containers)
+      {
+        detail::RunOptimize(container);
+      }
+    }
+
+    /**
+     * Approximate memory used by containers.
+     */
+    std::size_t Bytes() const noexcept
+    {
+      std::size_t result = this->keys.size() * sizeof(std::uint16_t);
+      for (const auto& container: this->containers)
+      {
+        result += sizeof(container) + container.values.size() * sizeof(std::uint16_t) + container.words.size() * sizeof(std::uint64_t);
+      }
+      return result;
+    }
+
+    bool operator==(const bitmap_t& rhs) const
+    {
+      return this->Rows() == rhs.Rows();
+    }
+
+    /**
+     * Rows present in both bitmaps.
+     */
+    friend bitmap_t And(const bitmap_t& lhs, const bitmap_t& rhs)
+    {
+      bitmap_t result;
+      std::size_t i = 0;
+      std::size_t j = 0;
+      while ((i < lhs.keys.size()) && (j < rhs.keys.size()))
+      {
+        if (lhs.keys[i] < rhs.keys[j])
+        {
+          ++i;
+        }
+        else if (rhs.keys[j] < lhs.keys[i])
+        {
+          ++j;
+        }
+        else
+        {
+          auto container = detail::And(lhs.containers[i], rhs.containers[j]);
+          if (container.cardinality != 0)
+          {
+            result.keys.push_back(lhs.keys[i]);
+            result.containers.push_back(std::move(container));
+          }
+          ++i;
+          ++j;
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Rows present in any bitmap.
+     */
+    friend bitmap_t Or(const bitmap_t& lhs, const bitmap_t& rhs)
+    {
+      bitmap_t result;
+      std::size_t i = 0;
+      std::size_t j = 0;
+      while ((i < lhs.keys.size()) || (j < rhs.keys.size()))
+      {
+        if ((j == rhs.keys.size()) || ((i < lhs.keys.size()) && (lhs.keys[i] < rhs.keys[j])))
+        {
+          result.keys.push_back(lhs.keys[i]);
+          result.containers.push_back(lhs.containers[i++]);
+        }
+        else if ((i == lhs.keys.size()) || (rhs.keys[j] < lhs.keys[i]))
+        {
+          result.keys.push_back(rhs.keys[j]);
+          result.containers.push_back(rhs.containers[j++]);
+        }
+        else
+        {
+          result.keys.push_back(lhs.keys[i]);
+          result.containers.push_back(detail::Or(lhs.containers[i++], rhs.containers[j++]));
+        }
+      }
+      return result;
+    }
+
+  private:
+
+    std::vector<std::uint16_t> keys;                 /**< Sorted high 16 bits */
+    std::vector<detail::container_t> containers;     /**< Low 16 bits for every key */
+  };
+
+  /**
+   * Column of values with optional bitmap indexes.
+   *
+   * Index maps every type to its rows and every distinct number and
+   * string to rows equal to it. NaN and pointers are indexed by type
+   * only, because they are never equal to copied key. Index is kept up
+   * to date by Append once it is built.
+   */
+  class column_t final
+  {
+  public:
+
+    column_t() = default;
+
+    /**
+     * Append value.
+     *
+     * @return row number
+     */
+    std::uint32_t Append(value_t value)
+    {
+      const auto row = static_cast<std::uint32_t>(this->rows.size());
+      this->rows.push_back(std::move(value));
+      if (this->index)
+      {
+        this->Index(row);
+      }
+      return row;
+    }
+
+    const value_t& operator[](std::uint32_t row) const
+    {
+      return this->rows[row];
+    }
+
+    std::size_t Size() const noexcept
+    {
+      return this->rows.size();
+    }
+
+    /**
+     * Build bitmap indexes of all rows.
+     */
+    void BuildIndex()
+    {
+      this->index.reset(new index_t());
+      for (std::uint32_t row = 0; row < this->rows.size(); ++row)
+      {
+        this->Index(row);
+      }
+      this->OptimizeIndex();
+    }
+
+    /**
+     * Convert index bitmaps to run layout where it is smaller.
+     */
+    void OptimizeIndex()
+    {
+      if (!this->index)
+      {
+        return;
+      }
+      for (auto& bitmap: this->index->types)
+      {
+        bitmap.RunOptimize();
+      }
+      for (auto& item: this->index->values)
+      {
+        item.second.RunOptimize();
+      }
+    }
+
+    /**
+     * Drop bitmap indexes.
+     */
+    void DropIndex()
+    {
+      this->index.reset();
+    }
+
+    bool Indexed() const noexcept
+    {
+      return static_cast<bool>(this->index);
+    }
+
+    /**
+     * Number of distinct indexed values.
+     */
+    std::size_t DistinctValues() const noexcept
+    {
+      return this->index? this->index->values.size(): 0;
+    }
+
+    /**
+     * Memory used by index bitmaps.
+     */
+    std::size_t IndexBytes() const noexcept
+    {
+      std::size_t result = 0;
+      if (this->index)
+      {
+        for (const auto& bitmap: this->index->types)
+        {
+          result += bitmap.Bytes();
+        }
+        for (const auto& item: this->index->values)
+        {
+          result += item.second.Bytes();
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Rows of given type.
+     */
+    bitmap_t OfType(value_t::type_t type) const
+    {
+      if (this->index)
+      {
+        return this->index->types[type];
+      }
+      return this->Select(
+        [type](const value_t& value)
+        {
+          return value.Type() == type;
+        }
+      );
+    }
+
+    /**
+     * Rows equal to key.
+     */
+    bitmap_t Equal(const value_t& key) const
+    {
+      if (this->index && Indexable(key))
+      {
+        auto it = this->index->values.find(key);
+        return (it != this->index->values.end())? it->second: bitmap_t();
+      }
+      if (this->index)
+      {
+        // not indexable key can be equal only to pointer
+        bitmap_t result;
+        this->index->types[key.Type()].ForEach(
+          [this, &key, &result](std::uint32_t row)
+          {
+            if (this->rows[row] == key)
+            {
+              result.Add(row);
+            }
+            return true;
+          }
+        );
+        return result;
+      }
+      return this->Select(
+        [&key](const value_t& value)
+        {
+          return value == key;
+        }
+      );
+    }
+
+    /**
+     * Rows where predicate(const value_t&) is true, by full scan.
+     */
+    template<typename predicate_t>
+    bitmap_t Select(predicate_t&& predicate) const
+    {
+      bitmap_t result;
+      for (std::uint32_t row = 0; row < this->rows.size(); ++row)
+      {
+        if (predicate(this->rows[row]))
+        {
+          result.Add(row);
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Call visitor(std::uint32_t row, const value_t& value) for rows in order,
+     * stop when it returns false.
+     */
+    template<typename visitor_t>
+    void Scan(const bitmap_t& selected, visitor_t&& visitor) const
+    {
+      selected.ForEach(
+        [this, &visitor](std::uint32_t row)
+        {
+          return (row < this->rows.size())? static_cast<bool>(visitor(row, this->rows[row])): false;
+        }
+      );
+    }
+
+    /**
+     * Scan rows equal to key.
+     */
+    template<typename visitor_t>
+    void ScanEqual(const value_t& key, visitor_t&& visitor) const
+    {
+      if (!this->index)
+      {
+        for (std::uint32_t row = 0; row < this->rows.size(); ++row)
+        {
+          if ((this->rows[row] == key) && !visitor(row, this->rows[row]))
+          {
+            return;
+          }
+        }
+        return;
+      }
+      this->Scan(this->Equal(key), std::forward<visitor_t>(visitor));
+    }
+
+    /**
+     * Scan rows of given type.
+     */
+    template<typename visitor_t>
+    void ScanType(value_t::type_t type, visitor_t&& visitor) const
+    {
+      if (!this->index)
+      {
+        for (std::uint32_t row = 0; row < this->rows.size(); ++row)
+        {
+          if ((this->rows[row].Type() == type) && !visitor(row, this->rows[row]))
+          {
+            return;
+          }
+        }
+        return;
+      }
+      this->Scan(this->index->types[type], std::forward<visitor_t>(visitor));
+    }
+
+  private:
+
+    struct index_t
+    {
+      bitmap_t types[3];                                   /**< Rows of every type */
+      std::unordered_map<value_t, bitmap_t> values;        /**< Rows of every distinct value */
+    };
+
+    static bool Indexable(const value_t& value) noexcept
+    {
+      switch (value.Type())
+      {
+        case value_t::number:
+          return !std::isnan(value.As<value_t::number>());
+        case value_t::string:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    void Index(std::uint32_t row)
+    {
+      const auto& value = this->rows[row];
+      this->index->types[value.Type()].Add(row);
+      if (Indexable(value))
+      {
+        auto it = this->index->values.find(value);
+        if (it == this->index->values.end())
+        {
+          it = this->index->values.emplace(value, bitmap_t()).first;
+        }
+        it->second.Add(row);
+      }
+    }
+
+    std::vector<value_t> rows;           /**< Values */
+    std::unique_ptr<index_t> index;      /**< Bitmap indexes, when built */
+  };
+
+} // namespace roaring
+} // namespace bvl
+
+#endif /* BAD_VALUE_ROARING_HEADER */
@@ -0,0 +1,626 @@
+/**
+ * @file badval_schema.hpp
+ * @author masscry
+ *
+ * Compiled validation of documents against JSON-schema-like spec.
+ *
+ * Schema is document itself, for example:
+ *
+ *     {
+ *       "type": "object",
+ *       "required": ["id", "items"],
+ *       "additionalProperties": 0,
+ *       "properties": {
+ *         "id": { "type": "integer", "minimum": 0 },
+ *         "items": { "type": "array", "maxItems": 100, "items": { "type": ["number", "string"] } }
+ *       }
+ *     }
+ *
+ * Supported keywords: type (number, integer, string, pointer, array,
+ * object, or array of them), minimum, maximum, exclusiveMinimum,
+ * exclusiveMaximum, minLength, maxLength, minItems, maxItems, items,
+ * properties, required and additionalProperties, which is number 0 or
+ * 1, as values have no booleans. As in JSON schema, keyword checks
+ * only nodes of its type.
+ *
+ * Schema is compiled once into flat program: every subschema is run of
+ * ops ending with end op, op is type tag test, range or length check,
+ * items loop calling subschema, or object members loop, which marks
+ * found required members in bitmask and compares it with required mask
+ * at once. Validation stops at first failure.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_SCHEMA_HEADER
+#define BAD_VALUE_SCHEMA_HEADER
+
+#include <badval_doc.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace schema
+{
+
+  using doc::node_t;
+
+  /**
+   * Validation failure.
+   */
+  enum error_t
+  {
+    none = 0,       /**< Document is valid */
+    type,           /**< Node has wrong type */
+    range,          /**< Number out of range */
+    length,         /**< String or array length out of range */
+    required,       /**< Required member missing */
+    additional      /**< Member not described by properties */
+  };
+
+  /**
+   * Failure with schema location.
+   */
+  struct failure_t
+  {
+    error_t error = none;   /**< Failure kind */
+    std::size_t op = 0;     /**< Failed op */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Type mask bits.
+     */
+    enum mask_t : unsigned
+    {
+      numberBit = 1 << 0,
+      integerBit = 1 << 1,
+      stringBit = 1 << 2,
+      pointerBit = 1 << 3,
+      arrayBit = 1 << 4,
+      objectBit = 1 << 5
+    };
+
+    /**
+     * Op codes.
+     */
+    enum code_t
+    {
+      end = 0,    /**< End of subschema */
+      kinds,      /**< Type mask test */
+      bounds,     /**< Number range */
+      size,       /**< String length */
+      items,      /**< Array length and items */
+      members     /**< Object members */
+    };
+
+    /**
+     * Program op, meaning of fields depends on code.
+     */
+    struct op_t
+    {
+      code_t code = end;                                            /**< Op code */
+      unsigned mask = 0;                                            /**< Allowed types of kinds op */
+      double low = -std::numeric_limits<double>::infinity();        /**< Smallest number */
+      double high = std::numeric_limits<double>::infinity();        /**< Largest number */
+      bool lowOpen = false;                                         /**< Smallest number is excluded */
+      bool highOpen = false;                                        /**< Largest number is excluded */
+      std::size_t shortest = 0;                                     /**< Smallest length */
+      std::size_t longest = std::numeric_limits<std::size_t>::max();  /**< Largest length */
+      std::size_t program = 0;                                      /**< Items subschema, or first property */
+      std::size_t count = 0;                                        /**< Number of properties */
+      std::uint64_t required = 0;                                   /**< Mask of required properties */
+      bool closed = false;                                          /**< Unknown members are errors */
+      bool hasItems = false;                                        /**< Items have subschema */
+    };
+
+    /**
+     * Object property.
+     */
+    struct property_t
+    {
+      std::string name;     /**< Member key */
+      std::size_t hash;     /**< KeyHash of key */
+      std::size_t program;  /**< Subschema */
+      int bit;              /**< Bit in required mask, -1 when optional */
+    };
+
+    /**
+     * Type mask of node.
+     */
+    inline unsigned Mask(const node_t& node) noexcept
+    {
+      switch (node.Kind())
+      {
+        case node_t::leaf:
+          switch (node.Value().Type())
+          {
+            case value_t::number:
+              {
+                const auto number = node.Value().As<value_t::number>();
+                return (std::trunc(number) == number)? (numberBit | integerBit): numberBit;
+              }
+            case value_t::string:
+              return stringBit;
+            case value_t::pointer:
+              return pointerBit;
+          }
+          return 0;
+        case node_t::array:
+          return arrayBit;
+        case node_t::object:
+          return objectBit;
+      }
+      return 0;
+    }
+
+    [[noreturn]] inline void Fail(const std::string& where, const std::string& what)
+    {
+      throw std::invalid_argument("bad schema at '" + where + "': " + what);
+    }
+
+    inline double Number(const node_t& node, const std::string& where, const char* keyword)
+    {
+      if ((node.Kind() != node_t::leaf) || (node.Value().Type() != value_t::number))
+      {
+        Fail(where, std::string(keyword) + " must be number");
+      }
+      return node.Value().As<value_t::number>();
+    }
+
+    inline std::size_t Count(const node_t& node, const std::string& where, const char* keyword)
+    {
+      const auto number = Number(node, where, keyword);
+      if ((number < 0.0) || (std::trunc(number) != number))
+      {
+        Fail(where, std::string(keyword) + " must be non-negative integer");
+      }
+      return static_cast<std::size_t>(number);
+    }
+
+    inline bool Flag(const node_t& node, const std::string& where, const char* keyword)
+    {
+      const auto number = Number(node, where, keyword);
+      if ((number != 0.0) && (number != 1.0))
+      {
+        Fail(where, std::string(keyword) + " must be 0 or 1");
+      }
+      return number != 0.0;
+    }
+
+    inline unsigned TypeBit(const node_t& node, const std::string& where)
+    {
+      static const std::pair<const char*, unsigned> names[] = {
+        { "number", numberBit | integerBit },
+        { "integer", integerBit },
+        { "string", stringBit },
+        { "pointer", pointerBit },
+        { "array", arrayBit },
+        { "object", objectBit }
+      };
+      if ((node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::string))
+      {
+        for (const auto& item: names)
+        {
+          if (node.Value().As<value_t::string>() == item.first)
+          {
+            return item.second;
+          }
+        }
+      }
+      Fail(where, "unknown type");
+    }
+
+  } // namespace detail
+
+  /**
+   * Compiled schema.
+   */
+  class validator_t final
+  {
+  public:
+
+    /**
+     * Compile schema.
+     *
+     * @throws std::invalid_argument when schema is malformed
+     */
+    explicit validator_t(const node_t& schema)
+    {
+      this->Compile(schema, "$");
+    }
+
+    /**
+     * Check document.
+     */
+    bool Validate(const node_t& document) const noexcept
+    {
+      failure_t failure;
+      return this->Run(0, document, failure);
+    }
+
+    /**
+     * Check document, report first failure.
+     */
+    bool Validate(const node_t& document, failure_t& failure) const noexcept
+    {
+      failure = failure_t();
+      return this->Run(0, document, failure);
+    }
+
+    /**
+     * Check batch of documents.
+     *
+     * @param [in] documents documents
+     * @param [in] size number of documents
+     * @param [out] valid validation results, one per document
+     *
+     * @return number of valid documents
+     */
+    std::size_t Validate(const node_t* documents, std::size_t size, bool* valid) const noexcept
+    {
+      std::size_t result = 0;
+      failure_t failure;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        valid[i] = this->Run(0, documents[i], failure);
+        result += valid[i]? 1: 0;
+      }
+      return result;
+    }
+
+    /**
+     * Human readable failure.
+     */
+    std::string Explain(const failure_t& failure) const
+    {
+      static const char* names[] = { "valid", "wrong type", "number out of range", "wrong length", "required member missing", "unknown member" };
+      if (failure.error == none)
+      {
+        return names[0];
+      }
+      return std::string(names[failure.error]) + " at '" + this->locations.at(failure.op) + "'";
+    }
+
+    /**
+     * Number of ops in program.
+     */
+    std::size_t Ops() const noexcept
+    {
+      return this->ops.size();
+    }
+
+  private:
+
+    /**
+     * Compile subschema.
+     *
+     * Nested subschemas are compiled after end op of this one.
+     *
+     * @return first op of subschema
+     */
+    std::size_t Compile(const node_t& schema, const std::string& where)
+    {
+      if (schema.Kind() != node_t::object)
+      {
+        detail::Fail(where, "schema must be object");
+      }
+
+      detail::op_t kinds;
+      kinds.code = detail::kinds;
+      detail::op_t bounds;
+      bounds.code = detail::bounds;
+      detail::op_t size;
+      size.code = detail::size;
+      detail::op_t items;
+      items.code = detail::items;
+      detail::op_t members;
+      members.code = detail::members;
+      const node_t* itemSchema = nullptr;
+      const node_t* properties = nullptr;
+      const node_t* requiredNames = nullptr;
+      bool hasBounds = false;
+      bool hasSize = false;
+      bool hasItems = false;
+      bool hasMembers = false;
+
+      for (std::size_t i = 0; i < schema.Size(); ++i)
+      {
+        const auto& key = schema.Key(i).name;
+        const auto& node = schema.At(i);
+        if (key == "type")
+        {
+          if (node.Kind() == node_t::array)
+          {
+            for (std::size_t j = 0; j < node.Size(); ++j)
+            {
+              kinds.mask |= detail::TypeBit(node.At(j), where);
+            }
+          }
+          else
+          {
+            kinds.mask = detail::TypeBit(node, where);
+          }
+        }
+        else if ((key == "minimum") || (key == "exclusiveMinimum"))
+        {
+          bounds.low = detail::Number(node, where, key.c_str());
+          bounds.lowOpen = (key == "exclusiveMinimum");
+          hasBounds = true;
+        }
+        else if ((key == "maximum") || (key == "exclusiveMaximum"))
+        {
+          bounds.high = detail::Number(node, where, key.c_str());
+          bounds.highOpen = (key == "exclusiveMaximum");
+          hasBounds = true;
+        }
+        else if (key == "minLength")
+        {
+          size.shortest = detail::Count(node, where, key.c_str());
+          hasSize = true;
+        }
+        else if (key == "maxLength")
+        {
+          size.longest = detail::Count(node, where, key.c_str());
+          hasSize = true;
+        }
+        else if (key == "minItems")
+        {
+          items.shortest = detail::Count(node, where, key.c_str());
+          hasItems = true;
+        }
+        else if (key == "maxItems")
+        {
+          items.longest = detail::Count(node, where, key.c_str());
+          hasItems = true;
+        }
+        else if (key == "items")
+        {
+          itemSchema = &node;
+          hasItems = true;
+        }
+        else if (key == "properties")
+        {
+          if (node.Kind() != node_t::object)
+          {
+            detail::Fail(where, "properties must be object");
+          }
+          properties = &node;
+          hasMembers = true;
+        }
+        else if (key == "required")
+        {
+          if (node.Kind() != node_t::array)
+          {
+            detail::Fail(where, "required must be array");
+          }
+          requiredNames = &node;
+          hasMembers = true;
+        }
+        else if (key == "additionalProperties")
+        {
+          members.closed = !detail::Flag(node, where, key.c_str());
+          hasMembers = true;
+        }
+        else
+        {
+          detail::Fail(where, "unknown keyword '" + key + "'");
+        }
+      }
+
+      const auto start = this->ops.size();
+      if (kinds.mask != 0)
+      {
+        this->Emit(kinds, where);
+      }
+      if (hasBounds)
+      {
+        this->Emit(bounds, where);
+      }
+      if (hasSize)
+      {
+        this->Emit(size, where);
+      }
+      std::size_t itemsOp = 0;
+      if (hasItems)
+      {
+        itemsOp = this->Emit(items, where);
+      }
+      std::size_t membersOp = 0;
+      if (hasMembers)
+      {
+        membersOp = this->Emit(members, where);
+      }
+      this->Emit(detail::op_t(), where);
+
+      // nested subschemas follow end op, ops may move, so they are patched by index
+      if (itemSchema != nullptr)
+      {
+        const auto program = this->Compile(*itemSchema, where + ".items");
+        this->ops[itemsOp].program = program;
+        this->ops[itemsOp].hasItems = true;
+      }
+      if (hasMembers)
+      {
+        const auto first = this->properties.size();
+        std::size_t count = (properties != nullptr)? properties->Size(): 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          const auto& key = properties->Key(i);
+          this->properties.push_back({ key.name, key.hash, 0, -1 });
+        }
+        std::uint64_t mask = 0;
+        int bits = 0;
+        for (std::size_t i = 0; (requiredNames != nullptr) && (i < requiredNames->Size()); ++i)
+        {
+          const auto& name = requiredNames->At(i);
+          if ((name.Kind() != node_t::leaf) || (name.Value().Type() != value_t::string))
+          {
+            detail::Fail(where, "required names must be strings");
+          }
+          std::size_t index = 0;
+          while ((index < count) && (this->properties[first + index].name != name.Value().As<value_t::string>()))
+          {
+            ++index;
+          }
+          if (index == count)
+          {
+            // required member without own schema accepts anything
+            const auto& missing = name.Value().As<value_t::string>();
+            this->properties.push_back({ missing, doc::KeyHash(missing), this->Emit(detail::op_t(), where + "." + missing), -1 });
+            ++count;
+          }
+          if (this->properties[first + index].bit >= 0)
+          {
+            continue;
+          }
+          if (bits == 64)
+          {
+            detail::Fail(where, "more than 64 required members");
+          }
+          this->properties[first + index].bit = bits;
+          mask |= std::uint64_t(1) << bits;
+          ++bits;
+        }
+        for (std::size_t i = 0; (properties != nullptr) && (i < properties->Size()); ++i)
+        {
+          const auto program = this->Compile(properties->At(i), where + "." + properties->Key(i).name);
+          this->properties[first + i].program = program;
+        }
+        this->ops[membersOp].program = first;
+        this->ops[membersOp].count = count;
+        this->ops[membersOp].required = mask;
+      }
+      return start;
+    }
+
+    /**
+     * Append op.
+     *
+     * @return index of op
+     */
+    std::size_t Emit(const detail::op_t& op, const std::string& where)
+    {
+      this->ops.push_back(op);
+      this->locations.push_back(where);
+      return this->ops.size() - 1;
+    }
+
+    bool Run(std::size_t pc, const node_t& node, failure_t& failure) const noexcept
+    {
+      for (;; ++pc)
+      {
+        const auto& op = this->ops[pc];
+        switch (op.code)
+        {
+          case detail::end:
+            return true;
+          case detail::kinds:
+            if ((detail::Mask(node) & op.mask) == 0)
+            {
+              return this->Failed(failure, type, pc);
+            }
+            break;
+          case detail::bounds:
+            if ((node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::number))
+            {
+              const auto number = node.Value().As<value_t::number>();
+              const auto low = op.lowOpen? (number > op.low): (number >= op.low);
+              const auto high = op.highOpen? (number < op.high): (number <= op.high);
+              if (!low || !high)
+              {
+                return this->Failed(failure, range, pc);
+              }
+            }
+            break;
+          case detail::size:
+            if ((node.Kind() == node_t::leaf) && (node.Value().Type() == value_t::string))
+            {
+              const auto chars = node.Value().As<value_t::string>().size();
+              if ((chars < op.shortest) || (chars > op.longest))
+              {
+                return this->Failed(failure, length, pc);
+              }
+            }
+            break;
+          case detail::items:
+            if (node.Kind() == node_t::array)
+            {
+              if ((node.Size() < op.shortest) || (node.Size() > op.longest))
+              {
+                return this->Failed(failure, length, pc);
+              }
+              for (std::size_t i = 0; op.hasItems && (i < node.Size()); ++i)
+              {
+                if (!this->Run(op.program, node.At(i), failure))
+                {
+                  return false;
+                }
+              }
+            }
+            break;
+          case detail::members:
+            if (node.Kind() == node_t::object)
+            {
+              std::uint64_t found = 0;
+              const auto* first = this->properties.data() + op.program;
+              for (std::size_t i = 0; i < node.Size(); ++i)
+              {
+                const auto& key = node.Key(i);
+                std::size_t index = 0;
+                while ((index < op.count) && ((first[index].hash != key.hash) || (first[index].name != key.name)))
+                {
+                  ++index;
+                }
+                if (index == op.count)
+                {
+                  if (op.closed)
+                  {
+                    return this->Failed(failure, additional, pc);
+                  }
+                  continue;
+                }
+                if (first[index].bit >= 0)
+                {
+                  found |= std::uint64_t(1) << first[index].bit;
+                }
+                if (!this->Run(first[index].program, node.At(i), failure))
+                {
+                  return false;
+                }
+              }
+              if ((found & op.required) != op.required)
+              {
+                return this->Failed(failure, required, pc);
+              }
+            }
+            break;
+        }
+      }
+    }
+
+    static bool Failed(failure_t& failure, error_t error, std::size_t op) noexcept
+    {
+      failure.error = error;
+      failure.op = op;
+      return false;
+    }
+
+    std::vector<detail::op_t> ops;                /**< Program, subschema at 0 is root */
+    std::vector<std::string> locations;           /**< Location in schema of every op */
+    std::vector<detail::property_t> properties;   /**< Properties of all objects */
+  };
+
+} // namespace schema
+} // namespace bvl
+
+#endif /* BAD_VALUE_SCHEMA_HEADER */
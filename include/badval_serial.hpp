@@ -0,0 +1,237 @@
+/**
+ * @file badval_serial.hpp
+ * @author masscry
+ *
+ * Binary serialization of values.
+ *
+ * Every value is written as one tag byte followed by payload:
+ *
+ *  - number: 8 bytes, IEEE 754 double, little-endian
+ *  - string: varint length, then bytes
+ *
+ * Pointers have no meaning outside of process and can't be serialized.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_SERIAL_HEADER
+#define BAD_VALUE_SERIAL_HEADER
+
+#include <badval.hpp>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace bvl
+{
+namespace serial
+{
+
+  /**
+   * Tag byte written before value payload.
+   */
+  enum tag_t : unsigned char
+  {
+    numberTag = 0, /**< 8 byte double follows */
+    stringTag = 1  /**< varint length and bytes follow */
+  };
+
+  /**
+   * Append 32-bit little-endian integer.
+   */
+  inline void PutFixed32(std::string& out, std::uint32_t num)
+  {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i)
+    {
+      bytes[i] = static_cast<char>((num >> (8 * i)) & 0xFF);
+    }
+    out.append(bytes, sizeof(bytes));
+  }
+
+  /**
+   * Append 64-bit little-endian integer.
+   */
+  inline void PutFixed64(std::string& out, std::uint64_t num)
+  {
+    char bytes[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      bytes[i] = static_cast<char>((num >> (8 * i)) & 0xFF);
+    }
+    out.append(bytes, sizeof(bytes));
+  }
+
+  /**
+   * Append unsigned integer, 7 bits per byte, high bit marks continuation.
+   */
+  inline void PutVarint(std::string& out, std::uint64_t num)
+  {
+    char bytes[10];
+    std::size_t size = 0;
+    while (num >= 0x80)
+    {
+      bytes[size++] = static_cast<char>((num & 0x7F) | 0x80);
+      num >>= 7;
+    }
+    bytes[size++] = static_cast<char>(num);
+    out.append(bytes, size);
+  }
+
+  /**
+   * Number of bytes varint takes.
+   */
+  inline std::size_t VarintSize(std::uint64_t num) noexcept
+  {
+    std::size_t size = 1;
+    while (num >= 0x80)
+    {
+      num >>= 7;
+      ++size;
+    }
+    return size;
+  }
+
+  /**
+   * Read 32-bit little-endian integer.
+   */
+  inline std::uint32_t DecodeFixed32(const char* data) noexcept
+  {
+    const auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<std::uint32_t>(bytes[0])
+      | (static_cast<std::uint32_t>(bytes[1]) << 8)
+      | (static_cast<std::uint32_t>(bytes[2]) << 16)
+      | (static_cast<std::uint32_t>(bytes[3]) << 24);
+  }
+
+  /**
+   * Read 64-bit little-endian integer.
+   */
+  inline std::uint64_t DecodeFixed64(const char* data) noexcept
+  {
+    return static_cast<std::uint64_t>(DecodeFixed32(data))
+      | (static_cast<std::uint64_t>(DecodeFixed32(data + 4)) << 32);
+  }
+
+  /**
+   * Read varint and move cursor past it.
+   *
+   * @return false when input ended or varint is too long
+   */
+  inline bool GetVarint(const char*& cursor, const char* end, std::uint64_t& num) noexcept
+  {
+    num = 0;
+    for (unsigned shift = 0; (shift < 64) && (cursor < end); shift += 7)
+    {
+      const auto byte = static_cast<unsigned char>(*cursor++);
+      num |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Number of bytes Encode appends.
+   *
+   * @throws std::runtime_error for pointers
+   */
+  inline std::size_t EncodedSize(const value_t& value)
+  {
+    switch (value.Type())
+    {
+      case value_t::number:
+        return 1 + 8;
+      case value_t::string:
+        {
+          const auto size = value.As<value_t::string>().size();
+          return 1 + VarintSize(size) + size;
+        }
+      case value_t::pointer:
+        throw std::runtime_error("Pointer can't be serialized");
+      default:
+        throw std::logic_error("Impossible type");
+    }
+  }
+
+  /**
+   * Append serialized value.
+   *
+   * @throws std::runtime_error for pointers
+   */
+  inline void Encode(const value_t& value, std::string& out)
+  {
+    switch (value.Type())
+    {
+      case value_t::number:
+        {
+          const double num = value.As<value_t::number>();
+          std::uint64_t bits;
+          std::memcpy(&bits, &num, sizeof(bits));
+          out.push_back(static_cast<char>(numberTag));
+          PutFixed64(out, bits);
+        }
+        break;
+      case value_t::string:
+        {
+          const auto& text = value.As<value_t::string>();
+          out.push_back(static_cast<char>(stringTag));
+          PutVarint(out, text.size());
+          out.append(text);
+        }
+        break;
+      case value_t::pointer:
+        throw std::runtime_error("Pointer can't be serialized");
+      default:
+        throw std::logic_error("Impossible type");
+    }
+  }
+
+  /**
+   * Read serialized value and move cursor past it.
+   *
+   * @throws std::runtime_error on malformed input
+   */
+  inline value_t Decode(const char*& cursor, const char* end)
+  {
+    if (cursor >= end)
+    {
+      throw std::runtime_error("Serialized value is truncated");
+    }
+    switch (static_cast<unsigned char>(*cursor++))
+    {
+      case numberTag:
+        {
+          if (end - cursor < 8)
+          {
+            throw std::runtime_error("Serialized number is truncated");
+          }
+          const auto bits = DecodeFixed64(cursor);
+          cursor += 8;
+          double num;
+          std::memcpy(&num, &bits, sizeof(num));
+          return value_t(num);
+        }
+      case stringTag:
+        {
+          std::uint64_t size;
+          if (!GetVarint(cursor, end, size) || (static_cast<std::uint64_t>(end - cursor) < size))
+          {
+            throw std::runtime_error("Serialized string is truncated");
+          }
+          auto begin = cursor;
+          cursor += size;
+          return value_t(begin, static_cast<std::size_t>(size));
+        }
+      default:
+        throw std::runtime_error("Unknown serialized value tag");
+    }
+  }
+
+} // namespace serial
+} // namespace bvl
+
+#endif /* BAD_VALUE_SERIAL_HEADER */
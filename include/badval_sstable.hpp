@@ -0,0 +1,812 @@
+/**
+ * @file badval_sstable.hpp
+ * @author masscry
+ *
+ * Immutable sorted table of string keys and values on disk.
+ *
+ * File layout:
+ *
+ *     [data block]...[data block][bloom filter][index block][footer]
+ *
+ * Data block holds entries sorted by key. Keys share prefix with previous
+ * entry, every restartInterval-th entry (restart point) stores full key.
+ * Entry is:
+ *
+ *     varint shared, varint unshared, varint valueSize, key suffix, value
+ *
+ * Value is serialized with bvl::serial. Block ends with fixed32 offsets
+ * of restart points and fixed32 restart count.
+ *
+ * Index block has one entry per data block: varint key size, last key
+ * of block, varint block offset, varint block size. Bloom filter is bit
+ * array followed by one byte with number of probes.
+ *
+ * Footer is six fixed64: bloom offset, bloom size, index offset,
+ * index size, entry count and magic.
+ *
+ * Reader maps file into memory, keeps only parsed index in heap and
+ * decodes nothing but requested entry.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_SSTABLE_HEADER
+#define BAD_VALUE_SSTABLE_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bvl
+{
+namespace sstable
+{
+
+  /**
+   * Magic number at the end of file, "BVLSST01".
+   */
+  constexpr std::uint64_t magic = 0x31305453534c5642ULL;
+
+  /**
+   * Footer size in bytes.
+   */
+  constexpr std::size_t footerSize = 6 * 8;
+
+  /**
+   * Table building options.
+   */
+  struct options_t
+  {
+    std::size_t blockSize = 4096;     /**< Approximate size of data block */
+    std::size_t restartInterval = 16; /**< Entries between full keys */
+    std::size_t bloomBitsPerKey = 10; /**< Bloom filter size, 0 disables filter */
+  };
+
+  /**
+   * Stable 64-bit hash of bytes, used by bloom filter.
+   */
+  inline std::uint64_t Hash64(const char* data, std::size_t size) noexcept
+  {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  /**
+   * Compare byte ranges like memcmp, shorter prefix is smaller.
+   */
+  inline int Compare(const char* lhs, std::size_t lhsSize, const char* rhs, std::size_t rhsSize) noexcept
+  {
+    const auto common = std::min(lhsSize, rhsSize);
+    const auto result = (common == 0)? 0: std::memcmp(lhs, rhs, common);
+    if (result != 0)
+    {
+      return result;
+    }
+    return (lhsSize < rhsSize)? -1: ((lhsSize > rhsSize)? 1: 0);
+  }
+
+  /**
+   * Streaming table writer.
+   *
+   * Keys must be added in strictly increasing byte order. Only current
+   * block, index and key hashes for bloom filter (8 bytes per key) are
+   * kept in memory. File is complete only after Finish.
+   */
+  class builder_t final
+  {
+  public:
+
+    /**
+     * Create file.
+     *
+     * @throws std::runtime_error when file can't be created
+     */
+    explicit builder_t(const std::string& path, options_t options = options_t())
+      : options(options), file(std::fopen(path.c_str(), "wb")), offset(0), count(0), sinceRestart(0), finished(false)
+    {
+      if (this->file == nullptr)
+      {
+        throw std::runtime_error("Can't create table " + path);
+      }
+      if (this->options.restartInterval == 0)
+      {
+        this->options.restartInterval = 1;
+      }
+    }
+
+    builder_t(const builder_t&) = delete;
+    builder_t& operator=(const builder_t&) = delete;
+
+    /**
+     * Destructor. Closes file, which is incomplete without Finish.
+     */
+    ~builder_t()
+    {
+      std::fclose(this->file);
+    }
+
+    /**
+     * Add entry.
+     *
+     * @throws std::runtime_error when key is not greater than previous one, or value can't be serialized
+     */
+    void Add(const std::string& key, const value_t& value)
+    {
+      this->scratch.clear();
+      serial::Encode(value, this->scratch);
+      this->AddRaw(key, this->scratch.data(), this->scratch.size());
+    }
+
+    /**
+     * Add entry with already serialized value.
+     *
+     * @throws std::runtime_error when key is not greater than previous one
+     */
+    void AddRaw(const std::string& key, const char* value, std::size_t valueSize)
+    {
+      if (this->finished)
+      {
+        throw std::logic_error("Table is already finished");
+      }
+      if ((this->count != 0) && (Compare(key.data(), key.size(), this->lastKey.data(), this->lastKey.size()) <= 0))
+      {
+        throw std::runtime_error("Keys must be added in increasing order");
+      }
+
+      std::size_t shared = 0;
+      if (this->sinceRestart == this->options.restartInterval)
+      {
+        this->sinceRestart = 0;
+      }
+      if (this->sinceRestart == 0)
+      {
+        serial::PutFixed32(this->restarts, static_cast<std::uint32_t>(this->block.size()));
+      }
+      else
+      {
+        const auto limit = std::min(key.size(), this->lastKey.size());
+        while ((shared < limit) && (key[shared] == this->lastKey[shared]))
+        {
+          ++shared;
+        }
+      }
+
+      serial::PutVarint(this->block, shared);
+      serial::PutVarint(this->block, key.size() - shared);
+      serial::PutVarint(this->block, valueSize);
+      this->block.append(key, shared, std::string::npos);
+      this->block.append(value, valueSize);
+
+      ++this->sinceRestart;
+      ++this->count;
+      this->lastKey = key;
+      if (this->options.bloomBitsPerKey != 0)
+      {
+        this->hashes.push_back(Hash64(key.data(), key.size()));
+      }
+
+      if (this->block.size() + this->restarts.size() >= this->options.blockSize)
+      {
+        this->FlushBlock();
+      }
+    }
+
+    /**
+     * Write rest of data, filter, index and footer, close file.
+     *
+     * @throws std::runtime_error on write error
+     */
+    void Finish()
+    {
+      if (this->finished)
+      {
+        return;
+      }
+      this->FlushBlock();
+
+      std::string bloom;
+      if (!this->hashes.empty())
+      {
+        auto bits = std::max<std::size_t>(64, this->hashes.size() * this->options.bloomBitsPerKey);
+        bits = (bits + 7) / 8 * 8;
+        // optimal number of probes is bitsPerKey * ln 2
+        auto probes = static_cast<unsigned>(this->options.bloomBitsPerKey * 69 / 100);
+        probes = std::max(1u, std::min(30u, probes));
+
+        bloom.assign(bits / 8, '\0');
+        for (auto hash: this->hashes)
+        {
+          auto h = hash;
+          const auto delta = (hash >> 32) | 1;
+          for (unsigned i = 0; i < probes; ++i)
+          {
+            const auto bit = h % bits;
+            bloom[bit / 8] = static_cast<char>(bloom[bit / 8] | (1 << (bit % 8)));
+            h += delta;
+          }
+        }
+        bloom.push_back(static_cast<char>(probes));
+        std::vector<std::uint64_t>().swap(this->hashes);
+      }
+      const auto bloomOffset = this->offset;
+      this->Write(bloom);
+
+      const auto indexOffset = this->offset;
+      this->Write(this->index);
+
+      std::string footer;
+      serial::PutFixed64(footer, bloomOffset);
+      serial::PutFixed64(footer, bloom.size());
+      serial::PutFixed64(footer, indexOffset);
+      serial::PutFixed64(footer, this->index.size());
+      serial::PutFixed64(footer, this->count);
+      serial::PutFixed64(footer, magic);
+      this->Write(footer);
+
+      if (std::fflush(this->file) != 0)
+      {
+        throw std::runtime_error("Can't write table");
+      }
+      this->finished = true;
+    }
+
+    /**
+     * Flush file to storage device. Call after Finish.
+     *
+     * @throws std::runtime_error on error
+     */
+    void Sync()
+    {
+      if ((std::fflush(this->file) != 0) || (::fsync(::fileno(this->file)) != 0))
+      {
+        throw std::runtime_error("Can't sync table");
+      }
+    }
+
+    /**
+     * Number of added entries.
+     */
+    std::uint64_t Count() const noexcept
+    {
+      return this->count;
+    }
+
+    /**
+     * Bytes written to file so far.
+     */
+    std::uint64_t FileSize() const noexcept
+    {
+      return this->offset;
+    }
+
+  private:
+
+    void Write(const std::string& data)
+    {
+      if (!data.empty() && (std::fwrite(data.data(), 1, data.size(), this->file) != data.size()))
+      {
+        throw std::runtime_error("Can't write table");
+      }
+      this->offset += data.size();
+    }
+
+    void FlushBlock()
+    {
+      if (this->block.empty())
+      {
+        return;
+      }
+      this->block.append(this->restarts);
+      serial::PutFixed32(this->block, static_cast<std::uint32_t>(this->restarts.size() / 4));
+
+      serial::PutVarint(this->index, this->lastKey.size());
+      this->index.append(this->lastKey);
+      serial::PutVarint(this->index, this->offset);
+      serial::PutVarint(this->index, this->block.size());
+
+      this->Write(this->block);
+      this->block.clear();
+      this->restarts.clear();
+      this->sinceRestart = 0;
+    }
+
+    options_t options;                  /**< Building options */
+    std::FILE* file;                    /**< Output file */
+    std::uint64_t offset;               /**< Bytes written */
+    std::uint64_t count;                /**< Entries added */
+    std::size_t sinceRestart;           /**< Entries since last restart point */
+    bool finished;                      /**< Footer written */
+    std::string block;                  /**< Current data block */
+    std::string restarts;               /**< Restart offsets of current block */
+    std::string index;                  /**< Index block */
+    std::string lastKey;                /**< Last added key */
+    std::string scratch;                /**< Serialized value */
+    std::vector<std::uint64_t> hashes;  /**< Key hashes for bloom filter */
+  };
+
+  /**
+   * Memory mapped table reader.
+   *
+   * Reader is immutable after construction, so it can be used from many
+   * threads at once.
+   */
+  class table_t final
+  {
+    struct block_t
+    {
+      const char* lastKey;     /**< Last key of block, points into file */
+      std::size_t lastKeySize; /**< Last key size */
+      const char* data;        /**< Block entries, points into file */
+      std::size_t size;        /**< Entries size, without restarts */
+      const char* restarts;    /**< Restart offsets */
+      std::uint32_t restartCount;
+    };
+
+  public:
+
+    /**
+     * Forward iterator over entries.
+     */
+    class iterator_t final
+    {
+    public:
+
+      /**
+       * Iterator points to entry.
+       */
+      bool Valid() const noexcept
+      {
+        return this->block < this->table->blocks.size();
+      }
+
+      /**
+       * Move to next entry.
+       */
+      void Next()
+      {
+        this->cursor = this->next;
+        this->Parse();
+      }
+
+      /**
+       * Current key.
+       */
+      const std::string& Key() const noexcept
+      {
+        return this->key;
+      }
+
+      /**
+       * Decode current value.
+       */
+      value_t Value() const
+      {
+        auto cursor = this->value;
+        return serial::Decode(cursor, this->value + this->valueSize);
+      }
+
+      /**
+       * Serialized current value.
+       */
+      const char* RawValue() const noexcept
+      {
+        return this->value;
+      }
+
+      /**
+       * Size of serialized current value.
+       */
+      std::size_t RawValueSize() const noexcept
+      {
+        return this->valueSize;
+      }
+
+    private:
+      friend class table_t;
+
+      iterator_t(const table_t* table, std::size_t block)
+        : table(table), block(block), cursor(nullptr), next(nullptr), value(nullptr), valueSize(0)
+      {
+        if (this->Valid())
+        {
+          this->cursor = this->table->blocks[block].data;
+        }
+      }
+
+      /**
+       * Decode entry at cursor, skip to next block at block end.
+       */
+      void Parse()
+      {
+        while (this->Valid())
+        {
+          const auto& current = this->table->blocks[this->block];
+          if (this->cursor < current.data + current.size)
+          {
+            this->next = this->cursor;
+            ParseEntry(this->next, current.data + current.size, this->key, this->value, this->valueSize);
+            return;
+          }
+          ++this->block;
+          if (this->Valid())
+          {
+            this->cursor = this->table->blocks[this->block].data;
+            this->key.clear();
+          }
+        }
+      }
+
+      const table_t* table;  /**< Iterated table */
+      std::size_t block;     /**< Current block */
+      const char* cursor;    /**< Current entry */
+      const char* next;      /**< Next entry */
+      std::string key;       /**< Current key */
+      const char* value;     /**< Current value */
+      std::size_t valueSize; /**< Current value size */
+    };
+
+    /**
+     * Open table.
+     *
+     * @throws std::runtime_error when file can't be opened or is malformed
+     */
+    explicit table_t(const std::string& path)
+      : data(nullptr), size(0), bloom(nullptr), bloomBits(0), probes(0), count(0)
+    {
+      auto fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        throw std::runtime_error("Can't open table " + path);
+      }
+      struct stat info;
+      if (::fstat(fd, &info) != 0)
+      {
+        ::close(fd);
+        throw std::runtime_error("Can't stat table " + path);
+      }
+      this->size = static_cast<std::size_t>(info.st_size);
+      if (this->size < footerSize)
+      {
+        ::close(fd);
+        throw std::runtime_error("Table is too small " + path);
+      }
+      auto mapped = ::mmap(nullptr, this->size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (mapped == MAP_FAILED)
+      {
+        throw std::runtime_error("Can't map table " + path);
+      }
+      this->data = static_cast<const char*>(mapped);
+      ::madvise(mapped, this->size, MADV_RANDOM);
+
+      try
+      {
+        this->Load();
+      }
+      catch (...)
+      {
+        ::munmap(mapped, this->size);
+        throw;
+      }
+    }
+
+    table_t(const table_t&) = delete;
+    table_t& operator=(const table_t&) = delete;
+
+    /**
+     * Destructor. Unmaps file.
+     */
+    ~table_t()
+    {
+      ::munmap(const_cast<char*>(this->data), this->size);
+    }
+
+    /**
+     * Number of entries.
+     */
+    std::uint64_t Size() const noexcept
+    {
+      return this->count;
+    }
+
+    /**
+     * Size of file.
+     */
+    std::size_t FileSize() const noexcept
+    {
+      return this->size;
+    }
+
+    /**
+     * Largest key in table, empty for empty table.
+     */
+    std::string LastKey() const
+    {
+      if (this->blocks.empty())
+      {
+        return std::string();
+      }
+      return std::string(this->blocks.back().lastKey, this->blocks.back().lastKeySize);
+    }
+
+    /**
+     * Check bloom filter.
+     *
+     * @return false when key is definitely not in table
+     */
+    bool MayContain(const std::string& key) const noexcept
+    {
+      if (this->bloom == nullptr)
+      {
+        return true;
+      }
+      const auto hash = Hash64(key.data(), key.size());
+      auto h = hash;
+      const auto delta = (hash >> 32) | 1;
+      for (unsigned i = 0; i < this->probes; ++i)
+      {
+        const auto bit = h % this->bloomBits;
+        if ((static_cast<unsigned char>(this->bloom[bit / 8]) & (1 << (bit % 8))) == 0)
+        {
+          return false;
+        }
+        h += delta;
+      }
+      return true;
+    }
+
+    /**
+     * Find serialized value of key.
+     *
+     * @return false when key is not in table
+     */
+    bool FindRaw(const std::string& key, const char*& value, std::size_t& valueSize) const
+    {
+      if (!this->MayContain(key))
+      {
+        return false;
+      }
+      const auto blockIndex = this->BlockOf(key);
+      if (blockIndex == this->blocks.size())
+      {
+        return false;
+      }
+      const auto& block = this->blocks[blockIndex];
+
+      // last restart point with key <= searched one
+      std::uint32_t left = 0;
+      std::uint32_t right = block.restartCount;
+      while (right - left > 1)
+      {
+        const auto mid = left + (right - left) / 2;
+        if (this->RestartKeyCompare(block, mid, key) <= 0)
+        {
+          left = mid;
+        }
+        else
+        {
+          right = mid;
+        }
+      }
+
+      const auto end = block.data + block.size;
+      auto cursor = block.data + serial::DecodeFixed32(block.restarts + 4 * left);
+      std::string current;
+      while (cursor < end)
+      {
+        ParseEntry(cursor, end, current, value, valueSize);
+        const auto order = Compare(current.data(), current.size(), key.data(), key.size());
+        if (order == 0)
+        {
+          return true;
+        }
+        if (order > 0)
+        {
+          return false;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * Find value of key.
+     *
+     * @return false when key is not in table
+     */
+    bool Find(const std::string& key, value_t& out) const
+    {
+      const char* value;
+      std::size_t valueSize;
+      if (!this->FindRaw(key, value, valueSize))
+      {
+        return false;
+      }
+      out = serial::Decode(value, value + valueSize);
+      return true;
+    }
+
+    /**
+     * Iterator to first entry.
+     */
+    iterator_t Begin() const
+    {
+      iterator_t it(this, 0);
+      it.Parse();
+      return it;
+    }
+
+    /**
+     * Iterator to first entry with key not less than given one.
+     */
+    iterator_t Seek(const std::string& key) const
+    {
+      iterator_t it(this, this->BlockOf(key));
+      it.Parse();
+      while (it.Valid() && (Compare(it.Key().data(), it.Key().size(), key.data(), key.size()) < 0))
+      {
+        it.Next();
+      }
+      return it;
+    }
+
+  private:
+
+    /**
+     * Decode entry at cursor, which follows entry with given key.
+     *
+     * @throws std::runtime_error on malformed entry
+     */
+    static void ParseEntry(const char*& cursor, const char* end, std::string& key, const char*& value, std::size_t& valueSize)
+    {
+      std::uint64_t shared;
+      std::uint64_t unshared;
+      std::uint64_t size;
+      if (!serial::GetVarint(cursor, end, shared)
+        || !serial::GetVarint(cursor, end, unshared)
+        || !serial::GetVarint(cursor, end, size)
+        || (shared > key.size())
+        || (static_cast<std::uint64_t>(end - cursor) < unshared + size))
+      {
+        throw std::runtime_error("Table entry is malformed");
+      }
+      key.resize(shared);
+      key.append(cursor, unshared);
+      cursor += unshared;
+      value = cursor;
+      valueSize = size;
+      cursor += size;
+    }
+
+    /**
+     * Compare key stored at restart point with given one.
+     */
+    int RestartKeyCompare(const block_t& block, std::uint32_t restart, const std::string& key) const
+    {
+      const auto end = block.data + block.size;
+      auto cursor = block.data + serial::DecodeFixed32(block.restarts + 4 * restart);
+      std::uint64_t shared;
+      std::uint64_t unshared;
+      std::uint64_t valueSize;
+      if ((cursor >= end)
+        || !serial::GetVarint(cursor, end, shared)
+        || !serial::GetVarint(cursor, end, unshared)
+        || !serial::GetVarint(cursor, end, valueSize)
+        || (shared != 0)
+        || (static_cast<std::uint64_t>(end - cursor) < unshared))
+      {
+        throw std::runtime_error("Table restart point is malformed");
+      }
+      return Compare(cursor, unshared, key.data(), key.size());
+    }
+
+    /**
+     * First block which last key is not less than given one.
+     */
+    std::size_t BlockOf(const std::string& key) const noexcept
+    {
+      auto it = std::lower_bound(this->blocks.begin(), this->blocks.end(), key,
+        [](const block_t& block, const std::string& item)
+        {
+          return Compare(block.lastKey, block.lastKeySize, item.data(), item.size()) < 0;
+        }
+      );
+      return static_cast<std::size_t>(it - this->blocks.begin());
+    }
+
+    /**
+     * Parse footer, bloom filter and index.
+     */
+    void Load()
+    {
+      const auto footer = this->data + this->size - footerSize;
+      if (serial::DecodeFixed64(footer + 40) != magic)
+      {
+        throw std::runtime_error("Table has wrong magic");
+      }
+      const auto bloomOffset = serial::DecodeFixed64(footer);
+      const auto bloomSize = serial::DecodeFixed64(footer + 8);
+      const auto indexOffset = serial::DecodeFixed64(footer + 16);
+      const auto indexSize = serial::DecodeFixed64(footer + 24);
+      this->count = serial::DecodeFixed64(footer + 32);
+
+      const std::uint64_t body = this->size - footerSize;
+      if ((bloomOffset > body) || (bloomSize > body - bloomOffset)
+        || (indexOffset > body) || (indexSize > body - indexOffset))
+      {
+        throw std::runtime_error("Table footer is malformed");
+      }
+
+      if (bloomSize > 1)
+      {
+        this->bloom = this->data + bloomOffset;
+        this->bloomBits = (bloomSize - 1) * 8;
+        this->probes = static_cast<unsigned char>(this->bloom[bloomSize - 1]);
+      }
+
+      auto cursor = this->data + indexOffset;
+      const auto end = cursor + indexSize;
+      while (cursor < end)
+      {
+        std::uint64_t keySize;
+        std::uint64_t offset;
+        std::uint64_t blockSize;
+        block_t block;
+        if (!serial::GetVarint(cursor, end, keySize) || (static_cast<std::uint64_t>(end - cursor) < keySize))
+        {
+          throw std::runtime_error("Table index is malformed");
+        }
+        block.lastKey = cursor;
+        block.lastKeySize = static_cast<std::size_t>(keySize);
+        cursor += keySize;
+        if (!serial::GetVarint(cursor, end, offset) || !serial::GetVarint(cursor, end, blockSize)
+          || (offset > bloomOffset) || (blockSize > bloomOffset - offset) || (blockSize < 4))
+        {
+          throw std::runtime_error("Table index is malformed");
+        }
+
+        const auto blockEnd = this->data + offset + blockSize;
+        block.restartCount = serial::DecodeFixed32(blockEnd - 4);
+        if ((block.restartCount == 0) || ((blockSize - 4) / 4 < block.restartCount))
+        {
+          throw std::runtime_error("Table block is malformed");
+        }
+        block.restarts = blockEnd - 4 - 4 * static_cast<std::size_t>(block.restartCount);
+        block.data = this->data + offset;
+        block.size = static_cast<std::size_t>(block.restarts - block.data);
+        this->blocks.push_back(block);
+      }
+    }
+
+    const char* data;              /**< Mapped file */
+    std::size_t size;              /**< File size */
+    const char* bloom;             /**< Bloom filter bits or nullptr */
+    std::uint64_t bloomBits;       /**< Bloom filter size in bits */
+    unsigned probes;               /**< Bloom filter probes per key */
+    std::uint64_t count;           /**< Entry count */
+    std::vector<block_t> blocks;   /**< Parsed index */
+  };
+
+} // namespace sstable
+} // namespace bvl
+
+#endif /* BAD_VALUE_SSTABLE_HEADER */
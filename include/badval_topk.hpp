@@ -0,0 +1,274 @@
+/**
+ * @file badval_topk.hpp
+ * @author masscry
+ *
+ * Top-K selection over ranges of values.
+ *
+ * Selection works on iterators into range, not on values, so only K
+ * selected values are moved out at the end and strings are never
+ * copied. Small K is selected with bounded heap, which most values pass
+ * with single comparison against its worst element. Large K is selected
+ * with introselect (std::nth_element) over iterators. Large ranges are
+ * split between threads, each thread selects own candidates and
+ * candidates are merged by one more selection.
+ *
+ * Values are ordered by less_t: numbers before strings before pointers,
+ * numbers by value with NaN after all others, strings lexicographically,
+ * pointers by address.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_TOPK_HEADER
+#define BAD_VALUE_TOPK_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+namespace bvl
+{
+namespace topk
+{
+
+  /**
+   * Total order of values.
+   */
+  struct less_t
+  {
+    bool operator()(const value_t& lhs, const value_t& rhs) const noexcept
+    {
+      if (lhs.Type() != rhs.Type())
+      {
+        return lhs.Type() < rhs.Type();
+      }
+      switch (lhs.Type())
+      {
+        case value_t::number:
+          {
+            const auto left = lhs.As<value_t::number>();
+            const auto right = rhs.As<value_t::number>();
+            if (std::isnan(left) || std::isnan(right))
+            {
+              return !std::isnan(left);
+            }
+            return left < right;
+          }
+        case value_t::string:
+          return lhs.As<value_t::string>() < rhs.As<value_t::string>();
+        case value_t::pointer:
+          return std::less<const void*>()(lhs.As<value_t::pointer>(), rhs.As<value_t::pointer>());
+      }
+      return false;
+    }
+  };
+
+  /**
+   * Reverse total order of values, selects largest values.
+   */
+  struct greater_t
+  {
+    bool operator()(const value_t& lhs, const value_t& rhs) const noexcept
+    {
+      return less_t()(rhs, lhs);
+    }
+  };
+
+  /**
+   * Selection options.
+   */
+  struct options_t
+  {
+    std::size_t threads = 1;                  /**< Worker threads, 0 for one per hardware thread */
+    std::size_t heapLimit = 1024;             /**< Largest K selected with heap */
+    std::size_t parallelThreshold = 1 << 16;  /**< Smallest range split between threads */
+  };
+
+  namespace detail
+  {
+
+    /**
+     * Compare iterators by values they point to.
+     */
+    template<typename compare_t>
+    struct deref_t
+    {
+      compare_t compare;
+
+      template<typename iterator_t>
+      bool operator()(const iterator_t& lhs, const iterator_t& rhs) const
+      {
+        return this->compare(*lhs, *rhs);
+      }
+    };
+
+    /**
+     * Iterators to first K values of range in compare order, unsorted.
+     */
+    template<typename iterator_t, typename compare_t>
+    std::vector<iterator_t> Candidates(iterator_t first, iterator_t last, std::size_t k,
+      const compare_t& compare, const options_t& options)
+    {
+      const deref_t<compare_t> order{ compare };
+      std::vector<iterator_t> result;
+      if (k == 0)
+      {
+        return result;
+      }
+
+      if (k <= options.heapLimit)
+      {
+        // heap top is worst selected value
+        result.reserve(k);
+        for (; (first != last) && (result.size() < k); ++first)
+        {
+          result.push_back(first);
+          std::push_heap(result.begin(), result.end(), order);
+        }
+        for (; first != last; ++first)
+        {
+          if (compare(*first, *result.front()))
+          {
+            std::pop_heap(result.begin(), result.end(), order);
+            result.back() = first;
+            std::push_heap(result.begin(), result.end(), order);
+          }
+        }
+        return result;
+      }
+
+      for (; first != last; ++first)
+      {
+        result.push_back(first);
+      }
+      if (k < result.size())
+      {
+        std::nth_element(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(k), result.end(), order);
+        result.resize(k);
+      }
+      return result;
+    }
+
+  } // namespace detail
+
+  /**
+   * Select first K values of range in compare order.
+   *
+   * Selected values are moved out of range, so they are left in
+   * moved-from state and must not be compared again. Other values of
+   * range are untouched.
+   *
+   * @param [in] first begin of range
+   * @param [in] last end of range
+   * @param [in] k number of values to select
+   * @param [in] compare strict weak order of values, greater_t selects largest values
+   * @param [in] options selection options
+   *
+   * @return at most K values sorted by compare
+   *
+   * @throws exception of compare, rethrown after all threads are joined
+   * @throws std::system_error when worker thread can't start
+   */
+  template<typename iterator_t, typename compare_t = greater_t>
+  std::vector<value_t> TopK(iterator_t first, iterator_t last, std::size_t k,
+    const compare_t& compare = compare_t(), const options_t& options = options_t())
+  {
+    const auto size = static_cast<std::size_t>(std::distance(first, last));
+    auto threads = (options.threads != 0)? options.threads: std::max(1u, std::thread::hardware_concurrency());
+    if (size < options.parallelThreshold)
+    {
+      threads = 1;
+    }
+
+    std::vector<iterator_t> selected;
+    if (threads <= 1)
+    {
+      selected = detail::Candidates(first, last, k, compare, options);
+    }
+    else
+    {
+      std::vector<std::vector<iterator_t>> candidates(threads);
+      // last slot is for failure to start workers
+      std::vector<std::exception_ptr> errors(threads + 1);
+      std::vector<std::thread> workers;
+      const auto chunk = (size + threads - 1) / threads;
+      try
+      {
+        workers.reserve(threads);
+        for (std::size_t t = 0; t < threads; ++t)
+        {
+          const auto begin = std::min(size, t * chunk);
+          const auto end = std::min(size, begin + chunk);
+          workers.emplace_back([&candidates, &errors, &compare, &options, first, begin, end, k, t]()
+          {
+            try
+            {
+              candidates[t] = detail::Candidates(std::next(first, static_cast<std::ptrdiff_t>(begin)),
+                std::next(first, static_cast<std::ptrdiff_t>(end)), k, compare, options);
+            }
+            catch (...)
+            {
+              errors[t] = std::current_exception();
+            }
+          });
+        }
+      }
+      catch (...)
+      {
+        errors[threads] = std::current_exception();
+      }
+      for (auto& worker: workers)
+      {
+        worker.join();
+      }
+      for (const auto& error: errors)
+      {
+        if (error)
+        {
+          std::rethrow_exception(error);
+        }
+      }
+      for (auto& item: candidates)
+      {
+        selected.insert(selected.end(), item.begin(), item.end());
+      }
+      if (k < selected.size())
+      {
+        std::nth_element(selected.begin(), selected.begin() + static_cast<std::ptrdiff_t>(k), selected.end(),
+          detail::deref_t<compare_t>{ compare });
+        selected.resize(k);
+      }
+    }
+
+    std::sort(selected.begin(), selected.end(), detail::deref_t<compare_t>{ compare });
+    std::vector<value_t> result;
+    result.reserve(selected.size());
+    for (const auto& item: selected)
+    {
+      result.push_back(std::move(*item));
+    }
+    return result;
+  }
+
+  /**
+   * Select first K values of vector in compare order.
+   *
+   * @see bvl::topk::TopK
+   */
+  template<typename compare_t = greater_t>
+  std::vector<value_t> TopK(std::vector<value_t>& values, std::size_t k,
+    const compare_t& compare = compare_t(), const options_t& options = options_t())
+  {
+    return TopK(values.begin(), values.end(), k, compare, options);
+  }
+
+} // namespace topk
+} // namespace bvl
+
+#endif /* BAD_VALUE_TOPK_HEADER */
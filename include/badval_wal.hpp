@@ -0,0 +1,572 @@
+/**
+ * @file badval_wal.hpp
+ * @author masscry
+ *
+ * Write-ahead log of value mutations with group commit.
+ *
+ * Writers collect mutations into batch_t and commit it. Commit puts
+ * framed batch into buffer shared by all writers. One of waiting
+ * writers becomes leader, writes everything collected so far and
+ * calls fdatasync once for the whole group, other writers just wait
+ * for their batch to be covered by finished sync.
+ *
+ * Every batch is one record:
+ *
+ *     fixed32 crc, fixed32 size, payload
+ *
+ * CRC32C covers size and payload, and is computed with SSE 4.2 crc32
+ * instruction when processor has it. Payload is fixed32 number of
+ * mutations, then mutations:
+ *
+ *     byte op, varint key size, key, serialized value (put only)
+ *
+ * Replay maps log into memory and stops at first record, which is
+ * truncated or fails checksum, which is what crash in the middle of
+ * write leaves behind. Such tail is cut, so new records follow valid ones.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_WAL_HEADER
+#define BAD_VALUE_WAL_HEADER
+
+#include <badval.hpp>
+#include <badval_serial.hpp>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define BAD_VALUE_WAL_CRC_X86 1
+#endif
+
+namespace bvl
+{
+namespace wal
+{
+
+  /**
+   * Record header size: crc and payload size.
+   */
+  constexpr std::size_t headerSize = 8;
+
+  namespace detail
+  {
+
+    /**
+     * Byte-wise CRC32C (Castagnoli, reflected polynomial 0x82F63B78).
+     */
+    inline std::uint32_t Crc32cSoftware(std::uint32_t crc, const char* data, std::size_t size) noexcept
+    {
+      struct table_t
+      {
+        std::uint32_t entries[256];
+
+        table_t() noexcept
+        {
+          for (std::uint32_t i = 0; i < 256; ++i)
+          {
+            auto entry = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+              entry = (entry >> 1) ^ ((entry & 1)? 0x82F63B78u: 0u);
+            }
+            this->entries[i] = entry;
+          }
+        }
+      };
+      static const table_t table;
+
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+      }
+      return crc;
+    }
+
+#ifdef BAD_VALUE_WAL_CRC_X86
+
+    /**
+     * CRC32C with SSE 4.2 crc32 instruction, 8 bytes per step.
+     */
+    __attribute__((target("sse4.2")))
+    inline std::uint32_t Crc32cHardware(std::uint32_t crc, const char* data, std::size_t size) noexcept
+    {
+#if defined(__x86_64__)
+      std::uint64_t wide = crc;
+      for (; size >= 8; size -= 8, data += 8)
+      {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+      }
+      crc = static_cast<std::uint32_t>(wide);
+#endif
+      for (; size >= 4; size -= 4, data += 4)
+      {
+        std::uint32_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+      }
+      for (; size > 0; --size, ++data)
+      {
+        crc = _mm_crc32_u8(crc, static_cast<unsigned char>(*data));
+      }
+      return crc;
+    }
+
+#endif /* BAD_VALUE_WAL_CRC_X86 */
+
+  } // namespace detail
+
+  /**
+   * Processor computes CRC32C in hardware.
+   */
+  inline bool HardwareCrc() noexcept
+  {
+#ifdef BAD_VALUE_WAL_CRC_X86
+    static const bool result = __builtin_cpu_supports("sse4.2");
+    return result;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * Extend CRC32C of previous bytes with more bytes.
+   */
+  inline std::uint32_t Crc32c(const char* data, std::size_t size, std::uint32_t crc = 0) noexcept
+  {
+    crc = ~crc;
+#ifdef BAD_VALUE_WAL_CRC_X86
+    if (HardwareCrc())
+    {
+      return ~detail::Crc32cHardware(crc, data, size);
+    }
+#endif
+    return ~detail::Crc32cSoftware(crc, data, size);
+  }
+
+  /**
+   * Mutation kind.
+   */
+  enum op_t : unsigned char
+  {
+    putOp = 0,  /**< Set value of key */
+    eraseOp = 1 /**< Remove key */
+  };
+
+  /**
+   * Mutations committed together. Batch keeps them already serialized.
+   */
+  class batch_t final
+  {
+  public:
+
+    batch_t()
+      : count(0)
+    {
+      this->data.append(headerSize + 4, '\0');
+    }
+
+    /**
+     * Add put mutation.
+     *
+     * @throws std::runtime_error for pointers
+     */
+    void Put(const std::string& key, const value_t& value)
+    {
+      const auto size = this->data.size();
+      try
+      {
+        this->data.push_back(static_cast<char>(putOp));
+        serial::PutVarint(this->data, key.size());
+        this->data.append(key);
+        serial::Encode(value, this->data);
+      }
+      catch (...)
+      {
+        this->data.resize(size);
+        throw;
+      }
+      ++this->count;
+    }
+
+    /**
+     * Add erase mutation.
+     */
+    void Erase(const std::string& key)
+    {
+      this->data.push_back(static_cast<char>(eraseOp));
+      serial::PutVarint(this->data, key.size());
+      this->data.append(key);
+      ++this->count;
+    }
+
+    /**
+     * Remove all mutations.
+     */
+    void Clear()
+    {
+      this->data.resize(headerSize + 4);
+      this->count = 0;
+    }
+
+    /**
+     * Number of mutations.
+     */
+    std::size_t Count() const noexcept
+    {
+      return this->count;
+    }
+
+    /**
+     * Decode record payload, call visitor for every mutation.
+     *
+     * @param visitor called as visitor(const std::string& key, const value_t* value), value is nullptr for erase
+     *
+     * @throws std::runtime_error on malformed payload
+     */
+    template<typename visitor_t>
+    static void Iterate(const char* cursor, const char* end, visitor_t&& visitor)
+    {
+      if (end - cursor < 4)
+      {
+        throw std::runtime_error("Log record is malformed");
+      }
+      const auto count = serial::DecodeFixed32(cursor);
+      cursor += 4;
+      std::string key;
+      for (std::uint32_t i = 0; i < count; ++i)
+      {
+        std::uint64_t keySize;
+        if ((cursor >= end) || (static_cast<unsigned char>(*cursor) > eraseOp))
+        {
+          throw std::runtime_error("Log record is malformed");
+        }
+        const auto op = static_cast<op_t>(*cursor++);
+        if (!serial::GetVarint(cursor, end, keySize) || (static_cast<std::uint64_t>(end - cursor) < keySize))
+        {
+          throw std::runtime_error("Log record is malformed");
+        }
+        key.assign(cursor, static_cast<std::size_t>(keySize));
+        cursor += keySize;
+        if (op == putOp)
+        {
+          const auto value = serial::Decode(cursor, end);
+          visitor(key, &value);
+        }
+        else
+        {
+          visitor(key, static_cast<const value_t*>(nullptr));
+        }
+      }
+    }
+
+  private:
+    friend class writer_t;
+
+    /**
+     * Fill header and mutation count in place, return framed record.
+     */
+    const std::string& Frame()
+    {
+      const auto size = static_cast<std::uint32_t>(this->data.size() - headerSize);
+      auto bytes = &this->data[0];
+      for (int i = 0; i < 4; ++i)
+      {
+        bytes[4 + i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+        bytes[headerSize + i] = static_cast<char>((static_cast<std::uint32_t>(this->count) >> (8 * i)) & 0xFF);
+      }
+      const auto crc = Crc32c(bytes + 4, 4 + size);
+      for (int i = 0; i < 4; ++i)
+      {
+        bytes[i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+      }
+      return this->data;
+    }
+
+    std::string data;   /**< Header, mutation count and mutations */
+    std::size_t count;  /**< Number of mutations */
+  };
+
+  /**
+   * Result of replay.
+   */
+  struct replay_t
+  {
+    std::uint64_t records = 0;   /**< Valid records */
+    std::uint64_t mutations = 0; /**< Mutations in valid records */
+    std::uint64_t validSize = 0; /**< Bytes of valid records */
+    std::uint64_t fileSize = 0;  /**< Log size before tail was cut */
+  };
+
+  /**
+   * Call visitor for every mutation in log, cut invalid tail.
+   *
+   * @param visitor called as visitor(const std::string& key, const value_t* value), value is nullptr for erase
+   * @param truncate cut invalid tail from file
+   *
+   * @throws std::runtime_error when log can't be read, or valid record has malformed payload
+   */
+  template<typename visitor_t>
+  replay_t Replay(const std::string& path, visitor_t&& visitor, bool truncate = true)
+  {
+    replay_t result;
+    auto fd = ::open(path.c_str(), truncate? O_RDWR: O_RDONLY);
+    if (fd < 0)
+    {
+      if (errno == ENOENT)
+      {
+        return result;
+      }
+      throw std::runtime_error("Can't open log " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("Can't stat log " + path);
+    }
+    result.fileSize = static_cast<std::uint64_t>(info.st_size);
+    if (result.fileSize == 0)
+    {
+      ::close(fd);
+      return result;
+    }
+
+    auto mapped = ::mmap(nullptr, result.fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+      ::close(fd);
+      throw std::runtime_error("Can't map log " + path);
+    }
+    ::madvise(mapped, result.fileSize, MADV_SEQUENTIAL);
+
+    try
+    {
+      const auto begin = static_cast<const char*>(mapped);
+      const auto end = begin + result.fileSize;
+      auto cursor = begin;
+      while (static_cast<std::size_t>(end - cursor) >= headerSize)
+      {
+        const auto crc = serial::DecodeFixed32(cursor);
+        const auto size = serial::DecodeFixed32(cursor + 4);
+        if ((static_cast<std::size_t>(end - cursor) - headerSize < size)
+          || (Crc32c(cursor + 4, 4 + static_cast<std::size_t>(size)) != crc))
+        {
+          break;
+        }
+        std::uint64_t mutations = 0;
+        batch_t::Iterate(cursor + headerSize, cursor + headerSize + size,
+          [&visitor, &mutations](const std::string& key, const value_t* value)
+          {
+            ++mutations;
+            visitor(key, value);
+          }
+        );
+        cursor += headerSize + size;
+        ++result.records;
+        result.mutations += mutations;
+      }
+      result.validSize = static_cast<std::uint64_t>(cursor - begin);
+    }
+    catch (...)
+    {
+      ::munmap(mapped, result.fileSize);
+      ::close(fd);
+      throw;
+    }
+    ::munmap(mapped, result.fileSize);
+
+    if (truncate && (result.validSize != result.fileSize)
+      && (::ftruncate(fd, static_cast<off_t>(result.validSize)) != 0))
+    {
+      ::close(fd);
+      throw std::runtime_error("Can't truncate log " + path);
+    }
+    ::close(fd);
+    return result;
+  }
+
+  /**
+   * Log writer, safe to use from many threads.
+   *
+   * Open log with Replay before writer, so records are appended after
+   * last valid one.
+   */
+  class writer_t final
+  {
+  public:
+
+    /**
+     * Open log for appending, create when missing.
+     *
+     * @param path log file
+     * @param sync call fdatasync for every group, otherwise data is only handed to OS
+     *
+     * @throws std::runtime_error when log can't be opened
+     */
+    explicit writer_t(const std::string& path, bool sync = true)
+      : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644)), sync(sync), leader(false),
+        appended(0), written(0), groups(0)
+    {
+      if (this->fd < 0)
+      {
+        throw std::runtime_error("Can't open log " + path);
+      }
+    }
+
+    writer_t(const writer_t&) = delete;
+    writer_t& operator=(const writer_t&) = delete;
+
+    /**
+     * Destructor. Closes log.
+     */
+    ~writer_t()
+    {
+      ::close(this->fd);
+    }
+
+    /**
+     * Write batch, return when it is on disk.
+     *
+     * Batch is framed by caller thread, so lock is held only to copy
+     * ready record into shared buffer.
+     *
+     * @throws std::runtime_error on write error, all later commits fail too
+     */
+    void Commit(batch_t& batch)
+    {
+      const auto& record = batch.Frame();
+
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->ThrowIfFailed();
+      this->pending.append(record);
+      const auto mine = ++this->appended;
+
+      while (this->written < mine)
+      {
+        if (this->leader)
+        {
+          this->done.wait(lock);
+          this->ThrowIfFailed();
+          continue;
+        }
+
+        // write everything collected so far, others wait for us
+        this->leader = true;
+        std::string group;
+        group.swap(this->pending);
+        this->pending.swap(this->spare);
+        const auto target = this->appended;
+        lock.unlock();
+
+        std::exception_ptr failure;
+        try
+        {
+          this->Write(group);
+        }
+        catch (...)
+        {
+          failure = std::current_exception();
+        }
+
+        lock.lock();
+        group.clear();
+        this->spare.swap(group);
+        this->leader = false;
+        if (failure)
+        {
+          this->error = failure;
+        }
+        else
+        {
+          this->written = target;
+          ++this->groups;
+        }
+        this->done.notify_all();
+        this->ThrowIfFailed();
+      }
+    }
+
+    /**
+     * Number of committed batches.
+     */
+    std::uint64_t Commits() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->written;
+    }
+
+    /**
+     * Number of group writes, which is number of syncs.
+     */
+    std::uint64_t Groups() const
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      return this->groups;
+    }
+
+  private:
+
+    void ThrowIfFailed() const
+    {
+      if (this->error)
+      {
+        std::rethrow_exception(this->error);
+      }
+    }
+
+    void Write(const std::string& group)
+    {
+      auto data = group.data();
+      auto left = group.size();
+      while (left != 0)
+      {
+        const auto result = ::write(this->fd, data, left);
+        if (result < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          throw std::runtime_error("Can't write log");
+        }
+        data += result;
+        left -= static_cast<std::size_t>(result);
+      }
+      if (this->sync && (::fdatasync(this->fd) != 0))
+      {
+        throw std::runtime_error("Can't sync log");
+      }
+    }
+
+    const int fd;                   /**< Log file */
+    const bool sync;                /**< Sync every group */
+    mutable std::mutex mutex;       /**< Guards everything below */
+    std::condition_variable done;   /**< Signals finished group */
+    bool leader;                    /**< Some writer writes group now */
+    std::string pending;            /**< Records waiting for next group */
+    std::string spare;              /**< Buffer of previous group, reused */
+    std::uint64_t appended;         /**< Records put into buffer */
+    std::uint64_t written;          /**< Records on disk */
+    std::uint64_t groups;           /**< Groups written */
+    std::exception_ptr error;       /**< First write failure */
+  };
+
+} // namespace wal
+} // namespace bvl
+
+#endif /* BAD_VALUE_WAL_HEADER */
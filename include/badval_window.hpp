@@ -0,0 +1,567 @@
+/**
+ * @file badval_window.hpp
+ * @author masscry
+ *
+ * Incremental window aggregation over timestamped number values.
+ *
+ * Aggregate keeps count, sum, minimum and maximum of numbers, so mean
+ * is available too. Every operator updates aggregate in O(1) amortized
+ * per value instead of recomputing whole window:
+ *
+ * - tumbling_t splits time into fixed adjacent windows and emits every
+ *   window when first value of next one arrives;
+ * - sliding_t keeps aggregate of values of last width time units, it
+ *   is two-stack queue: values are pushed on back stack with running
+ *   aggregate and popped from front stack, where every entry holds
+ *   aggregate of itself and all newer front entries. When front stack
+ *   is empty, back stack is moved onto it. Nothing is subtracted, so
+ *   minimum and maximum work and sums do not drift;
+ * - session_t groups values separated by at most gap and emits
+ *   session when gap is exceeded.
+ *
+ * Times must not decrease. Values other than numbers, and NaN, are
+ * skipped.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_WINDOW_HEADER
+#define BAD_VALUE_WINDOW_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace window
+{
+
+  /**
+   * Aggregate of numbers.
+   */
+  struct aggregate_t
+  {
+    std::uint64_t count = 0;                                  /**< Number of numbers */
+    double sum = 0.0;                                         /**< Sum of numbers */
+    double min = std::numeric_limits<double>::infinity();     /**< Smallest number */
+    double max = -std::numeric_limits<double>::infinity();    /**< Largest number */
+
+    /**
+     * Add number to aggregate.
+     */
+    void Add(double number) noexcept
+    {
+      ++this->count;
+      this->sum += number;
+      this->min = std::min(this->min, number);
+      this->max = std::max(this->max, number);
+    }
+
+    /**
+     * Add other aggregate.
+     */
+    void Add(const aggregate_t& other) noexcept
+    {
+      this->count += other.count;
+      this->sum += other.sum;
+      this->min = std::min(this->min, other.min);
+      this->max = std::max(this->max, other.max);
+    }
+
+    /**
+     * Mean of numbers, NaN for empty aggregate.
+     */
+    double Mean() const noexcept
+    {
+      return (this->count == 0)? std::numeric_limits<double>::quiet_NaN(): this->sum / static_cast<double>(this->count);
+    }
+  };
+
+  /**
+   * Closed window.
+   */
+  struct window_t
+  {
+    std::int64_t start;       /**< Time of window start */
+    std::int64_t end;         /**< Time of window end, exclusive */
+    aggregate_t aggregate;    /**< Aggregate of window numbers */
+  };
+
+  /**
+   * Receives closed windows.
+   */
+  using emit_t = std::function<void(const window_t& window)>;
+
+  namespace detail
+  {
+
+    /**
+     * Number of value, false for non-numbers and NaN.
+     */
+    inline bool Number(const value_t& value, double& number) noexcept
+    {
+      if (value.Type() != value_t::number)
+      {
+        return false;
+      }
+      number = value.As<value_t::number>();
+      return !std::isnan(number);
+    }
+
+    /**
+     * Floor division, so negative times fall into right window.
+     */
+    inline std::int64_t Floor(std::int64_t time, std::int64_t width) noexcept
+    {
+      const auto quot = time / width;
+      return ((time % width != 0) && ((time < 0) != (width < 0)))? quot - 1: quot;
+    }
+
+    /**
+     * Throw when time goes backwards.
+     */
+    inline void Order(std::int64_t last, std::int64_t time)
+    {
+      if (time < last)
+      {
+        throw std::invalid_argument("window times must not decrease");
+      }
+    }
+
+  } // namespace detail
+
+  /**
+   * Fixed adjacent windows [k * width, (k + 1) * width).
+   */
+  class tumbling_t final
+  {
+  public:
+
+    /**
+     * Create operator.
+     *
+     * @param [in] width window width, positive
+     * @param [in] emit receiver of closed windows
+     *
+     * @throws std::invalid_argument when width is not positive
+     */
+    tumbling_t(std::int64_t width, emit_t emit)
+      : width(width), start(0), last(std::numeric_limits<std::int64_t>::min()), emit(std::move(emit))
+    {
+      if (width <= 0)
+      {
+        throw std::invalid_argument("window width must be positive");
+      }
+    }
+
+    /**
+     * Add value, emit current window when value belongs to next one.
+     *
+     * @return true when value was added
+     *
+     * @throws std::invalid_argument when time goes backwards
+     */
+    bool Add(std::int64_t time, const value_t& value)
+    {
+      double number;
+      if (!detail::Number(value, number))
+      {
+        return false;
+      }
+      this->Add(time, number);
+      return true;
+    }
+
+    /**
+     * Add batch of values.
+     *
+     * @return numbers added
+     */
+    std::size_t Add(const std::int64_t* times, const value_t* values, std::size_t size)
+    {
+      std::size_t added = 0;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        double number;
+        if (detail::Number(values[i], number))
+        {
+          this->Add(times[i], number);
+          ++added;
+        }
+      }
+      return added;
+    }
+
+    /**
+     * Add number.
+     */
+    void Add(std::int64_t time, double number)
+    {
+      detail::Order(this->last, time);
+      this->last = time;
+      if ((this->current.count == 0) || (time >= this->start + this->width))
+      {
+        this->Flush();
+        this->start = detail::Floor(time, this->width) * this->width;
+      }
+      this->current.Add(number);
+    }
+
+    /**
+     * Emit current window, if it is not empty.
+     */
+    void Flush()
+    {
+      if (this->current.count != 0)
+      {
+        this->emit({ this->start, this->start + this->width, this->current });
+        this->current = aggregate_t();
+      }
+    }
+
+    /**
+     * Aggregate of current window.
+     */
+    const aggregate_t& Current() const noexcept
+    {
+      return this->current;
+    }
+
+  private:
+    std::int64_t width;     /**< Window width */
+    std::int64_t start;     /**< Start of current window */
+    std::int64_t last;      /**< Time of last value */
+    aggregate_t current;    /**< Aggregate of current window */
+    emit_t emit;            /**< Receiver of closed windows */
+  };
+
+  /**
+   * Window of values from (now - width, now], where now is time of last value.
+   */
+  class sliding_t final
+  {
+  public:
+
+    /**
+     * Create empty window.
+     *
+     * @param [in] width window width, positive
+     *
+     * @throws std::invalid_argument when width is not positive
+     */
+    explicit sliding_t(std::int64_t width)
+      : width(width), last(std::numeric_limits<std::int64_t>::min())
+    {
+      if (width <= 0)
+      {
+        throw std::invalid_argument("window width must be positive");
+      }
+    }
+
+    /**
+     * Add value and evict values which left window.
+     *
+     * Skipped value still moves window to its time.
+     *
+     * @return true when value was added
+     *
+     * @throws std::invalid_argument when time goes backwards
+     */
+    bool Add(std::int64_t time, const value_t& value)
+    {
+      double number;
+      if (!detail::Number(value, number))
+      {
+        this->Advance(time);
+        return false;
+      }
+      this->Push(time, number);
+      this->Evict(time);
+      return true;
+    }
+
+    /**
+     * Add batch of values, values which left window are evicted once.
+     *
+     * @return numbers added
+     */
+    std::size_t Add(const std::int64_t* times, const value_t* values, std::size_t size)
+    {
+      std::size_t added = 0;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        double number;
+        if (detail::Number(values[i], number))
+        {
+          this->Push(times[i], number);
+          ++added;
+        }
+        else
+        {
+          detail::Order(this->last, times[i]);
+          this->last = times[i];
+        }
+      }
+      if (size != 0)
+      {
+        this->Evict(this->last);
+      }
+      return added;
+    }
+
+    /**
+     * Add number.
+     */
+    void Add(std::int64_t time, double number)
+    {
+      this->Push(time, number);
+      this->Evict(time);
+    }
+
+    /**
+     * Evict values which are out of window ending at given time.
+     *
+     * @throws std::invalid_argument when time goes backwards
+     */
+    void Advance(std::int64_t time)
+    {
+      detail::Order(this->last, time);
+      this->last = time;
+      this->Evict(time);
+    }
+
+    /**
+     * Aggregate of values in window.
+     */
+    aggregate_t Aggregate() const noexcept
+    {
+      auto result = this->backAggregate;
+      if (!this->front.empty())
+      {
+        result.Add(this->front.back().aggregate);
+      }
+      return result;
+    }
+
+    /**
+     * Number of values in window.
+     */
+    std::size_t Size() const noexcept
+    {
+      return this->front.size() + this->back.size();
+    }
+
+  private:
+
+    struct item_t
+    {
+      std::int64_t time;  /**< Time of value */
+      double number;      /**< Value */
+    };
+
+    struct entry_t
+    {
+      std::int64_t time;      /**< Time of value */
+      aggregate_t aggregate;  /**< Aggregate of value and all newer front entries */
+    };
+
+    void Push(std::int64_t time, double number)
+    {
+      detail::Order(this->last, time);
+      this->last = time;
+      this->back.push_back({ time, number });
+      this->backAggregate.Add(number);
+    }
+
+    void Evict(std::int64_t now)
+    {
+      const auto horizon = now - this->width;
+      for (;;)
+      {
+        if (this->front.empty())
+        {
+          if (this->back.empty() || (this->back.front().time > horizon))
+          {
+            return;
+          }
+          this->Flip();
+        }
+        if (this->front.back().time > horizon)
+        {
+          return;
+        }
+        this->front.pop_back();
+      }
+    }
+
+    /**
+     * Move back stack onto front stack, newest first, so oldest is on top.
+     */
+    void Flip()
+    {
+      this->front.reserve(this->back.size());
+      for (auto it = this->back.rbegin(); it != this->back.rend(); ++it)
+      {
+        entry_t entry{ it->time, aggregate_t() };
+        if (!this->front.empty())
+        {
+          entry.aggregate = this->front.back().aggregate;
+        }
+        entry.aggregate.Add(it->number);
+        this->front.push_back(entry);
+      }
+      this->back.clear();
+      this->backAggregate = aggregate_t();
+    }
+
+    std::int64_t width;             /**< Window width */
+    std::int64_t last;              /**< Time of last value */
+    std::vector<entry_t> front;     /**< Front stack, oldest value on top */
+    std::vector<item_t> back;       /**< Back stack, newest value on top */
+    aggregate_t backAggregate;      /**< Aggregate of back stack */
+  };
+
+  /**
+   * Sessions of values separated by at most gap time units.
+   */
+  class session_t final
+  {
+  public:
+
+    /**
+     * Create operator.
+     *
+     * @param [in] gap largest gap inside session, not negative
+     * @param [in] emit receiver of closed sessions
+     *
+     * @throws std::invalid_argument when gap is negative
+     */
+    session_t(std::int64_t gap, emit_t emit)
+      : gap(gap), start(0), last(std::numeric_limits<std::int64_t>::min()), emit(std::move(emit))
+    {
+      if (gap < 0)
+      {
+        throw std::invalid_argument("session gap must not be negative");
+      }
+    }
+
+    /**
+     * Add value, emit current session when gap is exceeded.
+     *
+     * @return true when value was added
+     *
+     * @throws std::invalid_argument when time goes backwards
+     */
+    bool Add(std::int64_t time, const value_t& value)
+    {
+      double number;
+      if (!detail::Number(value, number))
+      {
+        return false;
+      }
+      this->Add(time, number);
+      return true;
+    }
+
+    /**
+     * Add batch of values.
+     *
+     * @return numbers added
+     */
+    std::size_t Add(const std::int64_t* times, const value_t* values, std::size_t size)
+    {
+      std::size_t added = 0;
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        double number;
+        if (detail::Number(values[i], number))
+        {
+          this->Add(times[i], number);
+          ++added;
+        }
+      }
+      return added;
+    }
+
+    /**
+     * Add number.
+     */
+    void Add(std::int64_t time, double number)
+    {
+      detail::Order(this->last, time);
+      if ((this->current.count != 0) && this->Exceeds(time))
+      {
+        this->Flush();
+      }
+      if (this->current.count == 0)
+      {
+        this->start = time;
+      }
+      this->last = time;
+      this->current.Add(number);
+    }
+
+    /**
+     * Emit session ended by given time, when gap is exceeded.
+     */
+    void Advance(std::int64_t time)
+    {
+      detail::Order(this->last, time);
+      if ((this->current.count != 0) && this->Exceeds(time))
+      {
+        this->Flush();
+      }
+    }
+
+    /**
+     * Emit current session, if it is not empty.
+     *
+     * Session ends right after its last value.
+     */
+    void Flush()
+    {
+      if (this->current.count != 0)
+      {
+        this->emit({ this->start, this->last + 1, this->current });
+        this->current = aggregate_t();
+      }
+    }
+
+    /**
+     * Aggregate of current session.
+     */
+    const aggregate_t& Current() const noexcept
+    {
+      return this->current;
+    }
+
+  private:
+
+    /**
+     * Time is more than gap after last value.
+     */
+    bool Exceeds(std::int64_t time) const noexcept
+    {
+      // time is not before last, so unsigned distance is exact for any times
+      return static_cast<std::uint64_t>(time) - static_cast<std::uint64_t>(this->last) > static_cast<std::uint64_t>(this->gap);
+    }
+
+    std::int64_t gap;       /**< Largest gap inside session */
+    std::int64_t start;     /**< Time of first value of session */
+    std::int64_t last;      /**< Time of last value */
+    aggregate_t current;    /**< Aggregate of current session */
+    emit_t emit;            /**< Receiver of closed sessions */
+  };
+
+} // namespace window
+} // namespace bvl
+
+#endif /* BAD_VALUE_WINDOW_HEADER */
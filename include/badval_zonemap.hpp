@@ -0,0 +1,400 @@
+/**
+ * @file badval_zonemap.hpp
+ * @author masscry
+ *
+ * Value array with per-block summaries (zone maps).
+ *
+ * Values are appended into blocks of fixed size. Every block keeps
+ * summary, updated on every append: bitmask of stored types, number
+ * of values of every type, smallest and largest number, and first
+ * bytes of smallest and largest string. Scan with predicate checks
+ * summary first and skips whole block, when predicate can't match
+ * any value in it. Skipping pays off when values are sorted or
+ * clustered, so each block covers narrow part of value range.
+ *
+ * String bounds keep only prefixBytes first bytes of strings, so
+ * summaries stay small, and comparisons stay conservative: prefix of
+ * smaller string is never greater than prefix of bigger one.
+ *
+ */
+
+#pragma once
+#ifndef BAD_VALUE_ZONEMAP_HEADER
+#define BAD_VALUE_ZONEMAP_HEADER
+
+#include <badval.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bvl
+{
+namespace zonemap
+{
+
+  /**
+   * Bytes of string kept in zone bounds.
+   */
+  constexpr std::size_t prefixBytes = 8;
+
+  /**
+   * Summary of one block of values.
+   */
+  struct zone_t
+  {
+    std::uint32_t count = 0;                                          /**< Values in block */
+    std::uint32_t types = 0;                                          /**< Bit (1 << type) for every stored type */
+    std::uint32_t numbers = 0;                                        /**< Number values, NaN included */
+    std::uint32_t strings = 0;                                        /**< String values */
+    std::uint32_t pointers = 0;                                       /**< Pointer values */
+    double min = std::numeric_limits<double>::infinity();             /**< Smallest number, NaN ignored */
+    double max = -std::numeric_limits<double>::infinity();            /**< Largest number, NaN ignored */
+    std::string minPrefix;                                            /**< Prefix of smallest string */
+    std::string maxPrefix;                                            /**< Prefix of largest string */
+
+    /**
+     * Include value into summary.
+     */
+    void Add(const value_t& value)
+    {
+      ++this->count;
+      this->types |= 1u << value.Type();
+      switch (value.Type())
+      {
+        case value_t::number:
+          {
+            ++this->numbers;
+            const auto number = value.As<value_t::number>();
+            if (!std::isnan(number))
+            {
+              this->min = std::min(this->min, number);
+              this->max = std::max(this->max, number);
+            }
+          }
+          break;
+        case value_t::string:
+          {
+            const auto prefix = value.As<value_t::string>().substr(0, prefixBytes);
+            if ((this->strings == 0) || (prefix < this->minPrefix))
+            {
+              this->minPrefix = prefix;
+            }
+            if ((this->strings == 0) || (this->maxPrefix < prefix))
+            {
+              this->maxPrefix = prefix;
+            }
+            ++this->strings;
+          }
+          break;
+        default:
+          ++this->pointers;
+          break;
+      }
+    }
+  };
+
+  /**
+   * Condition on single value.
+   */
+  class predicate_t final
+  {
+  public:
+
+    /**
+     * Values of given type.
+     */
+    static predicate_t Type(value_t::type_t type)
+    {
+      predicate_t result(typeIs);
+      result.type = type;
+      return result;
+    }
+
+    /**
+     * Values equal to key.
+     */
+    static predicate_t Equal(value_t key)
+    {
+      predicate_t result(equal);
+      result.type = key.Type();
+      if (key.Type() == value_t::number)
+      {
+        result.low = result.high = key.As<value_t::number>();
+      }
+      else if (key.Type() == value_t::string)
+      {
+        result.from = key.As<value_t::string>();
+      }
+      result.key = std::move(key);
+      return result;
+    }
+
+    /**
+     * Numbers in range [low, high].
+     */
+    static predicate_t Between(double low, double high)
+    {
+      predicate_t result(numberRange);
+      result.type = value_t::number;
+      result.low = low;
+      result.high = high;
+      return result;
+    }
+
+    /**
+     * Strings in range [from, to). Empty to means no upper bound.
+     */
+    static predicate_t Between(std::string from, std::string to)
+    {
+      predicate_t result(stringRange);
+      result.type = value_t::string;
+      result.from = std::move(from);
+      result.to = std::move(to);
+      return result;
+    }
+
+    /**
+     * Strings starting with prefix.
+     */
+    static predicate_t StartsWith(const std::string& prefix)
+    {
+      // first string after all strings with prefix
+      auto to = prefix;
+      while (!to.empty() && (static_cast<unsigned char>(to.back()) == 0xFF))
+      {
+        to.pop_back();
+      }
+      if (!to.empty())
+      {
+        to.back() = static_cast<char>(static_cast<unsigned char>(to.back()) + 1);
+      }
+      return Between(prefix, to);
+    }
+
+    /**
+     * Check value.
+     */
+    bool Matches(const value_t& value) const
+    {
+      if (value.Type() != this->type)
+      {
+        return false;
+      }
+      switch (this->kind)
+      {
+        case typeIs:
+          return true;
+        case equal:
+          return value == this->key;
+        case numberRange:
+          {
+            const auto number = value.As<value_t::number>();
+            return (number >= this->low) && (number <= this->high);
+          }
+        default:
+          {
+            const auto& text = value.As<value_t::string>();
+            return (this->from <= text) && (this->to.empty() || (text < this->to));
+          }
+      }
+    }
+
+    /**
+     * Check if any value summarized by zone can match.
+     */
+    bool MayMatch(const zone_t& zone) const
+    {
+      if ((zone.types & (1u << this->type)) == 0)
+      {
+        return false;
+      }
+      switch (this->type)
+      {
+        case value_t::number:
+          if (this->kind == typeIs)
+          {
+            return true;
+          }
+          return (zone.max >= this->low) && (zone.min <= this->high);
+        case value_t::string:
+          {
+            if (this->kind == typeIs)
+            {
+              return true;
+            }
+            const auto from = this->from.substr(0, prefixBytes);
+            if (zone.maxPrefix < from)
+            {
+              return false;
+            }
+            if (this->kind == equal)
+            {
+              return !(from < zone.minPrefix);
+            }
+            return this->to.empty() || !(this->to.substr(0, prefixBytes) < zone.minPrefix);
+          }
+        default:
+          return true;
+      }
+    }
+
+  private:
+
+    enum kind_t
+    {
+      typeIs,
+      equal,
+      numberRange,
+      stringRange
+    };
+
+    explicit predicate_t(kind_t kind)
+      : kind(kind), type(value_t::number), low(0.0), high(0.0)
+    {
+      ;
+    }
+
+    kind_t kind;              /**< Condition */
+    value_t::type_t type;     /**< Type of matching values */
+    value_t key;              /**< Key of equal */
+    double low;               /**< Number range begin */
+    double high;              /**< Number range end */
+    std::string from;         /**< String range begin, or string key */
+    std::string to;           /**< String range end */
+  };
+
+  /**
+   * Result of scan.
+   */
+  struct stats_t
+  {
+    std::size_t blocks = 0;    /**< Blocks in array */
+    std::size_t skipped = 0;   /**< Blocks ruled out by zone */
+    std::size_t checked = 0;   /**< Values checked by predicate */
+    std::size_t matched = 0;   /**< Values passed to visitor */
+  };
+
+  /**
+   * Append-only array of values with zone map.
+   */
+  class array_t final
+  {
+  public:
+
+    /**
+     * Create empty array.
+     *
+     * @param [in] blockSize values summarized by one zone
+     */
+    explicit array_t(std::size_t blockSize = 1024)
+      : blockSize((blockSize == 0)? 1: blockSize)
+    {
+      ;
+    }
+
+    /**
+     * Append value and update summary of last block.
+     *
+     * @return index of value
+     */
+    std::size_t Append(value_t value)
+    {
+      const auto index = this->values.size();
+      if (index % this->blockSize == 0)
+      {
+        this->zones.emplace_back();
+      }
+      this->zones.back().Add(value);
+      this->values.push_back(std::move(value));
+      return index;
+    }
+
+    const value_t& operator[](std::size_t index) const
+    {
+      return this->values[index];
+    }
+
+    std::size_t Size() const noexcept
+    {
+      return this->values.size();
+    }
+
+    std::size_t BlockSize() const noexcept
+    {
+      return this->blockSize;
+    }
+
+    /**
+     * Summaries of blocks.
+     */
+    const std::vector<zone_t>& Zones() const noexcept
+    {
+      return this->zones;
+    }
+
+    /**
+     * Call visitor(std::size_t index, const value_t& value) for matching
+     * values in order, stop when visitor returns false.
+     *
+     * @param skip false to check every value, ignoring zones
+     */
+    template<typename visitor_t>
+    stats_t Scan(const predicate_t& predicate, visitor_t&& visitor, bool skip = true) const
+    {
+      stats_t stats;
+      stats.blocks = this->zones.size();
+      for (std::size_t block = 0; block < this->zones.size(); ++block)
+      {
+        if (skip && !predicate.MayMatch(this->zones[block]))
+        {
+          ++stats.skipped;
+          continue;
+        }
+        const auto begin = block * this->blockSize;
+        const auto end = std::min(begin + this->blockSize, this->values.size());
+        stats.checked += end - begin;
+        for (auto index = begin; index < end; ++index)
+        {
+          if (predicate.Matches(this->values[index]))
+          {
+            ++stats.matched;
+            if (!visitor(index, this->values[index]))
+            {
+              return stats;
+            }
+          }
+        }
+      }
+      return stats;
+    }
+
+    /**
+     * Number of matching values.
+     */
+    std::size_t Count(const predicate_t& predicate, bool skip = true) const
+    {
+      return this->Scan(predicate,
+        [](std::size_t, const value_t&)
+        {
+          return true;
+        },
+        skip
+      ).matched;
+    }
+
+  private:
+
+    std::size_t blockSize;        /**< Values per zone */
+    std::vector<value_t> values;  /**< Values */
+    std::vector<zone_t> zones;    /**< Summary of every block */
+  };
+
+} // namespace zonemap
+} // namespace bvl
+
+#endif /* BAD_VALUE_ZONEMAP_HEADER */
@@ -0,0 +1,343 @@
+#include <badval_arrow.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Values of given kinds: n - number, s - string, p - pointer.
+   */
+  std::vector<value_t> Values(const std::string& kinds, std::size_t count, std::mt19937& rng)
+  {
+    static int marker = 0;
+    std::vector<value_t> values;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      switch (kinds[rng() % kinds.size()])
+      {
+        case 'n':
+          values.emplace_back(static_cast<double>(rng() % 1000) / 8.0);
+          break;
+        case 's':
+          values.emplace_back(std::string(rng() % 12, static_cast<char>('a' + rng() % 26)));
+          break;
+        default:
+          values.emplace_back(&marker, nullptr);
+          break;
+      }
+    }
+    return values;
+  }
+
+  /**
+   * Same values, pointers become nulls.
+   */
+  bool Same(const std::vector<value_t>& expected, const bvl::arrow::array_t& array)
+  {
+    if (array.length != static_cast<std::int64_t>(expected.size()))
+    {
+      return false;
+    }
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+      const auto index = static_cast<std::int64_t>(i);
+      if (expected[i].Type() == value_t::pointer)
+      {
+        if (!array.IsNull(index))
+        {
+          return false;
+        }
+        continue;
+      }
+      if (array.IsNull(index) || !(array.Value(index) == expected[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Two little-endian 64-bit integers, as in node and buffer tables.
+   */
+  std::string Pair(std::uint64_t first, std::uint64_t second)
+  {
+    std::string result;
+    for (int i = 0; i < 16; ++i)
+    {
+      result.push_back(static_cast<char>(((i < 8)? first >> (8 * i): second >> (8 * (i - 8))) & 0xFF));
+    }
+    return result;
+  }
+
+} // namespace
+
+int checkExport()
+{
+  using namespace bvl::arrow;
+
+  std::mt19937 rng(5);
+  const auto numbers = Values("nnnp", 1000, rng);
+  const auto strings = Values("sssp", 1000, rng);
+  const auto mixed = Values("nsp", 1000, rng);
+
+  const auto numberArray = FromValues(numbers);
+  CHECK(numberArray.type == float64);
+  CHECK(reinterpret_cast<std::uintptr_t>(numberArray.buffers[1].data) % 64 == 0);
+  CHECK(Same(numbers, numberArray));
+  const auto stringArray = FromValues(strings);
+  CHECK(stringArray.type == utf8);
+  CHECK(Same(strings, stringArray));
+  const auto mixedArray = FromValues(mixed);
+  CHECK(mixedArray.type == denseUnion);
+  CHECK(mixedArray.nullCount == 0);
+  CHECK(Same(mixed, mixedArray));
+
+  const auto nulls = ToValues(numberArray);
+  std::size_t pointers = 0;
+  for (const auto& value: nulls)
+  {
+    pointers += (value.Type() == value_t::pointer)? 1: 0;
+  }
+  CHECK(static_cast<std::int64_t>(pointers) == numberArray.nullCount);
+
+  const auto empty = FromValues({});
+  CHECK((empty.type == float64) && (empty.length == 0));
+
+  // validity bitmap is omitted without nulls
+  std::vector<value_t> dense;
+  dense.emplace_back(1.0);
+  dense.emplace_back(2.0);
+  CHECK(FromValues(dense).buffers[0].data == nullptr);
+  return 0;
+}
+
+int checkCInterface()
+{
+  using namespace bvl::arrow;
+
+  std::mt19937 rng(7);
+  const auto mixed = Values("nsp", 500, rng);
+
+  ArrowArray array;
+  ArrowSchema schema;
+  Export(FromValues(mixed), "mixed", &array, &schema);
+  CHECK(std::string(schema.format) == "+ud:0,1");
+  CHECK(std::string(schema.name) == "mixed");
+  CHECK((schema.n_children == 2) && (std::string(schema.children[0]->format) == "g") && (std::string(schema.children[1]->format) == "u"));
+  CHECK((array.length == 500) && (array.n_buffers == 2) && (array.n_children == 2));
+
+  const auto buffers = array.buffers[1];
+  auto imported = Import(&array, &schema);
+  CHECK(array.release == nullptr);
+  CHECK(schema.release == nullptr);
+  CHECK(imported.buffers[1].data == buffers);
+  CHECK(Same(mixed, imported));
+
+  // sliced array, unknown null count
+  auto strings = Values("sp", 300, rng);
+  Export(FromValues(strings), "strings", &array, &schema);
+  array.offset = 100;
+  array.length = 150;
+  array.null_count = -1;
+  imported = Import(&array, &schema);
+  const std::vector<value_t> tail(std::make_move_iterator(strings.begin() + 100), std::make_move_iterator(strings.begin() + 250));
+  CHECK(Same(tail, imported));
+  std::int64_t nulls = 0;
+  for (const auto& value: tail)
+  {
+    nulls += (value.Type() == value_t::pointer)? 1: 0;
+  }
+  CHECK(imported.nullCount == nulls);
+
+  // unsupported types are released and rejected
+  Export(FromValues(tail), "strings", &array, &schema);
+  schema.format = "i";
+  bool thrown = false;
+  try
+  {
+    Import(&array, &schema);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(array.release == nullptr);
+  return 0;
+}
+
+int checkStream()
+{
+  using namespace bvl::arrow;
+
+  std::mt19937 rng(11);
+  const std::string path = "arrowtest.arrows";
+  std::vector<std::vector<value_t>> columns[3];
+  {
+    streamWriter_t writer(path);
+    for (int round = 0; round < 3; ++round)
+    {
+      const auto rows = (round == 1)? 0: 200 + rng() % 100;
+      batch_t batch;
+      batch.names = { "number", "string", "mixed" };
+      const char* kinds[] = { "np", "sp", "nsp" };
+      for (int column = 0; column < 3; ++column)
+      {
+        // last rows keep column layout in empty batch
+        auto values = Values(kinds[column], rows, rng);
+        if (column != 2)
+        {
+          values.emplace_back(nullptr, nullptr);
+        }
+        if (column != 1)
+        {
+          values.emplace_back(1.5);
+        }
+        if (column != 0)
+        {
+          values.emplace_back("x");
+        }
+        batch.columns.push_back(FromValues(values));
+        columns[column].push_back(std::move(values));
+      }
+      writer.Write(batch);
+    }
+
+    // schema can't change
+    batch_t other;
+    other.names = { "number" };
+    other.columns.push_back(FromValues({}));
+    bool thrown = false;
+    try
+    {
+      writer.Write(other);
+    }
+    catch (const std::invalid_argument&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+    writer.Close();
+  }
+
+  const auto batches = ReadStream(path);
+  CHECK(batches.size() == 3);
+  for (std::size_t round = 0; round < batches.size(); ++round)
+  {
+    CHECK((batches[round].names.size() == 3) && (batches[round].names[2] == "mixed"));
+    for (std::size_t column = 0; column < 3; ++column)
+    {
+      CHECK(Same(columns[column][round], batches[round].columns[column]));
+    }
+  }
+
+  // truncated stream is rejected
+  {
+    auto file = std::fopen(path.c_str(), "r+b");
+    CHECK(file != nullptr);
+    std::fseek(file, 0, SEEK_END);
+    const auto size = std::ftell(file);
+    std::fclose(file);
+    CHECK(::truncate(path.c_str(), size - 20) == 0);
+  }
+  bool thrown = false;
+  try
+  {
+    ReadStream(path);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  std::remove(path.c_str());
+  return 0;
+}
+
+int checkBitmap()
+{
+  using namespace bvl::arrow;
+
+  const std::string path = "arrowtest-bitmap.arrows";
+  std::vector<value_t> values;
+  for (int i = 0; i < 100; ++i)
+  {
+    values.emplace_back(static_cast<double>(i));
+  }
+  values.emplace_back(nullptr, nullptr);
+  {
+    streamWriter_t writer(path);
+    batch_t batch;
+    batch.names = { "number" };
+    batch.columns.push_back(FromValues(values));
+    writer.Write(batch);
+    writer.Close();
+  }
+
+  std::string bytes;
+  {
+    std::ifstream input(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+  }
+  // no nulls declared, but too short bitmap is still present
+  const auto node = bytes.find(Pair(101, 1));
+  const auto validity = bytes.find(Pair(0, 13));
+  CHECK((node != std::string::npos) && (validity != std::string::npos));
+  bytes.replace(node, 16, Pair(101, 0));
+  bytes.replace(validity, 16, Pair(0, 1));
+  {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  bool thrown = false;
+  try
+  {
+    ReadStream(path);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  std::remove(path.c_str());
+  return 0;
+}
+
+int main()
+{
+  if (checkExport() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCInterface() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkStream() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkBitmap() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "arrow: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,317 @@
+#include <badval_art.hpp>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  /**
+   * Keys with shared prefixes, empty key, long keys and all byte values.
+   */
+  std::string RandomKey(std::mt19937& rng)
+  {
+    switch (rng() % 4)
+    {
+      case 0:
+        return std::string(rng() % 3, 'a') + std::to_string(rng() % 500);
+      case 1:
+        return "user:" + std::string(rng() % 40, 'x') + std::to_string(rng() % 50);
+      case 2:
+        {
+          std::string key(rng() % 4, '\0');
+          for (auto& byte: key)
+          {
+            byte = static_cast<char>(rng() % 256);
+          }
+          return key;
+        }
+      default:
+        return std::to_string(rng() % 2000);
+    }
+  }
+
+  std::string Dump(const bvl::art::tree_t& tree, const std::string& from, const std::string& to)
+  {
+    std::string result;
+    tree.Scan(from, to, [&result](const std::string& key, const bvl::value_t&)
+    {
+      result += key;
+      result += ';';
+      return true;
+    });
+    return result;
+  }
+
+  std::string Dump(const std::map<std::string, double>& model, const std::string& from, const std::string& to)
+  {
+    std::string result;
+    for (auto it = model.lower_bound(from); (it != model.end()) && (to.empty() || (it->first < to)); ++it)
+    {
+      result += it->first;
+      result += ';';
+    }
+    return result;
+  }
+
+} // namespace
+
+int checkBasic()
+{
+  using bvl::value_t;
+  using namespace bvl::art;
+
+  tree_t tree;
+  CHECK(tree.Insert("abc", value_t(1.0)));
+  CHECK(!tree.Insert("abc", value_t(2.0)));
+  CHECK(tree.Insert("ab", value_t("prefix")));
+  CHECK(tree.Insert("", value_t(0.0)));
+  CHECK(tree.Insert("abcdefghijklmnopqrstuvwxyz0123456789", value_t(3.0)));
+  CHECK(tree.Insert("abcdefghijklmnopqrstuvwxyz0123456780", value_t(4.0)));
+  CHECK(tree.Size() == 5);
+
+  value_t out;
+  CHECK(tree.Find("abc", out) && (out == value_t(1.0)));
+  CHECK(tree.Find("ab", out) && (out == value_t("prefix")));
+  CHECK(tree.Find("", out) && (out == value_t(0.0)));
+  CHECK(tree.Find("abcdefghijklmnopqrstuvwxyz0123456780", out) && (out == value_t(4.0)));
+  CHECK(!tree.Contains("a"));
+  CHECK(!tree.Contains("abcd"));
+  CHECK(!tree.Contains("abcdefghijklmnopqrstuvwxyz012345678"));
+
+  CHECK(!tree.Assign("abc", value_t(5.0)));
+  CHECK(tree.Find("abc", out) && (out == value_t(5.0)));
+  CHECK(tree.Assign("b", value_t(6.0)));
+
+  CHECK(tree.Erase("ab"));
+  CHECK(!tree.Erase("ab"));
+  CHECK(!tree.Contains("ab"));
+  CHECK(tree.Contains("abc"));
+  CHECK(tree.Size() == 5);
+
+  // node grows through every layout
+  for (int byte = 0; byte < 256; ++byte)
+  {
+    CHECK(tree.Insert(std::string("n") + static_cast<char>(byte), value_t(static_cast<double>(byte))));
+  }
+  for (int byte = 0; byte < 256; ++byte)
+  {
+    CHECK(tree.Find(std::string("n") + static_cast<char>(byte), out) && (out == value_t(static_cast<double>(byte))));
+  }
+
+  CHECK(Dump(tree, "", "b") == ";abc;abcdefghijklmnopqrstuvwxyz0123456780;abcdefghijklmnopqrstuvwxyz0123456789;");
+  std::string prefix;
+  tree.ScanPrefix("abc", [&prefix](const std::string& key, const value_t&)
+  {
+    prefix += key.substr(0, 4) + ";";
+    return true;
+  });
+  CHECK(prefix == "abc;abcd;abcd;");
+
+  // visitor stops scan
+  int visited = 0;
+  tree.ScanPrefix("n", [&visited](const std::string&, const value_t&)
+  {
+    return ++visited < 10;
+  });
+  CHECK(visited == 10);
+  return 0;
+}
+
+int checkModel()
+{
+  using bvl::value_t;
+  using namespace bvl::art;
+
+  tree_t tree;
+  std::map<std::string, double> model;
+  std::mt19937 rng(7);
+  for (int i = 0; i < 50000; ++i)
+  {
+    const auto key = RandomKey(rng);
+    const auto number = static_cast<double>(i);
+    switch (rng() % 4)
+    {
+      case 0:
+        CHECK(tree.Erase(key) == (model.erase(key) != 0));
+        break;
+      case 1:
+        CHECK(tree.Assign(key, value_t(number)) == (model.count(key) == 0));
+        model[key] = number;
+        break;
+      default:
+        CHECK(tree.Insert(key, value_t(number)) == model.emplace(key, number).second);
+        break;
+    }
+  }
+  CHECK(tree.Size() == model.size());
+  for (const auto& item: model)
+  {
+    value_t out;
+    CHECK(tree.Find(item.first, out) && (out == value_t(item.second)));
+  }
+
+  CHECK(Dump(tree, "", "") == Dump(model, "", ""));
+  for (int i = 0; i < 200; ++i)
+  {
+    auto from = RandomKey(rng);
+    auto to = RandomKey(rng);
+    if (to < from)
+    {
+      std::swap(from, to);
+    }
+    CHECK(Dump(tree, from, to) == Dump(model, from, to));
+    CHECK(Dump(tree, from, "") == Dump(model, from, ""));
+  }
+
+  for (const auto& prefix: { std::string("user:xxx"), std::string("a"), std::string("1"), std::string("\xFF") })
+  {
+    std::string scanned;
+    tree.ScanPrefix(prefix, [&scanned](const std::string& key, const value_t&)
+    {
+      scanned += key + ";";
+      return true;
+    });
+    std::string expected;
+    for (auto it = model.lower_bound(prefix); (it != model.end()) && (it->first.compare(0, prefix.size(), prefix) == 0); ++it)
+    {
+      expected += it->first + ";";
+    }
+    CHECK(scanned == expected);
+  }
+  return 0;
+}
+
+int checkConcurrent()
+{
+  using bvl::value_t;
+  using namespace bvl::art;
+
+  // writers own disjoint keys, readers check that visible values are right
+  tree_t tree;
+  const int writers = 4;
+  const int keys = 20000;
+  std::atomic<bool> done(false);
+  std::atomic<int> wrong(0);
+
+  auto key = [](int writer, int i)
+  {
+    return std::to_string(i % 97) + ":" + std::to_string(i) + "/" + std::to_string(writer);
+  };
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 2; ++t)
+  {
+    readers.emplace_back([&, t]()
+    {
+      std::mt19937 rng(t);
+      while (!done)
+      {
+        const int writer = rng() % writers;
+        const int i = rng() % keys;
+        tree.Visit(key(writer, i), [&](const value_t& value)
+        {
+          const auto number = value.As<value_t::number>();
+          if ((number != i) && (number != -i))
+          {
+            ++wrong;
+          }
+        });
+        std::string last;
+        tree.ScanPrefix(std::to_string(i % 97) + ":", [&](const std::string& item, const value_t&)
+        {
+          if (item <= last)
+          {
+            ++wrong;
+          }
+          last = item;
+          return true;
+        });
+      }
+    });
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < writers; ++t)
+  {
+    threads.emplace_back([&, t]()
+    {
+      for (int i = 0; i < keys; ++i)
+      {
+        tree.Insert(key(t, i), value_t(static_cast<double>(i)));
+        if (i % 3 == 0)
+        {
+          tree.Assign(key(t, i), value_t(static_cast<double>(-i)));
+        }
+        if (i % 5 == 0)
+        {
+          tree.Erase(key(t, i));
+        }
+      }
+    });
+  }
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+  done = true;
+  for (auto& reader: readers)
+  {
+    reader.join();
+  }
+  CHECK(wrong == 0);
+
+  std::size_t expected = 0;
+  for (int t = 0; t < writers; ++t)
+  {
+    for (int i = 0; i < keys; ++i)
+    {
+      value_t out;
+      const bool found = tree.Find(key(t, i), out);
+      CHECK(found == (i % 5 != 0));
+      if (found)
+      {
+        CHECK(out == value_t(static_cast<double>((i % 3 == 0)? -i: i)));
+        ++expected;
+      }
+    }
+  }
+  CHECK(tree.Size() == expected);
+
+  std::size_t scanned = 0;
+  tree.Scan("", "", [&scanned](const std::string&, const value_t&)
+  {
+    ++scanned;
+    return true;
+  });
+  CHECK(scanned == expected);
+  return 0;
+}
+
+int main()
+{
+  if (checkBasic() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkModel() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConcurrent() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "art: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
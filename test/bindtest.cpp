@@ -0,0 +1,294 @@
+#include <badval_bind.hpp>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  struct point_t
+  {
+    double x;
+    double y;
+  };
+
+  BVL_BIND(point_t, x, y)
+
+  struct user_t
+  {
+    int id;
+    std::string name;
+    bool active;
+    point_t home;
+    std::vector<std::string> tags;
+    std::vector<point_t> path;
+  };
+
+  BVL_BIND(user_t, id, name, active, home, tags, path)
+
+  struct trade_t
+  {
+    std::uint32_t id;
+    std::string symbol;
+    double price;
+    std::int64_t volume;
+  };
+
+  BVL_BIND(trade_t, id, symbol, price, volume)
+
+  user_t User()
+  {
+    user_t result;
+    result.id = 42;
+    result.name = "masscry";
+    result.active = true;
+    result.home = { 1.5, -2.0 };
+    result.tags = { "admin", "dev" };
+    result.path = { { 0.0, 0.0 }, { 3.0, 4.0 } };
+    return result;
+  }
+
+  bool Same(const user_t& lhs, const user_t& rhs)
+  {
+    if ((lhs.path.size() != rhs.path.size()) || (lhs.home.x != rhs.home.x) || (lhs.home.y != rhs.home.y))
+    {
+      return false;
+    }
+    for (std::size_t i = 0; i < lhs.path.size(); ++i)
+    {
+      if ((lhs.path[i].x != rhs.path[i].x) || (lhs.path[i].y != rhs.path[i].y))
+      {
+        return false;
+      }
+    }
+    return (lhs.id == rhs.id) && (lhs.name == rhs.name) && (lhs.active == rhs.active) && (lhs.tags == rhs.tags);
+  }
+
+  int checkNode()
+  {
+    static_assert(bvl::bind::Size<user_t>() == 6, "six fields");
+    CHECK(bvl::bind::Keys<user_t>()[3].name == "home");
+
+    const auto user = User();
+    const auto node = bvl::bind::ToNode(user);
+    CHECK(node.Kind() == node_t::object);
+    CHECK(node.Size() == 6);
+    CHECK(node.Find("id")->Value().As<value_t::number>() == 42.0);
+    CHECK(node.Find("name")->Value().As<value_t::string>() == "masscry");
+    CHECK(node.Find("home")->Find("y")->Value().As<value_t::number>() == -2.0);
+    CHECK(node.Find("tags")->At(1).Value().As<value_t::string>() == "dev");
+    CHECK(node.Find("path")->At(1).Find("x")->Value().As<value_t::number>() == 3.0);
+
+    user_t back;
+    bvl::bind::FromNode(node, back);
+    CHECK(Same(user, back));
+
+    // member order and extra members do not matter
+    auto shuffled = node_t::Object();
+    for (std::size_t i = node.Size(); i-- > 0;)
+    {
+      shuffled.Set(node.Key(i).name, node.At(i));
+    }
+    shuffled.Set("extra", node_t(value_t("ignored")));
+    user_t other;
+    bvl::bind::FromNode(shuffled, other);
+    CHECK(Same(user, other));
+
+    shuffled.Erase("name");
+    try
+    {
+      bvl::bind::FromNode(shuffled, other);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+    shuffled.Set("name", node_t(value_t(1.0)));
+    try
+    {
+      bvl::bind::FromNode(shuffled, other);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+    return 0;
+  }
+
+  int checkRow()
+  {
+    const trade_t trade = { 7, "ACME", 12.25, -300 };
+    const auto row = bvl::bind::ToRow(trade);
+    CHECK(row.size() == 4);
+    CHECK(row[0].As<value_t::number>() == 7.0);
+    CHECK(row[1].As<value_t::string>() == "ACME");
+    CHECK(row[3].As<value_t::number>() == -300.0);
+
+    trade_t back{};
+    bvl::bind::FromRow(row, back);
+    CHECK((back.id == 7) && (back.symbol == "ACME") && (back.price == 12.25) && (back.volume == -300));
+
+    try
+    {
+      bvl::bind::FromRow(std::vector<value_t>(3), back);
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+
+    // integral fields take only numbers they can hold
+    const double bad[][2] = {
+      { -1.0, 0.0 },
+      { 4294967296.0, 0.0 },
+      { 0.0, 1e20 },
+      { 0.0, 9223372036854775808.0 },
+      { std::nan(""), 0.0 },
+      { 0.0, -std::numeric_limits<double>::infinity() }
+    };
+    for (const auto& numbers: bad)
+    {
+      auto wrong = row;
+      wrong[0] = value_t(numbers[0]);
+      wrong[3] = value_t(numbers[1]);
+      try
+      {
+        bvl::bind::FromRow(wrong, back);
+        return -1;
+      }
+      catch (const std::runtime_error&)
+      {
+        ;
+      }
+    }
+    auto edge = row;
+    edge[0] = value_t(4294967295.0);
+    edge[3] = value_t(-9223372036854775808.0);
+    bvl::bind::FromRow(edge, back);
+    CHECK((back.id == 4294967295U) && (back.volume == std::numeric_limits<std::int64_t>::min()));
+    return 0;
+  }
+
+  int checkStream()
+  {
+    // scalar structure is written as its row
+    const trade_t trade = { 7, "ACME", 12.25, -300 };
+    std::string bound;
+    bvl::bind::Encode(trade, bound);
+    std::string generic;
+    for (const auto& value: bvl::bind::ToRow(trade))
+    {
+      bvl::serial::Encode(value, generic);
+    }
+    CHECK(bound == generic);
+
+    const auto user = User();
+    std::string out;
+    bvl::bind::Encode(user, out);
+    bvl::bind::Encode(trade, out);
+    const char* cursor = out.data();
+    const char* end = out.data() + out.size();
+    user_t back;
+    trade_t backTrade{};
+    bvl::bind::Decode(cursor, end, back);
+    bvl::bind::Decode(cursor, end, backTrade);
+    CHECK(cursor == end);
+    CHECK(Same(user, back));
+    CHECK(backTrade.symbol == "ACME");
+
+    for (std::size_t size = 0; size < out.size(); ++size)
+    {
+      cursor = out.data();
+      try
+      {
+        bvl::bind::Decode(cursor, out.data() + size, back);
+        CHECK(cursor <= out.data() + size);
+      }
+      catch (const std::runtime_error&)
+      {
+        ;
+      }
+    }
+
+    // number too large for integral field
+    auto huge = bvl::bind::ToNode(user);
+    huge.Set("id", node_t(value_t(1e20)));
+    try
+    {
+      bvl::bind::FromNode(huge, back);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+    auto row = bvl::bind::ToRow(trade);
+    row[0] = value_t(1e20);
+    std::string large;
+    for (const auto& value: row)
+    {
+      bvl::serial::Encode(value, large);
+    }
+    cursor = large.data();
+    try
+    {
+      bvl::bind::Decode(cursor, large.data() + large.size(), backTrade);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+
+    // second field of trade is string, point expects number
+    std::string swapped;
+    bvl::bind::Encode(trade, swapped);
+    cursor = swapped.data();
+    try
+    {
+      point_t point;
+      bvl::bind::Decode(cursor, swapped.data() + swapped.size(), point);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+    return 0;
+  }
+
+} // namespace
+
+int main()
+{
+  if (checkNode() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkRow() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkStream() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "bind: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#include <badval_cmap.hpp>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+int checkBasics()
+{
+  using namespace bvl;
+
+  concurrent_map_t map(4);
+  value_t out;
+
+  CHECK(map.Size() == 0);
+  CHECK(!map.Find(value_t("missing"), out));
+
+  CHECK(map.Insert(value_t("one"), value_t(1.0)));
+  CHECK(map.Insert(value_t(2.0), value_t("two")));
+  CHECK(!map.Insert(value_t("one"), value_t(100.0)));
+  CHECK(map.Size() == 2);
+
+  CHECK(map.Find(value_t("one"), out));
+  CHECK(out.As<value_t::number>() == 1.0);
+
+  // string keys can be looked up without boxing
+  CHECK(map.Find(std::string("one"), out));
+  CHECK(out.As<value_t::number>() == 1.0);
+  CHECK(!map.Contains(std::string("two")));
+
+  CHECK(map.Find(value_t(2.0), out));
+  CHECK(out.As<value_t::string>() == "two");
+
+  CHECK(!map.Assign(value_t("one"), value_t("uno")));
+  CHECK(map.Find(value_t("one"), out));
+  CHECK(out.As<value_t::string>() == "uno");
+
+  CHECK(map.Erase(value_t("one")));
+  CHECK(!map.Erase(value_t("one")));
+  CHECK(!map.Contains(value_t("one")));
+  CHECK(map.Size() == 1);
+
+  // pointers are stored as is, and freed with map
+  static int freed = 0;
+  {
+    concurrent_map_t ptrs(1);
+    static int data;
+    CHECK(ptrs.Insert(value_t("ptr"), value_t(&data, [](void*) { ++freed; })));
+    const void* seen = nullptr;
+    CHECK(ptrs.Visit(std::string("ptr"), [&seen](const value_t& value) { seen = value.As<value_t::pointer>(); }));
+    CHECK(seen == &data);
+
+    bool thrown = false;
+    try
+    {
+      ptrs.Find(std::string("ptr"), out);
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+  CHECK(freed == 1);
+
+  map.Reclaim();
+  return 0;
+}
+
+int checkGrowth()
+{
+  using namespace bvl;
+
+  concurrent_map_t map(2);
+  const int count = 10000;
+  for (int i = 0; i < count; ++i)
+  {
+    CHECK(map.Insert(value_t("key" + std::to_string(i)), value_t(static_cast<double>(i))));
+  }
+  CHECK(map.Size() == count);
+
+  for (int i = 0; i < count; i += 2)
+  {
+    CHECK(map.Erase(value_t("key" + std::to_string(i))));
+  }
+  CHECK(map.Size() == count / 2);
+
+  // reinsertion reuses erased slots
+  for (int round = 0; round < 4; ++round)
+  {
+    for (int i = 0; i < count; i += 2)
+    {
+      CHECK(map.Insert(value_t("key" + std::to_string(i)), value_t(static_cast<double>(-i))));
+    }
+    for (int i = 0; i < count; i += 2)
+    {
+      CHECK(map.Erase(value_t("key" + std::to_string(i))));
+    }
+  }
+
+  value_t out;
+  for (int i = 0; i < count; ++i)
+  {
+    auto found = map.Find("key" + std::to_string(i), out);
+    CHECK(found == (i % 2 == 1));
+    if (found)
+    {
+      CHECK(out.As<value_t::number>() == i);
+    }
+  }
+  return 0;
+}
+
+int checkConcurrent()
+{
+  using namespace bvl;
+
+  concurrent_map_t map(8);
+  const int keys = 512;
+  const int rounds = 200;
+
+  for (int i = 0; i < keys; ++i)
+  {
+    map.Assign(value_t(static_cast<double>(i)), value_t(std::to_string(i) + ":0"));
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<int> errors(0);
+
+  for (int w = 0; w < 2; ++w)
+  {
+    threads.emplace_back([&map, w]()
+    {
+      for (int round = 1; round <= rounds; ++round)
+      {
+        for (int i = w; i < keys; i += 2)
+        {
+          map.Assign(value_t(static_cast<double>(i)), value_t(std::to_string(i) + ":" + std::to_string(round)));
+          // churn extra keys to force rehashing
+          map.Assign(value_t("tmp" + std::to_string(i)), value_t(static_cast<double>(round)));
+          map.Erase(value_t("tmp" + std::to_string(i)));
+        }
+      }
+    });
+  }
+
+  for (int r = 0; r < 4; ++r)
+  {
+    threads.emplace_back([&map, &errors]()
+    {
+      value_t out;
+      for (int round = 0; round < rounds; ++round)
+      {
+        for (int i = 0; i < keys; ++i)
+        {
+          if (!map.Find(value_t(static_cast<double>(i)), out))
+          {
+            ++errors;
+            continue;
+          }
+          const auto& text = out.As<value_t::string>();
+          if (text.compare(0, text.find(':'), std::to_string(i)) != 0)
+          {
+            ++errors;
+          }
+        }
+      }
+    });
+  }
+
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+
+  CHECK(errors == 0);
+  CHECK(map.Size() == keys);
+
+  value_t out;
+  for (int i = 0; i < keys; ++i)
+  {
+    CHECK(map.Find(value_t(static_cast<double>(i)), out));
+    CHECK(out.As<value_t::string>() == std::to_string(i) + ":" + std::to_string(rounds));
+  }
+  return 0;
+}
+
+int main()
+{
+  if (checkBasics() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkGrowth() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConcurrent() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "concurrent map: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+#include <badval_codec.hpp>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using namespace bvl::codec;
+
+  using trade_t = schema_t<u64_t, str_t, f64_t, i32_t, bool_t, str_t, i8_t, f32_t>;
+
+  static_assert(trade_t::Size() == 8, "eight fields");
+  static_assert(trade_t::FixedSize() == 8 + 8 + 4 + 1 + 1 + 4, "fixed block");
+  static_assert(trade_t::Offset(2) == 8, "price follows id");
+  static_assert(trade_t::Offset(7) == 22, "last fixed field");
+
+  int checkLayout()
+  {
+    const trade_t::message_t trade{ 0x0102030405060708ULL, "ACME", 1.5, -2, true, "", -1, 0.25f };
+    std::string out;
+    trade_t::Encode(trade, out);
+    CHECK(out.size() == trade_t::EncodedSize(trade));
+    CHECK(out.size() == trade_t::FixedSize() + 1 + 4 + 1);
+
+    // little-endian fixed fields at compile-time offsets, no tags
+    CHECK(out[0] == 0x08);
+    CHECK(out[7] == 0x01);
+    std::uint64_t bits;
+    const double price = 1.5;
+    std::memcpy(&bits, &price, sizeof(bits));
+    CHECK(bvl::serial::DecodeFixed64(out.data() + trade_t::Offset(2)) == bits);
+    CHECK(bvl::serial::DecodeFixed32(out.data() + trade_t::Offset(3)) == 0xFFFFFFFEU);
+    CHECK(out[trade_t::Offset(4)] == 1);
+    CHECK(out[trade_t::Offset(6)] == '\xFF');
+    // strings follow block in schema order
+    CHECK(out[trade_t::FixedSize()] == 4);
+    CHECK(out.substr(trade_t::FixedSize() + 1, 4) == "ACME");
+    CHECK(out[trade_t::FixedSize() + 5] == 0);
+    return 0;
+  }
+
+  int checkMessage()
+  {
+    const trade_t::message_t first{ std::numeric_limits<std::uint64_t>::max(), std::string(300, 'x'), -0.0, std::numeric_limits<std::int32_t>::min(), false, "venue", 127, -3.5f };
+    const trade_t::message_t second{ 1, "", 1e300, 42, true, "other", -128, 0.0f };
+    std::string out;
+    trade_t::Encode(first, out);
+    trade_t::Encode(second, out);
+
+    const char* cursor = out.data();
+    const char* end = out.data() + out.size();
+    trade_t::message_t back;
+    trade_t::Decode(cursor, end, back);
+    CHECK(back == first);
+    CHECK(std::signbit(std::get<2>(back)));
+    trade_t::Decode(cursor, end, back);
+    CHECK(back == second);
+    CHECK(cursor == end);
+
+    for (std::size_t size = 0; size < out.size(); ++size)
+    {
+      cursor = out.data();
+      try
+      {
+        trade_t::Decode(cursor, out.data() + size, back);
+        CHECK(cursor <= out.data() + size);
+      }
+      catch (const std::runtime_error&)
+      {
+        ;
+      }
+    }
+    cursor = out.data();
+    try
+    {
+      trade_t::Decode(cursor, out.data() + trade_t::FixedSize() + 1, back);
+      return -1;
+    }
+    catch (const std::runtime_error&)
+    {
+      ;
+    }
+    return 0;
+  }
+
+  int checkRow()
+  {
+    std::vector<value_t> row;
+    row.emplace_back(7.0);
+    row.emplace_back("ACME");
+    row.emplace_back(12.25);
+    row.emplace_back(-300.0);
+    row.emplace_back(1.0);
+    row.emplace_back("XNAS");
+    row.emplace_back(-5.0);
+    row.emplace_back(0.5);
+
+    std::string out;
+    trade_t::Encode(row, out);
+    const trade_t::message_t expected{ 7, "ACME", 12.25, -300, true, "XNAS", -5, 0.5f };
+    std::string typed;
+    trade_t::Encode(expected, typed);
+    CHECK(out == typed);
+
+    const char* cursor = out.data();
+    std::vector<value_t> back(3);
+    trade_t::Decode(cursor, out.data() + out.size(), back);
+    CHECK(cursor == out.data() + out.size());
+    CHECK(back.size() == row.size());
+    for (std::size_t i = 0; i < row.size(); ++i)
+    {
+      CHECK(back[i] == row[i]);
+    }
+
+    // mismatch leaves output untouched
+    row[3] = value_t("not a number");
+    try
+    {
+      trade_t::Encode(row, out);
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+    CHECK(out == typed);
+    row.pop_back();
+    try
+    {
+      trade_t::Encode(row, out);
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+
+    // integer fields take only numbers they can hold
+    using pair_t = schema_t<u32_t, i32_t>;
+    const double bad[][2] = {
+      { -1.0, 0.0 },
+      { 4294967296.0, 0.0 },
+      { 0.0, 1e20 },
+      { 0.0, 2147483648.0 },
+      { 0.0, std::nan("") },
+      { std::numeric_limits<double>::infinity(), 0.0 }
+    };
+    std::string pair;
+    for (const auto& numbers: bad)
+    {
+      try
+      {
+        pair_t::Encode(std::vector<value_t>{ value_t(numbers[0]), value_t(numbers[1]) }, pair);
+        return -1;
+      }
+      catch (const std::invalid_argument&)
+      {
+        ;
+      }
+      CHECK(pair.empty());
+    }
+    pair_t::Encode(std::vector<value_t>{ value_t(4294967295.0), value_t(-2147483648.0) }, pair);
+    cursor = pair.data();
+    pair_t::message_t edge;
+    pair_t::Decode(cursor, pair.data() + pair.size(), edge);
+    CHECK((std::get<0>(edge) == 4294967295U) && (std::get<1>(edge) == std::numeric_limits<std::int32_t>::min()));
+    return 0;
+  }
+
+} // namespace
+
+int main()
+{
+  if (checkLayout() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkMessage() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkRow() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "codec: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
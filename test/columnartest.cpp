@@ -0,0 +1,262 @@
+#include <badval_columnar.hpp>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  const char path[] = "columnartest.tmp";
+
+  /**
+   * Columns shaped for different encodings.
+   */
+  const std::vector<std::string> names = {
+    "id", "category", "price", "status", "flag", "url", "mixed", "offset"
+  };
+
+  std::vector<value_t> Row(std::size_t row, std::mt19937& rng)
+  {
+    std::vector<value_t> result;
+    result.emplace_back(static_cast<double>(1000 + 3 * row));                        // delta
+    result.emplace_back("category-" + std::to_string(rng() % 10));                  // dictionary
+    result.emplace_back(static_cast<double>(rng() % 100000) / 7.0);                 // plain
+    result.emplace_back((row / 1000 % 2 == 0)? "active": "archived");               // rle
+    result.emplace_back(static_cast<double>(row / 500 % 3));                        // rle or dictionary
+    char url[64];
+    std::snprintf(url, sizeof(url), "https://example.com/items/%08zu", row);
+    result.emplace_back(url);                                                       // delta
+    if (row % 7 == 0)
+    {
+      result.emplace_back("note " + std::to_string(row));
+    }
+    else if (row % 11 == 0)
+    {
+      result.emplace_back(std::nan(""));
+    }
+    else
+    {
+      result.emplace_back((row % 2 == 0)? -0.0: 1.5);
+    }
+    result.emplace_back(static_cast<double>(rng() % 1000) - 500.0);                 // bitpacked
+    return result;
+  }
+
+  bool Same(const value_t& lhs, const value_t& rhs)
+  {
+    if ((lhs.Type() == value_t::number) && (rhs.Type() == value_t::number))
+    {
+      const auto left = lhs.As<value_t::number>();
+      const auto right = rhs.As<value_t::number>();
+      return (std::isnan(left) && std::isnan(right)) || ((left == right) && (std::signbit(left) == std::signbit(right)));
+    }
+    return lhs == rhs;
+  }
+
+} // namespace
+
+int checkRoundTrip()
+{
+  using namespace bvl::columnar;
+
+  const std::size_t rows = 50000;
+  std::vector<std::vector<value_t>> expected(names.size());
+  options_t options;
+  options.rowGroupRows = 20000;
+  options.pageRows = 1000;
+  {
+    std::mt19937 rng(1);
+    writer_t writer(path, names, options);
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+      auto values = Row(row, rng);
+      for (std::size_t column = 0; column < names.size(); ++column)
+      {
+        expected[column].push_back(values[column]);
+      }
+      writer.Append(std::move(values));
+    }
+    writer.Finish();
+    CHECK(writer.Rows() == rows);
+  }
+
+  file_t file(path);
+  CHECK(file.Rows() == rows);
+  CHECK(file.Columns() == names);
+  CHECK(file.RowGroups() == 3);
+  CHECK(file.Chunk(0, file.Column("id")).numbers == delta);
+  CHECK(file.Chunk(0, file.Column("category")).strings == dictionary);
+  CHECK(file.Chunk(0, file.Column("price")).numbers == plain);
+  CHECK(file.Chunk(0, file.Column("status")).strings == rle);
+  CHECK(file.Chunk(0, file.Column("url")).strings == delta);
+  CHECK(file.Chunk(0, file.Column("offset")).numbers == bitpacked);
+  CHECK(file.Chunk(2, file.Column("id")).pages.size() == 10);
+
+  for (std::size_t column = 0; column < names.size(); ++column)
+  {
+    std::vector<value_t> values;
+    file.Read(column, values);
+    CHECK(values.size() == rows);
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+      CHECK(Same(values[row], expected[column][row]));
+    }
+  }
+
+  // columnar file is smaller than serialized rows
+  std::string serialized;
+  for (const auto& column: expected)
+  {
+    for (const auto& value: column)
+    {
+      bvl::serial::Encode(value, serialized);
+    }
+  }
+  CHECK(file.FileSize() < serialized.size() / 2);
+  bool thrown = false;
+  try
+  {
+    file.Column("missing");
+  }
+  catch (const std::out_of_range&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkScan()
+{
+  using namespace bvl::columnar;
+  using bvl::zonemap::predicate_t;
+
+  file_t file(path);
+  const auto id = file.Column("id");
+  std::vector<std::uint64_t> rows;
+  auto stats = file.Scan(id, predicate_t::Between(31000.0, 31300.0), [&rows](std::uint64_t row, const value_t& value)
+  {
+    rows.push_back(row);
+    return value.As<value_t::number>() == static_cast<double>(1000 + 3 * row);
+  });
+  CHECK(rows.size() == 101);
+  CHECK(rows.front() == 10000);
+  CHECK(stats.blocks == 50);
+  CHECK(stats.skipped == 49);
+  CHECK(stats.checked == 1000);
+
+  const auto full = file.Scan(id, predicate_t::Between(31000.0, 31300.0), [](std::uint64_t, const value_t&)
+  {
+    return true;
+  }, false);
+  CHECK((full.skipped == 0) && (full.matched == 101) && (full.checked == 50000));
+
+  // string pages of one status value are skipped
+  stats = file.Scan(file.Column("status"), predicate_t::Equal(value_t("archived")), [](std::uint64_t row, const value_t&)
+  {
+    return row / 1000 % 2 == 1;
+  });
+  CHECK(stats.matched == 25000);
+  CHECK(stats.skipped == 25);
+
+  std::size_t visited = 0;
+  stats = file.Scan(file.Column("mixed"), predicate_t::Type(value_t::string), [&visited](std::uint64_t row, const value_t&)
+  {
+    ++visited;
+    return row % 7 == 0;
+  });
+  CHECK(visited == (50000 + 6) / 7);
+  return 0;
+}
+
+int checkErrors()
+{
+  using namespace bvl::columnar;
+
+  {
+    writer_t writer(path, { "a", "b" });
+    bool thrown = false;
+    try
+    {
+      std::vector<value_t> row;
+      row.emplace_back(1.0);
+      writer.Append(std::move(row));
+    }
+    catch (const std::invalid_argument&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+
+    int marker = 0;
+    thrown = false;
+    try
+    {
+      std::vector<value_t> row;
+      row.emplace_back(1.0);
+      row.emplace_back(&marker, nullptr);
+      writer.Append(std::move(row));
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+    writer.Finish();
+  }
+  {
+    file_t file(path);
+    CHECK((file.Rows() == 0) && (file.RowGroups() == 0));
+    std::vector<value_t> values;
+    file.Read(1, values);
+    CHECK(values.empty());
+  }
+
+  // broken trailer
+  auto file = std::fopen(path, "r+b");
+  CHECK(file != nullptr);
+  std::fseek(file, -1, SEEK_END);
+  std::fputc('X', file);
+  std::fclose(file);
+  bool thrown = false;
+  try
+  {
+    file_t broken(path);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  std::remove(path);
+  return 0;
+}
+
+int main()
+{
+  if (checkRoundTrip() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkScan() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkErrors() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "columnar: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+#include <badval_diff.hpp>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  /**
+   * Random document of given depth.
+   */
+  node_t Random(std::mt19937& rng, int depth)
+  {
+    const auto kind = (depth == 0)? 0: rng() % 3;
+    if (kind == 0)
+    {
+      if (rng() % 2 == 0)
+      {
+        return node_t(value_t(static_cast<double>(rng() % 10)));
+      }
+      return node_t(value_t("s" + std::to_string(rng() % 10)));
+    }
+    if (kind == 1)
+    {
+      auto result = node_t::Array();
+      for (auto size = rng() % 5; size != 0; --size)
+      {
+        result.Push(Random(rng, depth - 1));
+      }
+      return result;
+    }
+    auto result = node_t::Object();
+    for (auto size = rng() % 5; size != 0; --size)
+    {
+      result.Set("k" + std::to_string(rng() % 8), Random(rng, depth - 1));
+    }
+    return result;
+  }
+
+  /**
+   * Change random node somewhere in document.
+   */
+  void Mutate(std::mt19937& rng, node_t& node)
+  {
+    if ((node.Kind() != node_t::leaf) && (node.Size() != 0) && (rng() % 4 != 0))
+    {
+      Mutate(rng, node.At(rng() % node.Size()));
+      return;
+    }
+    switch (node.Kind())
+    {
+      case node_t::leaf:
+        node = Random(rng, 2);
+        break;
+      case node_t::array:
+        if ((node.Size() != 0) && (rng() % 2 == 0))
+        {
+          node.Remove(rng() % node.Size());
+        }
+        else
+        {
+          node.Push(Random(rng, 1));
+        }
+        break;
+      case node_t::object:
+        if ((node.Size() != 0) && (rng() % 2 == 0))
+        {
+          node.Erase(node.Key(rng() % node.Size()).name);
+        }
+        else
+        {
+          node.Set("n" + std::to_string(rng() % 4), Random(rng, 1));
+        }
+        break;
+    }
+  }
+
+} // namespace
+
+int checkHash()
+{
+  auto left = node_t::Object();
+  left.Set("a", value_t(1.0));
+  left.Set("b", value_t("x"));
+  auto right = node_t::Object();
+  right.Set("b", value_t("x"));
+  right.Set("a", value_t(1.0));
+  CHECK((left.Hash() == right.Hash()) && (left == right));
+
+  auto outer = node_t::Array();
+  outer.Push(left);
+  const auto before = outer.Hash();
+  // change through non-const access drops cached hashes on path
+  outer.At(0).At(0) = value_t(2.0);
+  CHECK(outer.Hash() != before);
+  CHECK(outer.At(0) != right);
+  outer.At(0).Set("a", value_t(1.0));
+  CHECK((outer.Hash() == before) && (outer.At(0) == right));
+
+  CHECK(node_t(value_t(1.0)).Hash() != node_t(value_t("1")).Hash());
+  CHECK(node_t::Array().Hash() != node_t::Object().Hash());
+  return 0;
+}
+
+int checkDiff()
+{
+  using namespace bvl::diff;
+
+  std::mt19937 rng(3);
+  for (int round = 0; round < 500; ++round)
+  {
+    const auto from = Random(rng, 4);
+    auto to = from;
+    for (auto changes = rng() % 4; changes != 0; --changes)
+    {
+      Mutate(rng, to);
+    }
+
+    const auto patch = Diff(from, to);
+    CHECK(patch.empty() == (from == to));
+    auto target = from;
+    Apply(target, patch);
+    CHECK(target == to);
+
+    std::string encoded;
+    Encode(patch, encoded);
+    const char* cursor = encoded.data();
+    const auto decoded = Decode(cursor, encoded.data() + encoded.size());
+    CHECK(cursor == encoded.data() + encoded.size());
+    auto copy = from;
+    Apply(copy, decoded);
+    CHECK(copy == to);
+  }
+  return 0;
+}
+
+int checkPatch()
+{
+  using namespace bvl::diff;
+
+  auto items = node_t::Array();
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto item = node_t::Object();
+    item.Set("id", value_t(static_cast<double>(i)));
+    item.Set("name", value_t("item-" + std::to_string(i)));
+    items.Push(item);
+  }
+  auto from = node_t::Object();
+  from.Set("items", items);
+  auto to = from;
+  to.Find("items", bvl::doc::KeyHash("items"))->At(500).Set("name", value_t("renamed"));
+
+  // only changed leaf is sent
+  const auto patch = Diff(from, to);
+  CHECK((patch.size() == 1) && (patch[0].path.size() == 3) && (patch[0].path[1].index == 500));
+  std::string encoded;
+  Encode(patch, encoded);
+  CHECK(encoded.size() < 40);
+
+  // path missing in document
+  bool thrown = false;
+  try
+  {
+    auto other = node_t::Object();
+    Apply(other, patch);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  encoded.resize(encoded.size() - 3);
+  thrown = false;
+  try
+  {
+    const char* cursor = encoded.data();
+    Decode(cursor, encoded.data() + encoded.size());
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkConcurrent()
+{
+  using namespace bvl::diff;
+
+  // one base document without cached hashes is diffed by many threads
+  std::mt19937 rng(5);
+  const int threadCount = 4;
+  for (int round = 0; round < 20; ++round)
+  {
+    const auto base = Random(rng, 6);
+    std::vector<node_t> versions(threadCount, base);
+    for (auto& version: versions)
+    {
+      Mutate(rng, version);
+    }
+    std::vector<int> errors(threadCount, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+      threads.emplace_back([&base, &versions, &errors, t]()
+      {
+        auto target = base;
+        Apply(target, Diff(base, versions[t]));
+        errors[t] = (target == versions[t])? 0: 1;
+      });
+    }
+    for (auto& thread: threads)
+    {
+      thread.join();
+    }
+    for (auto error: errors)
+    {
+      CHECK(error == 0);
+    }
+  }
+  return 0;
+}
+
+int main()
+{
+  if (checkHash() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkDiff() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkPatch() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConcurrent() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "diff: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
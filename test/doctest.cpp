@@ -0,0 +1,65 @@
+#include <badval_doc.hpp>
+#include <iostream>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+int checkNode()
+{
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  auto document = node_t::Object();
+  document.Set("name", value_t("widget"));
+  auto tags = node_t::Array();
+  tags.Push(value_t("red"));
+  tags.Push(value_t(2.0));
+  document.Set("tags", tags);
+  document.Set("size", value_t(1.0));
+  document.Set("size", value_t(3.0));
+
+  CHECK(document.Kind() == node_t::object);
+  CHECK(document.Size() == 3);
+  CHECK((document.Key(2).name == "size") && (document.At(2).Value() == value_t(3.0)));
+  CHECK(document.Find("tags")->At(0).Value() == value_t("red"));
+  CHECK(document.Find("missing") == nullptr);
+  CHECK(document.At(0).Find("name") == nullptr);
+
+  // member order does not matter
+  auto other = node_t::Object();
+  other.Set("size", value_t(3.0));
+  other.Set("tags", tags);
+  other.Set("name", value_t("widget"));
+  CHECK(document == other);
+  other.Find("tags", bvl::doc::KeyHash("tags"))->At(1) = value_t(5.0);
+  CHECK(document != other);
+
+  CHECK(document.Erase("tags") && !document.Erase("tags"));
+  CHECK((document.Size() == 2) && (document.Key(1).name == "size"));
+
+  bool thrown = false;
+  try
+  {
+    tags.Set("key", value_t(1.0));
+  }
+  catch (const std::logic_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int main()
+{
+  if (checkNode() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "doc: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+#include <badval_ebr.hpp>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  std::atomic<int> freed(0);
+
+  void countFree(void*)
+  {
+    ++freed;
+  }
+
+  /**
+   * Payload which detects use after release.
+   */
+  struct payload_t
+  {
+    static const std::uint64_t alive = 0xA11FE;
+    static const std::uint64_t dead = 0xDEAD;
+
+    std::atomic<std::uint64_t> magic;
+    std::uint64_t data;
+
+    explicit payload_t(std::uint64_t data)
+      : magic(alive), data(data)
+    {
+      ;
+    }
+
+    static void Release(void* ptr)
+    {
+      auto payload = static_cast<payload_t*>(ptr);
+      payload->magic.store(dead);
+      delete payload;
+    }
+  };
+
+} // namespace
+
+int checkGracePeriod()
+{
+  using namespace bvl;
+
+  ebr::domain_t domain(1);
+  freed = 0;
+
+  {
+    auto guard = domain.Pin();
+    {
+      auto nested = domain.Pin();
+    }
+    domain.Retire(value_t(nullptr, countFree));
+    CHECK(domain.Pending() == 1);
+
+    // pinned thread blocks epoch, so nothing can be released
+    for (int i = 0; i < 10; ++i)
+    {
+      CHECK(!domain.Collect());
+    }
+    CHECK(freed == 0);
+  }
+
+  domain.Synchronize();
+  CHECK(freed == 1);
+  CHECK(domain.Pending() == 0);
+
+  // other thread pinned also blocks release
+  std::atomic<bool> pinned(false);
+  std::atomic<bool> stop(false);
+  std::thread reader([&]()
+  {
+    auto guard = domain.Pin();
+    pinned = true;
+    while (!stop)
+    {
+      std::this_thread::yield();
+    }
+  });
+  while (!pinned)
+  {
+    std::this_thread::yield();
+  }
+
+  domain.Retire(value_t("retired string"));
+  domain.Retire(value_t(nullptr, countFree));
+  for (int i = 0; i < 10; ++i)
+  {
+    CHECK(!domain.Collect());
+  }
+  CHECK(freed == 1);
+
+  stop = true;
+  reader.join();
+  domain.Synchronize();
+  CHECK(freed == 2);
+  CHECK(domain.Pending() == 0);
+  return 0;
+}
+
+int checkOrphans()
+{
+  using namespace bvl;
+
+  freed = 0;
+  {
+    ebr::domain_t domain;
+    std::atomic<bool> pinned(false);
+    std::atomic<bool> stop(false);
+    std::thread reader([&]()
+    {
+      auto guard = domain.Pin();
+      pinned = true;
+      while (!stop)
+      {
+        std::this_thread::yield();
+      }
+    });
+    while (!pinned)
+    {
+      std::this_thread::yield();
+    }
+
+    std::thread writer([&domain]()
+    {
+      for (int i = 0; i < 10; ++i)
+      {
+        domain.Retire(value_t(nullptr, countFree));
+      }
+    });
+    writer.join();
+    CHECK(freed == 0);
+    CHECK(domain.Pending() == 10);
+
+    stop = true;
+    reader.join();
+
+    // garbage of exited writer is released by other threads
+    domain.Synchronize();
+    CHECK(freed == 10);
+
+    // records of exited threads are reused
+    std::thread again([&domain]()
+    {
+      domain.Retire(value_t(nullptr, countFree));
+    });
+    again.join();
+  }
+  // domain releases everything on destruction
+  CHECK(freed == 11);
+  return 0;
+}
+
+int checkStress()
+{
+  using namespace bvl;
+
+  const int readers = 4;
+  const int writers = 2;
+  const int updates = 20000;
+  const std::size_t limit = 256;
+
+  ebr::domain_t domain(16, limit);
+  std::atomic<value_t*> shared(new value_t(new payload_t(0), payload_t::Release));
+  std::atomic<int> writersLeft(writers);
+  std::atomic<int> errors(0);
+  std::atomic<std::size_t> maxPending(0);
+
+  std::vector<std::thread> threads;
+  for (int r = 0; r < readers; ++r)
+  {
+    threads.emplace_back([&]()
+    {
+      while (writersLeft != 0)
+      {
+        auto guard = domain.Pin();
+        auto value = shared.load(std::memory_order_acquire);
+        auto payload = static_cast<const payload_t*>(value->As<value_t::pointer>());
+        if (payload->magic.load() != payload_t::alive)
+        {
+          ++errors;
+        }
+      }
+    });
+  }
+
+  for (int w = 0; w < writers; ++w)
+  {
+    threads.emplace_back([&, w]()
+    {
+      for (int i = 1; i <= updates; ++i)
+      {
+        auto fresh = new value_t(new payload_t(i * writers + w), payload_t::Release);
+        auto old = shared.exchange(fresh, std::memory_order_acq_rel);
+        domain.Retire(old);
+
+        auto pending = domain.Pending();
+        auto seen = maxPending.load();
+        while ((pending > seen) && !maxPending.compare_exchange_weak(seen, pending))
+        {
+          ;
+        }
+      }
+      --writersLeft;
+    });
+  }
+
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+
+  CHECK(errors == 0);
+  // every writer holds at most limit retired values, readers hold none
+  CHECK(maxPending <= limit * writers);
+
+  domain.Synchronize();
+  delete shared.load();
+  CHECK(domain.Pending() == 0);
+  return 0;
+}
+
+int main()
+{
+  if (checkGracePeriod() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkOrphans() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkStress() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "epoch reclamation: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
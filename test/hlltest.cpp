@@ -0,0 +1,200 @@
+#include <badval_hll.hpp>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Distinct value number i, strings and numbers.
+   */
+  value_t Value(std::size_t i)
+  {
+    if (i % 2 == 0)
+    {
+      return value_t(static_cast<double>(i));
+    }
+    return value_t("user-" + std::to_string(i));
+  }
+
+} // namespace
+
+int checkAccuracy()
+{
+  using namespace bvl::hll;
+
+  for (const std::size_t count: { 10, 1000, 20000, 200000 })
+  {
+    sketch_t sketch(14);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      sketch.Add(Value(i));
+      // repeats change nothing
+      sketch.Add(Value(i / 2));
+    }
+    CHECK(sketch.Sparse() == (count <= 1000));
+    const auto error = std::fabs(sketch.Estimate() - static_cast<double>(count)) / static_cast<double>(count);
+    CHECK(error < 4 * sketch.StandardError());
+    if (sketch.Sparse())
+    {
+      CHECK(std::fabs(sketch.Estimate() - static_cast<double>(count)) < 1.0);
+    }
+  }
+
+  sketch_t empty(10);
+  CHECK(empty.Estimate() == 0.0);
+  bool thrown = false;
+  try
+  {
+    sketch_t wrong(30);
+  }
+  catch (const std::invalid_argument&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkMerge()
+{
+  using namespace bvl::hll;
+
+  // whole stream and its parts merged give same registers
+  const std::size_t count = 100000;
+  sketch_t whole(12);
+  std::vector<sketch_t> parts(4, sketch_t(12));
+  std::mt19937 rng(2);
+  std::unordered_set<std::size_t> distinct;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const auto key = rng() % 50000;
+    distinct.insert(key);
+    const auto value = Value(key);
+    whole.Add(value);
+    // one part stays sparse
+    parts[(i < 100)? 3: i % 3].Add(value);
+  }
+  CHECK(parts[3].Sparse() && !parts[0].Sparse());
+
+  sketch_t merged(12);
+  for (const auto& part: parts)
+  {
+    merged.Merge(part);
+  }
+  CHECK(merged.Estimate() == whole.Estimate());
+  const auto exact = static_cast<double>(distinct.size());
+  CHECK(std::fabs(merged.Estimate() - exact) / exact < 4 * merged.StandardError());
+
+  sketch_t sparse(12);
+  sparse.Merge(parts[3]);
+  CHECK(sparse.Sparse() && (sparse.Estimate() == parts[3].Estimate()));
+
+  // merge with itself changes nothing
+  for (auto* sketch: { &sparse, &merged })
+  {
+    const auto before = sketch->Estimate();
+    sketch->Add(Value(count));
+    const auto added = sketch->Estimate();
+    sketch->Merge(*sketch);
+    CHECK((sketch->Estimate() == added) && (added >= before));
+  }
+  CHECK(sparse.Sparse());
+
+  bool thrown = false;
+  try
+  {
+    merged.Merge(sketch_t(13));
+  }
+  catch (const std::invalid_argument&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  // serialized sketches merge on other side
+  for (const auto* sketch: { &parts[3], &merged })
+  {
+    std::string out;
+    sketch->Serialize(out);
+    const char* cursor = out.data();
+    const auto copy = sketch_t::Deserialize(cursor, out.data() + out.size());
+    CHECK(cursor == out.data() + out.size());
+    CHECK((copy.Sparse() == sketch->Sparse()) && (copy.Estimate() == sketch->Estimate()));
+    if (sketch->Sparse())
+    {
+      CHECK(out.size() < 4096 / 4);
+    }
+  }
+  std::string truncated;
+  merged.Serialize(truncated);
+  truncated.resize(truncated.size() / 2);
+  thrown = false;
+  try
+  {
+    const char* cursor = truncated.data();
+    sketch_t::Deserialize(cursor, truncated.data() + truncated.size());
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkKernels()
+{
+  using namespace bvl::hll::detail;
+
+  std::mt19937 rng(4);
+  std::vector<std::uint8_t> lhs(4096);
+  std::vector<std::uint8_t> rhs(4096);
+  for (std::size_t i = 0; i < lhs.size(); ++i)
+  {
+    lhs[i] = static_cast<std::uint8_t>((i % 9 == 0)? 0: rng() % 40);
+    rhs[i] = static_cast<std::uint8_t>(rng() % 40);
+  }
+  std::size_t scalarZeros;
+  std::size_t zeros;
+  const auto scalar = SumScalar(lhs.data(), lhs.size(), scalarZeros);
+  const auto sum = Sum(lhs.data(), lhs.size(), zeros);
+  CHECK(zeros == scalarZeros);
+  CHECK(std::fabs(sum - scalar) < 1e-6 * scalar);
+
+  auto expected = lhs;
+  MaxScalar(expected.data(), rhs.data(), expected.size());
+  Max(lhs.data(), rhs.data(), lhs.size());
+  CHECK(lhs == expected);
+  return 0;
+}
+
+int main()
+{
+  if (checkAccuracy() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkMerge() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkKernels() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "hll: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
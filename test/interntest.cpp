@@ -0,0 +1,261 @@
+#include <badval_intern.hpp>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+  using bvl::intern::factory_t;
+  using bvl::intern::handle_t;
+
+  /**
+   * Record with shared nested parts.
+   */
+  node_t Record(int id, bool reversed)
+  {
+    auto address = node_t::Object();
+    if (reversed)
+    {
+      address.Set("zip", value_t(static_cast<double>(id % 3)));
+      address.Set("city", value_t("city" + std::to_string(id % 2)));
+    }
+    else
+    {
+      address.Set("city", value_t("city" + std::to_string(id % 2)));
+      address.Set("zip", value_t(static_cast<double>(id % 3)));
+    }
+    auto tags = node_t::Array();
+    tags.Push(value_t("tag"));
+    tags.Push(value_t(static_cast<double>(id % 4)));
+    auto result = node_t::Object();
+    result.Set("address", std::move(address));
+    result.Set("tags", std::move(tags));
+    return result;
+  }
+
+  int checkLeaves()
+  {
+    factory_t factory;
+    auto a = factory.Leaf(value_t("hello"));
+    auto b = factory.Leaf(value_t(std::string("hel") + "lo"));
+    CHECK(a == b);
+    CHECK(a->Value().As<value_t::string>() == "hello");
+    CHECK(factory.Leaf(value_t(1.0)) != factory.Leaf(value_t("1")));
+    CHECK(factory.Leaf(value_t(0.0)) != factory.Leaf(value_t(-0.0)));
+
+    const auto nan = std::numeric_limits<double>::quiet_NaN();
+    auto n1 = factory.Leaf(value_t(nan));
+    auto n2 = factory.Leaf(value_t(nan));
+    CHECK(n1 == n2);
+    CHECK(a->Hash() == node_t(value_t("hello")).Hash());
+
+    int dummy = 0;
+    try
+    {
+      factory.Leaf(value_t(&dummy, nullptr));
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+    return 0;
+  }
+
+  int checkDocuments()
+  {
+    factory_t factory;
+    std::vector<handle_t> records;
+    for (int i = 0; i < 24; ++i)
+    {
+      records.push_back(factory.Intern(Record(i, i % 2 == 1)));
+    }
+    for (int i = 0; i < 24; ++i)
+    {
+      const auto doc = Record(i, false);
+      CHECK(records[i]->Hash() == doc.Hash());
+      CHECK(records[i]->Node() == doc);
+      // records repeat with period 12, member order does not matter
+      CHECK((records[i] == records[i % 12]));
+      CHECK((records[i] == factory.Intern(doc)));
+      CHECK((records[i] != records[(i + 1) % 24]));
+    }
+
+    // shared subterms are one instance
+    const auto* first = records[0]->Find("address");
+    const auto* second = records[6]->Find("address");
+    CHECK(first != nullptr);
+    CHECK(first == second);
+    CHECK(first->Key(0) == "city");
+    CHECK(first->Key(1) == "zip");
+    CHECK(records[0]->Find("missing") == nullptr);
+    CHECK(records[0]->Find("tags")->At(0) == records[1]->Find("tags")->At(0));
+
+    // 12 records, 6 addresses, 4 tag arrays, 2 cities, numbers 0-3, "tag" and 4 keys
+    CHECK(factory.Size() == 12 + 6 + 4 + 2 + 4 + 1 + 4);
+
+    try
+    {
+      factory.Object({ { "a", factory.Leaf(value_t(1.0)) }, { "a", factory.Leaf(value_t(2.0)) } });
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+    factory_t other;
+    try
+    {
+      factory.Array({ other.Leaf(value_t(1.0)) });
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+    try
+    {
+      factory.Array({ handle_t() });
+      return -1;
+    }
+    catch (const std::invalid_argument&)
+    {
+      ;
+    }
+    return 0;
+  }
+
+  int checkWeak()
+  {
+    handle_t survivor;
+    {
+      factory_t factory;
+      {
+        auto record = factory.Intern(Record(1, false));
+        CHECK(factory.Size() != 0);
+      }
+      CHECK(factory.Size() == 0);
+
+      const auto misses = factory.Misses();
+      survivor = factory.Intern(Record(1, false));
+      CHECK(factory.Misses() > misses);
+      const auto size = factory.Size();
+      auto again = factory.Intern(Record(1, true));
+      CHECK(again == survivor);
+      CHECK(factory.Size() == size);
+      CHECK(factory.Hits() != 0);
+    }
+    // terms outlive factory
+    CHECK(survivor->Find("tags")->Size() == 2);
+    return 0;
+  }
+
+  int checkThreads()
+  {
+    factory_t factory(4);
+    const int threadCount = 4;
+    std::vector<std::vector<handle_t>> results(threadCount);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+      threads.emplace_back([&factory, &results, t]()
+      {
+        for (int round = 0; round < 200; ++round)
+        {
+          // transient terms die and get recreated while other threads look them up
+          factory.Intern(Record(round % 16 + 100, round % 2 == 0));
+          results[t].push_back(factory.Intern(Record(round % 16, (round + t) % 2 == 0)));
+        }
+      });
+    }
+    for (auto& thread: threads)
+    {
+      thread.join();
+    }
+    for (int t = 0; t < threadCount; ++t)
+    {
+      for (std::size_t i = 0; i < results[t].size(); ++i)
+      {
+        CHECK(results[t][i] == results[0][i]);
+      }
+    }
+    results.clear();
+    CHECK(factory.Size() == 0);
+    return 0;
+  }
+
+  int checkCollisions()
+  {
+    // 0.0 and -0.0 have equal hashes but are different terms, so lookups
+    // of one find entries of other, which may be dropped concurrently
+    factory_t factory(1);
+    const auto zero = factory.Array({ factory.Leaf(value_t(0.0)) });
+    std::vector<std::thread> threads;
+    std::vector<int> errors(3, 0);
+    for (int t = 0; t < 3; ++t)
+    {
+      threads.emplace_back([&factory, &zero, &errors, t]()
+      {
+        for (int round = 0; round < 300000; ++round)
+        {
+          if (t == 0)
+          {
+            errors[t] += (factory.Array({ factory.Leaf(value_t(0.0)) }) != zero)? 1: 0;
+          }
+          else
+          {
+            auto negative = factory.Array({ factory.Leaf(value_t(-0.0)) });
+            errors[t] += (negative == zero)? 1: 0;
+          }
+        }
+      });
+    }
+    for (auto& thread: threads)
+    {
+      thread.join();
+    }
+    CHECK(errors[0] + errors[1] + errors[2] == 0);
+    CHECK(factory.Size() == 2);
+    return 0;
+  }
+
+} // namespace
+
+int main()
+{
+  if (checkLeaves() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkDocuments() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkWeak() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkThreads() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCollisions() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "intern: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+#include <badval_inverted.hpp>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  const char* const words[] = {
+    "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta",
+    "iota", "kappa", "lambda", "mu", "nu", "xi", "omicron", "pi"
+  };
+
+  /**
+   * Text of random words, first words are much more frequent.
+   */
+  std::string RandomText(std::mt19937& rng)
+  {
+    std::string text;
+    const auto count = rng() % 6;
+    for (unsigned i = 0; i < count; ++i)
+    {
+      const auto word = std::min(rng() % 16, rng() % 16);
+      text += (rng() % 2 == 0)? words[word]: std::string(words[word]) + ", ";
+      text += ' ';
+    }
+    return text;
+  }
+
+  std::vector<std::uint32_t> Expected(const std::vector<std::set<std::string>>& docs,
+    const std::vector<std::string>& terms, bvl::inverted::match_t match)
+  {
+    std::vector<std::uint32_t> result;
+    for (std::size_t doc = 0; doc < docs.size(); ++doc)
+    {
+      std::size_t found = 0;
+      for (const auto& term: terms)
+      {
+        found += docs[doc].count(term);
+      }
+      if ((match == bvl::inverted::all)? (found == terms.size()): (found != 0))
+      {
+        result.push_back(static_cast<std::uint32_t>(doc));
+      }
+    }
+    return result;
+  }
+
+} // namespace
+
+int checkTokenize()
+{
+  using namespace bvl::inverted;
+
+  std::vector<std::string> tokens;
+  Tokenize("Hello, World! 42x  \xD0\xBF\xD1\x80\xD0\xB8-ok", [&tokens](const std::string& token)
+  {
+    tokens.push_back(token);
+  });
+  CHECK((tokens == std::vector<std::string>{ "hello", "world", "42x", "\xD0\xBF\xD1\x80\xD0\xB8", "ok" }));
+  CHECK(Normalize("  MiXeD ") == "mixed");
+  CHECK(Normalize("two words").empty());
+  return 0;
+}
+
+int checkCodec()
+{
+  using namespace bvl::inverted;
+
+  std::mt19937 rng(5);
+  for (unsigned width = 0; width <= 32; ++width)
+  {
+    // differences below 2^width, one of them largest possible
+    const auto mask = (width == 32)? ~0u: ((1u << width) - 1);
+    const std::uint32_t base = rng() % 1000;
+    std::uint32_t docs[blockSize];
+    for (std::size_t i = 0; i < blockSize; ++i)
+    {
+      const auto delta = (i == 77)? mask: static_cast<std::uint32_t>(rng()) & mask;
+      docs[i] = ((i < 4)? base: docs[i - 4]) + delta;
+    }
+
+    std::string data;
+    CHECK(bvl::inverted::detail::Pack(docs, base, data) == width);
+    CHECK(data.size() == 16 * width);
+
+    std::uint32_t scalar[blockSize];
+    std::uint32_t fast[blockSize];
+    bvl::inverted::detail::UnpackScalar(data.data(), width, base, scalar);
+    bvl::inverted::detail::Unpack(data.data(), width, base, fast);
+    CHECK(std::equal(docs, docs + blockSize, scalar));
+    CHECK(std::equal(docs, docs + blockSize, fast));
+  }
+  return 0;
+}
+
+int checkSearch()
+{
+  using bvl::value_t;
+  using namespace bvl::inverted;
+
+  options_t options;
+  options.segmentDocuments = 500;
+  options.mergeFactor = 3;
+  index_t index(options);
+
+  std::mt19937 rng(11);
+  std::vector<std::set<std::string>> docs;
+  auto check = [&]() -> int
+  {
+    for (int i = 0; i < 200; ++i)
+    {
+      std::vector<std::string> terms;
+      const auto count = 1 + rng() % 3;
+      for (unsigned j = 0; j < count; ++j)
+      {
+        terms.push_back(words[rng() % 16]);
+      }
+      if (i == 0)
+      {
+        terms.push_back("missing");
+      }
+      CHECK(index.And(terms) == Expected(docs, terms, all));
+      CHECK(index.Or(terms) == Expected(docs, terms, any));
+    }
+    return 0;
+  };
+
+  for (int i = 0; i < 20000; ++i)
+  {
+    std::set<std::string> tokens;
+    if (i % 10 == 0)
+    {
+      CHECK(index.Add(value_t(static_cast<double>(i))) == static_cast<std::uint32_t>(i));
+    }
+    else
+    {
+      const auto text = RandomText(rng);
+      Tokenize(text, [&tokens](const std::string& token)
+      {
+        tokens.insert(token);
+      });
+      CHECK(index.Add(value_t(text)) == static_cast<std::uint32_t>(i));
+    }
+    docs.push_back(tokens);
+    if (i == 777)
+    {
+      // part of documents not sealed yet
+      CHECK(check() == 0);
+    }
+  }
+  CHECK(index.Documents() == 20000);
+  CHECK(index.Segments() < 10);
+  CHECK(check() == 0);
+
+  CHECK(index.And({ "ALPHA" }) == Expected(docs, { "alpha" }, all));
+  CHECK(index.And({}).empty());
+
+  index.Optimize();
+  CHECK(index.Segments() == 1);
+  CHECK(check() == 0);
+  return 0;
+}
+
+int main()
+{
+  if (checkTokenize() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCodec() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkSearch() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "inverted: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+#include <badval_join.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Key drawn from small universe of numbers and strings.
+   */
+  value_t Key(std::mt19937& rng, std::size_t universe)
+  {
+    const auto key = rng() % universe;
+    if (key % 3 == 0)
+    {
+      return value_t("key-" + std::to_string(key));
+    }
+    return value_t(static_cast<double>(key));
+  }
+
+  /**
+   * Pairs found with standard multimap, sorted.
+   */
+  std::vector<std::pair<std::size_t, std::size_t>> Expected(const std::vector<value_t>& build, const std::vector<value_t>& probe)
+  {
+    std::unordered_multimap<value_t, std::size_t> rows;
+    for (std::size_t i = 0; i < build.size(); ++i)
+    {
+      rows.emplace(build[i], i);
+    }
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    for (std::size_t i = 0; i < probe.size(); ++i)
+    {
+      const auto range = rows.equal_range(probe[i]);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        result.emplace_back(it->second, i);
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  std::vector<std::pair<std::size_t, std::size_t>> Sorted(const std::vector<bvl::join::pair_t>& pairs)
+  {
+    std::vector<std::pair<std::size_t, std::size_t>> result;
+    for (const auto& item: pairs)
+    {
+      result.emplace_back(item.build, item.probe);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+} // namespace
+
+int checkJoin()
+{
+  using namespace bvl::join;
+
+  std::mt19937 rng(1);
+  std::vector<value_t> build;
+  std::vector<value_t> probe;
+  for (int i = 0; i < 20000; ++i)
+  {
+    build.push_back(Key(rng, 15000));
+  }
+  for (int i = 0; i < 100000; ++i)
+  {
+    probe.push_back(Key(rng, 30000));
+  }
+  // NaN never matches, zero matches negative zero
+  build.emplace_back(std::nan(""));
+  probe.emplace_back(std::nan(""));
+  build.emplace_back(-0.0);
+  const auto expected = Expected(build, probe);
+  CHECK(!expected.empty());
+
+  options_t plain;
+  plain.threads = 1;
+  options_t radix;
+  radix.threads = 4;
+  radix.radixThreshold = 1000;
+  options_t wide = radix;
+  wide.radixBits = 9;
+  for (const auto& options: { plain, radix, wide })
+  {
+    const auto pairs = Join(build, probe, options);
+    CHECK(Sorted(pairs) == expected);
+    for (const auto& item: pairs)
+    {
+      CHECK(build[item.build] == probe[item.probe]);
+    }
+  }
+
+  // probe rows of one partition keep their order
+  const auto pairs = Join(build, probe, plain);
+  for (std::size_t i = 1; i < pairs.size(); ++i)
+  {
+    CHECK(pairs[i - 1].probe <= pairs[i].probe);
+  }
+
+  CHECK(Join(std::vector<value_t>(), probe).empty());
+  CHECK(Join(build, std::vector<value_t>(), radix).empty());
+  return 0;
+}
+
+int checkTypes()
+{
+  using namespace bvl::join;
+
+  std::vector<value_t> build;
+  build.emplace_back(1.0);
+  build.emplace_back("1");
+  build.emplace_back("1");
+  build.emplace_back(nullptr, nullptr);
+  std::vector<value_t> probe;
+  probe.emplace_back("1");
+  probe.emplace_back(2.0);
+  probe.emplace_back(1.0);
+  probe.emplace_back(nullptr, nullptr);
+
+  const auto pairs = Sorted(Join(build, probe));
+  const std::vector<std::pair<std::size_t, std::size_t>> expected = { { 0, 2 }, { 1, 0 }, { 2, 0 }, { 3, 3 } };
+  CHECK(pairs == expected);
+  return 0;
+}
+
+int checkFailure()
+{
+  // exception of any worker reaches caller after all workers stop
+  for (const std::size_t failed: { std::size_t(0), std::size_t(37), std::size_t(999) })
+  {
+    std::atomic<std::size_t> done(0);
+    bool thrown = false;
+    try
+    {
+      bvl::join::detail::Parallel(4, 1000, [&done, failed](std::size_t task, std::size_t)
+      {
+        if (task == failed)
+        {
+          throw std::length_error("join partition too large");
+        }
+        ++done;
+      });
+    }
+    catch (const std::length_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(done < 1000);
+  }
+  return 0;
+}
+
+int main()
+{
+  if (checkJoin() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkTypes() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkFailure() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "join: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
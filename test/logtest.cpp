@@ -0,0 +1,223 @@
+#include <badval_log.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  std::string Format(const bvl::value_t& value)
+  {
+    char data[128];
+    bvl::logging::buffer_t buffer(data, sizeof(data));
+    buffer.Value(value);
+    return std::string(buffer.Data(), buffer.Size());
+  }
+
+} // namespace
+
+int checkNumbers()
+{
+  using bvl::value_t;
+
+  CHECK(Format(value_t(0.0)) == "0");
+  CHECK(Format(value_t(-0.0)) == "-0");
+  CHECK(Format(value_t(10.0)) == "10");
+  CHECK(Format(value_t(-123456789.0)) == "-123456789");
+  CHECK(Format(value_t(0.1)) == "0.1");
+  CHECK(Format(value_t(1.25)) == "1.25");
+  CHECK(Format(value_t(-0.001)) == "-0.001");
+  CHECK(Format(value_t(1e300)) == "1e+300");
+  CHECK(Format(value_t(std::nan(""))) == "\"nan\"");
+  CHECK(Format(value_t(-HUGE_VAL)) == "\"-inf\"");
+
+  // every number reads back exactly
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> uniform(-1e6, 1e6);
+  for (int i = 0; i < 100000; ++i)
+  {
+    double num = uniform(rng);
+    if (i % 3 == 0)
+    {
+      num = std::round(num * 100.0) / 100.0;
+    }
+    else if (i % 3 == 1)
+    {
+      num = std::ldexp(num, static_cast<int>(rng() % 400) - 200);
+    }
+    auto text = Format(value_t(num));
+    CHECK(std::strtod(text.c_str(), nullptr) == num);
+  }
+
+  // short decimals stay short
+  CHECK(Format(value_t(std::round(123.456 * 100.0) / 100.0)) == "123.46");
+  return 0;
+}
+
+int checkStrings()
+{
+  using bvl::value_t;
+
+  CHECK(Format(value_t("plain")) == "\"plain\"");
+  CHECK(Format(value_t("q\"b\\n\nt\t")) == "\"q\\\"b\\\\n\\nt\\t\"");
+  CHECK(Format(value_t(std::string("\x01", 1))) == "\"\\u0001\"");
+  CHECK(Format(value_t(reinterpret_cast<void*>(0x1f), nullptr)) == "\"0x1f\"");
+
+  // string is cut, but stays closed
+  char data[8];
+  bvl::logging::buffer_t buffer(data, sizeof(data));
+  CHECK(!buffer.Value(value_t("long string")));
+  CHECK(std::string(buffer.Data(), buffer.Size()) == "\"long s\"");
+  CHECK(buffer.Truncated());
+  return 0;
+}
+
+int checkRecords()
+{
+  using bvl::value_t;
+  using namespace bvl::logging;
+
+  char data[sink_t::recordSize];
+  buffer_t buffer(data, sizeof(data));
+  value_t path("/index");
+  value_t ms(1.5);
+  FormatRecord(buffer, info, "request", { { "path", path }, { "ms", ms } });
+
+  std::string line(buffer.Data(), buffer.Size());
+  CHECK(line.compare(0, 6, "{\"ts\":") == 0);
+  CHECK(line.find(",\"level\":\"info\",\"msg\":\"request\",\"path\":\"/index\",\"ms\":1.5}\n") != std::string::npos);
+
+  // fields which do not fit are dropped, record stays valid
+  buffer.Clear();
+  value_t huge(std::string(1000, 'x'));
+  FormatRecord(buffer, error, "huge", { { "ms", ms }, { "huge", huge }, { "after", ms } });
+  line.assign(buffer.Data(), buffer.Size());
+  CHECK(line.size() <= sink_t::recordSize);
+  CHECK(line.find("\"ms\":1.5,\"huge\":\"xxx") != std::string::npos);
+  CHECK(line.find("after") == std::string::npos);
+  CHECK(line.compare(line.size() - 20, 20, "\",\"truncated\":true}\n") == 0);
+  return 0;
+}
+
+int checkSink()
+{
+  using bvl::value_t;
+  using namespace bvl::logging;
+
+  std::mutex mutex;
+  std::string output;
+  const int threads = 4;
+  const int records = 5000;
+
+  {
+    sink_t sink(
+      [&](const char* data, std::size_t size)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        output.append(data, size);
+      },
+      64
+    );
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&sink, t]()
+      {
+        value_t thread(static_cast<double>(t));
+        for (int i = 0; i < records; ++i)
+        {
+          value_t index(static_cast<double>(i));
+          sink.Log(debug, "tick", { { "thread", thread }, { "i", index } });
+        }
+      });
+    }
+    for (auto& worker: workers)
+    {
+      worker.join();
+    }
+
+    sink.Flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      CHECK(std::count(output.begin(), output.end(), '\n') == threads * records);
+    }
+    CHECK(sink.Dropped() == 0);
+
+    sink.Log(warning, "last");
+  }
+
+  // destructor writes everything left
+  CHECK(std::count(output.begin(), output.end(), '\n') == threads * records + 1);
+
+  // records of every thread keep their order
+  for (int t = 0; t < threads; ++t)
+  {
+    auto marker = "\"thread\":" + std::to_string(t) + ",\"i\":";
+    int expected = 0;
+    for (auto pos = output.find(marker); pos != std::string::npos; pos = output.find(marker, pos + 1))
+    {
+      CHECK(std::atoi(output.c_str() + pos + marker.size()) == expected);
+      ++expected;
+    }
+    CHECK(expected == records);
+  }
+
+  // drop policy never waits for writer
+  {
+    std::atomic<bool> release(false);
+    sink_t sink(
+      [&release](const char*, std::size_t)
+      {
+        while (!release)
+        {
+          std::this_thread::yield();
+        }
+      },
+      4,
+      sink_t::drop
+    );
+    int accepted = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+      accepted += sink.Log(info, "flood")? 1: 0;
+    }
+    release = true;
+    CHECK(accepted < 100);
+    CHECK(sink.Dropped() == static_cast<std::uint64_t>(100 - accepted));
+  }
+  return 0;
+}
+
+int main()
+{
+  if (checkNumbers() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkStrings() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkRecords() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkSink() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "logging: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,269 @@
+#include <badval_lsm.hpp>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  const char path[] = "lsmtest.db";
+
+  std::string Key(int i)
+  {
+    char key[32];
+    std::snprintf(key, sizeof(key), "key%08d", i);
+    return key;
+  }
+
+  /**
+   * Small limits, so few thousand keys reach deeper levels.
+   */
+  bvl::lsm::options_t SmallOptions()
+  {
+    bvl::lsm::options_t options;
+    options.memtableSize = 16 * 1024;
+    options.l0CompactionTrigger = 2;
+    options.levelBaseSize = 32 * 1024;
+    options.levelMultiplier = 4;
+    options.targetFileSize = 8 * 1024;
+    options.levels = 4;
+    options.table.blockSize = 512;
+    return options;
+  }
+
+  bool Same(const bvl::lsm::store_t& store, const std::map<std::string, bvl::value_t>& expected, const std::string& from, const std::string& to)
+  {
+    auto it = expected.lower_bound(from);
+    auto end = to.empty()? expected.end(): expected.lower_bound(to);
+    bool same = true;
+    store.Scan(from, to, [&](const std::string& key, const bvl::value_t& value)
+    {
+      same = same && (it != end) && (it->first == key) && (it->second == value);
+      if (it != end)
+      {
+        ++it;
+      }
+      return same;
+    });
+    return same && (it == end);
+  }
+
+} // namespace
+
+int checkMemtable()
+{
+  using bvl::value_t;
+
+  bvl::lsm::memtable_t table;
+  table.Add(1, "b", nullptr);
+  value_t one(1.0);
+  value_t two(2.0);
+  table.Add(2, "a", &one);
+  table.Add(3, "b", &two);
+  table.Add(4, "c", &one);
+  table.Add(5, "a", nullptr);
+
+  const value_t* found;
+  CHECK(table.Get("a", found) && (found == nullptr));
+  CHECK(table.Get("b", found) && (found != nullptr) && (*found == two));
+  CHECK(!table.Get("d", found));
+  CHECK(table.Count() == 5);
+
+  // newest version of key goes first
+  std::string order;
+  for (auto it = table.Begin(); it.Valid(); it.Next())
+  {
+    order += it.Key() + std::to_string(it.Sequence());
+  }
+  CHECK(order == "a5a2b3b1c4");
+
+  value_t pointer(&table, nullptr);
+  bool thrown = false;
+  try
+  {
+    table.Add(6, "p", &pointer);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown && !table.Get("p", found));
+  return 0;
+}
+
+int checkStore()
+{
+  using bvl::value_t;
+
+  bvl::lsm::Destroy(path);
+  std::map<std::string, value_t> expected;
+  std::mt19937 rng(7);
+  const int keys = 3000;
+
+  {
+    bvl::lsm::store_t store(path, SmallOptions());
+    for (int i = 0; i < 30000; ++i)
+    {
+      const auto key = Key(static_cast<int>(rng() % keys));
+      if (i % 7 == 0)
+      {
+        store.Erase(key);
+        expected.erase(key);
+      }
+      else
+      {
+        value_t value = (i % 2 == 0)? value_t(static_cast<double>(i)): value_t("value " + std::to_string(i));
+        store.Put(key, value);
+        expected[key] = value;
+      }
+    }
+    CHECK(Same(store, expected, "", ""));
+
+    store.WaitForCompaction();
+    const auto stats = store.Stats();
+    CHECK(stats.flushes > 0);
+    CHECK(stats.compactions > 0);
+    CHECK(stats.files[1] + stats.files[2] + stats.files[3] > 0);
+
+    value_t out;
+    for (int i = 0; i < keys; ++i)
+    {
+      const auto key = Key(i);
+      auto it = expected.find(key);
+      const bool found = store.Get(key, out);
+      CHECK(found == (it != expected.end()));
+      CHECK(!found || (out == it->second));
+    }
+    CHECK(Same(store, expected, Key(100), Key(200)));
+    CHECK(Same(store, expected, Key(keys - 10), ""));
+    CHECK(Same(store, expected, "zzz", ""));
+
+    // scan stops when visitor asks
+    int visited = 0;
+    store.Scan("", "", [&visited](const std::string&, const value_t&)
+    {
+      return ++visited < 5;
+    });
+    CHECK(visited == 5);
+
+    bool thrown = false;
+    try
+    {
+      store.Put("pointer", value_t(&store, nullptr));
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+
+    // stays in memtable until destructor
+    store.Put("last", value_t(1.0));
+    expected["last"] = value_t(1.0);
+  }
+
+  // everything is back after reopen
+  {
+    bvl::lsm::store_t store(path, SmallOptions());
+    CHECK(Same(store, expected, "", ""));
+    value_t out;
+    CHECK(store.Get("last", out) && (out == value_t(1.0)));
+  }
+  bvl::lsm::Destroy(path);
+  return 0;
+}
+
+int checkConcurrent()
+{
+  using bvl::value_t;
+
+  bvl::lsm::Destroy(path);
+  const int writers = 4;
+  const int keys = 5000;
+  std::atomic<bool> done(false);
+  std::atomic<int> wrong(0);
+
+  {
+    bvl::lsm::store_t store(path, SmallOptions());
+
+    // value of key is always its index
+    std::thread reader([&]()
+    {
+      std::mt19937 rng(1);
+      value_t out;
+      while (!done)
+      {
+        const int i = static_cast<int>(rng() % (writers * keys));
+        if (store.Get(Key(i), out) && (out.As<value_t::number>() != i))
+        {
+          ++wrong;
+        }
+      }
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < writers; ++t)
+    {
+      threads.emplace_back([&store, t]()
+      {
+        for (int i = t * keys; i < (t + 1) * keys; ++i)
+        {
+          store.Put(Key(i), value_t(static_cast<double>(i)));
+        }
+      });
+    }
+    for (auto& thread: threads)
+    {
+      thread.join();
+    }
+    done = true;
+    reader.join();
+    CHECK(wrong == 0);
+
+    int count = 0;
+    int previous = -1;
+    store.Scan("", "", [&](const std::string& key, const value_t& value)
+    {
+      const int i = static_cast<int>(value.As<value_t::number>());
+      if ((key != Key(i)) || (i <= previous))
+      {
+        return false;
+      }
+      previous = i;
+      ++count;
+      return true;
+    });
+    CHECK(count == writers * keys);
+  }
+  bvl::lsm::Destroy(path);
+  return 0;
+}
+
+int main()
+{
+  if (checkMemtable() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkStore() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConcurrent() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "lsm: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
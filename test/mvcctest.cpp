@@ -0,0 +1,284 @@
+#include <badval_mvcc.hpp>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  bvl::mvcc::options_t Manual()
+  {
+    bvl::mvcc::options_t options;
+    options.gcInterval = std::chrono::milliseconds(0);
+    return options;
+  }
+
+  double Number(const bvl::mvcc::snapshot_t& snapshot, const std::string& key)
+  {
+    bvl::value_t out;
+    return snapshot.Get(key, out)? out.As<bvl::value_t::number>(): -1.0;
+  }
+
+} // namespace
+
+int checkSnapshots()
+{
+  using bvl::value_t;
+  using namespace bvl::mvcc;
+
+  table_t table(Manual());
+  auto before = table.Snapshot();
+
+  auto txn = table.Begin();
+  txn.Put("a", value_t(1.0));
+  txn.Put("b", value_t("text"));
+  value_t out;
+  CHECK(txn.Get("a", out) && (out == value_t(1.0)));
+  CHECK(txn.Commit());
+  CHECK(table.Clock() == 2);
+
+  auto after = table.Snapshot();
+  CHECK(Number(before, "a") < 0);
+  CHECK(Number(after, "a") == 1.0);
+  CHECK(after.Get("b", out) && (out == value_t("text")));
+
+  auto erase = table.Begin();
+  erase.Erase("a");
+  CHECK(!erase.Get("a", out));
+  CHECK(erase.Commit());
+  CHECK(Number(after, "a") == 1.0);
+  CHECK(Number(table.Snapshot(), "a") < 0);
+
+  // finished transaction can't be used
+  bool thrown = false;
+  try
+  {
+    erase.Put("a", value_t(2.0));
+  }
+  catch (const std::logic_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkConflicts()
+{
+  using bvl::value_t;
+  using namespace bvl::mvcc;
+
+  table_t table(Manual());
+
+  // write-write: first committer wins
+  auto first = table.Begin();
+  auto second = table.Begin();
+  first.Put("x", value_t(1.0));
+  second.Put("x", value_t(2.0));
+  CHECK(first.Commit());
+  CHECK(!second.Commit());
+  CHECK(Number(table.Snapshot(), "x") == 1.0);
+
+  // read-write: value read is stale at commit
+  auto reader = table.Begin();
+  value_t out;
+  CHECK(reader.Get("x", out));
+  auto writer = table.Begin();
+  writer.Put("x", value_t(3.0));
+  CHECK(writer.Commit());
+  reader.Put("y", value_t(out.As<value_t::number>() + 1));
+  CHECK(!reader.Commit());
+  CHECK(Number(table.Snapshot(), "y") < 0);
+
+  // disjoint keys do not conflict
+  auto left = table.Begin();
+  auto right = table.Begin();
+  left.Put("l", value_t(1.0));
+  right.Put("r", value_t(1.0));
+  CHECK(left.Commit());
+  CHECK(right.Commit());
+
+  // read-only transaction always commits
+  auto readOnly = table.Begin();
+  CHECK(readOnly.Get("l", out));
+  CHECK(readOnly.Commit());
+  return 0;
+}
+
+int checkCollect()
+{
+  using bvl::value_t;
+  using namespace bvl::mvcc;
+
+  table_t table(Manual());
+  for (int i = 0; i < 100; ++i)
+  {
+    auto txn = table.Begin();
+    txn.Put("key", value_t(static_cast<double>(i)));
+    CHECK(txn.Commit());
+    if (i == 10)
+    {
+      // snapshot pins version 10
+      auto old = table.Snapshot();
+      for (int j = 11; j < 20; ++j)
+      {
+        auto inner = table.Begin();
+        inner.Put("key", value_t(static_cast<double>(j)));
+        CHECK(inner.Commit());
+      }
+      CHECK(table.Collect() == 10);
+      CHECK(Number(old, "key") == 10.0);
+      CHECK(Number(table.Snapshot(), "key") == 19.0);
+      i = 19;
+    }
+  }
+  CHECK(table.Versions() == 100 - 10);
+  CHECK(table.Collect() == 100 - 10 - 1);
+  CHECK(table.Versions() == 1);
+  CHECK(Number(table.Snapshot(), "key") == 99.0);
+
+  auto erase = table.Begin();
+  erase.Erase("key");
+  CHECK(erase.Commit());
+  CHECK(table.Size() == 1);
+  CHECK(table.Collect() == 2);
+  CHECK(table.Size() == 0);
+  CHECK(table.Versions() == 0);
+
+  // index grows while keys are added
+  auto txn = table.Begin();
+  for (int i = 0; i < 10000; ++i)
+  {
+    txn.Put(std::to_string(i), value_t(static_cast<double>(i)));
+  }
+  CHECK(txn.Commit());
+  auto snapshot = table.Snapshot();
+  for (int i = 0; i < 10000; ++i)
+  {
+    CHECK(Number(snapshot, std::to_string(i)) == i);
+  }
+  return 0;
+}
+
+int checkConcurrent()
+{
+  using bvl::value_t;
+  using namespace bvl::mvcc;
+
+  // money moves between accounts, total never changes
+  options_t options;
+  options.gcInterval = std::chrono::milliseconds(1);
+  table_t table(options);
+  const int accounts = 16;
+  const double total = accounts * 100.0;
+  {
+    auto txn = table.Begin();
+    for (int i = 0; i < accounts; ++i)
+    {
+      txn.Put(std::to_string(i), value_t(100.0));
+    }
+    CHECK(txn.Commit());
+  }
+
+  std::atomic<bool> done(false);
+  std::atomic<int> wrong(0);
+  std::atomic<int> committed(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t)
+  {
+    threads.emplace_back([&]()
+    {
+      while (!done)
+      {
+        auto snapshot = table.Snapshot();
+        double sum = 0.0;
+        for (int i = 0; i < accounts; ++i)
+        {
+          sum += Number(snapshot, std::to_string(i));
+        }
+        if (sum != total)
+        {
+          ++wrong;
+        }
+      }
+    });
+  }
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; ++t)
+  {
+    writers.emplace_back([&, t]()
+    {
+      std::mt19937 rng(t);
+      for (int i = 0; i < 2000; ++i)
+      {
+        const auto from = std::to_string(rng() % accounts);
+        const auto to = std::to_string(rng() % accounts);
+        auto txn = table.Begin();
+        value_t a;
+        value_t b;
+        txn.Get(from, a);
+        txn.Get(to, b);
+        if (from == to)
+        {
+          continue;
+        }
+        txn.Put(from, value_t(a.As<value_t::number>() - 1));
+        txn.Put(to, value_t(b.As<value_t::number>() + 1));
+        committed += txn.Commit()? 1: 0;
+      }
+    });
+  }
+  for (auto& writer: writers)
+  {
+    writer.join();
+  }
+  done = true;
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+  CHECK(wrong == 0);
+  CHECK(committed > 0);
+
+  auto snapshot = table.Snapshot();
+  double sum = 0.0;
+  for (int i = 0; i < accounts; ++i)
+  {
+    sum += Number(snapshot, std::to_string(i));
+  }
+  CHECK(sum == total);
+  table.Collect();
+  CHECK(table.Versions() == accounts);
+  return 0;
+}
+
+int main()
+{
+  if (checkSnapshots() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConflicts() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCollect() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkConcurrent() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "mvcc: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
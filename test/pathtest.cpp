@@ -0,0 +1,161 @@
+#include <badval_path.hpp>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  /**
+   * Document {"a": {"b": [{"c": i}, ..., {"c": i + 4}], "x.y": "dot"}}
+   */
+  node_t Document(int i)
+  {
+    auto items = node_t::Array();
+    for (int j = 0; j < 5; ++j)
+    {
+      auto item = node_t::Object();
+      item.Set("c", value_t(static_cast<double>(i + j)));
+      items.Push(std::move(item));
+    }
+    auto inner = node_t::Object();
+    inner.Set("b", std::move(items));
+    inner.Set("x.y", value_t("dot"));
+    auto result = node_t::Object();
+    result.Set("a", std::move(inner));
+    return result;
+  }
+
+  bool Malformed(const std::string& expression)
+  {
+    try
+    {
+      bvl::path::path_t path(expression);
+    }
+    catch (const std::invalid_argument&)
+    {
+      return true;
+    }
+    return false;
+  }
+
+} // namespace
+
+int checkPath()
+{
+  using namespace bvl::path;
+
+  const auto document = Document(10);
+  const path_t path("a.b[3].c");
+  CHECK(path.Steps().size() == 4);
+  CHECK(path.Steps()[0].member && (path.Steps()[0].hash == bvl::doc::KeyHash("a")));
+  CHECK(!path.Steps()[2].member && (path.Steps()[2].index == 3));
+  CHECK(path.Eval(document)->Value() == value_t(13.0));
+
+  CHECK(path_t("a.b[-1].c").Eval(document)->Value() == value_t(14.0));
+  CHECK(path_t("a[\"x.y\"]").Eval(document)->Value() == value_t("dot"));
+  CHECK(path_t("[\"a\"].b").Eval(document)->Size() == 5);
+  CHECK(path_t("").Eval(document) == &document);
+
+  // missing nodes
+  CHECK(path_t("a.b[5].c").Eval(document) == nullptr);
+  CHECK(path_t("a.b[-6]").Eval(document) == nullptr);
+  CHECK(path_t("a.b.c").Eval(document) == nullptr);
+  CHECK(path_t("a[0]").Eval(document) == nullptr);
+  CHECK(path_t("a.b[0].c.d").Eval(document) == nullptr);
+
+  CHECK(Malformed("a..b") && Malformed("a[") && Malformed("a[x]") && Malformed("a[1") && Malformed("a[\"b]"));
+  CHECK(Malformed("a b") && Malformed(".a") && Malformed("a[99999999999999999999]"));
+
+  // batch
+  std::vector<node_t> documents;
+  for (int i = 0; i < 10; ++i)
+  {
+    documents.push_back(Document(i));
+  }
+  documents.push_back(node_t::Array());
+  std::vector<const node_t*> found(documents.size());
+  CHECK(path.Eval(documents.data(), documents.size(), found.data()) == 10);
+  for (int i = 0; i < 10; ++i)
+  {
+    CHECK(found[i]->Value() == value_t(static_cast<double>(i + 3)));
+  }
+  CHECK(found.back() == nullptr);
+  return 0;
+}
+
+int checkCache()
+{
+  using namespace bvl::path;
+
+  cache_t cache(2);
+  const auto first = cache.Get("a.b");
+  CHECK(cache.Get("a.b") == first);
+  cache.Get("a.c");
+  cache.Get("a.b");
+  cache.Get("a.d");
+  // a.c was least recently used
+  CHECK(cache.Size() == 2);
+  CHECK(cache.Get("a.b") == first);
+  CHECK((cache.Hits() == 3) && (cache.Misses() == 3));
+  cache.Get("a.c");
+  CHECK(cache.Misses() == 4);
+
+  bool thrown = false;
+  try
+  {
+    cache.Get("a..b");
+  }
+  catch (const std::invalid_argument&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  cache_t shared;
+  const auto document = Document(0);
+  std::vector<std::thread> threads;
+  std::vector<int> bad(4, 0);
+  for (int t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&shared, &document, &bad, t]()
+    {
+      for (int i = 0; i < 1000; ++i)
+      {
+        const auto index = i % 5;
+        const auto node = shared.Get("a.b[" + std::to_string(index) + "].c")->Eval(document);
+        bad[t] += ((node == nullptr) || (node->Value() != value_t(static_cast<double>(index))))? 1: 0;
+      }
+    });
+  }
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+  CHECK((bad == std::vector<int>(4, 0)) && (shared.Size() == 5));
+  return 0;
+}
+
+int main()
+{
+  if (checkPath() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCache() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "path: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
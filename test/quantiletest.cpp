@@ -0,0 +1,158 @@
+#include <badval_quantile.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Exact rank of number in sorted numbers.
+   */
+  double ExactRank(const std::vector<double>& sorted, double number)
+  {
+    const auto it = std::upper_bound(sorted.begin(), sorted.end(), number);
+    return static_cast<double>(it - sorted.begin()) / static_cast<double>(sorted.size());
+  }
+
+} // namespace
+
+int checkSketch()
+{
+  using namespace bvl::quantile;
+
+  std::mt19937 rng(1);
+  std::lognormal_distribution<double> latency(3.0, 1.0);
+  std::vector<value_t> values;
+  std::vector<double> numbers;
+  for (int i = 0; i < 300000; ++i)
+  {
+    if (i % 10 == 0)
+    {
+      values.emplace_back("timeout");
+      continue;
+    }
+    numbers.push_back(latency(rng));
+    values.emplace_back(numbers.back());
+  }
+  values.emplace_back(std::nan(""));
+  std::sort(numbers.begin(), numbers.end());
+
+  sketch_t single;
+  for (const auto& value: values)
+  {
+    single.Add(value);
+  }
+  sketch_t batch;
+  CHECK(batch.Add(values.data(), values.size()) == numbers.size());
+
+  for (const auto* sketch: { &single, &batch })
+  {
+    CHECK(sketch->Count() == numbers.size());
+    CHECK(sketch->Skipped() == values.size() - numbers.size());
+    CHECK(sketch->Retained() < 2000);
+    CHECK((sketch->Min() == numbers.front()) && (sketch->Max() == numbers.back()));
+    const auto quantiles = sketch->Quantiles({ 0.0, 0.01, 0.5, 0.9, 0.99, 0.999, 1.0 });
+    CHECK((quantiles.front() == numbers.front()) && (quantiles.back() == numbers.back()));
+    const double fractions[] = { 0.0, 0.01, 0.5, 0.9, 0.99, 0.999, 1.0 };
+    for (std::size_t i = 1; i + 1 < quantiles.size(); ++i)
+    {
+      CHECK(std::fabs(ExactRank(numbers, quantiles[i]) - fractions[i]) < sketch->RankError());
+      CHECK(std::fabs(sketch->Rank(quantiles[i]) - ExactRank(numbers, quantiles[i])) < sketch->RankError());
+    }
+  }
+
+  sketch_t empty;
+  CHECK(std::isnan(empty.Quantile(0.5)) && (empty.Rank(1.0) == 0.0));
+
+  // small inputs are exact
+  sketch_t small;
+  for (int i = 1; i <= 100; ++i)
+  {
+    small.Add(static_cast<double>(i));
+  }
+  CHECK(small.Quantile(0.5) == 50.0);
+  CHECK(small.Rank(25.0) == 0.25);
+  return 0;
+}
+
+int checkMerge()
+{
+  using namespace bvl::quantile;
+
+  std::mt19937 rng(5);
+  std::vector<double> numbers;
+  std::vector<sketch_t> parts(8, sketch_t(100));
+  for (int i = 0; i < 200000; ++i)
+  {
+    // parts see different ranges
+    const auto part = static_cast<std::size_t>(i % 8);
+    numbers.push_back(static_cast<double>(rng() % 1000) + 1000.0 * static_cast<double>(part));
+    parts[part].Add(numbers.back());
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  sketch_t merged(100);
+  for (const auto& part: parts)
+  {
+    merged.Merge(part);
+  }
+  CHECK(merged.Count() == numbers.size());
+  for (const auto fraction: { 0.05, 0.3, 0.5, 0.77, 0.95 })
+  {
+    CHECK(std::fabs(ExactRank(numbers, merged.Quantile(fraction)) - fraction) < merged.RankError());
+  }
+
+  // threads ingest into shards
+  sharded_t sharded(4);
+  std::vector<value_t> values;
+  for (const auto number: numbers)
+  {
+    values.emplace_back(number);
+  }
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < 4; ++t)
+  {
+    threads.emplace_back([&sharded, &values, t]()
+    {
+      for (std::size_t begin = t * 1000; begin < values.size(); begin += 4000)
+      {
+        sharded.Add(values.data() + begin, std::min<std::size_t>(1000, values.size() - begin));
+      }
+    });
+  }
+  for (auto& thread: threads)
+  {
+    thread.join();
+  }
+  const auto snapshot = sharded.Snapshot();
+  CHECK(snapshot.Count() == numbers.size());
+  CHECK(std::fabs(ExactRank(numbers, snapshot.Quantile(0.5)) - 0.5) < snapshot.RankError());
+  return 0;
+}
+
+int main()
+{
+  if (checkSketch() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkMerge() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "quantile: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
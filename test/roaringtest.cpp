@@ -0,0 +1,228 @@
+#include <badval_roaring.hpp>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  /**
+   * Rows of different density in every 65536 block, so all container
+   * kinds are made: sparse, dense, long ranges.
+   */
+  std::set<std::uint32_t> RandomRows(std::mt19937& rng)
+  {
+    std::set<std::uint32_t> rows;
+    for (std::uint32_t block = 0; block < 6; ++block)
+    {
+      const auto base = block * 65536 + (rng() % 3) * 65536 * 4;
+      switch (rng() % 4)
+      {
+        case 0:
+          for (int i = 0; i < 100; ++i)
+          {
+            rows.insert(base + rng() % 65536);
+          }
+          break;
+        case 1:
+          for (int i = 0; i < 20000; ++i)
+          {
+            rows.insert(base + rng() % 65536);
+          }
+          break;
+        case 2:
+          {
+            const auto start = rng() % 30000;
+            for (std::uint32_t row = start; row < start + 5000 + rng() % 30000; ++row)
+            {
+              rows.insert(base + row);
+            }
+          }
+          break;
+        default:
+          for (std::uint32_t row = 0; row < 65536; row += 1 + rng() % 40)
+          {
+            rows.insert(base + row);
+          }
+          break;
+      }
+    }
+    return rows;
+  }
+
+  bvl::roaring::bitmap_t Make(const std::set<std::uint32_t>& rows, bool optimize)
+  {
+    bvl::roaring::bitmap_t bitmap;
+    for (const auto row: rows)
+    {
+      bitmap.Add(row);
+    }
+    if (optimize)
+    {
+      bitmap.RunOptimize();
+    }
+    return bitmap;
+  }
+
+  std::vector<std::uint32_t> Rows(const std::set<std::uint32_t>& rows)
+  {
+    return std::vector<std::uint32_t>(rows.begin(), rows.end());
+  }
+
+} // namespace
+
+int checkBitmap()
+{
+  using namespace bvl::roaring;
+
+  bitmap_t empty;
+  CHECK(empty.Empty() && (empty.Cardinality() == 0) && !empty.Contains(0));
+
+  std::mt19937 rng(3);
+  for (int round = 0; round < 30; ++round)
+  {
+    const auto lhsRows = RandomRows(rng);
+    const auto rhsRows = RandomRows(rng);
+    const auto lhs = Make(lhsRows, round % 2 == 0);
+    const auto rhs = Make(rhsRows, round % 3 == 0);
+
+    CHECK(lhs.Cardinality() == lhsRows.size());
+    CHECK(lhs.Rows() == Rows(lhsRows));
+    for (int i = 0; i < 1000; ++i)
+    {
+      const auto row = static_cast<std::uint32_t>(rng() % (65536 * 12));
+      CHECK(lhs.Contains(row) == (lhsRows.count(row) != 0));
+    }
+
+    std::set<std::uint32_t> both;
+    std::set<std::uint32_t> any = lhsRows;
+    for (const auto row: rhsRows)
+    {
+      if (lhsRows.count(row) != 0)
+      {
+        both.insert(row);
+      }
+      any.insert(row);
+    }
+    const auto conjunction = And(lhs, rhs);
+    CHECK(conjunction.Rows() == Rows(both));
+    CHECK(conjunction.Cardinality() == both.size());
+    const auto disjunction = Or(lhs, rhs);
+    CHECK(disjunction.Rows() == Rows(any));
+    CHECK(disjunction.Cardinality() == any.size());
+  }
+
+  // ranges and adds into run containers
+  bitmap_t ranges;
+  ranges.AddRange(10, 200000);
+  ranges.RunOptimize();
+  CHECK(ranges.Cardinality() == 200000 - 10);
+  CHECK(ranges.Bytes() < 1024);
+  ranges.Add(5);
+  ranges.Add(300000);
+  CHECK(ranges.Contains(5) && ranges.Contains(10) && ranges.Contains(199999) && !ranges.Contains(200000));
+  CHECK(ranges.Cardinality() == 200000 - 10 + 2);
+  return 0;
+}
+
+int checkColumn()
+{
+  using bvl::value_t;
+  using namespace bvl::roaring;
+
+  column_t column;
+  std::mt19937 rng(9);
+  int marker = 0;
+  auto append = [&](int i)
+  {
+    switch (i % 5)
+    {
+      case 0:
+        column.Append(value_t(static_cast<double>(rng() % 50)));
+        break;
+      case 1:
+        column.Append(value_t("s" + std::to_string(rng() % 20)));
+        break;
+      case 2:
+        column.Append(value_t(&marker, nullptr));
+        break;
+      case 3:
+        column.Append(value_t(std::nan("")));
+        break;
+      default:
+        column.Append(value_t(static_cast<double>(i / 1000)));
+        break;
+    }
+  };
+  for (int i = 0; i < 50000; ++i)
+  {
+    append(i);
+  }
+
+  const std::vector<value_t> keys = { value_t(7.0), value_t(30.0), value_t("s3"), value_t("none"), value_t(std::nan("")) };
+  std::vector<std::vector<std::uint32_t>> expected;
+  for (const auto& key: keys)
+  {
+    expected.push_back(column.Equal(key).Rows());
+  }
+  const auto strings = column.OfType(value_t::string).Rows();
+  CHECK(strings.size() == 10000);
+  CHECK(expected[4].empty());
+
+  column.BuildIndex();
+  CHECK(column.Indexed());
+  CHECK(column.DistinctValues() == 50 + 20);
+  for (std::size_t i = 0; i < keys.size(); ++i)
+  {
+    CHECK(column.Equal(keys[i]).Rows() == expected[i]);
+  }
+  CHECK(column.OfType(value_t::string).Rows() == strings);
+  CHECK(column.Equal(value_t(&marker, nullptr)).Cardinality() == 10000);
+
+  // index follows appends
+  for (int i = 50000; i < 60000; ++i)
+  {
+    append(i);
+  }
+  const auto indexed = column.Equal(value_t(7.0)).Rows();
+  std::vector<std::uint32_t> rows;
+  column.ScanEqual(value_t(7.0), [&rows](std::uint32_t row, const value_t& value)
+  {
+    rows.push_back(row);
+    return value == value_t(7.0);
+  });
+  CHECK(rows == indexed);
+  column.DropIndex();
+  CHECK(column.Equal(value_t(7.0)).Rows() == indexed);
+
+  std::size_t pointers = 0;
+  column.ScanType(value_t::pointer, [&pointers](std::uint32_t, const value_t&)
+  {
+    return ++pointers < 100;
+  });
+  CHECK(pointers == 100);
+  return 0;
+}
+
+int main()
+{
+  if (checkBitmap() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkColumn() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "roaring: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+#include <badval_schema.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+  using bvl::doc::node_t;
+
+  node_t Strings(const std::vector<std::string>& items)
+  {
+    auto result = node_t::Array();
+    for (const auto& item: items)
+    {
+      result.Push(value_t(item));
+    }
+    return result;
+  }
+
+  /**
+   * Schema of order with id, name and items of numbers or strings.
+   */
+  node_t Schema()
+  {
+    auto id = node_t::Object();
+    id.Set("type", value_t("integer"));
+    id.Set("minimum", value_t(0.0));
+    auto name = node_t::Object();
+    name.Set("type", value_t("string"));
+    name.Set("minLength", value_t(1.0));
+    name.Set("maxLength", value_t(8.0));
+    auto item = node_t::Object();
+    item.Set("type", Strings({ "number", "string" }));
+    item.Set("exclusiveMaximum", value_t(100.0));
+    auto items = node_t::Object();
+    items.Set("type", value_t("array"));
+    items.Set("maxItems", value_t(3.0));
+    items.Set("items", item);
+
+    auto properties = node_t::Object();
+    properties.Set("id", id);
+    properties.Set("name", name);
+    properties.Set("items", items);
+    auto schema = node_t::Object();
+    schema.Set("type", value_t("object"));
+    schema.Set("required", Strings({ "id", "items", "owner" }));
+    schema.Set("additionalProperties", value_t(0.0));
+    schema.Set("properties", properties);
+    return schema;
+  }
+
+  node_t Document(double id, const std::string& name, const std::vector<double>& items)
+  {
+    auto list = node_t::Array();
+    for (const auto item: items)
+    {
+      list.Push(value_t(item));
+    }
+    auto document = node_t::Object();
+    document.Set("owner", value_t(nullptr, nullptr));
+    document.Set("id", value_t(id));
+    document.Set("name", value_t(name));
+    document.Set("items", list);
+    return document;
+  }
+
+  bool Malformed(const node_t& schema)
+  {
+    try
+    {
+      bvl::schema::validator_t validator(schema);
+    }
+    catch (const std::invalid_argument&)
+    {
+      return true;
+    }
+    return false;
+  }
+
+} // namespace
+
+int checkValidate()
+{
+  using namespace bvl::schema;
+
+  const validator_t validator(Schema());
+  failure_t failure;
+  CHECK(validator.Validate(Document(1.0, "book", { 1.0, 99.5 }), failure));
+  CHECK((failure.error == none) && (validator.Explain(failure) == "valid"));
+
+  CHECK(!validator.Validate(Document(1.5, "book", {}), failure) && (failure.error == type));
+  CHECK(validator.Explain(failure) == "wrong type at '$.id'");
+  CHECK(!validator.Validate(Document(-1.0, "book", {}), failure) && (failure.error == range));
+  CHECK(!validator.Validate(Document(1.0, "", {}), failure) && (failure.error == length));
+  CHECK(!validator.Validate(Document(1.0, "too long name", {}), failure) && (failure.error == length));
+  CHECK(!validator.Validate(Document(1.0, "book", { 1.0, 2.0, 3.0, 4.0 }), failure) && (failure.error == length));
+  CHECK(!validator.Validate(Document(1.0, "book", { 100.0 }), failure) && (failure.error == range));
+  CHECK(validator.Explain(failure) == "number out of range at '$.items.items'");
+
+  auto document = Document(1.0, "book", {});
+  document.Find("items", bvl::doc::KeyHash("items"))->Push(value_t("pen"));
+  CHECK(validator.Validate(document));
+  document.Set("extra", value_t(1.0));
+  CHECK(!validator.Validate(document, failure) && (failure.error == additional));
+  document.Erase("extra");
+  document.Erase("owner");
+  CHECK(!validator.Validate(document, failure) && (failure.error == required));
+  CHECK(!validator.Validate(node_t::Array(), failure) && (failure.error == type));
+
+  std::vector<node_t> batch;
+  batch.push_back(Document(1.0, "a", {}));
+  batch.push_back(Document(-1.0, "a", {}));
+  batch.push_back(Document(2.0, "b", { 5.0 }));
+  bool valid[3];
+  CHECK(validator.Validate(batch.data(), batch.size(), valid) == 2);
+  CHECK(valid[0] && !valid[1] && valid[2]);
+  return 0;
+}
+
+int checkCompile()
+{
+  using namespace bvl::schema;
+
+  // empty schema accepts anything
+  const validator_t any(node_t::Object());
+  CHECK(any.Validate(node_t(value_t("x"))) && any.Validate(node_t::Array()));
+
+  auto unknown = node_t::Object();
+  unknown.Set("typo", value_t(1.0));
+  CHECK(Malformed(unknown));
+  auto type = node_t::Object();
+  type.Set("type", value_t("boolean"));
+  CHECK(Malformed(type));
+  auto flag = node_t::Object();
+  flag.Set("additionalProperties", value_t(2.0));
+  CHECK(Malformed(flag));
+  CHECK(Malformed(node_t(value_t(1.0))));
+
+  std::vector<std::string> names;
+  for (int i = 0; i < 65; ++i)
+  {
+    names.push_back("field" + std::to_string(i));
+  }
+  auto wide = node_t::Object();
+  wide.Set("required", Strings(names));
+  CHECK(Malformed(wide));
+  names.pop_back();
+  wide.Set("required", Strings(names));
+  const validator_t validator(wide);
+  auto document = node_t::Object();
+  for (const auto& name: names)
+  {
+    document.Set(name, value_t(1.0));
+  }
+  CHECK(validator.Validate(document));
+  document.Erase("field63");
+  CHECK(!validator.Validate(document));
+  return 0;
+}
+
+int main()
+{
+  if (checkValidate() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkCompile() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "schema: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
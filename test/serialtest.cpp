@@ -0,0 +1,129 @@
+#include <badval_serial.hpp>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+int checkRoundTrip()
+{
+  using bvl::value_t;
+  using namespace bvl::serial;
+
+  const value_t values[] = {
+    value_t(0.0),
+    value_t(-1.5),
+    value_t(std::numeric_limits<double>::infinity()),
+    value_t(""),
+    value_t("short"),
+    value_t(std::string(300, 'z')),
+    value_t(std::string("with\0zero", 9))
+  };
+
+  std::string out;
+  for (const auto& value: values)
+  {
+    const auto before = out.size();
+    Encode(value, out);
+    CHECK(out.size() - before == EncodedSize(value));
+  }
+
+  const char* cursor = out.data();
+  const char* end = out.data() + out.size();
+  for (const auto& value: values)
+  {
+    CHECK(Decode(cursor, end) == value);
+  }
+  CHECK(cursor == end);
+
+  // NaN survives bit for bit
+  out.clear();
+  Encode(value_t(std::nan("")), out);
+  cursor = out.data();
+  CHECK(std::isnan(Decode(cursor, out.data() + out.size()).As<value_t::number>()));
+
+  // varints
+  for (std::uint64_t num: { 0ULL, 127ULL, 128ULL, 300ULL, 0xFFFFFFFFULL, ~0ULL })
+  {
+    out.clear();
+    PutVarint(out, num);
+    CHECK(out.size() == VarintSize(num));
+    cursor = out.data();
+    std::uint64_t read;
+    CHECK(GetVarint(cursor, out.data() + out.size(), read));
+    CHECK(read == num);
+  }
+
+  out.clear();
+  PutFixed64(out, 0x0102030405060708ULL);
+  CHECK(out[0] == 8);
+  CHECK(DecodeFixed64(out.data()) == 0x0102030405060708ULL);
+  return 0;
+}
+
+int checkErrors()
+{
+  using bvl::value_t;
+  using namespace bvl::serial;
+
+  std::string out;
+  bool thrown = false;
+  try
+  {
+    Encode(value_t(nullptr, nullptr), out);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  Encode(value_t("truncated"), out);
+  for (std::size_t size = 0; size < out.size(); ++size)
+  {
+    thrown = false;
+    try
+    {
+      const char* cursor = out.data();
+      Decode(cursor, out.data() + size);
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
+  thrown = false;
+  try
+  {
+    const char bad[] = { 42 };
+    const char* cursor = bad;
+    Decode(cursor, bad + 1);
+  }
+  catch (const std::runtime_error&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int main()
+{
+  if (checkRoundTrip() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkErrors() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "serialization: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
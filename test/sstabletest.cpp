@@ -0,0 +1,188 @@
+#include <badval_sstable.hpp>
+#include <cstdio>
+#include <iostream>
+#include <map>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  const char path[] = "sstabletest.tmp";
+
+  std::string Key(int i)
+  {
+    char key[32];
+    std::snprintf(key, sizeof(key), "key%08d", i);
+    return key;
+  }
+
+} // namespace
+
+int checkLookup()
+{
+  using bvl::value_t;
+  using namespace bvl::sstable;
+
+  const int count = 20000;
+  options_t options;
+  options.blockSize = 256;
+  options.restartInterval = 4;
+  {
+    builder_t builder(path, options);
+    for (int i = 0; i < count; i += 2)
+    {
+      if (i % 3 == 0)
+      {
+        builder.Add(Key(i), value_t("value of " + Key(i)));
+      }
+      else
+      {
+        builder.Add(Key(i), value_t(static_cast<double>(i)));
+      }
+    }
+    builder.Finish();
+    CHECK(builder.Count() == count / 2);
+  }
+
+  table_t table(path);
+  CHECK(table.Size() == count / 2);
+
+  value_t out;
+  int bloomRejects = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    const auto key = Key(i);
+    const bool found = table.Find(key, out);
+    CHECK(found == (i % 2 == 0));
+    if (!found)
+    {
+      bloomRejects += table.MayContain(key)? 0: 1;
+      continue;
+    }
+    if (i % 3 == 0)
+    {
+      CHECK(out.As<value_t::string>() == "value of " + key);
+    }
+    else
+    {
+      CHECK(out.As<value_t::number>() == i);
+    }
+  }
+  // 10 bits per key give about 1% false positives
+  CHECK(bloomRejects > count / 2 * 95 / 100);
+
+  CHECK(!table.Find("", out));
+  CHECK(!table.Find("zzz", out));
+  CHECK(!table.Find("key", out));
+
+  // iteration visits everything in order
+  int expected = 0;
+  for (auto it = table.Begin(); it.Valid(); it.Next())
+  {
+    CHECK(it.Key() == Key(expected));
+    expected += 2;
+  }
+  CHECK(expected == count);
+
+  auto it = table.Seek(Key(1003));
+  CHECK(it.Valid() && (it.Key() == Key(1004)));
+  CHECK(it.Value().As<value_t::number>() == 1004);
+  it = table.Seek("zzz");
+  CHECK(!it.Valid());
+  it = table.Seek("");
+  CHECK(it.Valid() && (it.Key() == Key(0)));
+  return 0;
+}
+
+int checkEdgeCases()
+{
+  using bvl::value_t;
+  using namespace bvl::sstable;
+
+  // empty table
+  {
+    builder_t builder(path);
+    builder.Finish();
+  }
+  {
+    table_t table(path);
+    value_t out;
+    CHECK(table.Size() == 0);
+    CHECK(!table.Find("a", out));
+    CHECK(!table.Begin().Valid());
+  }
+
+  // no bloom filter, keys with shared prefixes and empty key
+  options_t options;
+  options.bloomBitsPerKey = 0;
+  {
+    builder_t builder(path, options);
+    builder.Add("", value_t("empty"));
+    builder.Add("a", value_t(1.0));
+    builder.Add("aa", value_t(2.0));
+    builder.Add(std::string("aa\0", 3), value_t(3.0));
+    builder.Add("ab", value_t(4.0));
+
+    bool thrown = false;
+    try
+    {
+      builder.Add("aa", value_t(5.0));
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+    builder.Finish();
+  }
+  {
+    table_t table(path);
+    value_t out;
+    CHECK(table.Find("", out) && (out.As<value_t::string>() == "empty"));
+    CHECK(table.Find(std::string("aa\0", 3), out) && (out.As<value_t::number>() == 3.0));
+    CHECK(table.Find("ab", out) && (out.As<value_t::number>() == 4.0));
+    CHECK(!table.Find("b", out));
+  }
+
+  // corrupted file is rejected
+  {
+    std::FILE* file = std::fopen(path, "r+b");
+    std::fseek(file, -1, SEEK_END);
+    std::fputc('X', file);
+    std::fclose(file);
+
+    bool thrown = false;
+    try
+    {
+      table_t table(path);
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+
+  std::remove(path);
+  return 0;
+}
+
+int main()
+{
+  if (checkLookup() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkEdgeCases() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "sorted table: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
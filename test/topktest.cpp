@@ -0,0 +1,174 @@
+#include <badval_topk.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Mixed values with repeats.
+   */
+  std::vector<value_t> Values(std::size_t size)
+  {
+    std::mt19937 rng(1);
+    std::vector<value_t> result;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      const auto key = rng() % (size / 2);
+      if (key % 4 == 0)
+      {
+        result.emplace_back("item-" + std::to_string(key));
+      }
+      else
+      {
+        result.emplace_back(static_cast<double>(key) - static_cast<double>(size / 4));
+      }
+    }
+    result.emplace_back(std::nan(""));
+    return result;
+  }
+
+  bool Same(const value_t& lhs, const value_t& rhs)
+  {
+    return !bvl::topk::less_t()(lhs, rhs) && !bvl::topk::less_t()(rhs, lhs);
+  }
+
+  /**
+   * Order that fails on marked value.
+   */
+  struct failing_t
+  {
+    bool operator()(const value_t& lhs, const value_t& rhs) const
+    {
+      if ((lhs.Type() == value_t::pointer) || (rhs.Type() == value_t::pointer))
+      {
+        throw std::domain_error("value can't be compared");
+      }
+      return bvl::topk::greater_t()(lhs, rhs);
+    }
+  };
+
+} // namespace
+
+int checkOrder()
+{
+  using namespace bvl::topk;
+
+  const less_t less;
+  CHECK(less(value_t(-1.0), value_t(2.0)) && !less(value_t(2.0), value_t(-1.0)));
+  CHECK(less(value_t(1e300), value_t(std::nan(""))) && !less(value_t(std::nan("")), value_t(1e300)));
+  CHECK(!less(value_t(std::nan("")), value_t(std::nan(""))));
+  CHECK(less(value_t(1e300), value_t("a")) && less(value_t("a"), value_t("b")));
+  CHECK(less(value_t("zzz"), value_t(nullptr, nullptr)));
+  CHECK(greater_t()(value_t("b"), value_t("a")));
+  return 0;
+}
+
+int checkSelect()
+{
+  using namespace bvl::topk;
+
+  const auto values = Values(200000);
+  auto sorted = values;
+  std::sort(sorted.begin(), sorted.end(), greater_t());
+
+  options_t parallel;
+  parallel.threads = 4;
+  parallel.parallelThreshold = 1000;
+  options_t select;
+  select.heapLimit = 10;
+
+  for (const std::size_t k: { std::size_t(0), std::size_t(1), std::size_t(100), std::size_t(5000), values.size() + 5 })
+  {
+    for (const auto& options: { options_t(), parallel, select })
+    {
+      auto input = values;
+      const auto top = TopK(input, k, greater_t(), options);
+      CHECK(top.size() == std::min(k, values.size()));
+      for (std::size_t i = 0; i < top.size(); ++i)
+      {
+        CHECK(Same(top[i], sorted[i]));
+      }
+    }
+  }
+
+  // smallest values, by custom order
+  auto input = values;
+  const auto bottom = TopK(input.begin(), input.end(), 50, less_t());
+  auto ascending = values;
+  std::sort(ascending.begin(), ascending.end(), less_t());
+  for (std::size_t i = 0; i < bottom.size(); ++i)
+  {
+    CHECK(Same(bottom[i], ascending[i]));
+  }
+
+  // string values are moved, rest of range stays
+  std::vector<value_t> strings;
+  for (int i = 0; i < 10; ++i)
+  {
+    strings.emplace_back("value-" + std::to_string(i));
+  }
+  strings.emplace_back(3.0);
+  const auto* data = &strings[9].As<value_t::string>();
+  const auto top = TopK(strings, 2);
+  CHECK((top[0].As<value_t::string>() == "value-9") && (&top[0].As<value_t::string>() == data));
+  CHECK(strings[0].As<value_t::string>() == "value-0");
+  return 0;
+}
+
+int checkFailure()
+{
+  using namespace bvl::topk;
+
+  // exception of compare in any thread reaches caller
+  options_t parallel;
+  parallel.threads = 4;
+  parallel.parallelThreshold = 1000;
+  for (const std::size_t marked: { std::size_t(0), std::size_t(25000), std::size_t(99999) })
+  {
+    auto values = Values(100000);
+    values[marked] = value_t(nullptr, nullptr);
+    bool thrown = false;
+    try
+    {
+      TopK(values, 10, failing_t(), parallel);
+    }
+    catch (const std::domain_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+  return 0;
+}
+
+int main()
+{
+  if (checkOrder() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkSelect() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkFailure() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "topk: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
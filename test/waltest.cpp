@@ -0,0 +1,215 @@
+#include <badval_wal.hpp>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  const char path[] = "waltest.tmp";
+
+  std::uint64_t FileSize()
+  {
+    struct stat info;
+    return (::stat(path, &info) == 0)? static_cast<std::uint64_t>(info.st_size): 0;
+  }
+
+} // namespace
+
+int checkCrc()
+{
+  using namespace bvl::wal;
+
+  CHECK(Crc32c("123456789", 9) == 0xE3069283u);
+  const std::string zeros(32, '\0');
+  CHECK(Crc32c(zeros.data(), zeros.size()) == 0x8A9136AAu);
+  CHECK(Crc32c("56789", 5, Crc32c("1234", 4)) == 0xE3069283u);
+
+  // hardware and software paths agree on every length and alignment
+  std::mt19937 rng(3);
+  std::string data(300, '\0');
+  for (auto& byte: data)
+  {
+    byte = static_cast<char>(rng());
+  }
+  for (std::size_t offset = 0; offset < 8; ++offset)
+  {
+    for (std::size_t size = 0; size + offset <= data.size(); size += 13)
+    {
+      const auto expected = ~bvl::wal::detail::Crc32cSoftware(~0u, data.data() + offset, size);
+      CHECK(Crc32c(data.data() + offset, size) == expected);
+    }
+  }
+  std::cout << "hardware crc: " << (HardwareCrc()? "yes": "no") << std::endl;
+  return 0;
+}
+
+int checkReplay()
+{
+  using bvl::value_t;
+  using namespace bvl::wal;
+
+  std::remove(path);
+  {
+    writer_t writer(path);
+    batch_t batch;
+    batch.Put("a", value_t(1.0));
+    batch.Put("b", value_t("text"));
+    batch.Erase("a");
+    writer.Commit(batch);
+
+    // failed put leaves batch as it was
+    bool thrown = false;
+    try
+    {
+      batch.Put("p", value_t(&writer, nullptr));
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown && (batch.Count() == 3));
+
+    batch.Clear();
+    batch.Put("c", value_t(3.0));
+    writer.Commit(batch);
+    CHECK(writer.Commits() == 2);
+  }
+
+  std::string seen;
+  auto visitor = [&seen](const std::string& key, const value_t* value)
+  {
+    seen += key;
+    if (value == nullptr)
+    {
+      seen += "-";
+    }
+    else if (value->Type() == value_t::number)
+    {
+      seen += std::to_string(static_cast<int>(value->As<value_t::number>()));
+    }
+    else
+    {
+      seen += value->As<value_t::string>();
+    }
+    seen += ";";
+  };
+  auto result = Replay(path, visitor);
+  CHECK(seen == "a1;btext;a-;c3;");
+  CHECK(result.records == 2);
+  CHECK(result.mutations == 4);
+  CHECK(result.validSize == FileSize());
+
+  // torn write: half of record, then garbage
+  const auto valid = FileSize();
+  {
+    batch_t batch;
+    batch.Put("torn", value_t(std::string(100, 'x')));
+    writer_t writer(path);
+    writer.Commit(batch);
+  }
+  CHECK(::truncate(path, static_cast<off_t>(valid + 50)) == 0);
+  seen.clear();
+  result = Replay(path, visitor);
+  CHECK(seen == "a1;btext;a-;c3;");
+  CHECK(result.fileSize == valid + 50);
+  CHECK(result.validSize == valid);
+  CHECK(FileSize() == valid);
+
+  // flipped bit fails checksum
+  {
+    auto file = std::fopen(path, "r+b");
+    std::fseek(file, 12, SEEK_SET);
+    std::fputc('Z', file);
+    std::fclose(file);
+  }
+  seen.clear();
+  result = Replay(path, visitor, false);
+  CHECK(seen.empty());
+  CHECK(result.records == 0);
+  CHECK(FileSize() == valid);
+
+  std::remove(path);
+  result = Replay(path, visitor);
+  CHECK(result.records == 0);
+  return 0;
+}
+
+int checkGroupCommit()
+{
+  using bvl::value_t;
+  using namespace bvl::wal;
+
+  std::remove(path);
+  const int threads = 8;
+  const int commits = 300;
+  std::uint64_t groups;
+  {
+    writer_t writer(path);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&writer, t]()
+      {
+        batch_t batch;
+        for (int i = 0; i < commits; ++i)
+        {
+          batch.Clear();
+          batch.Put(std::to_string(t), value_t(static_cast<double>(i)));
+          writer.Commit(batch);
+        }
+      });
+    }
+    for (auto& worker: workers)
+    {
+      worker.join();
+    }
+    CHECK(writer.Commits() == threads * commits);
+    groups = writer.Groups();
+    CHECK(groups <= writer.Commits());
+  }
+  std::cout << "groups: " << groups << " for " << threads * commits << " commits" << std::endl;
+
+  // commits of every thread keep their order
+  std::map<std::string, int> last;
+  bool ordered = true;
+  const auto result = Replay(path, [&](const std::string& key, const value_t* value)
+  {
+    const int i = static_cast<int>(value->As<value_t::number>());
+    auto it = last.find(key);
+    ordered = ordered && (((it == last.end()) && (i == 0)) || ((it != last.end()) && (it->second + 1 == i)));
+    last[key] = i;
+  });
+  CHECK(ordered);
+  CHECK(result.records == threads * commits);
+  std::remove(path);
+  return 0;
+}
+
+int main()
+{
+  if (checkCrc() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkReplay() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkGroupCommit() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "wal: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
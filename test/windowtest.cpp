@@ -0,0 +1,202 @@
+#include <badval_window.hpp>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  using bvl::value_t;
+
+  /**
+   * Stream of increasing times with some non-numbers.
+   */
+  void Stream(std::size_t size, std::vector<std::int64_t>& times, std::vector<value_t>& values)
+  {
+    std::mt19937 rng(1);
+    std::int64_t time = -50;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      time += static_cast<std::int64_t>(rng() % 4);
+      times.push_back(time);
+      if (i % 17 == 0)
+      {
+        values.emplace_back("missing");
+      }
+      else
+      {
+        values.emplace_back(static_cast<double>(rng() % 1000) - 500.0);
+      }
+    }
+  }
+
+  /**
+   * Aggregate of first size numbers with times in [from, to).
+   */
+  bvl::window::aggregate_t Exact(const std::vector<std::int64_t>& times, const std::vector<value_t>& values,
+    std::int64_t from, std::int64_t to, std::size_t size)
+  {
+    bvl::window::aggregate_t result;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      if ((times[i] >= from) && (times[i] < to) && (values[i].Type() == value_t::number))
+      {
+        result.Add(values[i].As<value_t::number>());
+      }
+    }
+    return result;
+  }
+
+  bool Same(const bvl::window::aggregate_t& lhs, const bvl::window::aggregate_t& rhs)
+  {
+    return (lhs.count == rhs.count) && (lhs.sum == rhs.sum) && (lhs.min == rhs.min) && (lhs.max == rhs.max);
+  }
+
+} // namespace
+
+int checkSliding()
+{
+  using namespace bvl::window;
+
+  std::vector<std::int64_t> times;
+  std::vector<value_t> values;
+  Stream(5000, times, values);
+
+  sliding_t window(40);
+  for (std::size_t i = 0; i < times.size(); ++i)
+  {
+    window.Add(times[i], values[i]);
+    const auto aggregate = window.Aggregate();
+    CHECK(Same(aggregate, Exact(times, values, times[i] - 39, times[i] + 1, i + 1)));
+    CHECK(window.Size() == aggregate.count);
+  }
+
+  // batches give same window
+  sliding_t batch(40);
+  for (std::size_t begin = 0; begin < times.size(); begin += 300)
+  {
+    const auto size = std::min<std::size_t>(300, times.size() - begin);
+    batch.Add(times.data() + begin, values.data() + begin, size);
+    const auto end = times[begin + size - 1];
+    CHECK(Same(batch.Aggregate(), Exact(times, values, end - 39, end + 1, begin + size)));
+  }
+
+  batch.Advance(times.back() + 40);
+  CHECK((batch.Size() == 0) && std::isnan(batch.Aggregate().Mean()));
+
+  bool thrown = false;
+  try
+  {
+    batch.Add(times.back() - 1, 1.0);
+  }
+  catch (const std::invalid_argument&)
+  {
+    thrown = true;
+  }
+  CHECK(thrown);
+  return 0;
+}
+
+int checkTumbling()
+{
+  using namespace bvl::window;
+
+  std::vector<std::int64_t> times;
+  std::vector<value_t> values;
+  Stream(5000, times, values);
+
+  std::vector<window_t> windows;
+  tumbling_t tumbling(100, [&windows](const window_t& window)
+  {
+    windows.push_back(window);
+  });
+  CHECK(tumbling.Add(times.data(), values.data(), times.size()) < times.size());
+  tumbling.Flush();
+
+  CHECK(windows.front().start == -100);
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < windows.size(); ++i)
+  {
+    CHECK((windows[i].end - windows[i].start == 100) && (windows[i].start % 100 == 0));
+    CHECK((i == 0) || (windows[i].start >= windows[i - 1].end));
+    CHECK(Same(windows[i].aggregate, Exact(times, values, windows[i].start, windows[i].end, times.size())));
+    total += windows[i].aggregate.count;
+  }
+  CHECK(total == Exact(times, values, times.front(), times.back() + 1, times.size()).count);
+  return 0;
+}
+
+int checkSession()
+{
+  using namespace bvl::window;
+
+  std::vector<window_t> sessions;
+  session_t session(5, [&sessions](const window_t& window)
+  {
+    sessions.push_back(window);
+  });
+  const std::int64_t times[] = { 0, 3, 8, 20, 22, 30 };
+  for (const auto time: times)
+  {
+    session.Add(time, static_cast<double>(time));
+  }
+  CHECK(sessions.size() == 2);
+  session.Advance(35);
+  CHECK(sessions.size() == 2);
+  session.Advance(36);
+  CHECK(sessions.size() == 3);
+
+  CHECK((sessions[0].start == 0) && (sessions[0].end == 9) && (sessions[0].aggregate.count == 3));
+  CHECK(sessions[0].aggregate.Mean() == 11.0 / 3.0);
+  CHECK((sessions[1].start == 20) && (sessions[1].aggregate.min == 20.0) && (sessions[1].aggregate.max == 22.0));
+  CHECK((sessions[2].start == 30) && (sessions[2].aggregate.sum == 30.0));
+
+  // distance of far apart times does not overflow
+  const auto lowest = std::numeric_limits<std::int64_t>::min();
+  session_t wide(std::numeric_limits<std::int64_t>::max(), [&sessions](const window_t& window)
+  {
+    sessions.push_back(window);
+  });
+  wide.Add(lowest, 1.0);
+  wide.Add(-1, 2.0);
+  wide.Advance(std::numeric_limits<std::int64_t>::max() - 1);
+  CHECK((sessions.size() == 3) && (wide.Current().count == 2));
+  wide.Advance(std::numeric_limits<std::int64_t>::max());
+  CHECK((sessions.size() == 4) && (sessions[3].start == lowest) && (sessions[3].end == 0));
+
+  session_t narrow(5, [&sessions](const window_t& window)
+  {
+    sessions.push_back(window);
+  });
+  narrow.Add(lowest, 1.0);
+  narrow.Add(std::numeric_limits<std::int64_t>::max() - 1, 2.0);
+  CHECK((sessions.size() == 5) && (sessions[4].start == lowest) && (sessions[4].aggregate.count == 1));
+  return 0;
+}
+
+int main()
+{
+  if (checkSliding() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkTumbling() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkSession() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "window: ok" << std::endl;
+  return EXIT_SUCCESS;
+}
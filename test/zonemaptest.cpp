@@ -0,0 +1,171 @@
+#include <badval_zonemap.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#define CHECK(cond) \
+  if (!(cond)) \
+  { \
+    std::cerr << __FILE__ <<":"<< __LINE__ << ": error: check failed: " #cond << std::endl; \
+    return -1; \
+  }
+
+namespace
+{
+
+  /**
+   * Indexes of matching values, checked one by one.
+   */
+  std::vector<std::size_t> Expected(const bvl::zonemap::array_t& array, const bvl::zonemap::predicate_t& predicate)
+  {
+    std::vector<std::size_t> result;
+    for (std::size_t i = 0; i < array.Size(); ++i)
+    {
+      if (predicate.Matches(array[i]))
+      {
+        result.push_back(i);
+      }
+    }
+    return result;
+  }
+
+  std::vector<std::size_t> Found(const bvl::zonemap::array_t& array, const bvl::zonemap::predicate_t& predicate)
+  {
+    std::vector<std::size_t> result;
+    array.Scan(predicate, [&result](std::size_t index, const bvl::value_t&)
+    {
+      result.push_back(index);
+      return true;
+    });
+    return result;
+  }
+
+} // namespace
+
+int checkZone()
+{
+  using bvl::value_t;
+  using namespace bvl::zonemap;
+
+  zone_t zone;
+  zone.Add(value_t(3.0));
+  zone.Add(value_t(std::nan("")));
+  zone.Add(value_t(-1.0));
+  zone.Add(value_t("pear and apple"));
+  zone.Add(value_t("banana"));
+  CHECK(zone.count == 5);
+  CHECK(zone.numbers == 3 && zone.strings == 2 && zone.pointers == 0);
+  CHECK(zone.min == -1.0 && zone.max == 3.0);
+  CHECK(zone.minPrefix == "banana" && zone.maxPrefix == "pear and");
+  CHECK(zone.types == ((1u << value_t::number) | (1u << value_t::string)));
+
+  CHECK(predicate_t::Between(0.0, 1.0).MayMatch(zone));
+  CHECK(!predicate_t::Between(3.5, 10.0).MayMatch(zone));
+  CHECK(!predicate_t::Equal(value_t(std::nan(""))).MayMatch(zone));
+  CHECK(!predicate_t::Type(value_t::pointer).MayMatch(zone));
+  CHECK(predicate_t::Equal(value_t("pear and apple")).MayMatch(zone));
+  CHECK(predicate_t::Equal(value_t("pear and banana")).MayMatch(zone));
+  CHECK(!predicate_t::Equal(value_t("zebra")).MayMatch(zone));
+  CHECK(!predicate_t::Equal(value_t("apple")).MayMatch(zone));
+  CHECK(!predicate_t::StartsWith("q").MayMatch(zone));
+  CHECK(predicate_t::StartsWith("pea").MayMatch(zone));
+  CHECK(!predicate_t::Between("a", "b").MayMatch(zone));
+  CHECK(!predicate_t::Between("a", "ba").MayMatch(zone));
+  CHECK(predicate_t::Between("a", "bb").MayMatch(zone));
+  return 0;
+}
+
+int checkScan()
+{
+  using bvl::value_t;
+  using namespace bvl::zonemap;
+
+  // sorted numbers, clustered strings, rare outliers
+  std::mt19937 rng(2);
+  array_t array(64);
+  int marker = 0;
+  for (int i = 0; i < 20000; ++i)
+  {
+    switch (rng() % 8)
+    {
+      case 0:
+        array.Append(value_t("key:" + std::to_string(i / 500) + ":" + std::to_string(rng() % 10)));
+        break;
+      case 1:
+        if (i / 64 % 50 == 0)
+        {
+          // few blocks with outliers
+          array.Append(value_t(static_cast<double>(rng() % 100000)));
+          break;
+        }
+        array.Append(value_t(static_cast<double>(i)));
+        break;
+      case 2:
+        if (i % 1000 < 10)
+        {
+          array.Append(value_t(&marker, nullptr));
+          break;
+        }
+        // fall through
+      default:
+        array.Append(value_t(static_cast<double>(i)));
+        break;
+    }
+  }
+  CHECK(array.Zones().size() == (20000 + 63) / 64);
+
+  std::vector<predicate_t> predicates;
+  predicates.push_back(predicate_t::Type(value_t::pointer));
+  predicates.push_back(predicate_t::Type(value_t::string));
+  predicates.push_back(predicate_t::Equal(value_t(1234.0)));
+  predicates.push_back(predicate_t::Equal(value_t(&marker, nullptr)));
+  predicates.push_back(predicate_t::Equal(value_t("key:7:3")));
+  predicates.push_back(predicate_t::StartsWith("key:12:"));
+  predicates.push_back(predicate_t::Between("key:2", "key:3"));
+  predicates.push_back(predicate_t::Between("key:38", ""));
+  for (int i = 0; i < 50; ++i)
+  {
+    const double low = rng() % 100000;
+    predicates.push_back(predicate_t::Between(low, low + rng() % 1000));
+  }
+
+  std::size_t skipped = 0;
+  std::size_t blocks = 0;
+  for (const auto& predicate: predicates)
+  {
+    const auto expected = Expected(array, predicate);
+    CHECK(Found(array, predicate) == expected);
+    CHECK(array.Count(predicate, false) == expected.size());
+    const auto stats = array.Scan(predicate, [](std::size_t, const value_t&)
+    {
+      return true;
+    });
+    skipped += stats.skipped;
+    blocks += stats.blocks;
+  }
+  std::cout << "skipped " << skipped << " of " << blocks << " blocks" << std::endl;
+  CHECK(skipped * 2 > blocks);
+
+  // visitor stops scan
+  std::size_t visited = 0;
+  const auto stats = array.Scan(predicate_t::Type(value_t::number), [&visited](std::size_t, const value_t&)
+  {
+    return ++visited < 10;
+  });
+  CHECK(visited == 10 && stats.matched == 10);
+  return 0;
+}
+
+int main()
+{
+  if (checkZone() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  if (checkScan() != 0)
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "zonemap: ok" << std::endl;
+  return EXIT_SUCCESS;
+}